@@ -94,6 +94,10 @@ void Connection::resetActivityTime() {
 	qtLastPacket.restart();
 }
 
+qint64 Connection::bytesToWrite() const {
+	return qtsSocket->bytesToWrite();
+}
+
 /**
  * This function waits until a complete package is received and then emits it as a message.
  * It gets called everytime new data is available and interprets the message prefix header
@@ -65,6 +65,9 @@ class Connection : public QObject {
 		void forceFlush();
 		qint64 activityTime() const;
 		void resetActivityTime();
+		/// The number of bytes queued on the socket that have not
+		/// been written to the network yet.
+		qint64 bytesToWrite() const;
 
 #ifdef MURMUR
 		/// qmCrypt locks access to csCrypt.
@@ -0,0 +1,260 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AdaptiveJitterBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+/// Arrival delays the target is computed from.
+#define JITTER_HISTORY 500
+/// Until this many packets have arrived, the target delay is at least
+/// the spread the buffer was created with.
+#define JITTER_WARMUP 50
+/// Beyond this much excess delay, compress even loud packets, in frames.
+#define JITTER_FORCE_COMPRESS 4
+/// Distance from the target tolerated before stretching, in frames.
+/// Arrivals are only noticed once per decoded frame, so the target jumps
+/// around by up to a frame; a smaller shortfall is just that noise.
+#define JITTER_EXPAND_SLACK 1.0
+#define JITTER_COMPRESS_SLACK 0.5
+
+AdaptiveJitterBuffer::AdaptiveJitterBuffer(unsigned int sampleRate, unsigned int frameSize, int percentile, unsigned int margin, unsigned int spread)
+	: uiFrameSize(frameSize)
+	, iPercentile(qBound(50, percentile, 100))
+	, uiMargin(margin)
+	, iMaxJump(5 * static_cast<qint64>(sampleRate))
+	, bStarted(false)
+	, iClock(0)
+	, iPlayout(0)
+	, iReadyDelay(0)
+	, qvDelays(JITTER_HISTORY)
+	, qvSorted(JITTER_HISTORY)
+	, iDelayCount(0)
+	, iDelayNext(0)
+	, bTargetStale(false)
+	, uiInitialSpread(spread)
+	, uiSpread(spread) {
+	memset(&sStats, 0, sizeof(sStats));
+	updateTarget();
+}
+
+void AdaptiveJitterBuffer::put(const QByteArray &data, qint64 timestamp, unsigned int span) {
+	++sStats.uiReceived;
+
+	if (qmPackets.isEmpty() && ! bStarted && (iDelayCount == 0)) {
+		iPlayout = timestamp;
+	} else if ((timestamp < iPlayout - iMaxJump) || (timestamp > iPlayout + iMaxJump)) {
+		restart(timestamp);
+	}
+
+	qvDelays[iDelayNext] = iClock - timestamp;
+	iDelayNext = (iDelayNext + 1) % JITTER_HISTORY;
+	iDelayCount = qMin(iDelayCount + 1, JITTER_HISTORY);
+	bTargetStale = true;
+
+	if (timestamp < iPlayout) {
+		// Before playout starts, a reordered packet just moves the start.
+		if (bStarted) {
+			++sStats.uiLate;
+			return;
+		}
+		iPlayout = timestamp;
+	}
+
+	if (qmPackets.contains(timestamp))
+		return;
+
+	Packet packet;
+	packet.qbaData = data;
+	packet.uiSpan = span;
+	qmPackets.insert(timestamp, packet);
+}
+
+AdaptiveJitterBuffer::Status AdaptiveJitterBuffer::get(QByteArray &data) {
+	if (bTargetStale) {
+		updateTarget();
+		bTargetStale = false;
+	}
+
+	if (! bStarted) {
+		if (qmPackets.isEmpty() || (delay() < iTarget))
+			return Buffering;
+		bStarted = true;
+	}
+
+	// Packets overlapping the playout position can only come from a
+	// sender changing its frame count mid-stream. They are of no use.
+	while (! qmPackets.isEmpty() && (qmPackets.constBegin().key() < iPlayout))
+		qmPackets.erase(qmPackets.begin());
+
+	if (qmPackets.isEmpty()) {
+		++sStats.uiWaited;
+		return Empty;
+	}
+
+	QMap<qint64, Packet>::iterator i = qmPackets.begin();
+	if (i.key() > iPlayout) {
+		++sStats.uiLost;
+		iPlayout += uiFrameSize;
+		return Lost;
+	}
+
+	iReadyDelay = delay();
+	data = i.value().qbaData;
+	iPlayout += i.value().uiSpan;
+	qmPackets.erase(i);
+	return Ready;
+}
+
+bool AdaptiveJitterBuffer::next(QByteArray &data) const {
+	if (qmPackets.isEmpty() || (qmPackets.constBegin().key() != iPlayout))
+		return false;
+	data = qmPackets.constBegin().value().qbaData;
+	return true;
+}
+
+void AdaptiveJitterBuffer::advance(unsigned int samples) {
+	iClock += samples;
+}
+
+int AdaptiveJitterBuffer::stretch(bool quiet) const {
+	if (! bStarted)
+		return 0;
+
+	const qint64 frame = static_cast<qint64>(uiFrameSize);
+	const qint64 excess = iReadyDelay - iTarget;
+	if (excess < -static_cast<qint64>(JITTER_EXPAND_SLACK * frame))
+		return static_cast<int>(-excess);
+	if ((excess > static_cast<qint64>(JITTER_COMPRESS_SLACK * frame)) && (quiet || (excess > JITTER_FORCE_COMPRESS * frame)))
+		return static_cast<int>(-excess);
+	return 0;
+}
+
+void AdaptiveJitterBuffer::stretched(int samples) {
+	if (samples < 0)
+		++sStats.uiCompressed;
+	else if (samples > 0)
+		++sStats.uiExpanded;
+}
+
+qint64 AdaptiveJitterBuffer::delay() const {
+	return iClock - iPlayout;
+}
+
+qint64 AdaptiveJitterBuffer::targetDelay() const {
+	return iTarget;
+}
+
+unsigned int AdaptiveJitterBuffer::spread() const {
+	return uiSpread;
+}
+
+const AdaptiveJitterBuffer::Stats &AdaptiveJitterBuffer::stats() const {
+	return sStats;
+}
+
+void AdaptiveJitterBuffer::updateTarget() {
+	if (iDelayCount == 0) {
+		iTarget = uiSpread + uiMargin;
+		return;
+	}
+
+	// Order statistics rather than the minimum: arrivals are only seen
+	// once per decode, so the fastest packets are off by up to a frame.
+	qint64 *sorted = qvSorted.data();
+	std::copy(qvDelays.constData(), qvDelays.constData() + iDelayCount, sorted);
+	const int rank = ((iDelayCount - 1) * iPercentile) / 100;
+	const int middle = (iDelayCount - 1) / 2;
+	std::nth_element(sorted, sorted + rank, sorted + iDelayCount);
+	const qint64 quantile = sorted[rank];
+	std::nth_element(sorted, sorted + middle, sorted + rank);
+	const qint64 median = sorted[middle];
+
+	uiSpread = static_cast<unsigned int>(quantile - median);
+	if (iDelayCount < JITTER_WARMUP)
+		uiSpread = qMax(uiSpread, uiInitialSpread);
+
+	iTarget = median + uiSpread + uiMargin;
+}
+
+void AdaptiveJitterBuffer::restart(qint64 timestamp) {
+	qmPackets.clear();
+	bStarted = false;
+	iPlayout = timestamp;
+	iDelayCount = 0;
+	iDelayNext = 0;
+	uiInitialSpread = uiSpread;
+}
+
+unsigned int AdaptiveJitterBuffer::maxStretch(unsigned int sampleRate) {
+	return (sampleRate * 15) / 1000;
+}
+
+unsigned int AdaptiveJitterBuffer::bestLag(const float *pcm, unsigned int n, unsigned int window, unsigned int sampleRate, unsigned int limit) {
+	const unsigned int minLag = sampleRate / 400;
+	if (n < window + minLag)
+		return 0;
+	// Voiced audio needs room for a whole pitch period, down to 100 Hz.
+	const unsigned int maxLag = qMin(qMin(maxStretch(sampleRate), n - window), qMax(limit, sampleRate / 100));
+
+	double self = 0.0;
+	for (unsigned int i = 0; i < window; ++i)
+		self += static_cast<double>(pcm[i]) * pcm[i];
+
+	// Silence matches anywhere, so take just what was asked for.
+	if (self < 1e-6 * window)
+		return qBound(minLag, limit, maxLag);
+
+	unsigned int best = minLag;
+	double bestScore = -2.0;
+	for (unsigned int lag = minLag; lag <= maxLag; ++lag) {
+		double cross = 0.0, energy = 0.0;
+		for (unsigned int i = 0; i < window; ++i) {
+			cross += static_cast<double>(pcm[i]) * pcm[lag + i];
+			energy += static_cast<double>(pcm[lag + i]) * pcm[lag + i];
+		}
+		const double score = cross / sqrt(self * energy + 1e-12);
+		if (score > bestScore) {
+			bestScore = score;
+			best = lag;
+		}
+	}
+	return best;
+}
+
+unsigned int AdaptiveJitterBuffer::compress(float *pcm, unsigned int n, unsigned int sampleRate, unsigned int limit) {
+	const unsigned int window = sampleRate / 200;
+	const unsigned int lag = bestLag(pcm, n, window, sampleRate, limit);
+	if (lag == 0)
+		return n;
+
+	// Fade from the start of pcm into the matching window one lag later,
+	// then continue from there. Every read is at or ahead of its write.
+	for (unsigned int i = 0; i < window; ++i) {
+		const float in = (static_cast<float>(i) + 0.5f) / static_cast<float>(window);
+		pcm[i] = pcm[i] * (1.0f - in) + pcm[lag + i] * in;
+	}
+	memmove(pcm + window, pcm + lag + window, (n - lag - window) * sizeof(float));
+	return n - lag;
+}
+
+unsigned int AdaptiveJitterBuffer::expand(float *pcm, unsigned int n, unsigned int sampleRate, unsigned int limit) {
+	const unsigned int window = sampleRate / 200;
+	const unsigned int lag = bestLag(pcm, n, window, sampleRate, limit);
+	if (lag == 0)
+		return n;
+
+	// Play pcm up to lag, fade back into its start and play all of it
+	// again from there, repeating one period. The tail moves first, and
+	// the fade runs backwards so it never reads what it has written.
+	memmove(pcm + lag + window, pcm + window, (n - window) * sizeof(float));
+	for (unsigned int i = window; i-- > 0;) {
+		const float in = (static_cast<float>(i) + 0.5f) / static_cast<float>(window);
+		pcm[lag + i] = pcm[lag + i] * (1.0f - in) + pcm[i] * in;
+	}
+	return n + lag;
+}
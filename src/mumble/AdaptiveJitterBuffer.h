@@ -0,0 +1,154 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_ADAPTIVEJITTERBUFFER_H_
+#define MUMBLE_MUMBLE_ADAPTIVEJITTERBUFFER_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMap>
+#include <QtCore/QVector>
+
+/// The jitter buffer of one speaker. It holds voice packets until they
+/// are due and decides how fast playout should go.
+///
+/// All times are in samples at the codec rate. The buffer's clock counts
+/// the samples played out, which stands in for wall time as long as the
+/// mixer keeps asking for audio. Timestamps are the sender's sequence
+/// number times the frame size.
+///
+/// For every packet, the buffer records how far behind its timestamp it
+/// arrived. The target delay is the configured percentile of that over
+/// the last few hundred packets, so it stays close to a frame on a good
+/// link and only grows as far as a bad one requires. The buffer does not
+/// skip or insert whole frames to reach the target. Instead, stretch()
+/// asks the decoder to play a decoded packet a little faster or slower,
+/// using compress() and expand().
+class AdaptiveJitterBuffer {
+	private:
+		Q_DISABLE_COPY(AdaptiveJitterBuffer)
+	public:
+		enum Status {
+			/// Too little has arrived to start playout. Play silence.
+			Buffering,
+			/// The packet that is due has been returned for decoding.
+			Ready,
+			/// The packet that is due is missing, but later packets have
+			/// arrived. It was lost or will come too late. Conceal it.
+			Lost,
+			/// Nothing is buffered. The packet that is due may just be
+			/// late, so playout waits for it while the caller conceals.
+			Empty
+		};
+
+		/// Counters for the simulator and for debugging.
+		struct Stats {
+			quint64 uiReceived;
+			/// Packets that arrived after their playout time.
+			quint64 uiLate;
+			quint64 uiLost;
+			quint64 uiWaited;
+			quint64 uiCompressed;
+			quint64 uiExpanded;
+		};
+
+		/// @param sampleRate Codec rate.
+		/// @param frameSize Samples per sequence number.
+		/// @param percentile Percentage of packets that should arrive in
+		///        time, from 50 to 100.
+		/// @param margin Added to the target delay, as a safety margin.
+		/// @param spread Target delay to assume until enough packets have
+		///        arrived to measure it, usually spread() from the last
+		///        stream of the same speaker.
+		AdaptiveJitterBuffer(unsigned int sampleRate, unsigned int frameSize, int percentile, unsigned int margin, unsigned int spread);
+
+		/// Adds a packet covering span samples from timestamp on.
+		void put(const QByteArray &data, qint64 timestamp, unsigned int span);
+
+		/// Returns the packet that is due in data and moves playout past
+		/// it. After Lost and Empty, playout moves by one frame or not at
+		/// all, and the caller should conceal one frame.
+		Status get(QByteArray &data);
+
+		/// After get() returned Lost: sets data to the packet following
+		/// the lost one, if it has already arrived, so the decoder can use
+		/// its forward error correction.
+		bool next(QByteArray &data) const;
+
+		/// Advances the clock by the samples actually played out.
+		void advance(unsigned int samples);
+
+		/// Returns how many samples the packet get() last returned should
+		/// be lengthened by, or shortened by if negative. Compressing is
+		/// only suggested for quiet packets, unless the delay is far too
+		/// long.
+		int stretch(bool quiet) const;
+		/// Records that the caller stretched the last packet by samples.
+		void stretched(int samples);
+
+		/// Current delay between arrival and playout, in samples.
+		qint64 delay() const;
+		/// Delay the buffer is aiming for, as of the last get().
+		qint64 targetDelay() const;
+		/// Spread of the arrival delays, to start the next stream with, as
+		/// of the last get().
+		unsigned int spread() const;
+
+		const Stats &stats() const;
+
+		/// Shortens pcm by about one pitch period, using a WSOLA-style
+		/// overlap-add at the best matching offset. Silence is shortened
+		/// by limit samples, voiced audio by up to limit or one period,
+		/// whichever is longer. Returns the new length, or n if pcm is too
+		/// short.
+		static unsigned int compress(float *pcm, unsigned int n, unsigned int sampleRate, unsigned int limit);
+		/// Lengthens pcm like compress() shortens it. pcm must have room
+		/// for maxStretch() more samples. Returns the new length.
+		static unsigned int expand(float *pcm, unsigned int n, unsigned int sampleRate, unsigned int limit);
+		/// Most samples expand() adds.
+		static unsigned int maxStretch(unsigned int sampleRate);
+	protected:
+		struct Packet {
+			QByteArray qbaData;
+			unsigned int uiSpan;
+		};
+
+		const unsigned int uiFrameSize;
+		const int iPercentile;
+		const unsigned int uiMargin;
+		/// Packets further than this from the playout position restart
+		/// the buffer; the sender must have restarted its sequence.
+		const qint64 iMaxJump;
+
+		QMap<qint64, Packet> qmPackets;
+		bool bStarted;
+		qint64 iClock;
+		qint64 iPlayout;
+		/// delay() when get() last returned Ready.
+		qint64 iReadyDelay;
+
+		/// Ring of the last arrival delays.
+		QVector<qint64> qvDelays;
+		/// Scratch space to take the order statistics of qvDelays in.
+		QVector<qint64> qvSorted;
+		int iDelayCount;
+		int iDelayNext;
+		/// Set by put(), so get() recomputes the target at most once per
+		/// decoded frame however many packets arrived since.
+		bool bTargetStale;
+		unsigned int uiInitialSpread;
+		unsigned int uiSpread;
+		qint64 iTarget;
+
+		Stats sStats;
+
+		void updateTarget();
+		void restart(qint64 timestamp);
+
+		/// Offset between 2.5 and 15 ms into pcm whose following window
+		/// best matches the start of pcm, or 0 if pcm is too short.
+		static unsigned int bestLag(const float *pcm, unsigned int n, unsigned int window, unsigned int sampleRate, unsigned int limit);
+};
+
+#endif
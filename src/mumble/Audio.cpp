@@ -14,6 +14,8 @@
 #include "Global.h"
 #include "PacketDataStream.h"
 
+#include <QtCore/QTimer>
+
 class CodecInit : public DeferInit {
 	public:
 		void initialize();
@@ -90,6 +92,13 @@ LoopUser::LoopUser() {
 	cChannel = NULL;
 	qtTicker.start();
 	qtLastFetch.start();
+
+	qtFetch = new QTimer(this);
+#if QT_VERSION >= 0x050000
+	qtFetch->setTimerType(Qt::PreciseTimer);
+#endif
+	qtFetch->setInterval(10);
+	connect(qtFetch, SIGNAL(timeout()), this, SLOT(fetchFrames()));
 }
 
 void LoopUser::addFrame(const QByteArray &packet) {
@@ -113,6 +122,9 @@ void LoopUser::addFrame(const QByteArray &packet) {
 		qmPackets.insert(static_cast<float>(time + r), packet);
 	}
 
+	if (aiFetching.testAndSetOrdered(0, 1))
+		QMetaObject::invokeMethod(qtFetch, "start", Qt::QueuedConnection);
+
 	// Restart check
 	if (qtLastFetch.elapsed() > 100) {
 		AudioOutputPtr ao = g.ao;
@@ -124,9 +136,18 @@ void LoopUser::addFrame(const QByteArray &packet) {
 
 }
 
+/// Hands the packets that are due to AudioOutput. Main thread only.
 void LoopUser::fetchFrames() {
 	QMutexLocker l(&qmLock);
 
+	// addFrame() only starts the timer again after this, so a packet
+	// queued from now on is always picked up.
+	if (qmPackets.isEmpty()) {
+		qtFetch->stop();
+		aiFetching.fetchAndStoreOrdered(0);
+		return;
+	}
+
 	AudioOutputPtr ao(g.ao);
 	if (!ao || qmPackets.isEmpty()) {
 		return;
@@ -148,14 +169,9 @@ void LoopUser::fetchFrames() {
 
 		pds >> iSeq;
 
-		QByteArray qba;
-		qba.reserve(pds.left() + 1);
-		qba.append(static_cast<char>(msgFlags));
-		qba.append(pds.dataBlock(pds.left()));
-
 		MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((msgFlags >> 5) & 0x7);
 
-		ao->addFrameToBuffer(this, qba, iSeq, msgType);
+		ao->addFrameToBuffer(this, msgFlags, pds.charPtr(), pds.left(), iSeq, msgType);
 		i = qmPackets.erase(i);
 	}
 
@@ -184,14 +200,9 @@ void RecordUser::addFrame(const QByteArray &packet) {
 
 	pds >> iSeq;
 
-	QByteArray qba;
-	qba.reserve(pds.left() + 1);
-	qba.append(static_cast<char>(msgFlags));
-	qba.append(pds.dataBlock(pds.left()));
-
 	MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((msgFlags >> 5) & 0x7);
 
-	ao->addFrameToBuffer(this, qba, iSeq, msgType);
+	ao->addFrameToBuffer(this, msgFlags, pds.charPtr(), pds.left(), iSeq, msgType);
 }
 
 void Audio::startOutput(const QString &output) {
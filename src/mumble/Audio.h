@@ -6,6 +6,7 @@
 #ifndef MUMBLE_MUMBLE_AUDIO_H_
 #define MUMBLE_MUMBLE_AUDIO_H_
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QByteArray>
 #include <QtCore/QMultiMap>
 #include <QtCore/QMutex>
@@ -15,22 +16,34 @@
 
 #include "ClientUser.h"
 
+class QTimer;
+
 #define SAMPLE_RATE 48000
 
 typedef QPair<QString,QVariant> audioDevice;
 
+/// Plays the local user's own voice back, with simulated delay and loss.
+/// The input thread queues packets with addFrame(), and a timer on the
+/// main thread releases them to AudioOutput once they are due, so the
+/// mixer never has to.
 class LoopUser : public ClientUser {
 	private:
+		Q_OBJECT
 		Q_DISABLE_COPY(LoopUser)
 	protected:
 		QMutex qmLock;
 		QTime qtTicker;
 		QTime qtLastFetch;
 		QMultiMap<float, QByteArray> qmPackets;
+		/// Runs fetchFrames() while packets are queued.
+		QTimer *qtFetch;
+		/// Set once addFrame() has asked qtFetch to start.
+		QAtomicInt aiFetching;
 		LoopUser();
 	public:
 		static LoopUser lpLoopy;
 		virtual void addFrame(const QByteArray &packet);
+	public slots:
 		void fetchFrames();
 };
 
@@ -0,0 +1,234 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioBenchmark.h"
+
+#include "AudioInput.h"
+#include "AudioOutput.h"
+#include "AudioOutputSample.h"
+#include "ClientUser.h"
+#include "PacketDataStream.h"
+
+#include <time.h>
+#include <vector>
+
+// We define a global macro called 'g'. This can lead to issues when included code uses 'g' as a type or parameter name (like protobuf 3.7 does). As such, for now, we have to make this our last include.
+#include "Global.h"
+
+AudioStageTimer::AudioStageTimer() : uiLast(0) {
+	for (int i = 0; i < StageCount; ++i)
+		uiTime[i] = 0;
+	qetWall.start();
+}
+
+quint64 AudioStageTimer::now() const {
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+	struct timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		return static_cast<quint64>(ts.tv_sec) * 1000000000ULL + static_cast<quint64>(ts.tv_nsec);
+#endif
+	return static_cast<quint64>(qetWall.nsecsElapsed());
+}
+
+void AudioStageTimer::start() {
+	uiLast = now();
+}
+
+void AudioStageTimer::lap(Stage s) {
+	const quint64 t = now();
+	uiTime[s] += t - uiLast;
+	uiLast = t;
+}
+
+quint64 AudioStageTimer::total() const {
+	quint64 sum = 0;
+	for (int i = 0; i < StageCount; ++i)
+		sum += uiTime[i];
+	return sum;
+}
+
+const char *AudioStageTimer::stageName(Stage s) {
+	switch (s) {
+		case InputMix:
+			return "input mix";
+		case Resample:
+			return "resample";
+		case Denoise:
+			return "denoise";
+		case Preprocess:
+			return "preprocess";
+		case Encode:
+			return "encode";
+		case Decode:
+			return "decode";
+		case Mix:
+			return "mix";
+		default:
+			return "?";
+	}
+}
+
+/// Feeds AudioInput from memory on the calling thread and keeps the
+/// packets it would have sent.
+class BenchmarkInput : public AudioInput {
+	private:
+		Q_DISABLE_COPY(BenchmarkInput)
+	protected:
+		void sendAudioFrame(const char *data, PacketDataStream &pds) Q_DECL_OVERRIDE {
+			qlPackets << QByteArray(data, pds.size() + 1);
+		}
+	public:
+		QList<QByteArray> qlPackets;
+
+		BenchmarkInput(AudioStageTimer *timer, unsigned int channels, unsigned int freq) {
+			astTimer = timer;
+			eMicFormat = SampleFloat;
+			iMicChannels = channels;
+			iMicFreq = freq;
+			initializeMixer();
+		}
+
+		/// Device frames making up one 10 ms frame.
+		unsigned int frameLength() const {
+			return iMicLength;
+		}
+
+		void feed(const float *data, unsigned int nsamp) {
+			addMic(data, nsamp);
+		}
+
+		void run() Q_DECL_OVERRIDE {
+		}
+};
+
+/// A stereo float AudioOutput mixed on the calling thread.
+class BenchmarkOutput : public AudioOutput {
+	private:
+		Q_DISABLE_COPY(BenchmarkOutput)
+	public:
+		BenchmarkOutput(AudioStageTimer *timer) {
+			const unsigned int chanmasks[32] = {
+				SPEAKER_FRONT_LEFT,
+				SPEAKER_FRONT_RIGHT
+			};
+
+			astTimer = timer;
+			eSampleFormat = SampleFloat;
+			iChannels = 2;
+			iMixerFreq = SAMPLE_RATE;
+			initializeMixer(chanmasks);
+		}
+
+		unsigned int channels() const {
+			return iChannels;
+		}
+
+		void feed(float *output, unsigned int nsamp) {
+			mix(output, nsamp);
+		}
+
+		void run() Q_DECL_OVERRIDE {
+		}
+};
+
+int AudioBenchmark::run(const QString &file, int speakers) {
+	SoundFile *sf = AudioOutputSample::loadSndfile(file);
+	if (! sf) {
+		printf("Failed to load %s\n", qPrintable(file));
+		return 1;
+	}
+
+	const unsigned int channels = static_cast<unsigned int>(sf->channels());
+	const unsigned int freq = static_cast<unsigned int>(sf->samplerate());
+
+	std::vector<float> input;
+	float chunk[4096];
+	sf_count_t read;
+	while ((read = sf->read(chunk, 4096)) > 0)
+		input.insert(input.end(), chunk, chunk + read);
+	delete sf;
+
+	// Transmit everything and encode it the way local loopback does, so
+	// neither a server nor a voice activity threshold is needed.
+	g.s.atTransmit = Settings::Continuous;
+	g.s.lmLoopMode = Settings::Local;
+	g.s.bMute = false;
+	g.s.bTxAudioCue = false;
+	g.s.bTransmitPosition = false;
+	g.s.bPositionalAudio = false;
+	g.s.bDenoise = true;
+	g.s.fVolume = 1.0f;
+
+	AudioStageTimer ast;
+	BenchmarkOutput *bo = new BenchmarkOutput(&ast);
+	BenchmarkInput *bi = new BenchmarkInput(&ast, channels, freq);
+
+	QList<ClientUser *> qlSpeakers;
+	for (int i = 0; i < speakers; ++i) {
+		ClientUser *p = new ClientUser();
+		p->uiSession = static_cast<unsigned int>(i + 1);
+		p->qsName = QString::fromLatin1("Speaker %1").arg(i + 1);
+		qlSpeakers << p;
+	}
+
+	const unsigned int period = bi->frameLength();
+	const unsigned int available = static_cast<unsigned int>(input.size() / channels);
+	const unsigned int mixFrame = SAMPLE_RATE / 100;
+	std::vector<float> output(mixFrame * bo->channels());
+
+	// Short files are repeated until there is a minute of audio, which
+	// keeps the numbers steady.
+	const unsigned int minFrames = 6000;
+	unsigned int frames = 0;
+	unsigned int packets = 0;
+
+	if (available < period) {
+		printf("%s is shorter than one frame\n", qPrintable(file));
+	} else {
+		while (frames < minFrames) {
+			for (unsigned int offset = 0; offset + period <= available; offset += period) {
+				bi->feed(&input[offset * channels], period);
+
+				foreach(const QByteArray &packet, bi->qlPackets) {
+					PacketDataStream pds(packet.constData(), packet.size());
+					const unsigned int msgFlags = static_cast<unsigned int>(pds.next());
+					int iSeq;
+					pds >> iSeq;
+					const MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((msgFlags >> 5) & 0x7);
+
+					foreach(ClientUser *p, qlSpeakers)
+						bo->addFrameToBuffer(p, msgFlags, pds.charPtr(), pds.left(), iSeq, msgType);
+					++packets;
+				}
+				bi->qlPackets.clear();
+
+				bo->feed(&output[0], mixFrame);
+				++frames;
+			}
+		}
+	}
+
+	delete bi;
+	delete bo;
+	qDeleteAll(qlSpeakers);
+
+	if (packets == 0) {
+		printf("No audio was encoded\n");
+		return 1;
+	}
+
+	const double audio = static_cast<double>(frames) / 100.0;
+	const double cpu = static_cast<double>(ast.total()) / 1000000000.0;
+
+	printf("%s: %u channel(s) at %u Hz, %d speaker(s)\n", qPrintable(file), channels, freq, speakers);
+	printf("%u frames of 10 ms, %u packets\n\n", frames, packets);
+	printf("%-12s %10s\n", "stage", "us/frame");
+	for (int i = 0; i < AudioStageTimer::StageCount; ++i)
+		printf("%-12s %10.2f\n", AudioStageTimer::stageName(static_cast<AudioStageTimer::Stage>(i)), static_cast<double>(ast.uiTime[i]) / 1000.0 / frames);
+	printf("%-12s %10.2f\n\n", "total", static_cast<double>(ast.total()) / 1000.0 / frames);
+	printf("Realtime factor: %.1fx\n", (cpu > 0.0) ? audio / cpu : 0.0);
+
+	return 0;
+}
@@ -0,0 +1,51 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOBENCHMARK_H_
+#define MUMBLE_MUMBLE_AUDIOBENCHMARK_H_
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QString>
+#include <QtCore/QtGlobal>
+
+/// AudioStageTimer adds up the CPU time the calling thread spends in each
+/// stage of the audio pipeline. Every lap() charges the time since the
+/// previous lap() or start() to one stage.
+///
+/// Where the platform has no per-thread CPU clock, monotonic wall time is
+/// used instead.
+class AudioStageTimer {
+	private:
+		Q_DISABLE_COPY(AudioStageTimer)
+	public:
+		enum Stage { InputMix, Resample, Denoise, Preprocess, Encode, Decode, Mix, StageCount };
+
+		/// Nanoseconds spent in each stage.
+		quint64 uiTime[StageCount];
+
+		AudioStageTimer();
+		void start();
+		void lap(Stage s);
+		quint64 total() const;
+		static const char *stageName(Stage s);
+	protected:
+		QElapsedTimer qetWall;
+		quint64 uiLast;
+		quint64 now() const;
+};
+
+namespace AudioBenchmark {
+	/// Runs the WAV file through AudioInput and the packets it produces
+	/// through AudioOutput for the given number of speakers, all on the
+	/// calling thread and as fast as possible, then prints the CPU time
+	/// per 10 ms frame of every stage and the realtime factor.
+	///
+	/// Needs the codecs loaded, but neither an audio device nor a main
+	/// window. Changes settings without saving them. Returns the process
+	/// exit code.
+	int run(const QString &file, int speakers);
+}
+
+#endif
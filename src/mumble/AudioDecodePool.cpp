@@ -0,0 +1,91 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioDecodePool.h"
+
+#include "AudioOutputSpeech.h"
+
+#include <QtCore/QThread>
+
+class AudioDecodePool::Worker : public QThread {
+	private:
+		Q_DISABLE_COPY(Worker)
+		AudioDecodePool *adp;
+	public:
+		Worker(AudioDecodePool *pool) : adp(pool) {}
+		void run() Q_DECL_OVERRIDE {
+			unsigned int idle = 0;
+			while (adp->bRunning) {
+				if (adp->runJob()) {
+					idle = 0;
+				} else {
+					if (idle < IdlePolls)
+						++idle;
+					usleep(adp->pollInterval(idle));
+				}
+			}
+		}
+};
+
+AudioDecodePool::AudioDecodePool() : aiPeriod(10000), bRunning(true) {
+}
+
+AudioDecodePool::~AudioDecodePool() {
+	bRunning = false;
+	foreach(QThread *w, qlWorkers) {
+		w->wait();
+		delete w;
+	}
+}
+
+void AudioDecodePool::start() {
+	// Leave a core for the audio callback itself.
+	const int threads = qBound(1, QThread::idealThreadCount() - 1, 4);
+	for (int i = 0; i < threads; ++i) {
+		Worker *w = new Worker(this);
+		w->start(QThread::HighPriority);
+		qlWorkers << w;
+	}
+}
+
+void AudioDecodePool::setPeriod(unsigned int usec) {
+	aiPeriod.fetchAndStoreRelaxed(static_cast<int>(usec));
+}
+
+bool AudioDecodePool::enqueue(AudioOutputSpeech *aos, unsigned int target) {
+	// Only the first time lookahead is needed.
+	if (qlWorkers.isEmpty())
+		start();
+
+	Job job;
+	job.aos = aos;
+	job.uiTarget = target;
+	return srJobs.push(job);
+}
+
+/// Runs the next queued job, if any. Returns whether there was one.
+bool AudioDecodePool::runJob() {
+	Job job;
+	{
+		QMutexLocker lock(&qmJobs);
+		Job *front = srJobs.front();
+		if (! front)
+			return false;
+		job = *front;
+		srJobs.pop();
+	}
+
+	job.aos->decodeAhead(job.uiTarget);
+	job.aos->releaseDecode();
+	return true;
+}
+
+/// A quarter of the mixer period, or IdlePollInterval once the mixer has
+/// stopped queueing jobs for a while.
+unsigned long AudioDecodePool::pollInterval(unsigned int idle) {
+	if (idle >= IdlePolls)
+		return IdlePollInterval;
+	return static_cast<unsigned long>(qMax(aiPeriod.fetchAndAddRelaxed(0) / 4, 250));
+}
@@ -0,0 +1,76 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIODECODEPOOL_H_
+#define MUMBLE_MUMBLE_AUDIODECODEPOOL_H_
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+
+#include "SPSCRing.h"
+
+class AudioOutputSpeech;
+class QThread;
+
+/// AudioDecodePool decodes speech ahead of the mixer on a few worker
+/// threads, so that codec and resampler work does not count against the
+/// audio callback's deadline.
+///
+/// The mixer queues a speech buffer after claiming it with
+/// AudioOutputSpeech::claimDecode(); a worker then decodes it up to the
+/// requested number of samples and releases the claim.
+///
+/// Waking a sleeping thread takes a lock, so the mixer doesn't: the
+/// workers look for jobs four times per mixer period instead. The jobs
+/// are queued a period or more before they are needed, which leaves
+/// plenty of slack for that.
+class AudioDecodePool {
+	private:
+		Q_DISABLE_COPY(AudioDecodePool)
+
+		class Worker;
+
+		struct Job {
+			AudioOutputSpeech *aos;
+			unsigned int uiTarget;
+		};
+
+		/// A buffer is queued at most once at a time, so this matches
+		/// AudioOutput's limit on the number of buffers.
+		enum { MaxJobs = 256 };
+
+		/// Once the workers have found nothing this many times in a row,
+		/// they only look every IdlePollInterval microseconds.
+		enum { IdlePolls = 400, IdlePollInterval = 20000 };
+
+		/// Filled by the mixer. Workers serialize on qmJobs to pop.
+		SPSCRing<Job, MaxJobs> srJobs;
+		QMutex qmJobs;
+		/// Length of a mixer period in microseconds.
+		QAtomicInt aiPeriod;
+		/// Started by the first enqueue(), so that a pool the mixer
+		/// never needs costs no threads.
+		QList<QThread *> qlWorkers;
+		volatile bool bRunning;
+
+		void start();
+		bool runJob();
+		unsigned long pollInterval(unsigned int idle);
+	public:
+		AudioDecodePool();
+		~AudioDecodePool();
+
+		/// Sets the mixer period, in microseconds, that the workers poll
+		/// for jobs by. Mixer only.
+		void setPeriod(unsigned int usec);
+		/// Queues aos, which the caller has claimed, to be decoded until
+		/// target samples are ready. Returns false if the queue is full.
+		/// Apart from starting the workers on the first call, never
+		/// blocks. Mixer only.
+		bool enqueue(AudioOutputSpeech *aos, unsigned int target);
+};
+
+#endif
@@ -5,6 +5,8 @@
 
 #include "AudioInput.h"
 
+#include "AudioInputKernels.h"
+#include "AudioMixKernels.h"
 #include "AudioOutput.h"
 #include "CELTCodec.h"
 #ifdef USE_OPUS
@@ -17,7 +19,9 @@
 #include "Plugins.h"
 #include "Message.h"
 #include "Global.h"
+#include "LatencyProbe.h"
 #include "NetworkConfig.h"
+#include "Resampler.h"
 #include "Utils.h"
 #include "VoiceRecorder.h"
 
@@ -127,14 +131,19 @@ AudioInput::AudioInput() : opusBuffer(g.s.iFramesPerPacket * (SAMPLE_RATE / 100)
 
 	sppPreprocess = NULL;
 	sesEcho = NULL;
-	srsMic = srsEcho = NULL;
-	iJitterSeq = 0;
+	rsMic = rsEcho = NULL;
+	srEcho = NULL;
+	uiEchoSeqStart = 0;
 	iMinBuffered = 1000;
+	uiEchoDropped = uiEchoMissing = uiEchoOverrun = 0;
 
 	psMic = new short[iFrameSize];
+	uiMicEnergy = 0;
+	iMicPeak = 0;
 	psClean = new short[iFrameSize];
 
 	psSpeaker = NULL;
+	psEchoFrame = NULL;
 
 	iEchoChannels = iMicChannels = 0;
 	iEchoFilled = iMicFilled = 0;
@@ -154,16 +163,24 @@ AudioInput::AudioInput() : opusBuffer(g.s.iFramesPerPacket * (SAMPLE_RATE / 100)
 		setMaxBandwidth(g.iMaxBandwidth);
 	}
 
+	astTimer = NULL;
+
 	bRunning = true;
 
-	connect(this, SIGNAL(doDeaf()), g.mw->qaAudioDeaf, SLOT(trigger()), Qt::QueuedConnection);
-	connect(this, SIGNAL(doMute()), g.mw->qaAudioMute, SLOT(trigger()), Qt::QueuedConnection);
+	// There is no main window when running the audio benchmark.
+	if (g.mw) {
+		connect(this, SIGNAL(doDeaf()), g.mw->qaAudioDeaf, SLOT(trigger()), Qt::QueuedConnection);
+		connect(this, SIGNAL(doMute()), g.mw->qaAudioMute, SLOT(trigger()), Qt::QueuedConnection);
+	}
 }
 
 AudioInput::~AudioInput() {
 	bRunning = false;
 	wait();
 
+	if (uiEchoDropped || uiEchoMissing || uiEchoOverrun)
+		qWarning("AudioInput: Echo frames skipped for drift: %u, missing: %u, lost to overrun: %u", uiEchoDropped, uiEchoMissing, uiEchoOverrun);
+
 #ifdef USE_OPUS
 	if (opusState) {
 		oCodec->opus_encoder_destroy(opusState);
@@ -180,22 +197,19 @@ AudioInput::~AudioInput() {
 		cCodec->celt_encoder_destroy(ceEncoder);
 	}
 
-	foreach(short *buf, qlEchoFrames)
-		delete [] buf;
+	delete srEcho;
 
 	if (sppPreprocess)
 		speex_preprocess_state_destroy(sppPreprocess);
 	if (sesEcho)
 		speex_echo_state_destroy(sesEcho);
 
-	if (srsMic)
-		speex_resampler_destroy(srsMic);
-	if (srsEcho)
-		speex_resampler_destroy(srsEcho);
+	delete rsMic;
+	delete rsEcho;
 
 	delete [] psMic;
 	delete [] psClean;
-	delete [] psSpeaker;
+	delete [] psEchoFrame;
 
 	delete [] pfMicInput;
 	delete [] pfEchoInput;
@@ -206,189 +220,30 @@ bool AudioInput::isTransmitting() const {
 	return bPreviousVoice;
 };
 
-#define IN_MIXER_FLOAT(channels) \
-static void inMixerFloat##channels ( float * RESTRICT buffer, const void * RESTRICT ipt, unsigned int nsamp, unsigned int N, quint64 mask) { \
-  const float * RESTRICT input = reinterpret_cast<const float *>(ipt); \
-  const float m = 1.0f / static_cast<float>(channels); \
-  Q_UNUSED(N); \
-  Q_UNUSED(mask); \
-  for(unsigned int i=0;i<nsamp;++i) {\
-	  float v= 0.0f; \
-	  for(unsigned int j=0;j<channels;++j) \
-	  	v += input[i*channels+j]; \
-	  buffer[i] = v * m; \
-  } \
-}
-
-#define IN_MIXER_SHORT(channels) \
-static void inMixerShort##channels ( float * RESTRICT buffer, const void * RESTRICT ipt, unsigned int nsamp, unsigned int N, quint64 mask) { \
-  const short * RESTRICT input = reinterpret_cast<const short *>(ipt); \
-  const float m = 1.0f / (32768.f * static_cast<float>(channels)); \
-  Q_UNUSED(N); \
-  Q_UNUSED(mask); \
-  for(unsigned int i=0;i<nsamp;++i) {\
-	  float v= 0.0f; \
-	  for(unsigned int j=0;j<channels;++j) \
-	  	v += static_cast<float>(input[i*channels+j]); \
-	  buffer[i] = v * m; \
-  } \
-}
-
-static void inMixerFloatMask(float * RESTRICT buffer, const void * RESTRICT ipt, unsigned int nsamp, unsigned int N, quint64 mask) { \
-	const float * RESTRICT input = reinterpret_cast<const float *>(ipt);
-
-	unsigned int chancount = 0;
-	STACKVAR(unsigned int, chanindex, N);
-	for (unsigned int j = 0; j < N; ++j) {
-		if ((mask & (1ULL << j)) == 0) {
-			continue;
-		}
-		chanindex[chancount] = j; // Use chancount as index into chanindex.
-		++chancount;
-	}
-
-	const float m = 1.0f / static_cast<float>(chancount);
-	for(unsigned int i = 0; i < nsamp; ++i) {
-		float v = 0.0f;
-		for(unsigned int j = 0; j < chancount; ++j) {
-			v += input[i * N + chanindex[j]];
-		}
-		buffer[i] = v * m;
-	}
-}
-
-static void inMixerShortMask(float * RESTRICT buffer, const void * RESTRICT ipt, unsigned int nsamp, unsigned int N, quint64 mask) {
-	const short * RESTRICT input = reinterpret_cast<const short *>(ipt);
-
-	unsigned int chancount = 0;
-	STACKVAR(unsigned int, chanindex, N);
-	for (unsigned int j = 0; j < N; ++j) {
-		if ((mask & (1ULL << j)) == 0) {
-			continue;
-		}
-		chanindex[chancount] = j; // Use chancount as index into chanindex.
-		++chancount;
-	}
-
-	const float m = 1.0f / static_cast<float>(chancount);
-	for(unsigned int i = 0; i < nsamp; ++i) {
-		float v = 0.0f;
-		for(unsigned int j = 0; j < chancount; ++j) {
-			v += static_cast<float>(input[i * N + chanindex[j]]);
-		}
-		buffer[i] = v * m;
-	}
-}
-
-IN_MIXER_FLOAT(1)
-IN_MIXER_FLOAT(2)
-IN_MIXER_FLOAT(3)
-IN_MIXER_FLOAT(4)
-IN_MIXER_FLOAT(5)
-IN_MIXER_FLOAT(6)
-IN_MIXER_FLOAT(7)
-IN_MIXER_FLOAT(8)
-IN_MIXER_FLOAT(N)
-
-IN_MIXER_SHORT(1)
-IN_MIXER_SHORT(2)
-IN_MIXER_SHORT(3)
-IN_MIXER_SHORT(4)
-IN_MIXER_SHORT(5)
-IN_MIXER_SHORT(6)
-IN_MIXER_SHORT(7)
-IN_MIXER_SHORT(8)
-IN_MIXER_SHORT(N)
-
 AudioInput::inMixerFunc AudioInput::chooseMixer(const unsigned int nchan, SampleFormat sf, quint64 chanmask) {
-	inMixerFunc r = NULL;
-
-	if (chanmask != 0xffffffffffffffffULL) {
-		if (sf == SampleFloat) {
-			r = inMixerFloatMask;
-		} else if (sf == SampleShort) {
-			r = inMixerShortMask;
-		}
-		return r;
-	}
+	Q_UNUSED(nchan);
+	Q_UNUSED(chanmask);
 
-	if (sf == SampleFloat) {
-		switch (nchan) {
-			case 1:
-				r = inMixerFloat1;
-				break;
-			case 2:
-				r = inMixerFloat2;
-				break;
-			case 3:
-				r = inMixerFloat3;
-				break;
-			case 4:
-				r = inMixerFloat4;
-				break;
-			case 5:
-				r = inMixerFloat5;
-				break;
-			case 6:
-				r = inMixerFloat6;
-				break;
-			case 7:
-				r = inMixerFloat7;
-				break;
-			case 8:
-				r = inMixerFloat8;
-				break;
-			default:
-				r = inMixerFloatN;
-				break;
-		}
-	} else {
-		switch (nchan) {
-			case 1:
-				r = inMixerShort1;
-				break;
-			case 2:
-				r = inMixerShort2;
-				break;
-			case 3:
-				r = inMixerShort3;
-				break;
-			case 4:
-				r = inMixerShort4;
-				break;
-			case 5:
-				r = inMixerShort5;
-				break;
-			case 6:
-				r = inMixerShort6;
-				break;
-			case 7:
-				r = inMixerShort7;
-				break;
-			case 8:
-				r = inMixerShort8;
-				break;
-			default:
-				r = inMixerShortN;
-				break;
-		}
-	}
-	return r;
+	// The kernels specialize on the channel layout themselves.
+	const AudioInputKernels &k = AudioInputKernels::best();
+	return (sf == SampleFloat) ? k.downmixFloat : k.downmixShort;
 }
 
 void AudioInput::initializeMixer() {
-	int err;
-
-	if (srsMic)
-		speex_resampler_destroy(srsMic);
-	if (srsEcho)
-		speex_resampler_destroy(srsEcho);
+	delete rsMic;
+	delete rsEcho;
+	rsMic = rsEcho = NULL;
 	delete [] pfMicInput;
 	delete [] pfEchoInput;
 	delete [] pfOutput;
+	delete srEcho;
+	delete [] psEchoFrame;
+	srEcho = NULL;
+	psEchoFrame = NULL;
+	psSpeaker = NULL;
 
 	if (iMicFreq != iSampleRate)
-		srsMic = speex_resampler_init(1, iMicFreq, iSampleRate, 3, &err);
+		rsMic = new Resampler(1, iMicFreq, iSampleRate, g.s.iResampleQuality);
 
 	iMicLength = (iFrameSize * iMicFreq) / iSampleRate;
 
@@ -398,13 +253,17 @@ void AudioInput::initializeMixer() {
 	if (iEchoChannels > 0) {
 		bEchoMulti = g.s.bEchoMulti;
 		if (iEchoFreq != iSampleRate)
-			srsEcho = speex_resampler_init(bEchoMulti ? iEchoChannels : 1, iEchoFreq, iSampleRate, 3, &err);
+			rsEcho = new Resampler(bEchoMulti ? iEchoChannels : 1, iEchoFreq, iSampleRate, g.s.iResampleQuality);
 		iEchoLength = (iFrameSize * iEchoFreq) / iSampleRate;
 		iEchoMCLength = bEchoMulti ? iEchoLength * iEchoChannels : iEchoLength;
 		iEchoFrameSize = bEchoMulti ? iFrameSize * iEchoChannels : iFrameSize;
 		pfEchoInput = new float[iEchoMCLength];
+
+		// 320ms of speaker reference; anything older is useless to the
+		// echo canceller anyway.
+		srEcho = new SPSCSampleRing<short>(32 * iEchoFrameSize, iEchoFrameSize);
+		psEchoFrame = new short[iEchoFrameSize];
 	} else {
-		srsEcho = NULL;
 		pfEchoInput = NULL;
 	}
 
@@ -428,12 +287,16 @@ void AudioInput::initializeMixer() {
 }
 
 void AudioInput::addMic(const void *data, unsigned int nsamp) {
+	if (astTimer)
+		astTimer->start();
+
 	while (nsamp > 0) {
 		// Make sure we don't overrun the frame buffer
 		const unsigned int left = qMin(nsamp, iMicLength - iMicFilled);
 
 		// Append mix into pfMicInput frame buffer (converts 16bit pcm->float if necessary)
 		imfMic(pfMicInput + iMicFilled, data, left, iMicChannels, uiMicChannelMask);
+		lapStage(AudioStageTimer::InputMix);
 
 		iMicFilled += left;
 		nsamp -= left;
@@ -451,46 +314,45 @@ void AudioInput::addMic(const void *data, unsigned int nsamp) {
 			iMicFilled = 0;
 
 			// If needed resample frame
-			float *ptr = srsMic ? pfOutput : pfMicInput;
+			float *ptr = rsMic ? pfOutput : pfMicInput;
 
-			if (srsMic) {
-				spx_uint32_t inlen = iMicLength;
-				spx_uint32_t outlen = iFrameSize;
-				speex_resampler_process_float(srsMic, 0, pfMicInput, &inlen, pfOutput, &outlen);
+			if (rsMic) {
+				rsMic->process(pfMicInput, iMicLength, pfOutput, iFrameSize);
+				lapStage(AudioStageTimer::Resample);
 			}
 
-			// Convert float to 16bit PCM
-			const float mul = 32768.f;
-			for (int j = 0; j < iFrameSize; ++j)
-				psMic[j] = static_cast<short>(qBound(-32768.f, (ptr[j] * mul), 32767.f));
+			// Convert float to 16bit PCM, metering the frame in the same pass
+			AudioInputKernels::best().toShortLevels(ptr, psMic, iFrameSize, &uiMicEnergy, &iMicPeak);
+
+			// encodeAudioFrame() is about to count this frame, and its
+			// sequence number is the count before that.
+			if (LatencyProbe::lpProbe.isActive())
+				LatencyProbe::lpProbe.processInput(psMic, iFrameSize, iFrameCounter);
 
 			// If we have echo chancellation enabled...
 			if (iEchoChannels > 0) {
-				short *echo = NULL;
-
-				{
-					QMutexLocker l(&qmEcho);
-
-					if (qlEchoFrames.isEmpty()) {
-						iJitterSeq = 0;
+				const int queued = static_cast<int>(srEcho->available() / iEchoFrameSize);
+				const unsigned int seq = static_cast<unsigned int>(aiEchoQueued.fetchAndAddAcquire(0));
+
+				if (queued == 0) {
+					uiEchoSeqStart = seq;
+					iMinBuffered = 1000;
+					++uiEchoMissing;
+				} else {
+					// Compensate for drift between the microphone and the echo source
+					iMinBuffered = qMin(iMinBuffered, queued);
+
+					if ((seq - uiEchoSeqStart > 100) && (iMinBuffered > 1)) {
+						uiEchoSeqStart = seq;
 						iMinBuffered = 1000;
-					} else {
-						// Compensate for drift between the microphone and the echo source
-						iMinBuffered = qMin(iMinBuffered, qlEchoFrames.count());
-
-						if ((iJitterSeq > 100) && (iMinBuffered > 1)) {
-							iJitterSeq = 0;
-							iMinBuffered = 1000;
-							delete [] qlEchoFrames.takeFirst();
-						}
-						echo = qlEchoFrames.takeFirst();
+						srEcho->commitRead(iEchoFrameSize);
+						++uiEchoDropped;
 					}
-				}
 
-				if (echo) {
 					// We have echo data for the current frame, remember that
-					delete [] psSpeaker;
-					psSpeaker = echo;
+					memcpy(psEchoFrame, srEcho->readView(iEchoFrameSize), iEchoFrameSize * sizeof(short));
+					srEcho->commitRead(iEchoFrameSize);
+					psSpeaker = psEchoFrame;
 				}
 			}
 
@@ -507,16 +369,12 @@ void AudioInput::addEcho(const void *data, unsigned int nsamp) {
 
 		if (bEchoMulti) {
 			const unsigned int samples = left * iEchoChannels;
+			float *dst = pfEchoInput + iEchoFilled * iEchoChannels;
 
-			if (eEchoFormat == SampleFloat) {
-				for (unsigned int i=0;i<samples;++i)
-					pfEchoInput[i] = reinterpret_cast<const float *>(data)[i];
-			}
-			else {
-				// 16bit PCM -> float
-				for (unsigned int i=0;i<samples;++i)
-					pfEchoInput[i] = static_cast<float>(reinterpret_cast<const short *>(data)[i]) * (1.0f / 32768.f);
-			}
+			if (eEchoFormat == SampleFloat)
+				memcpy(dst, data, samples * sizeof(float));
+			else
+				AudioInputKernels::best().toFloat(reinterpret_cast<const short *>(data), dst, samples); // 16bit PCM -> float
 		} else {
 			// Mix echo channels (converts 16bit PCM -> float if needed)
 			imfEcho(pfEchoInput + iEchoFilled, data, left, iEchoChannels, uiEchoChannelMask);
@@ -539,26 +397,24 @@ void AudioInput::addEcho(const void *data, unsigned int nsamp) {
 			iEchoFilled = 0;
 
 			// Resample if necessary
-			float *ptr = srsEcho ? pfOutput : pfEchoInput;
+			float *ptr = rsEcho ? pfOutput : pfEchoInput;
 
-			if (srsEcho) {
-				spx_uint32_t inlen = iEchoLength;
-				spx_uint32_t outlen = iFrameSize;
-				speex_resampler_process_interleaved_float(srsEcho, pfEchoInput, &inlen, pfOutput, &outlen);
+			if (rsEcho) {
+				rsEcho->process(pfEchoInput, iEchoLength, pfOutput, iFrameSize);
 			}
 
-			short *outbuff = new short[iEchoFrameSize];
+			// Push frame into the echo chancellers jitter buffer
+			short *outbuff = srEcho->writeView(iEchoFrameSize);
+			if (! outbuff) {
+				++uiEchoOverrun;
+				continue;
+			}
 
 			// float -> 16bit PCM
-			const float mul = 32768.f;
-			for (unsigned int j=0;j<iEchoFrameSize;++j)
-				outbuff[j] = static_cast<short>(ptr[j] * mul);
+			AudioMixKernels::best().toShort(ptr, outbuff, iEchoFrameSize);
 
-			// Push frame into the echo chancellers jitter buffer
-			QMutexLocker l(&qmEcho);
-
-			iJitterSeq = qMin(iJitterSeq + 1,10000U);
-			qlEchoFrames.append(outbuff);
+			srEcho->commitWrite(iEchoFrameSize);
+			aiEchoQueued.fetchAndAddRelease(1);
 		}
 	}
 }
@@ -793,9 +649,9 @@ int AudioInput::encodeCELTFrame(short *psSource, EncodingOutputBuffer& buffer) {
 
 void AudioInput::encodeAudioFrame() {
 	int iArg;
-	int i;
 	float sum;
-	short max;
+	quint64 energy;
+	int peak;
 
 	short *psSource;
 
@@ -804,30 +660,27 @@ void AudioInput::encodeAudioFrame() {
 	if (! bRunning)
 		return;
 
-	sum=1.0f;
-	max = 1;
-	for (i=0;i<iFrameSize;i++) {
-		sum += static_cast<float>(psMic[i] * psMic[i]);
-		max = std::max(static_cast<short>(abs(psMic[i])), max);
-	}
+	sum = 1.0f + static_cast<float>(uiMicEnergy);
 	dPeakMic = qMax(20.0f*log10f(sqrtf(sum / static_cast<float>(iFrameSize)) / 32768.0f), -96.0f);
-	dMaxMic = max;
+	dMaxMic = static_cast<float>(qMax(iMicPeak, 1));
 
 	if (psSpeaker && (iEchoChannels > 0)) {
-		sum=1.0f;
-		for (i=0;i<iFrameSize;i++)
-			sum += static_cast<float>(psSpeaker[i] * psSpeaker[i]);
+		AudioInputKernels::best().levels(psSpeaker, iFrameSize, &energy, &peak);
+		sum = 1.0f + static_cast<float>(energy);
 		dPeakSpeaker = qMax(20.0f*log10f(sqrtf(sum / static_cast<float>(iFrameSize)) / 32768.0f), -96.0f);
 	} else {
 		dPeakSpeaker = 0.0;
 	}
+	lapStage(AudioStageTimer::InputMix);
 
 	QMutexLocker l(&qmSpeex);
 	resetAudioProcessor();
+	lapStage(AudioStageTimer::Preprocess);
 
 #ifdef USE_RNNOISE
 	// At the time of writing this code, RNNoise only supports a sample rate of 48000 Hz.
-	if (g.s.bDenoise && denoiseState && (iFrameSize == 480)) {
+	// RNNoise would take the latency probe's marker for noise.
+	if (g.s.bDenoise && denoiseState && (iFrameSize == 480) && ! LatencyProbe::lpProbe.isActive()) {
 		float denoiseFrames[480];
 		for (int i = 0; i < 480; i++) {
 			denoiseFrames[i] = psMic[i];
@@ -838,6 +691,7 @@ void AudioInput::encodeAudioFrame() {
 		for (int i = 0; i < 480; i++) {
 			psMic[i] = denoiseFrames[i];
 		}
+		lapStage(AudioStageTimer::Denoise);
 	}
 #endif
 
@@ -855,15 +709,15 @@ void AudioInput::encodeAudioFrame() {
 		psSource = psMic;
 	}
 
-	sum=1.0f;
-	for (i=0;i<iFrameSize;i++)
-		sum += static_cast<float>(psSource[i] * psSource[i]);
+	AudioInputKernels::best().levels(psSource, iFrameSize, &energy, &peak);
+	sum = 1.0f + static_cast<float>(energy);
 	float micLevel = sqrtf(sum / static_cast<float>(iFrameSize));
 	dPeakSignal = qMax(20.0f*log10f(micLevel / 32768.0f), -96.0f);
 
 	spx_int32_t prob = 0;
 	speex_preprocess_ctl(sppPreprocess, SPEEX_PREPROCESS_GET_PROB, &prob);
 	fSpeechProb = static_cast<float>(prob) / 100.0f;
+	lapStage(AudioStageTimer::Preprocess);
 
 	// clean microphone level: peak of filtered signal attenuated by AGC gain
 	dPeakCleanMic = qMax(dPeakSignal - gainValue, -96.0f);
@@ -891,6 +745,10 @@ void AudioInput::encodeAudioFrame() {
 
 	bIsSpeech = bIsSpeech || (g.iPushToTalk > 0);
 
+	// The latency probe's silence has to be sent as well.
+	if (LatencyProbe::lpProbe.isActive())
+		bIsSpeech = true;
+
 	ClientUser *p = ClientUser::get(g.uiSession);
 	if (g.s.bMute || ((g.s.lmLoopMode != Settings::Local) && p && (p->bMute || p->bSuppress)) || g.bPushToMute || (g.iTarget < 0)) {
 		bIsSpeech = false;
@@ -1010,6 +868,7 @@ void AudioInput::encodeAudioFrame() {
 	if (encoded) {
 		flushCheck(QByteArray(reinterpret_cast<char *>(&buffer[0]), len), !bIsSpeech);
 	}
+	lapStage(AudioStageTimer::Encode);
 
 	if (! bIsSpeech)
 		iBitrate = 0;
@@ -1017,7 +876,7 @@ void AudioInput::encodeAudioFrame() {
 	bPreviousVoice = bIsSpeech;
 }
 
-static void sendAudioFrame(const char *data, PacketDataStream &pds) {
+void AudioInput::sendAudioFrame(const char *data, PacketDataStream &pds) {
 	ServerHandlerPtr sh = g.sh;
 	if (sh) {
 		VoiceRecorderPtr recorder(sh->recorder);
@@ -1058,7 +917,8 @@ void AudioInput::flushCheck(const QByteArray &frame, bool terminator) {
 
 	PacketDataStream pds(data + 1, 1023);
 	// Sequence number
-	pds << iFrameCounter - frames;
+	const int seq = iFrameCounter - frames;
+	pds << seq;
 
 	if (umtType == MessageHandler::UDPVoiceOpus) {
 		const QByteArray &qba = qlFrames.takeFirst();
@@ -1083,14 +943,18 @@ void AudioInput::flushCheck(const QByteArray &frame, bool terminator) {
 		}
 	}
 
-	if (g.s.bTransmitPosition && g.p && ! g.bCenterPosition && g.p->fetch()) {
-		pds << g.p->fPosition[0];
-		pds << g.p->fPosition[1];
-		pds << g.p->fPosition[2];
+	PositionalSample pos;
+	if (g.s.bTransmitPosition && g.p && ! g.bCenterPosition && g.p->position(pos)) {
+		pds << pos.fPosition[0];
+		pds << pos.fPosition[1];
+		pds << pos.fPosition[2];
 	}
 
 	sendAudioFrame(data, pds);
 
+	if (LatencyProbe::lpProbe.isActive())
+		LatencyProbe::lpProbe.sent(seq, iFrameCounter - seq);
+
 	Q_ASSERT(qlFrames.isEmpty());
 }
 
@@ -11,19 +11,23 @@
 #include <speex/speex.h>
 #include <speex/speex_echo.h>
 #include <speex/speex_preprocess.h>
-#include <speex/speex_resampler.h>
 #include <QtCore/QObject>
 #include <QtCore/QThread>
 #include <vector>
 
 #include "Audio.h"
+#include "AudioBenchmark.h"
 #include "Settings.h"
 #include "Timer.h"
 #include "Message.h"
+#include "SPSCRing.h"
+
+class Resampler;
 
 class AudioInput;
 class CELTCodec;
 class OpusCodec;
+class PacketDataStream;
 struct CELTEncoder;
 struct OpusEncoder;
 struct DenoiseState;
@@ -62,12 +66,21 @@ class AudioInput : public QThread {
 		typedef enum { SampleShort, SampleFloat } SampleFormat;
 		typedef void (*inMixerFunc)(float * RESTRICT, const void * RESTRICT, unsigned int, unsigned int, quint64);
 	private:
-		SpeexResamplerState *srsMic, *srsEcho;
-
-		QMutex qmEcho;
-		QList<short *> qlEchoFrames;
-		unsigned int iJitterSeq;
+		Resampler *rsMic, *rsEcho;
+
+		/// Speaker reference frames of iEchoFrameSize samples, from the
+		/// echo callback to the mic callback. Created by initializeMixer();
+		/// neither side locks or allocates.
+		SPSCSampleRing<short> *srEcho;
+		/// Number of echo frames ever queued, wrapping around. Only the
+		/// echo callback writes it.
+		QAtomicInt aiEchoQueued;
+		/// aiEchoQueued when drift compensation last started over, and the
+		/// fewest frames found queued since. Mic callback only.
+		unsigned int uiEchoSeqStart;
 		int iMinBuffered;
+		/// Frame psSpeaker points at once echo has arrived.
+		short *psEchoFrame;
 
 		unsigned int iMicFilled, iEchoFilled;
 		inMixerFunc imfMic, imfEcho;
@@ -117,9 +130,23 @@ class AudioInput : public QThread {
 		int iAudioFrames;
 
 		short *psMic;
+		/// Sum of squares and peak magnitude of psMic, measured by addMic
+		/// while converting the frame.
+		quint64 uiMicEnergy;
+		int iMicPeak;
 		short *psSpeaker;
 		short *psClean;
 
+		/// Echo frames the mic callback skipped because the echo source
+		/// runs faster than the microphone. These counters are reported
+		/// in the debug log when input stops.
+		unsigned int uiEchoDropped;
+		/// Mic frames for which no echo frame had arrived, so the previous
+		/// one was reused.
+		unsigned int uiEchoMissing;
+		/// Echo frames lost because the mic callback fell too far behind.
+		unsigned int uiEchoOverrun;
+
 		float *pfMicInput;
 		float *pfEchoInput;
 		float *pfOutput;
@@ -140,6 +167,17 @@ class AudioInput : public QThread {
 
 		QList<QByteArray> qlFrames;
 		void flushCheck(const QByteArray &, bool terminator);
+		/// Hands a finished voice packet to the recorder and to the server
+		/// or the local loopback.
+		virtual void sendAudioFrame(const char *data, PacketDataStream &pds);
+
+		/// Collects per-stage processing time when set. NULL unless
+		/// AudioBenchmark drives this input.
+		AudioStageTimer *astTimer;
+		void lapStage(AudioStageTimer::Stage s) {
+			if (astTimer)
+				astTimer->lap(s);
+		}
 
 		void initializeMixer();
 
@@ -0,0 +1,582 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "AudioInputKernels.h"
+
+#include "AudioMixKernels.h"
+#include "Utils.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define INPUT_X86
+# include <emmintrin.h>
+# include <immintrin.h>
+# if defined(__GNUC__)
+#  define INPUT_TARGET_SSE2 __attribute__((target("sse2")))
+#  define INPUT_TARGET_AVX2 __attribute__((target("avx2")))
+# else
+#  define INPUT_TARGET_SSE2
+#  define INPUT_TARGET_AVX2
+# endif
+#endif
+
+// See AudioMixKernels.cpp for why 32 bit ARM is left out.
+#if defined(__aarch64__) || defined(_M_ARM64)
+# define INPUT_NEON
+# include <arm_neon.h>
+#endif
+
+/// Whether mask selects every one of the nchan channels.
+static inline bool allChannels(unsigned int nchan, quint64 mask) {
+	if (mask == 0xffffffffffffffffULL)
+		return true;
+	if (nchan >= 64)
+		return false;
+	const quint64 want = (1ULL << nchan) - 1;
+	return (mask & want) == want;
+}
+
+/// Lists the channels selected by mask in ascending order and returns
+/// how many there are.
+static unsigned int selectChannels(unsigned int nchan, quint64 mask, unsigned int *index) {
+	const bool all = allChannels(nchan, mask);
+	unsigned int count = 0;
+	for (unsigned int j = 0; j < nchan; ++j) {
+		if (all || ((j < 64) && (mask & (1ULL << j))))
+			index[count++] = j;
+	}
+	return count;
+}
+
+template <unsigned int channels>
+static void downmixFloatFixed(float * RESTRICT out, const float * RESTRICT in, unsigned int nsamp) {
+	const float m = 1.0f / static_cast<float>(channels);
+	for (unsigned int i=0;i<nsamp;++i) {
+		float v = 0.0f;
+		for (unsigned int j=0;j<channels;++j)
+			v += in[i*channels+j];
+		out[i] = v * m;
+	}
+}
+
+template <unsigned int channels>
+static void downmixShortFixed(float * RESTRICT out, const short * RESTRICT in, unsigned int nsamp) {
+	const float m = 1.0f / (32768.f * static_cast<float>(channels));
+	for (unsigned int i=0;i<nsamp;++i) {
+		float v = 0.0f;
+		for (unsigned int j=0;j<channels;++j)
+			v += static_cast<float>(in[i*channels+j]);
+		out[i] = v * m;
+	}
+}
+
+/// Downmixes frames [from, nsamp) through an explicit channel list.
+static void downmixFloatFrames(float * RESTRICT out, const float * RESTRICT in, unsigned int from, unsigned int nsamp, unsigned int nchan, const unsigned int *index, unsigned int count, float m) {
+	for (unsigned int i=from;i<nsamp;++i) {
+		float v = 0.0f;
+		for (unsigned int j=0;j<count;++j)
+			v += in[i*nchan+index[j]];
+		out[i] = v * m;
+	}
+}
+
+static void downmixShortFrames(float * RESTRICT out, const short * RESTRICT in, unsigned int from, unsigned int nsamp, unsigned int nchan, const unsigned int *index, unsigned int count, float m) {
+	for (unsigned int i=from;i<nsamp;++i) {
+		float v = 0.0f;
+		for (unsigned int j=0;j<count;++j)
+			v += static_cast<float>(in[i*nchan+index[j]]);
+		out[i] = v * m;
+	}
+}
+
+static void downmixFloatScalar(float * RESTRICT out, const void * RESTRICT ipt, unsigned int nsamp, unsigned int nchan, quint64 mask) {
+	const float * RESTRICT in = reinterpret_cast<const float *>(ipt);
+
+	if (allChannels(nchan, mask)) {
+		switch (nchan) {
+			case 1:
+				downmixFloatFixed<1>(out, in, nsamp);
+				return;
+			case 2:
+				downmixFloatFixed<2>(out, in, nsamp);
+				return;
+			case 3:
+				downmixFloatFixed<3>(out, in, nsamp);
+				return;
+			case 4:
+				downmixFloatFixed<4>(out, in, nsamp);
+				return;
+			case 5:
+				downmixFloatFixed<5>(out, in, nsamp);
+				return;
+			case 6:
+				downmixFloatFixed<6>(out, in, nsamp);
+				return;
+			case 7:
+				downmixFloatFixed<7>(out, in, nsamp);
+				return;
+			case 8:
+				downmixFloatFixed<8>(out, in, nsamp);
+				return;
+			default:
+				break;
+		}
+	}
+
+	STACKVAR(unsigned int, index, nchan);
+	const unsigned int count = selectChannels(nchan, mask, index);
+	downmixFloatFrames(out, in, 0, nsamp, nchan, index, count, 1.0f / static_cast<float>(count));
+}
+
+static void downmixShortScalar(float * RESTRICT out, const void * RESTRICT ipt, unsigned int nsamp, unsigned int nchan, quint64 mask) {
+	const short * RESTRICT in = reinterpret_cast<const short *>(ipt);
+
+	if (allChannels(nchan, mask)) {
+		switch (nchan) {
+			case 1:
+				downmixShortFixed<1>(out, in, nsamp);
+				return;
+			case 2:
+				downmixShortFixed<2>(out, in, nsamp);
+				return;
+			case 3:
+				downmixShortFixed<3>(out, in, nsamp);
+				return;
+			case 4:
+				downmixShortFixed<4>(out, in, nsamp);
+				return;
+			case 5:
+				downmixShortFixed<5>(out, in, nsamp);
+				return;
+			case 6:
+				downmixShortFixed<6>(out, in, nsamp);
+				return;
+			case 7:
+				downmixShortFixed<7>(out, in, nsamp);
+				return;
+			case 8:
+				downmixShortFixed<8>(out, in, nsamp);
+				return;
+			default:
+				break;
+		}
+	}
+
+	STACKVAR(unsigned int, index, nchan);
+	const unsigned int count = selectChannels(nchan, mask, index);
+	downmixShortFrames(out, in, 0, nsamp, nchan, index, count, 1.0f / (32768.f * static_cast<float>(count)));
+}
+
+/// Adds count samples to the running levels() state.
+static inline void levelsAccumulate(const short *in, unsigned int count, quint64 &energy, int &hi, int &lo) {
+	for (unsigned int i=0;i<count;++i) {
+		const int v = in[i];
+		energy += static_cast<quint64>(v * v);
+		hi = qMax(hi, v);
+		lo = qMin(lo, v);
+	}
+}
+
+static inline void toShortLevelsAccumulate(const float * RESTRICT in, short * RESTRICT out, unsigned int count, quint64 &energy, int &hi, int &lo) {
+	for (unsigned int i=0;i<count;++i) {
+		const short s = static_cast<short>(qBound(-32768.f, (in[i] * 32768.f), 32767.f));
+		out[i] = s;
+		const int v = s;
+		energy += static_cast<quint64>(v * v);
+		hi = qMax(hi, v);
+		lo = qMin(lo, v);
+	}
+}
+
+static void levelsScalar(const short *in, unsigned int count, quint64 *energy, int *peak) {
+	quint64 e = 0;
+	int hi = 0, lo = 0;
+	levelsAccumulate(in, count, e, hi, lo);
+	*energy = e;
+	*peak = qMax(hi, -lo);
+}
+
+static void toShortLevelsScalar(const float * RESTRICT in, short * RESTRICT out, unsigned int count, quint64 *energy, int *peak) {
+	quint64 e = 0;
+	int hi = 0, lo = 0;
+	toShortLevelsAccumulate(in, out, count, e, hi, lo);
+	*energy = e;
+	*peak = qMax(hi, -lo);
+}
+
+static void toFloatScalar(const short * RESTRICT in, float * RESTRICT out, unsigned int count) {
+	for (unsigned int i=0;i<count;++i)
+		out[i] = static_cast<float>(in[i]) * (1.0f / 32768.f);
+}
+
+#ifdef INPUT_X86
+// The short downmixers add in integers. Sums of up to 512 channels are
+// exact in a float, so the order of the additions makes no difference.
+
+static INPUT_TARGET_SSE2 void downmixFloatSSE2(float * RESTRICT out, const void * RESTRICT ipt, unsigned int nsamp, unsigned int nchan, quint64 mask) {
+	const float * RESTRICT in = reinterpret_cast<const float *>(ipt);
+	const __m128 zero = _mm_setzero_ps();
+
+	STACKVAR(unsigned int, index, nchan);
+	const unsigned int count = selectChannels(nchan, mask, index);
+	const float fm = 1.0f / static_cast<float>(count);
+	const __m128 m = _mm_set1_ps(fm);
+	unsigned int i = 0;
+
+	// Starting from 0.0f turns -0.0f into 0.0f, exactly like the scalar loop.
+	if ((count == nchan) && (nchan == 1)) {
+		for (; i + 4 <= nsamp; i += 4)
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(zero, _mm_loadu_ps(in + i)), m));
+	} else if ((count == nchan) && (nchan == 2)) {
+		for (; i + 4 <= nsamp; i += 4) {
+			const __m128 a = _mm_loadu_ps(in + i * 2);
+			const __m128 b = _mm_loadu_ps(in + i * 2 + 4);
+			const __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			const __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_add_ps(_mm_add_ps(zero, l), r), m));
+		}
+	} else {
+		// Four frames per vector, one channel at a time.
+		for (; i + 4 <= nsamp; i += 4) {
+			const float *f = in + i * nchan;
+			__m128 v = zero;
+			for (unsigned int j = 0; j < count; ++j) {
+				const unsigned int c = index[j];
+				v = _mm_add_ps(v, _mm_setr_ps(f[c], f[nchan + c], f[2 * nchan + c], f[3 * nchan + c]));
+			}
+			_mm_storeu_ps(out + i, _mm_mul_ps(v, m));
+		}
+	}
+
+	downmixFloatFrames(out, in, i, nsamp, nchan, index, count, fm);
+}
+
+static INPUT_TARGET_SSE2 void downmixShortSSE2(float * RESTRICT out, const void * RESTRICT ipt, unsigned int nsamp, unsigned int nchan, quint64 mask) {
+	const short * RESTRICT in = reinterpret_cast<const short *>(ipt);
+
+	STACKVAR(unsigned int, index, nchan);
+	const unsigned int count = selectChannels(nchan, mask, index);
+	const float fm = 1.0f / (32768.f * static_cast<float>(count));
+	const __m128 m = _mm_set1_ps(fm);
+	unsigned int i = 0;
+
+	if ((count == nchan) && (nchan == 1)) {
+		for (; i + 8 <= nsamp; i += 8) {
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+			const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+			const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), m));
+			_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), m));
+		}
+	} else if ((count == nchan) && (nchan == 2)) {
+		// pmaddwd against ones adds each L R pair into 32 bits.
+		const __m128i one = _mm_set1_epi16(1);
+		for (; i + 4 <= nsamp; i += 4) {
+			const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i * 2));
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_madd_epi16(x, one)), m));
+		}
+	} else {
+		for (; i + 4 <= nsamp; i += 4) {
+			const short *f = in + i * nchan;
+			__m128i v = _mm_setzero_si128();
+			for (unsigned int j = 0; j < count; ++j) {
+				const unsigned int c = index[j];
+				v = _mm_add_epi32(v, _mm_setr_epi32(f[c], f[nchan + c], f[2 * nchan + c], f[3 * nchan + c]));
+			}
+			_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(v), m));
+		}
+	}
+
+	downmixShortFrames(out, in, i, nsamp, nchan, index, count, fm);
+}
+
+/// Adds eight samples to the vector levels() state. pmaddwd of two
+/// -32768 pairs is 2^31, so its sums are widened as unsigned.
+static INPUT_TARGET_SSE2 inline void levelsStepSSE2(__m128i x, __m128i &energy, __m128i &hi, __m128i &lo) {
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i sq = _mm_madd_epi16(x, x);
+	energy = _mm_add_epi64(energy, _mm_add_epi64(_mm_unpacklo_epi32(sq, zero), _mm_unpackhi_epi32(sq, zero)));
+	hi = _mm_max_epi16(hi, x);
+	lo = _mm_min_epi16(lo, x);
+}
+
+static INPUT_TARGET_SSE2 void levelsReduceSSE2(__m128i energy, __m128i hi, __m128i lo, quint64 &e, int &h, int &l) {
+	quint64 ea[2];
+	short ha[8], la[8];
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(ea), energy);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(ha), hi);
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(la), lo);
+	e += ea[0] + ea[1];
+	for (int k = 0; k < 8; ++k) {
+		h = qMax(h, static_cast<int>(ha[k]));
+		l = qMin(l, static_cast<int>(la[k]));
+	}
+}
+
+static INPUT_TARGET_SSE2 void levelsSSE2(const short *in, unsigned int count, quint64 *energy, int *peak) {
+	__m128i ve = _mm_setzero_si128();
+	__m128i vh = ve, vl = ve;
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+		levelsStepSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)), ve, vh, vl);
+
+	quint64 e = 0;
+	int hi = 0, lo = 0;
+	levelsReduceSSE2(ve, vh, vl, e, hi, lo);
+	levelsAccumulate(in + i, count - i, e, hi, lo);
+	*energy = e;
+	*peak = qMax(hi, -lo);
+}
+
+static INPUT_TARGET_SSE2 void toShortLevelsSSE2(const float * RESTRICT in, short * RESTRICT out, unsigned int count, quint64 *energy, int *peak) {
+	const __m128 scale = _mm_set1_ps(32768.f);
+	const __m128 flo = _mm_set1_ps(-32768.f);
+	const __m128 fhi = _mm_set1_ps(32767.f);
+	__m128i ve = _mm_setzero_si128();
+	__m128i vh = ve, vl = ve;
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128 a = _mm_max_ps(_mm_min_ps(fhi, _mm_mul_ps(_mm_loadu_ps(in + i), scale)), flo);
+		const __m128 b = _mm_max_ps(_mm_min_ps(fhi, _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale)), flo);
+		const __m128i x = _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), x);
+		levelsStepSSE2(x, ve, vh, vl);
+	}
+
+	quint64 e = 0;
+	int hi = 0, lo = 0;
+	levelsReduceSSE2(ve, vh, vl, e, hi, lo);
+	toShortLevelsAccumulate(in + i, out + i, count - i, e, hi, lo);
+	*energy = e;
+	*peak = qMax(hi, -lo);
+}
+
+static INPUT_TARGET_SSE2 void toFloatSSE2(const short * RESTRICT in, float * RESTRICT out, unsigned int count) {
+	const __m128 m = _mm_set1_ps(1.0f / 32768.f);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+		const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+		const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), m));
+		_mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), m));
+	}
+	toFloatScalar(in + i, out + i, count - i);
+}
+
+static INPUT_TARGET_AVX2 inline void levelsStepAVX2(__m256i x, __m256i &energy, __m256i &hi, __m256i &lo) {
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i sq = _mm256_madd_epi16(x, x);
+	energy = _mm256_add_epi64(energy, _mm256_add_epi64(_mm256_unpacklo_epi32(sq, zero), _mm256_unpackhi_epi32(sq, zero)));
+	hi = _mm256_max_epi16(hi, x);
+	lo = _mm256_min_epi16(lo, x);
+}
+
+static INPUT_TARGET_AVX2 void levelsReduceAVX2(__m256i energy, __m256i hi, __m256i lo, quint64 &e, int &h, int &l) {
+	quint64 ea[4];
+	short ha[16], la[16];
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(ea), energy);
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(ha), hi);
+	_mm256_storeu_si256(reinterpret_cast<__m256i *>(la), lo);
+	e += ea[0] + ea[1] + ea[2] + ea[3];
+	for (int k = 0; k < 16; ++k) {
+		h = qMax(h, static_cast<int>(ha[k]));
+		l = qMin(l, static_cast<int>(la[k]));
+	}
+}
+
+static INPUT_TARGET_AVX2 void levelsAVX2(const short *in, unsigned int count, quint64 *energy, int *peak) {
+	__m256i ve = _mm256_setzero_si256();
+	__m256i vh = ve, vl = ve;
+	unsigned int i = 0;
+	for (; i + 16 <= count; i += 16)
+		levelsStepAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i)), ve, vh, vl);
+
+	quint64 e = 0;
+	int hi = 0, lo = 0;
+	levelsReduceAVX2(ve, vh, vl, e, hi, lo);
+	levelsAccumulate(in + i, count - i, e, hi, lo);
+	*energy = e;
+	*peak = qMax(hi, -lo);
+}
+
+static INPUT_TARGET_AVX2 void toShortLevelsAVX2(const float * RESTRICT in, short * RESTRICT out, unsigned int count, quint64 *energy, int *peak) {
+	const __m256 scale = _mm256_set1_ps(32768.f);
+	const __m256 flo = _mm256_set1_ps(-32768.f);
+	const __m256 fhi = _mm256_set1_ps(32767.f);
+	__m256i ve = _mm256_setzero_si256();
+	__m256i vh = ve, vl = ve;
+	unsigned int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const __m256 a = _mm256_max_ps(_mm256_min_ps(fhi, _mm256_mul_ps(_mm256_loadu_ps(in + i), scale)), flo);
+		const __m256 b = _mm256_max_ps(_mm256_min_ps(fhi, _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale)), flo);
+		const __m256i p = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+		const __m256i x = _mm256_permute4x64_epi64(p, 0xd8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), x);
+		levelsStepAVX2(x, ve, vh, vl);
+	}
+
+	quint64 e = 0;
+	int hi = 0, lo = 0;
+	levelsReduceAVX2(ve, vh, vl, e, hi, lo);
+	toShortLevelsAccumulate(in + i, out + i, count - i, e, hi, lo);
+	*energy = e;
+	*peak = qMax(hi, -lo);
+}
+
+static INPUT_TARGET_AVX2 void toFloatAVX2(const short * RESTRICT in, float * RESTRICT out, unsigned int count) {
+	const __m256 m = _mm256_set1_ps(1.0f / 32768.f);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i x = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i)));
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(x), m));
+	}
+	toFloatScalar(in + i, out + i, count - i);
+}
+#endif
+
+#ifdef INPUT_NEON
+static void downmixFloatNEON(float * RESTRICT out, const void * RESTRICT ipt, unsigned int nsamp, unsigned int nchan, quint64 mask) {
+	const float * RESTRICT in = reinterpret_cast<const float *>(ipt);
+	const float32x4_t zero = vdupq_n_f32(0.0f);
+
+	STACKVAR(unsigned int, index, nchan);
+	const unsigned int count = selectChannels(nchan, mask, index);
+	const float fm = 1.0f / static_cast<float>(count);
+	const float32x4_t m = vdupq_n_f32(fm);
+	unsigned int i = 0;
+
+	if ((count == nchan) && (nchan == 1)) {
+		for (; i + 4 <= nsamp; i += 4)
+			vst1q_f32(out + i, vmulq_f32(vaddq_f32(zero, vld1q_f32(in + i)), m));
+	} else if ((count == nchan) && (nchan == 2)) {
+		for (; i + 4 <= nsamp; i += 4) {
+			const float32x4x2_t x = vld2q_f32(in + i * 2);
+			vst1q_f32(out + i, vmulq_f32(vaddq_f32(vaddq_f32(zero, x.val[0]), x.val[1]), m));
+		}
+	}
+
+	downmixFloatFrames(out, in, i, nsamp, nchan, index, count, fm);
+}
+
+static void downmixShortNEON(float * RESTRICT out, const void * RESTRICT ipt, unsigned int nsamp, unsigned int nchan, quint64 mask) {
+	const short * RESTRICT in = reinterpret_cast<const short *>(ipt);
+
+	STACKVAR(unsigned int, index, nchan);
+	const unsigned int count = selectChannels(nchan, mask, index);
+	const float fm = 1.0f / (32768.f * static_cast<float>(count));
+	const float32x4_t m = vdupq_n_f32(fm);
+	unsigned int i = 0;
+
+	if ((count == nchan) && (nchan == 1)) {
+		for (; i + 8 <= nsamp; i += 8) {
+			const int16x8_t x = vld1q_s16(in + i);
+			vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), m));
+			vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), m));
+		}
+	} else if ((count == nchan) && (nchan == 2)) {
+		for (; i + 4 <= nsamp; i += 4) {
+			const int16x4x2_t x = vld2_s16(in + i * 2);
+			vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vaddl_s16(x.val[0], x.val[1])), m));
+		}
+	}
+
+	downmixShortFrames(out, in, i, nsamp, nchan, index, count, fm);
+}
+
+static inline void levelsStepNEON(int16x8_t x, int64x2_t &energy, int16x8_t &hi, int16x8_t &lo) {
+	energy = vpadalq_s32(energy, vmull_s16(vget_low_s16(x), vget_low_s16(x)));
+	energy = vpadalq_s32(energy, vmull_s16(vget_high_s16(x), vget_high_s16(x)));
+	hi = vmaxq_s16(hi, x);
+	lo = vminq_s16(lo, x);
+}
+
+static void levelsNEON(const short *in, unsigned int count, quint64 *energy, int *peak) {
+	int64x2_t ve = vdupq_n_s64(0);
+	int16x8_t vh = vdupq_n_s16(0), vl = vdupq_n_s16(0);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+		levelsStepNEON(vld1q_s16(in + i), ve, vh, vl);
+
+	quint64 e = static_cast<quint64>(vaddvq_s64(ve));
+	int hi = vmaxvq_s16(vh), lo = vminvq_s16(vl);
+	levelsAccumulate(in + i, count - i, e, hi, lo);
+	*energy = e;
+	*peak = qMax(hi, -lo);
+}
+
+/// qBound(lo, v, hi); see AudioMixKernels.cpp.
+static inline float32x4_t boundNEON(float32x4_t lo, float32x4_t v, float32x4_t hi) {
+	const float32x4_t t = vbslq_f32(vcltq_f32(hi, v), hi, v);
+	return vbslq_f32(vcltq_f32(lo, t), t, lo);
+}
+
+static void toShortLevelsNEON(const float * RESTRICT in, short * RESTRICT out, unsigned int count, quint64 *energy, int *peak) {
+	const float32x4_t scale = vdupq_n_f32(32768.f);
+	const float32x4_t flo = vdupq_n_f32(-32768.f);
+	const float32x4_t fhi = vdupq_n_f32(32767.f);
+	int64x2_t ve = vdupq_n_s64(0);
+	int16x8_t vh = vdupq_n_s16(0), vl = vdupq_n_s16(0);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const int32x4_t a = vcvtq_s32_f32(boundNEON(flo, vmulq_f32(vld1q_f32(in + i), scale), fhi));
+		const int32x4_t b = vcvtq_s32_f32(boundNEON(flo, vmulq_f32(vld1q_f32(in + i + 4), scale), fhi));
+		const int16x8_t x = vcombine_s16(vqmovn_s32(a), vqmovn_s32(b));
+		vst1q_s16(out + i, x);
+		levelsStepNEON(x, ve, vh, vl);
+	}
+
+	quint64 e = static_cast<quint64>(vaddvq_s64(ve));
+	int hi = vmaxvq_s16(vh), lo = vminvq_s16(vl);
+	toShortLevelsAccumulate(in + i, out + i, count - i, e, hi, lo);
+	*energy = e;
+	*peak = qMax(hi, -lo);
+}
+
+static void toFloatNEON(const short * RESTRICT in, float * RESTRICT out, unsigned int count) {
+	const float32x4_t m = vdupq_n_f32(1.0f / 32768.f);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const int16x8_t x = vld1q_s16(in + i);
+		vst1q_f32(out + i, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), m));
+		vst1q_f32(out + i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(x))), m));
+	}
+	toFloatScalar(in + i, out + i, count - i);
+}
+#endif
+
+static const AudioInputKernels kScalar = { "scalar", downmixFloatScalar, downmixShortScalar, toShortLevelsScalar, levelsScalar, toFloatScalar };
+#ifdef INPUT_X86
+static const AudioInputKernels kSSE2 = { "sse2", downmixFloatSSE2, downmixShortSSE2, toShortLevelsSSE2, levelsSSE2, toFloatSSE2 };
+// The downmixers are bound by their strided loads; wider vectors do not help them.
+static const AudioInputKernels kAVX2 = { "avx2", downmixFloatSSE2, downmixShortSSE2, toShortLevelsAVX2, levelsAVX2, toFloatAVX2 };
+#endif
+#ifdef INPUT_NEON
+static const AudioInputKernels kNEON = { "neon", downmixFloatNEON, downmixShortNEON, toShortLevelsNEON, levelsNEON, toFloatNEON };
+#endif
+
+const AudioInputKernels &AudioInputKernels::scalar() {
+	return kScalar;
+}
+
+QList<const AudioInputKernels *> AudioInputKernels::available() {
+	QList<const AudioInputKernels *> ql;
+	ql << &kScalar;
+#ifdef INPUT_X86
+	if (AudioMixKernels::cpuHasSSE2()) {
+		ql << &kSSE2;
+		if (AudioMixKernels::cpuHasAVX2())
+			ql << &kAVX2;
+	}
+#endif
+#ifdef INPUT_NEON
+	ql << &kNEON;
+#endif
+	return ql;
+}
+
+const AudioInputKernels &AudioInputKernels::best() {
+	static const AudioInputKernels *k = available().last();
+	return *k;
+}
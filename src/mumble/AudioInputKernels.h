@@ -0,0 +1,44 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOINPUTKERNELS_H_
+#define MUMBLE_MUMBLE_AUDIOINPUTKERNELS_H_
+
+#include <QtCore/QList>
+#include <QtCore/QtGlobal>
+
+/// AudioInputKernels holds the per-sample loops of AudioInput: downmixing
+/// the device channels to mono, converting the finished frame to 16 bit
+/// and metering it. As with AudioMixKernels, every implementation gives
+/// results bit-for-bit identical to the scalar one.
+struct AudioInputKernels {
+	/// Averages the channels selected by mask of nsamp interleaved frames
+	/// with nchan channels into out. in is either float or short, which
+	/// is scaled by 1/32768. Same signature as AudioInput::inMixerFunc.
+	typedef void (*downmixFunc)(float * RESTRICT out, const void * RESTRICT in, unsigned int nsamp, unsigned int nchan, quint64 mask);
+	/// Converts like AudioMixKernels::toShort and returns levels() of the
+	/// converted samples in the same pass.
+	typedef void (*toShortLevelsFunc)(const float * RESTRICT in, short * RESTRICT out, unsigned int count, quint64 *energy, int *peak);
+	/// energy is the exact sum of squares, peak the largest magnitude.
+	typedef void (*levelsFunc)(const short *in, unsigned int count, quint64 *energy, int *peak);
+	/// out[i] = in[i] / 32768.
+	typedef void (*toFloatFunc)(const short * RESTRICT in, float * RESTRICT out, unsigned int count);
+
+	const char *name;
+	downmixFunc downmixFloat;
+	downmixFunc downmixShort;
+	toShortLevelsFunc toShortLevels;
+	levelsFunc levels;
+	toFloatFunc toFloat;
+
+	/// The portable reference implementation.
+	static const AudioInputKernels &scalar();
+	/// The fastest implementation supported by this CPU.
+	static const AudioInputKernels &best();
+	/// All implementations supported by this CPU, slowest first.
+	static QList<const AudioInputKernels *> available();
+};
+
+#endif
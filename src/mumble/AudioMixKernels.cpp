@@ -0,0 +1,395 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// The vector kernels must round exactly like the scalar reference, so
+// multiplies and adds may never be fused.
+#if defined(__clang__)
+# pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+# pragma GCC optimize ("fp-contract=off")
+#endif
+
+#include "AudioMixKernels.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define MIX_X86
+# include <emmintrin.h>
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+# if defined(__GNUC__)
+#  define MIX_TARGET_SSE2 __attribute__((target("sse2")))
+#  define MIX_TARGET_AVX2 __attribute__((target("avx2")))
+# else
+#  define MIX_TARGET_SSE2
+#  define MIX_TARGET_AVX2
+# endif
+#endif
+
+// 32 bit ARM NEON flushes denormals to zero, so it cannot match the scalar
+// code bit for bit. AArch64 Advanced SIMD is fully IEEE 754 compliant.
+#if defined(__aarch64__) || defined(_M_ARM64)
+# define MIX_NEON
+# include <arm_neon.h>
+#endif
+
+static void accumulateScalar(float * RESTRICT out, const float * RESTRICT in, unsigned int nsamp, unsigned int nchan, const float *gain, const float *inc, const quint32 *mask) {
+	for (unsigned int s=0;s<nchan;++s) {
+		if (! mask[s])
+			continue;
+		const float g = gain[s];
+		const float d = inc[s];
+		float * RESTRICT o = out + s;
+		for (unsigned int i=0;i<nsamp;++i)
+			o[i*nchan] += in[i] * (g + d * static_cast<float>(i));
+	}
+}
+
+/// Mixes sample i into channels [from, nchan) of frame o.
+static inline void accumulateFrameScalar(float *o, float x, float fi, unsigned int from, unsigned int nchan, const float *gain, const float *inc, const quint32 *mask) {
+	for (unsigned int s=from;s<nchan;++s)
+		if (mask[s])
+			o[s] += x * (gain[s] + inc[s] * fi);
+}
+
+static void clipScalar(float *buf, unsigned int count) {
+	for (unsigned int i=0;i<count;++i)
+		buf[i] = qBound(-1.0f, buf[i], 1.0f);
+}
+
+static void toShortScalar(const float * RESTRICT in, short * RESTRICT out, unsigned int count) {
+	for (unsigned int i=0;i<count;++i)
+		out[i] = static_cast<short>(qBound(-32768.f, (in[i] * 32768.f), 32767.f));
+}
+
+#ifdef MIX_X86
+// Note on clamping: qBound(lo, v, hi) is qMax(lo, qMin(hi, v)), which is
+// (hi < v ? hi : v) followed by (lo < t ? t : lo). minps(hi, v) and
+// maxps(t, lo) evaluate exactly these expressions, NaN included.
+
+static MIX_TARGET_SSE2 void accumulateSSE2(float * RESTRICT out, const float * RESTRICT in, unsigned int nsamp, unsigned int nchan, const float *gain, const float *inc, const quint32 *mask) {
+	unsigned int i = 0;
+
+	if (nchan == 1) {
+		if (! mask[0])
+			return;
+		const __m128 g = _mm_set1_ps(gain[0]);
+		const __m128 d = _mm_set1_ps(inc[0]);
+		const __m128 step = _mm_set1_ps(4.0f);
+		__m128 fi = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		for (; i + 4 <= nsamp; i += 4) {
+			const __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), _mm_add_ps(g, _mm_mul_ps(d, fi)));
+			_mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), v));
+			fi = _mm_add_ps(fi, step);
+		}
+	} else if (nchan == 2) {
+		// Two frames per vector: L R L R.
+		const __m128 g = _mm_setr_ps(gain[0], gain[1], gain[0], gain[1]);
+		const __m128 d = _mm_setr_ps(inc[0], inc[1], inc[0], inc[1]);
+		const __m128 m = _mm_castsi128_ps(_mm_setr_epi32(mask[0], mask[1], mask[0], mask[1]));
+		const __m128 step = _mm_set1_ps(2.0f);
+		__m128 fi = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+		for (; i + 4 <= nsamp; i += 4) {
+			const __m128 x = _mm_loadu_ps(in + i);
+			float *o = out + i * 2;
+
+			__m128 v = _mm_and_ps(_mm_mul_ps(_mm_unpacklo_ps(x, x), _mm_add_ps(g, _mm_mul_ps(d, fi))), m);
+			_mm_storeu_ps(o, _mm_add_ps(_mm_loadu_ps(o), v));
+			fi = _mm_add_ps(fi, step);
+
+			v = _mm_and_ps(_mm_mul_ps(_mm_unpackhi_ps(x, x), _mm_add_ps(g, _mm_mul_ps(d, fi))), m);
+			_mm_storeu_ps(o + 4, _mm_add_ps(_mm_loadu_ps(o + 4), v));
+			fi = _mm_add_ps(fi, step);
+		}
+	} else {
+		// One frame at a time, four channels per vector.
+		const unsigned int vchan = nchan & ~3U;
+		for (; i < nsamp; ++i) {
+			const float fi = static_cast<float>(i);
+			const __m128 x = _mm_set1_ps(in[i]);
+			const __m128 vfi = _mm_set1_ps(fi);
+			float *o = out + i * nchan;
+			for (unsigned int s = 0; s < vchan; s += 4) {
+				const __m128 m = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(mask + s)));
+				const __m128 v = _mm_and_ps(_mm_mul_ps(x, _mm_add_ps(_mm_loadu_ps(gain + s), _mm_mul_ps(_mm_loadu_ps(inc + s), vfi))), m);
+				_mm_storeu_ps(o + s, _mm_add_ps(_mm_loadu_ps(o + s), v));
+			}
+			accumulateFrameScalar(o, in[i], fi, vchan, nchan, gain, inc, mask);
+		}
+	}
+
+	for (; i < nsamp; ++i)
+		accumulateFrameScalar(out + i * nchan, in[i], static_cast<float>(i), 0, nchan, gain, inc, mask);
+}
+
+static MIX_TARGET_SSE2 void clipSSE2(float *buf, unsigned int count) {
+	const __m128 lo = _mm_set1_ps(-1.0f);
+	const __m128 hi = _mm_set1_ps(1.0f);
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(buf + i, _mm_max_ps(_mm_min_ps(hi, _mm_loadu_ps(buf + i)), lo));
+	clipScalar(buf + i, count - i);
+}
+
+static MIX_TARGET_SSE2 void toShortSSE2(const float * RESTRICT in, short * RESTRICT out, unsigned int count) {
+	const __m128 scale = _mm_set1_ps(32768.f);
+	const __m128 lo = _mm_set1_ps(-32768.f);
+	const __m128 hi = _mm_set1_ps(32767.f);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128 a = _mm_max_ps(_mm_min_ps(hi, _mm_mul_ps(_mm_loadu_ps(in + i), scale)), lo);
+		const __m128 b = _mm_max_ps(_mm_min_ps(hi, _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale)), lo);
+		_mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+	}
+	toShortScalar(in + i, out + i, count - i);
+}
+
+static MIX_TARGET_AVX2 void accumulateAVX2(float * RESTRICT out, const float * RESTRICT in, unsigned int nsamp, unsigned int nchan, const float *gain, const float *inc, const quint32 *mask) {
+	unsigned int i = 0;
+
+	if (nchan == 1) {
+		if (! mask[0])
+			return;
+		const __m256 g = _mm256_set1_ps(gain[0]);
+		const __m256 d = _mm256_set1_ps(inc[0]);
+		const __m256 step = _mm256_set1_ps(8.0f);
+		__m256 fi = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		for (; i + 8 <= nsamp; i += 8) {
+			const __m256 v = _mm256_mul_ps(_mm256_loadu_ps(in + i), _mm256_add_ps(g, _mm256_mul_ps(d, fi)));
+			_mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(out + i), v));
+			fi = _mm256_add_ps(fi, step);
+		}
+	} else if (nchan == 2) {
+		// Four frames per vector: L R L R L R L R.
+		const __m256 g = _mm256_setr_ps(gain[0], gain[1], gain[0], gain[1], gain[0], gain[1], gain[0], gain[1]);
+		const __m256 d = _mm256_setr_ps(inc[0], inc[1], inc[0], inc[1], inc[0], inc[1], inc[0], inc[1]);
+		const __m256 m = _mm256_castsi256_ps(_mm256_setr_epi32(mask[0], mask[1], mask[0], mask[1], mask[0], mask[1], mask[0], mask[1]));
+		const __m256i dup = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+		const __m256 step = _mm256_set1_ps(4.0f);
+		__m256 fi = _mm256_setr_ps(0.0f, 0.0f, 1.0f, 1.0f, 2.0f, 2.0f, 3.0f, 3.0f);
+		for (; i + 4 <= nsamp; i += 4) {
+			const __m256 x = _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(in + i)), dup);
+			float *o = out + i * 2;
+			const __m256 v = _mm256_and_ps(_mm256_mul_ps(x, _mm256_add_ps(g, _mm256_mul_ps(d, fi))), m);
+			_mm256_storeu_ps(o, _mm256_add_ps(_mm256_loadu_ps(o), v));
+			fi = _mm256_add_ps(fi, step);
+		}
+	} else {
+		// One frame at a time, eight and then four channels per vector.
+		const unsigned int wchan = nchan & ~7U;
+		const unsigned int vchan = nchan & ~3U;
+		for (; i < nsamp; ++i) {
+			const float fi = static_cast<float>(i);
+			float *o = out + i * nchan;
+			unsigned int s = 0;
+			if (wchan) {
+				const __m256 x = _mm256_set1_ps(in[i]);
+				const __m256 vfi = _mm256_set1_ps(fi);
+				for (; s < wchan; s += 8) {
+					const __m256 m = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(mask + s)));
+					const __m256 v = _mm256_and_ps(_mm256_mul_ps(x, _mm256_add_ps(_mm256_loadu_ps(gain + s), _mm256_mul_ps(_mm256_loadu_ps(inc + s), vfi))), m);
+					_mm256_storeu_ps(o + s, _mm256_add_ps(_mm256_loadu_ps(o + s), v));
+				}
+			}
+			if (s < vchan) {
+				const __m128 m = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(mask + s)));
+				const __m128 v = _mm_and_ps(_mm_mul_ps(_mm_set1_ps(in[i]), _mm_add_ps(_mm_loadu_ps(gain + s), _mm_mul_ps(_mm_loadu_ps(inc + s), _mm_set1_ps(fi)))), m);
+				_mm_storeu_ps(o + s, _mm_add_ps(_mm_loadu_ps(o + s), v));
+				s += 4;
+			}
+			accumulateFrameScalar(o, in[i], fi, s, nchan, gain, inc, mask);
+		}
+	}
+
+	for (; i < nsamp; ++i)
+		accumulateFrameScalar(out + i * nchan, in[i], static_cast<float>(i), 0, nchan, gain, inc, mask);
+}
+
+static MIX_TARGET_AVX2 void clipAVX2(float *buf, unsigned int count) {
+	const __m256 lo = _mm256_set1_ps(-1.0f);
+	const __m256 hi = _mm256_set1_ps(1.0f);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(buf + i, _mm256_max_ps(_mm256_min_ps(hi, _mm256_loadu_ps(buf + i)), lo));
+	clipScalar(buf + i, count - i);
+}
+
+static MIX_TARGET_AVX2 void toShortAVX2(const float * RESTRICT in, short * RESTRICT out, unsigned int count) {
+	const __m256 scale = _mm256_set1_ps(32768.f);
+	const __m256 lo = _mm256_set1_ps(-32768.f);
+	const __m256 hi = _mm256_set1_ps(32767.f);
+	unsigned int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const __m256 a = _mm256_max_ps(_mm256_min_ps(hi, _mm256_mul_ps(_mm256_loadu_ps(in + i), scale)), lo);
+		const __m256 b = _mm256_max_ps(_mm256_min_ps(hi, _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), scale)), lo);
+		// packs works within 128 bit lanes; put the quadwords back in order.
+		const __m256i p = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+		_mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_permute4x64_epi64(p, 0xd8));
+	}
+	toShortSSE2(in + i, out + i, count - i);
+}
+#endif
+
+#ifdef MIX_NEON
+static void accumulateNEON(float * RESTRICT out, const float * RESTRICT in, unsigned int nsamp, unsigned int nchan, const float *gain, const float *inc, const quint32 *mask) {
+	unsigned int i = 0;
+
+	if (nchan == 1) {
+		if (! mask[0])
+			return;
+		const float32x4_t g = vdupq_n_f32(gain[0]);
+		const float32x4_t d = vdupq_n_f32(inc[0]);
+		const float32x4_t step = vdupq_n_f32(4.0f);
+		const float idx[4] = { 0.0f, 1.0f, 2.0f, 3.0f };
+		float32x4_t fi = vld1q_f32(idx);
+		for (; i + 4 <= nsamp; i += 4) {
+			const float32x4_t v = vmulq_f32(vld1q_f32(in + i), vaddq_f32(g, vmulq_f32(d, fi)));
+			vst1q_f32(out + i, vaddq_f32(vld1q_f32(out + i), v));
+			fi = vaddq_f32(fi, step);
+		}
+	} else if (nchan == 2) {
+		const float ga[4] = { gain[0], gain[1], gain[0], gain[1] };
+		const float da[4] = { inc[0], inc[1], inc[0], inc[1] };
+		const quint32 ma[4] = { mask[0], mask[1], mask[0], mask[1] };
+		const float idx[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+		const float32x4_t g = vld1q_f32(ga);
+		const float32x4_t d = vld1q_f32(da);
+		const uint32x4_t m = vld1q_u32(ma);
+		const float32x4_t step = vdupq_n_f32(2.0f);
+		float32x4_t fi = vld1q_f32(idx);
+		for (; i + 4 <= nsamp; i += 4) {
+			const float32x4x2_t x = vzipq_f32(vld1q_f32(in + i), vld1q_f32(in + i));
+			float *o = out + i * 2;
+
+			float32x4_t v = vmulq_f32(x.val[0], vaddq_f32(g, vmulq_f32(d, fi)));
+			v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), m));
+			vst1q_f32(o, vaddq_f32(vld1q_f32(o), v));
+			fi = vaddq_f32(fi, step);
+
+			v = vmulq_f32(x.val[1], vaddq_f32(g, vmulq_f32(d, fi)));
+			v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), m));
+			vst1q_f32(o + 4, vaddq_f32(vld1q_f32(o + 4), v));
+			fi = vaddq_f32(fi, step);
+		}
+	} else {
+		const unsigned int vchan = nchan & ~3U;
+		for (; i < nsamp; ++i) {
+			const float fi = static_cast<float>(i);
+			const float32x4_t x = vdupq_n_f32(in[i]);
+			const float32x4_t vfi = vdupq_n_f32(fi);
+			float *o = out + i * nchan;
+			for (unsigned int s = 0; s < vchan; s += 4) {
+				float32x4_t v = vmulq_f32(x, vaddq_f32(vld1q_f32(gain + s), vmulq_f32(vld1q_f32(inc + s), vfi)));
+				v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), vld1q_u32(mask + s)));
+				vst1q_f32(o + s, vaddq_f32(vld1q_f32(o + s), v));
+			}
+			accumulateFrameScalar(o, in[i], fi, vchan, nchan, gain, inc, mask);
+		}
+	}
+
+	for (; i < nsamp; ++i)
+		accumulateFrameScalar(out + i * nchan, in[i], static_cast<float>(i), 0, nchan, gain, inc, mask);
+}
+
+/// qBound(lo, v, hi), spelled out with compares because vminq/vmaxq
+/// propagate NaN where qMin/qMax do not.
+static inline float32x4_t boundNEON(float32x4_t lo, float32x4_t v, float32x4_t hi) {
+	const float32x4_t t = vbslq_f32(vcltq_f32(hi, v), hi, v);
+	return vbslq_f32(vcltq_f32(lo, t), t, lo);
+}
+
+static void clipNEON(float *buf, unsigned int count) {
+	const float32x4_t lo = vdupq_n_f32(-1.0f);
+	const float32x4_t hi = vdupq_n_f32(1.0f);
+	unsigned int i = 0;
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(buf + i, boundNEON(lo, vld1q_f32(buf + i), hi));
+	clipScalar(buf + i, count - i);
+}
+
+static void toShortNEON(const float * RESTRICT in, short * RESTRICT out, unsigned int count) {
+	const float32x4_t scale = vdupq_n_f32(32768.f);
+	const float32x4_t lo = vdupq_n_f32(-32768.f);
+	const float32x4_t hi = vdupq_n_f32(32767.f);
+	unsigned int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const int32x4_t a = vcvtq_s32_f32(boundNEON(lo, vmulq_f32(vld1q_f32(in + i), scale), hi));
+		const int32x4_t b = vcvtq_s32_f32(boundNEON(lo, vmulq_f32(vld1q_f32(in + i + 4), scale), hi));
+		vst1q_s16(out + i, vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+	}
+	toShortScalar(in + i, out + i, count - i);
+}
+#endif
+
+static const AudioMixKernels kScalar = { "scalar", accumulateScalar, clipScalar, toShortScalar };
+#ifdef MIX_X86
+static const AudioMixKernels kSSE2 = { "sse2", accumulateSSE2, clipSSE2, toShortSSE2 };
+static const AudioMixKernels kAVX2 = { "avx2", accumulateAVX2, clipAVX2, toShortAVX2 };
+#endif
+#ifdef MIX_NEON
+static const AudioMixKernels kNEON = { "neon", accumulateNEON, clipNEON, toShortNEON };
+#endif
+
+bool AudioMixKernels::cpuHasSSE2() {
+#if !defined(MIX_X86)
+	return false;
+#elif defined(__x86_64__) || defined(_M_X64)
+	return true;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[3] & (1 << 26)) != 0;
+#else
+	return __builtin_cpu_supports("sse2");
+#endif
+}
+
+bool AudioMixKernels::cpuHasAVX2() {
+#if !defined(MIX_X86)
+	return false;
+#elif defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	// AVX and OSXSAVE, and the OS must save the YMM registers.
+	if ((info[2] & ((1 << 27) | (1 << 28))) != ((1 << 27) | (1 << 28)))
+		return false;
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+const AudioMixKernels &AudioMixKernels::scalar() {
+	return kScalar;
+}
+
+QList<const AudioMixKernels *> AudioMixKernels::available() {
+	QList<const AudioMixKernels *> ql;
+	ql << &kScalar;
+#ifdef MIX_X86
+	if (cpuHasSSE2()) {
+		ql << &kSSE2;
+		if (cpuHasAVX2())
+			ql << &kAVX2;
+	}
+#endif
+#ifdef MIX_NEON
+	ql << &kNEON;
+#endif
+	return ql;
+}
+
+const AudioMixKernels &AudioMixKernels::best() {
+	static const AudioMixKernels *k = available().last();
+	return *k;
+}
@@ -0,0 +1,47 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_AUDIOMIXKERNELS_H_
+#define MUMBLE_MUMBLE_AUDIOMIXKERNELS_H_
+
+#include <QtCore/QList>
+#include <QtCore/QtGlobal>
+
+/// AudioMixKernels holds the inner loops of AudioOutput::mix(): mixing a
+/// mono speaker into the interleaved output, clipping, and converting to
+/// 16 bit. Every implementation produces results that are bit-for-bit
+/// identical to the portable scalar one; they only differ in speed.
+///
+/// The best implementation for the running CPU is picked once, at first
+/// use. SSE2 and AVX2 are used on x86, Advanced SIMD on AArch64.
+struct AudioMixKernels {
+	/// For every channel s with mask[s] set, and every sample i:
+	///   out[i * nchan + s] += in[i] * (gain[s] + inc[s] * i)
+	/// mask[s] must be either 0 or 0xffffffff.
+	typedef void (*accumulateFunc)(float * RESTRICT out, const float * RESTRICT in, unsigned int nsamp, unsigned int nchan, const float *gain, const float *inc, const quint32 *mask);
+	/// Clamps every sample to [-1, 1], exactly like qBound().
+	typedef void (*clipFunc)(float *buf, unsigned int count);
+	/// Converts to 16 bit as static_cast<short>(qBound(-32768.f, x * 32768.f, 32767.f)).
+	typedef void (*toShortFunc)(const float * RESTRICT in, short * RESTRICT out, unsigned int count);
+
+	const char *name;
+	accumulateFunc accumulate;
+	clipFunc clip;
+	toShortFunc toShort;
+
+	/// The portable reference implementation.
+	static const AudioMixKernels &scalar();
+	/// The fastest implementation supported by this CPU.
+	static const AudioMixKernels &best();
+	/// All implementations supported by this CPU, slowest first.
+	static QList<const AudioMixKernels *> available();
+
+	/// Runtime CPU feature checks, also used by AudioInputKernels.
+	/// Always false on other architectures.
+	static bool cpuHasSSE2();
+	static bool cpuHasAVX2();
+};
+
+#endif
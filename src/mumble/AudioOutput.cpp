@@ -13,9 +13,12 @@
 
 #include "AudioOutput.h"
 
+#include "AudioDecodePool.h"
 #include "AudioInput.h"
+#include "AudioMixKernels.h"
 #include "AudioOutputSample.h"
 #include "AudioOutputSpeech.h"
+#include "LatencyProbe.h"
 #include "User.h"
 #include "Message.h"
 #include "Plugins.h"
@@ -28,6 +31,10 @@
 // We define a global macro called 'g'. This can lead to issues when included code uses 'g' as a type or parameter name (like protobuf 3.7 does). As such, for now, we have to make this our last include.
 #include "Global.h"
 
+/// Speakers mixed quieter than this on every channel, -80 dB, are not
+/// decoded at all.
+#define INAUDIBLE_GAIN 0.0001f
+
 // Remember that we cannot use static member classes that are not pointers, as the constructor
 // for AudioOutputRegistrar() might be called before they are initialized, as the constructor
 // is called from global initialization.
@@ -89,6 +96,13 @@ AudioOutput::AudioOutput()
     , fSpeakerVolume(NULL)
     , bSpeakerPositional(NULL)
     
+    , uiMix(0)
+    , iLive(0)
+    , aiMixEpoch(0)
+    , adpDecode(new AudioDecodePool())
+    , uiDecodeAhead(0)
+    , uiDecodeCalm(0)
+    
     , eSampleFormat(SampleFloat)
     
     , bRunning(true)
@@ -99,7 +113,8 @@ AudioOutput::AudioOutput()
     , iSampleSize(0)
     
     , qrwlOutputs()
-    , qmOutputs() {
+    , qmOutputs()
+    , astTimer(NULL) {
 	
 	// Nothing
 }
@@ -109,6 +124,14 @@ AudioOutput::~AudioOutput() {
 	wait();
 	wipe();
 
+	// Nothing mixes anymore, so act as the mixer one last time to hand
+	// every buffer back for deletion.
+	processCommands();
+	reapBuffers();
+
+	// Deleting the speech buffers waited for their decode jobs.
+	delete adpDecode;
+
 	delete [] fSpeakers;
 	delete [] fSpeakerVolume;
 	delete [] bSpeakerPositional;
@@ -151,8 +174,16 @@ float AudioOutput::calcGain(float dotproduct, float distance) {
 }
 
 void AudioOutput::wipe() {
-	foreach(AudioOutputUser *aop, qmOutputs)
-		removeBuffer(aop);
+	QList<AudioOutputUser *> qlOutputs;
+	{
+		QReadLocker locker(&qrwlOutputs);
+		qlOutputs = qmOutputs.values();
+	}
+
+	foreach(AudioOutputUser *aop, qlOutputs)
+		detachBuffer(aop);
+	waitForMixer();
+	reapBuffers();
 }
 
 const float *AudioOutput::getSpeakerPos(unsigned int &speakers) {
@@ -164,53 +195,83 @@ const float *AudioOutput::getSpeakerPos(unsigned int &speakers) {
 }
 
 void AudioOutput::addFrameToBuffer(ClientUser *user, const QByteArray &qbaPacket, unsigned int iSeq, MessageHandler::UDPMessageType type) {
+	if (qbaPacket.isEmpty())
+		addFrameToBuffer(user, 0, NULL, 0, iSeq, type);
+	else
+		addFrameToBuffer(user, static_cast<unsigned char>(qbaPacket.at(0)), qbaPacket.constData() + 1, static_cast<unsigned int>(qbaPacket.size() - 1), iSeq, type);
+}
+
+void AudioOutput::addFrameToBuffer(ClientUser *user, unsigned int msgFlags, const char *data, unsigned int len, unsigned int iSeq, MessageHandler::UDPMessageType type) {
 	if (iChannels == 0)
 		return;
-	qrwlOutputs.lockForRead();
-	AudioOutputSpeech *aop = qobject_cast<AudioOutputSpeech *>(qmOutputs.value(user));
 
 	if (!UDPMessageTypeIsValidVoicePacket(type)) {
 		qWarning("AudioOutput: ignored frame with invalid message type 0x%x in addFrameToBuffer().", static_cast<unsigned char>(type));
 		return;
 	}
 
-	if (! aop || (aop->umtType != type)) {
-		qrwlOutputs.unlock();
+	reapBuffers();
 
-		if (aop)
-			removeBuffer(aop);
+	if (LatencyProbe::lpProbe.isActive())
+		LatencyProbe::lpProbe.received(user, iSeq);
 
-		while ((iMixerFreq == 0) && isAlive()) {
-			QThread::yieldCurrentThread();
+	ServerHandlerPtr sh = g.sh;
+	if (sh) {
+		VoiceRecorderPtr recorder(sh->recorder);
+		if (recorder && recorder->isInPassthroughMode()) {
+			recorder->addPacket(user, data, len, iSeq, type);
+
+			// Our own voice is only recorded, there is no need to decode it.
+			if (qobject_cast<RecordUser *>(user))
+				return;
 		}
+	}
 
-		if (! iMixerFreq)
+	AudioOutputSpeech *aop;
+	{
+		QReadLocker locker(&qrwlOutputs);
+		aop = qobject_cast<AudioOutputSpeech *>(qmOutputs.value(user));
+		if (aop && (aop->umtType == type)) {
+			aop->addFrameToBuffer(msgFlags, data, len, iSeq);
 			return;
+		}
+	}
+
+	if (aop)
+		detachBuffer(aop);
 
-		qrwlOutputs.lockForWrite();
-		aop = new AudioOutputSpeech(user, iMixerFreq, type);
-		qmOutputs.replace(user, aop);
+	while ((iMixerFreq == 0) && isAlive()) {
+		QThread::yieldCurrentThread();
 	}
 
-	aop->addFrameToBuffer(qbaPacket, iSeq);
+	if (! iMixerFreq)
+		return;
+
+	if (! reserveBuffer())
+		return;
 
-	qrwlOutputs.unlock();
+	aop = new AudioOutputSpeech(user, iMixerFreq, type);
+	aop->addFrameToBuffer(msgFlags, data, len, iSeq);
+	publishBuffer(user, aop);
 }
 
 void AudioOutput::removeBuffer(const ClientUser *user) {
-	removeBuffer(qmOutputs.value(user));
+	AudioOutputUser *aop;
+	{
+		QReadLocker locker(&qrwlOutputs);
+		aop = qmOutputs.value(user);
+	}
+	if (aop)
+		removeBuffer(aop);
 }
 
+/// Stops mixing aop. When this returns, neither the mixer nor a decode
+/// worker references aop or the user it belongs to any more; aop itself
+/// is deleted later.
 void AudioOutput::removeBuffer(AudioOutputUser *aop) {
-	QWriteLocker locker(&qrwlOutputs);
-	QMultiHash<const ClientUser *, AudioOutputUser *>::iterator i;
-	for (i=qmOutputs.begin(); i != qmOutputs.end(); ++i) {
-		if (i.value() == aop) {
-			qmOutputs.erase(i);
-			delete aop;
-			break;
-		}
-	}
+	if (detachBuffer(aop))
+		waitForMixer();
+	reapBuffers();
 }
 
 AudioOutputSample *AudioOutput::playSample(const QString &filename, bool loop) {
@@ -234,14 +295,148 @@ AudioOutputSample *AudioOutput::playSample(const QString &filename, bool loop) {
 	if (! iMixerFreq)
 		return NULL;
 
-	QWriteLocker locker(&qrwlOutputs);
+	reapBuffers();
+	if (! reserveBuffer()) {
+		delete handle;
+		return NULL;
+	}
+
 	AudioOutputSample *aos = new AudioOutputSample(filename, handle, loop, iMixerFreq);
-	qmOutputs.insert(NULL, aos);
+	publishBuffer(NULL, aos);
 
 	return aos;
 
 }
 
+/// Accounts for a new buffer. Returns false if MaxOutputs buffers exist
+/// already.
+bool AudioOutput::reserveBuffer() {
+	QMutexLocker lock(&qmControl);
+
+	if (iLive >= MaxOutputs) {
+		qWarning("AudioOutput: Too many simultaneous outputs, dropping one");
+		return false;
+	}
+	++iLive;
+	return true;
+}
+
+/// Registers a buffer created after reserveBuffer() and queues it for
+/// the mixer.
+void AudioOutput::publishBuffer(const ClientUser *user, AudioOutputUser *aop) {
+	QWriteLocker locker(&qrwlOutputs);
+	qmOutputs.insert(user, aop);
+
+	// Queued under qrwlOutputs, so that a removal can never overtake
+	// the addition.
+	QMutexLocker lock(&qmControl);
+	Command cmd;
+	cmd.eType = Command::Add;
+	cmd.aop = aop;
+	bool ok = srControl.push(cmd);
+	Q_ASSERT(ok);
+	Q_UNUSED(ok);
+}
+
+/// Unregisters aop, tells the mixer to stop using it and waits for any
+/// decode of it to finish. Returns false if aop was not registered.
+bool AudioOutput::detachBuffer(AudioOutputUser *aop) {
+	QWriteLocker locker(&qrwlOutputs);
+
+	QMultiHash<const ClientUser *, AudioOutputUser *>::iterator i;
+	for (i=qmOutputs.begin(); i != qmOutputs.end(); ++i) {
+		if (i.value() == aop) {
+			qmOutputs.erase(i);
+
+			{
+				QMutexLocker lock(&qmControl);
+				Command cmd;
+				cmd.eType = Command::Remove;
+				cmd.aop = aop;
+				bool ok = srControl.push(cmd);
+				Q_ASSERT(ok);
+				Q_UNUSED(ok);
+			}
+
+			// Decode workers touch the user, so they must be done with
+			// it before it can be deleted. The write lock keeps the
+			// buffer from being reaped meanwhile.
+			AudioOutputSpeech *speech = qobject_cast<AudioOutputSpeech *>(aop);
+			if (speech)
+				speech->stopDecoding();
+			return true;
+		}
+	}
+	return false;
+}
+
+/// Deletes the buffers the mixer has handed back.
+void AudioOutput::reapBuffers() {
+	AudioOutputUser *retired[MaxOutputs];
+	int count = 0;
+
+	{
+		QMutexLocker lock(&qmControl);
+		while (AudioOutputUser **aop = srRetired.front()) {
+			retired[count++] = *aop;
+			srRetired.pop();
+		}
+	}
+
+	if (count == 0)
+		return;
+
+	{
+		// Buffers the mixer retired on its own, because they ran dry,
+		// are still registered.
+		QWriteLocker locker(&qrwlOutputs);
+		for (int j = 0; j < count; ++j) {
+			QMultiHash<const ClientUser *, AudioOutputUser *>::iterator i;
+			for (i=qmOutputs.begin(); i != qmOutputs.end(); ++i) {
+				if (i.value() == retired[j]) {
+					qmOutputs.erase(i);
+					break;
+				}
+			}
+		}
+	}
+
+	for (int j = 0; j < count; ++j)
+		delete retired[j];
+
+	QMutexLocker lock(&qmControl);
+	iLive -= count;
+}
+
+/// Waits for a mix() that might have started before the last command was
+/// queued. Any later mix() processes the command before touching a buffer.
+void AudioOutput::waitForMixer() {
+	const int epoch = aiMixEpoch.fetchAndAddOrdered(0);
+	if (! (epoch & 1))
+		return;
+	while (aiMixEpoch.fetchAndAddOrdered(0) == epoch)
+		QThread::yieldCurrentThread();
+}
+
+/// Applies queued additions and removals to the mix list. Mixer only.
+void AudioOutput::processCommands() {
+	while (Command *cmd = srControl.front()) {
+		if (cmd->eType == Command::Add) {
+			aopMix[uiMix++] = cmd->aop;
+		} else {
+			// The buffer may have been retired by the mixer already.
+			for (unsigned int i = 0; i < uiMix; ++i) {
+				if (aopMix[i] == cmd->aop) {
+					aopMix[i] = aopMix[--uiMix];
+					srRetired.push(cmd->aop);
+					break;
+				}
+			}
+		}
+		srControl.pop();
+	}
+}
+
 void AudioOutput::initializeMixer(const unsigned int *chanmasks, bool forceheadphone) {
 	delete[] fSpeakers;
 	delete[] bSpeakerPositional;
@@ -360,9 +555,22 @@ void AudioOutput::initializeMixer(const unsigned int *chanmasks, bool forceheadp
 }
 
 bool AudioOutput::mix(void *outbuff, unsigned int nsamp) {
-	QList<AudioOutputUser *> qlMix;
-	QList<AudioOutputUser *> qlDel;
-	
+	aiMixEpoch.fetchAndAddOrdered(1);
+	if (astTimer)
+		astTimer->start();
+	const bool mixed = mixOutputs(outbuff, nsamp);
+	if (astTimer)
+		astTimer->lap(AudioStageTimer::Mix);
+	aiMixEpoch.fetchAndAddOrdered(1);
+	return mixed;
+}
+
+/// Mixes all active buffers into outbuff. Runs on the audio thread and
+/// neither takes locks nor waits for the threads feeding it. Speech that
+/// is decoded ahead is only picked up here; see scheduleDecode().
+bool AudioOutput::mixOutputs(void *outbuff, unsigned int nsamp) {
+	processCommands();
+
 	if (g.s.fVolume < 0.01f) {
 		return false;
 	}
@@ -374,35 +582,57 @@ bool AudioOutput::mix(void *outbuff, unsigned int nsamp) {
 	VoiceRecorderPtr recorder;
 	if (sh) {
 		recorder = g.sh->recorder;
+		// A passthrough recorder takes the packets, not the decoded audio.
+		if (recorder && recorder->isInPassthroughMode())
+			recorder.reset();
 	}
 
-	qrwlOutputs.lockForRead();
-	
 	bool prioritySpeakerActive = false;
-	
-	QMultiHash<const ClientUser *, AudioOutputUser *>::const_iterator it = qmOutputs.constBegin();
-	while (it != qmOutputs.constEnd()) {
-		AudioOutputUser *aop = it.value();
-		if (! aop->prepareSampleBuffer(nsamp)) {
-			qlDel.append(aop);
+	unsigned int decodeTime = 0;
+	bool underrun = false;
+
+	// Buffers that ran dry are handed back for deletion right away;
+	// the rest stay in aopMix in their original order.
+	unsigned int nmix = 0;
+	for (unsigned int i = 0; i < uiMix; ++i) {
+		AudioOutputUser *aop = aopMix[i];
+		AudioOutputSpeech *speech = qobject_cast<AudioOutputSpeech *>(aop);
+		const bool alive = aop->prepareSampleBuffer(nsamp);
+		if (speech) {
+			decodeTime += speech->takeDecodeTime();
+			underrun = underrun || speech->bUnderrun;
+			if (alive && LatencyProbe::lpProbe.isActive())
+				LatencyProbe::lpProbe.mixed(speech->p, speech->pfBuffer, nsamp);
+		}
+		if (! alive) {
+			srRetired.push(aop);
 		} else {
-			qlMix.append(aop);
-			
-			const ClientUser *user = it.key();
-			if (user && user->bPrioritySpeaker) {
+			aopMix[nmix++] = aop;
+
+			if (speech && speech->p && speech->p->bPrioritySpeaker) {
 				prioritySpeakerActive = true;
 			}
 		}
-		++it;
 	}
+	uiMix = nmix;
+
+	if (astTimer)
+		astTimer->lap(AudioStageTimer::Decode);
+	else
+		scheduleDecode(nsamp, decodeTime, underrun);
 
 	if (g.prioritySpeakerActiveOverride) {
 		prioritySpeakerActive = true;
 	}
 
-	if (! qlMix.isEmpty()) {
+	if (nmix > 0) {
 		STACKVAR(float, speaker, iChannels*3);
 		STACKVAR(float, svol, iChannels);
+		// Per-channel gain ramp for the speaker currently being mixed.
+		STACKVAR(float, gain, iChannels);
+		STACKVAR(float, inc, iChannels);
+		STACKVAR(quint32, mask, iChannels);
+		const AudioMixKernels &kernels = AudioMixKernels::best();
 
 		STACKVAR(float, fOutput, iChannels * nsamp);
 		float *output = (eSampleFormat == SampleFloat) ? reinterpret_cast<float *>(outbuff) : fOutput;
@@ -420,10 +650,11 @@ bool AudioOutput::mix(void *outbuff, unsigned int nsamp) {
 		for (unsigned int i=0;i<iChannels;++i)
 			svol[i] = mul * fSpeakerVolume[i];
 
-		if (g.s.bPositionalAudio && (iChannels > 1) && g.p->fetch() && (g.bPosTest || g.p->fCameraPosition[0] != 0 || g.p->fCameraPosition[1] != 0 || g.p->fCameraPosition[2] != 0)) {
+		PositionalSample pos;
+		if (g.s.bPositionalAudio && (iChannels > 1) && g.p->position(pos) && (g.bPosTest || pos.fCameraPosition[0] != 0 || pos.fCameraPosition[1] != 0 || pos.fCameraPosition[2] != 0)) {
 
-			float front[3] = { g.p->fCameraFront[0], g.p->fCameraFront[1], g.p->fCameraFront[2] };
-			float top[3] = { g.p->fCameraTop[0], g.p->fCameraTop[1], g.p->fCameraTop[2] };
+			float front[3] = { pos.fCameraFront[0], pos.fCameraFront[1], pos.fCameraFront[2] };
+			float top[3] = { pos.fCameraTop[0], pos.fCameraTop[1], pos.fCameraTop[2] };
 
 			// Front vector is dominant; if it's zero we presume all is zero.
 
@@ -485,7 +716,8 @@ bool AudioOutput::mix(void *outbuff, unsigned int nsamp) {
 			validListener = true;
 		}
 
-		foreach(AudioOutputUser *aop, qlMix) {
+		for (unsigned int m = 0; m < nmix; ++m) {
+			AudioOutputUser *aop = aopMix[m];
 			const float * RESTRICT pfBuffer = aop->pfBuffer;
 			float volumeAdjustment = 1;
 
@@ -525,7 +757,7 @@ bool AudioOutput::mix(void *outbuff, unsigned int nsamp) {
 			}
 
 			if (validListener && ((aop->fPos[0] != 0.0f) || (aop->fPos[1] != 0.0f) || (aop->fPos[2] != 0.0f))) {
-				float dir[3] = { aop->fPos[0] - g.p->fCameraPosition[0], aop->fPos[1] - g.p->fCameraPosition[1], aop->fPos[2] - g.p->fCameraPosition[2] };
+				float dir[3] = { aop->fPos[0] - pos.fCameraPosition[0], aop->fPos[1] - pos.fCameraPosition[1], aop->fPos[2] - pos.fCameraPosition[2] };
 				float len = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
 				if (len > 0.0f) {
 					dir[0] /= len;
@@ -544,25 +776,36 @@ bool AudioOutput::mix(void *outbuff, unsigned int nsamp) {
 				for (unsigned int s=0;s<nchan;++s) {
 					const float dot = bSpeakerPositional[s] ? dir[0] * speaker[s*3+0] + dir[1] * speaker[s*3+1] + dir[2] * speaker[s*3+2] : 1.0f;
 					const float str = svol[s] * calcGain(dot, len) * volumeAdjustment;
-					float * RESTRICT o = output + s;
 					const float old = (aop->pfVolume[s] >= 0.0f) ? aop->pfVolume[s] : str;
-					const float inc = (str - old) / static_cast<float>(nsamp);
+					gain[s] = old;
+					inc[s] = (str - old) / static_cast<float>(nsamp);
+					mask[s] = ((old >= 0.00000001f) || (str >= 0.00000001f)) ? 0xffffffffU : 0U;
 					aop->pfVolume[s] = str;
 					/*
 										qWarning("%d: Pos %f %f %f : Dot %f Len %f Str %f", s, speaker[s*3+0], speaker[s*3+1], speaker[s*3+2], dot, len, str);
 					*/
-					if ((old >= 0.00000001f) || (str >= 0.00000001f))
-						for (unsigned int i=0;i<nsamp;++i)
-							o[i*nchan] += pfBuffer[i] * (old + inc*static_cast<float>(i));
 				}
 			} else {
 				for (unsigned int s=0;s<nchan;++s) {
-					const float str = svol[s] * volumeAdjustment;
-					float * RESTRICT o = output + s;
-					for (unsigned int i=0;i<nsamp;++i)
-						o[i*nchan] += pfBuffer[i] * str;
+					gain[s] = svol[s] * volumeAdjustment;
+					inc[s] = 0.0f;
+					mask[s] = 0xffffffffU;
 				}
 			}
+
+			float loudest = 0.0f;
+			for (unsigned int s=0;s<nchan;++s) {
+				if (mask[s])
+					loudest = qMax(loudest, qMax(gain[s], gain[s] + inc[s] * static_cast<float>(nsamp)));
+			}
+			// Muted, drowned out by a priority speaker or too far away. The
+			// recorder still wants the audio, so keep decoding for it.
+			if (speech)
+				speech->setInaudible(! recorder && (loudest < INAUDIBLE_GAIN));
+			if (loudest < INAUDIBLE_GAIN)
+				continue;
+
+			kernels.accumulate(output, pfBuffer, nsamp, nchan, gain, inc, mask);
 		}
 
 		if (recorder && recorder->isInMixDownMode()) {
@@ -571,19 +814,53 @@ bool AudioOutput::mix(void *outbuff, unsigned int nsamp) {
 
 		// Clip
 		if (eSampleFormat == SampleFloat)
-			for (unsigned int i=0;i<nsamp*iChannels;i++)
-				output[i] = qBound(-1.0f, output[i], 1.0f);
+			kernels.clip(output, nsamp * iChannels);
 		else
-			for (unsigned int i=0;i<nsamp*iChannels;i++)
-				reinterpret_cast<short *>(outbuff)[i] = static_cast<short>(qBound(-32768.f, (output[i] * 32768.f), 32767.f));
+			kernels.toShort(output, reinterpret_cast<short *>(outbuff), nsamp * iChannels);
 	}
 
-	qrwlOutputs.unlock();
+	return (nmix > 0);
+}
 
-	foreach(AudioOutputUser *aop, qlDel)
-		removeBuffer(aop);
-	
-	return (! qlMix.isEmpty());
+/// Adapts the decode lookahead to the decoding load and queues every
+/// speaker that is not far enough ahead on the decode pool. Mixer only.
+///
+/// Lookahead starts when decoding takes more than a quarter of the time
+/// one mix covers, grows by a frame whenever a worker fell behind, and
+/// shrinks again after about two seconds of light load.
+void AudioOutput::scheduleDecode(unsigned int nsamp, unsigned int decodeTime, bool underrun) {
+	const unsigned int period = static_cast<unsigned int>((static_cast<quint64>(nsamp) * 1000000ULL) / iMixerFreq);
+
+	if (underrun && (uiDecodeAhead > 0)) {
+		uiDecodeAhead = qMin(uiDecodeAhead + 1, static_cast<unsigned int>(MaxDecodeAhead));
+		uiDecodeCalm = 0;
+	} else if ((uiDecodeAhead == 0) && (decodeTime * 4 > period)) {
+		uiDecodeAhead = 1;
+		uiDecodeCalm = 0;
+	} else if (decodeTime * 8 < period) {
+		if ((uiDecodeAhead > 0) && (++uiDecodeCalm >= 200)) {
+			--uiDecodeAhead;
+			uiDecodeCalm = 0;
+		}
+	} else {
+		uiDecodeCalm = 0;
+	}
+
+	if (uiDecodeAhead == 0)
+		return;
+
+	// The samples being mixed now are still queued, so ask for enough
+	// to cover them, the next mix and the lookahead.
+	const unsigned int target = nsamp * (uiDecodeAhead + 2);
+	adpDecode->setPeriod(period);
+	for (unsigned int i = 0; i < uiMix; ++i) {
+		AudioOutputSpeech *speech = qobject_cast<AudioOutputSpeech *>(aopMix[i]);
+		// Skipping an inaudible speaker is cheap enough to leave inline.
+		if (! speech || speech->isInaudible() || (speech->decodedSamples() >= target) || ! speech->claimDecode())
+			continue;
+		if (! adpDecode->enqueue(speech, target))
+			speech->releaseDecode();
+	}
 }
 
 bool AudioOutput::isAlive() const {
@@ -7,6 +7,8 @@
 #define MUMBLE_MUMBLE_AUDIOOUTPUT_H_
 
 #include <boost/shared_ptr.hpp>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
 #include <QtCore/QObject>
 #include <QtCore/QThread>
 
@@ -38,8 +40,11 @@
 #endif
 
 #include "Audio.h"
+#include "AudioBenchmark.h"
 #include "Message.h"
+#include "SPSCRing.h"
 
+class AudioDecodePool;
 class AudioOutput;
 class ClientUser;
 class AudioOutputUser;
@@ -76,6 +81,51 @@ class AudioOutput : public QThread {
 		float *fSpeakers;
 		float *fSpeakerVolume;
 		bool *bSpeakerPositional;
+
+		/// Upper bound on the number of speech and sample buffers that may
+		/// exist at once. It bounds every queue below, so none of them can
+		/// ever overflow.
+		enum { MaxOutputs = 256 };
+
+		struct Command {
+			enum { Add, Remove } eType;
+			AudioOutputUser *aop;
+		};
+
+		/// The buffers being mixed. Owned by the thread calling mix().
+		AudioOutputUser *aopMix[MaxOutputs];
+		unsigned int uiMix;
+
+		/// Adds and removals of buffers, from any thread to the mixer.
+		/// Producers serialize on qmControl.
+		SPSCRing<Command, 2 * MaxOutputs> srControl;
+		/// Buffers the mixer no longer references, from the mixer back to
+		/// whoever deletes them next. Consumers serialize on qmControl.
+		SPSCRing<AudioOutputUser *, MaxOutputs> srRetired;
+		QMutex qmControl;
+		/// Number of buffers that have been created but not yet deleted.
+		/// Protected by qmControl.
+		int iLive;
+		/// Incremented when mix() is entered and when it returns, so it is
+		/// odd while a mix is running.
+		QAtomicInt aiMixEpoch;
+
+		/// Speech is decoded this many mixer frames ahead on adpDecode.
+		/// Zero while decoding inline is cheap, so no latency is added.
+		enum { MaxDecodeAhead = 3 };
+		AudioDecodePool *adpDecode;
+		unsigned int uiDecodeAhead;
+		/// Consecutive mixes with little decoding work.
+		unsigned int uiDecodeCalm;
+
+		bool reserveBuffer();
+		void publishBuffer(const ClientUser *, AudioOutputUser *);
+		bool detachBuffer(AudioOutputUser *);
+		void reapBuffers();
+		void waitForMixer();
+		void processCommands();
+		bool mixOutputs(void *output, unsigned int nsamp);
+		void scheduleDecode(unsigned int nsamp, unsigned int decodeTime, bool underrun);
 	protected:
 		enum { SampleShort, SampleFloat } eSampleFormat;
 		volatile bool bRunning;
@@ -83,8 +133,14 @@ class AudioOutput : public QThread {
 		volatile unsigned int iMixerFreq;
 		unsigned int iChannels;
 		unsigned int iSampleSize;
+		/// Maps users to their buffers for the threads feeding audio in.
+		/// The mixer never reads it; see aopMix.
 		QReadWriteLock qrwlOutputs;
 		QMultiHash<const ClientUser *, AudioOutputUser *> qmOutputs;
+		/// Collects decode and mix time when set. NULL unless AudioBenchmark
+		/// drives this output. While it is set, speech is always decoded
+		/// inline on the mixing thread so that all of it is measured.
+		AudioStageTimer *astTimer;
 
 		virtual void removeBuffer(AudioOutputUser *);
 		void initializeMixer(const unsigned int *chanmasks, bool forceheadphone = false);
@@ -105,6 +161,7 @@ class AudioOutput : public QThread {
 		~AudioOutput() Q_DECL_OVERRIDE;
 
 		void addFrameToBuffer(ClientUser *, const QByteArray &, unsigned int iSeq, MessageHandler::UDPMessageType type);
+		void addFrameToBuffer(ClientUser *, unsigned int msgFlags, const char *data, unsigned int len, unsigned int iSeq, MessageHandler::UDPMessageType type);
 		void removeBuffer(const ClientUser *);
 		AudioOutputSample *playSample(const QString &filename, bool loop = false);
 		void run() Q_DECL_OVERRIDE = 0;
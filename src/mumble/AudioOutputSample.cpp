@@ -148,7 +148,6 @@ AudioOutputSample::AudioOutputSample(const QString &name, SoundFile *psndfile, b
 		srs = NULL;
 	}
 
-	iLastConsume = iBufferFilled = 0;
 	bLoop = loop;
 	bEof = false;
 }
@@ -203,15 +202,19 @@ QString AudioOutputSample::browseForSndfile(QString defaultpath) {
 }
 
 bool AudioOutputSample::prepareSampleBuffer(unsigned int snum) {
-	// Forward the buffer
-	for (unsigned int i=iLastConsume;i<iBufferFilled;++i)
-		pfBuffer[i-iLastConsume]=pfBuffer[i];
-	iBufferFilled -= iLastConsume;
-	iLastConsume = snum;
+	// Both sides of the ring are on the mixer thread, so it can simply be
+	// sized for the first request. It only ever grows if the device asks
+	// for larger blocks later on, which drops what is still queued.
+	if (! srBuffer || (snum > srBuffer->maxView()))
+		initBuffer(2 * snum, snum);
+	else
+		releaseBuffer();
 
 	// Check if we can satisfy request with current buffer
-	if (iBufferFilled >= snum)
+	if (srBuffer->available() >= snum) {
+		viewBuffer(snum);
 		return true;
+	}
 
 	// Calculate the required buffersize to hold the results
 	unsigned int iInputFrames = static_cast<unsigned int>(ceilf(static_cast<float>(snum * sfHandle->samplerate()) / static_cast<float>(iOutSampleRate)));
@@ -224,10 +227,11 @@ bool AudioOutputSample::prepareSampleBuffer(unsigned int snum) {
 	bool eof = false;
 	sf_count_t read;
 	do {
-		resizeBuffer(iBufferFilled + snum);
+		// Less than snum samples are queued, so there is room for snum.
+		float *pBuffer = srBuffer->writeView(snum);
 
 		// If we need to resample or mix write to the buffer on stack
-		float *pOut = (srs || mix) ? fOut : pfBuffer + iBufferFilled;
+		float *pOut = (srs || mix) ? fOut : pBuffer;
 
 		// Try to read all samples needed to satifsy this request
 		if ((read = sfHandle->read(pOut, iInputSamples)) < iInputSamples) {
@@ -244,7 +248,7 @@ bool AudioOutputSample::prepareSampleBuffer(unsigned int snum) {
 		if (mix) { // Mix the channels (only two channels)
 			read /= 2;
 			// If we need to resample after this write to extra buffer
-			pOut = srs ? fMix : pfBuffer + iBufferFilled;
+			pOut = srs ? fMix : pBuffer;
 			for (unsigned int i = 0; i < read; i++)
 				pOut[i] = (fOut[i*2] + fOut[i*2 + 1]) * 0.5f;
 
@@ -253,10 +257,12 @@ bool AudioOutputSample::prepareSampleBuffer(unsigned int snum) {
 		spx_uint32_t inlen = static_cast<unsigned int>(read);
 		spx_uint32_t outlen = snum;
 		if (srs) // If necessary resample
-			speex_resampler_process_float(srs, 0, pOut, &inlen, pfBuffer + iBufferFilled, &outlen);
+			speex_resampler_process_float(srs, 0, pOut, &inlen, pBuffer, &outlen);
+
+		srBuffer->commitWrite(outlen);
+	} while (srBuffer->available() < snum);
 
-		iBufferFilled += outlen;
-	} while (iBufferFilled < snum);
+	viewBuffer(snum);
 
 	if (eof && !bEof) {
 		emit playbackFinished();
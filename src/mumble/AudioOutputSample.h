@@ -45,8 +45,6 @@ class AudioOutputSample : public AudioOutputUser {
 		Q_OBJECT
 		Q_DISABLE_COPY(AudioOutputSample)
 	protected:
-		unsigned int iLastConsume;
-		unsigned int iBufferFilled;
 		unsigned int iOutSampleRate;
 		SpeexResamplerState *srs;
 
@@ -15,6 +15,7 @@
 
 #include "AudioOutputSpeech.h"
 
+#include "AdaptiveJitterBuffer.h"
 #include "Audio.h"
 #include "CELTCodec.h"
 #ifdef USE_OPUS
@@ -22,11 +23,12 @@
 #endif
 #include "ClientUser.h"
 #include "Global.h"
+#include "LatencyProbe.h"
 #include "PacketDataStream.h"
+#include "Resampler.h"
 #include "Utils.h"
 
 AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, MessageHandler::UDPMessageType type) : AudioOutputUser(user->qsName) {
-	int err;
 	p = user;
 	umtType = type;
 	iMixerFreq = freq;
@@ -63,30 +65,39 @@ AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, Messag
 		iAudioBufferSize = iFrameSize;
 	}
 
-	iOutputSize = static_cast<unsigned int>(ceilf(static_cast<float>(iAudioBufferSize * iMixerFreq) / static_cast<float>(iSampleRate)));
+	// Time-stretching is done in place on the decoded frame.
+	iStretchSize = bStereo ? 0 : AdaptiveJitterBuffer::maxStretch(iSampleRate);
+	iOutputSize = static_cast<unsigned int>(ceilf(static_cast<float>((iAudioBufferSize + iStretchSize) * iMixerFreq) / static_cast<float>(iSampleRate)));
 	if (bStereo) {
 		iAudioBufferSize *= 2;
 		iOutputSize *= 2;
 	}
 
-	srs = NULL;
+	rsResampler = NULL;
 	fResamplerBuffer = NULL;
 	if (iMixerFreq != iSampleRate) {
-		srs = speex_resampler_init(bStereo ? 2 : 1, iSampleRate, iMixerFreq, 3, &err);
-		fResamplerBuffer = new float[iAudioBufferSize];
+		// The decoded buffer is resampled as one channel, as it always was.
+		rsResampler = new Resampler(1, iSampleRate, iMixerFreq, g.s.iResampleQuality);
+		fResamplerBuffer = new float[iAudioBufferSize + iStretchSize];
 	}
 
-	iBufferOffset = iBufferFilled = iLastConsume = 0;
+	// Room for two of the largest frames on top of 100ms of lookahead
+	// and mixer requests. Frames are decoded straight into the ring, and
+	// the mixer reads up to 100ms from it in place.
+	initBuffer(2 * iOutputSize + iMixerFreq / 10, qMax(iOutputSize, iMixerFreq / 10));
 	bLastAlive = true;
+	bFadeIn = true;
+	bDropSilence = false;
+	aiSilenceEnd.fetchAndStoreRelaxed(-1);
+	bUnderrun = false;
+	fDecodedPos[0] = fDecodedPos[1] = fDecodedPos[2] = 0.0f;
 
 	iMissCount = 0;
 	iMissedFrames = 0;
 
 	ucFlags = 0xFF;
 
-	jbJitter = jitter_buffer_init(iFrameSize);
-	int margin = g.s.iJitterBufferSize * iFrameSize;
-	jitter_buffer_ctl(jbJitter, JITTER_BUFFER_SET_MARGIN, &margin);
+	ajbJitter = new AdaptiveJitterBuffer(iSampleRate, iFrameSize, g.s.iJitterPercentile, g.s.iJitterBufferSize * iFrameSize, p ? static_cast<unsigned int>(p->aiJitterSpread.fetchAndAddRelaxed(0)) : 0);
 
 	fFadeIn = new float[iFrameSize];
 	fFadeOut = new float[iFrameSize];
@@ -97,6 +108,10 @@ AudioOutputSpeech::AudioOutputSpeech(ClientUser *user, unsigned int freq, Messag
 }
 
 AudioOutputSpeech::~AudioOutputSpeech() {
+	// A decode job may still be queued or running.
+	while (! claimDecode() && (aiDecodeClaim.fetchAndAddAcquire(0) != DecodeStopped))
+		QThread::yieldCurrentThread();
+
 #ifdef USE_OPUS
 	if (opusState)
 		oCodec->opus_decoder_destroy(opusState);
@@ -108,23 +123,40 @@ AudioOutputSpeech::~AudioOutputSpeech() {
 		speex_decoder_destroy(dsSpeex);
 	}
 
-	if (srs)
-		speex_resampler_destroy(srs);
+	delete rsResampler;
 
-	jitter_buffer_destroy(jbJitter);
+	delete ajbJitter;
 
 	delete [] fFadeIn;
 	delete [] fFadeOut;
 	delete [] fResamplerBuffer;
 }
 
-void AudioOutputSpeech::addFrameToBuffer(const QByteArray &qbaPacket, unsigned int iSeq) {
-	QMutexLocker lock(&qmJitter);
-
-	if (qbaPacket.size() < 2)
-		return;
+/// Queues a voice packet for the decoder. msgFlags is the first byte
+/// of the UDP voice packet, data is the voice payload following the
+/// sequence number.
+///
+/// Must only be called from a single thread at a time. Returns false if
+/// the packet was dropped.
+bool AudioOutputSpeech::addFrameToBuffer(unsigned int msgFlags, const char *data, unsigned int len, unsigned int iSeq) {
+	if ((len == 0) || (len >= MaxPacketSize))
+		return false;
+
+	Packet *packet = srPackets.beginPush();
+	if (! packet)
+		return false;
+
+	packet->iSeq = iSeq;
+	packet->iLen = len + 1;
+	packet->cData[0] = static_cast<char>(msgFlags);
+	memcpy(packet->cData + 1, data, len);
+	srPackets.commitPush();
+
+	return true;
+}
 
-	PacketDataStream pds(qbaPacket);
+void AudioOutputSpeech::putFrame(const char *data, unsigned int len, unsigned int iSeq) {
+	PacketDataStream pds(data, len);
 
 	// skip flags
 	pds.next();
@@ -138,12 +170,12 @@ void AudioOutputSpeech::addFrameToBuffer(const QByteArray &qbaPacket, unsigned i
 			return;
 		}
 
-		const QByteArray &qba = pds.dataBlock(size);
-		if (size != qba.size() || !pds.isValid()) {
+		if (static_cast<unsigned int>(size) > pds.left() || !pds.isValid()) {
 			return;
 		}
 
-		const unsigned char *packet = reinterpret_cast<const unsigned char*>(qba.constData());
+		const unsigned char *packet = pds.dataPtr();
+		pds.skip(size);
 
 #ifdef USE_OPUS
 		if (oCodec) {
@@ -154,6 +186,10 @@ void AudioOutputSpeech::addFrameToBuffer(const QByteArray &qbaPacket, unsigned i
 		return;
 #endif
 
+		// A malformed packet gives a negative error code or no frames.
+		if (samples <= 0)
+			return;
+
 		// We can't handle frames which are not a multiple of 10ms.
 		Q_ASSERT(samples % iFrameSize == 0);
 	} else {
@@ -166,265 +202,374 @@ void AudioOutputSpeech::addFrameToBuffer(const QByteArray &qbaPacket, unsigned i
 		} while ((header & 0x80) && pds.isValid());
 	}
 
-	if (pds.isValid()) {
-		JitterBufferPacket jbp;
-		jbp.data = const_cast<char *>(qbaPacket.constData());
-		jbp.len = qbaPacket.size();
-		jbp.span = samples;
-		jbp.timestamp = iFrameSize * iSeq;
+	if (pds.isValid())
+		ajbJitter->put(QByteArray(data, static_cast<int>(len)), static_cast<qint64>(iSeq) * iFrameSize, static_cast<unsigned int>(samples));
+}
+
+/// Takes the decode claim. Whoever holds it is the only thread touching
+/// the jitter buffer, the decoder and the producer side of srBuffer.
+bool AudioOutputSpeech::claimDecode() {
+	return aiDecodeClaim.testAndSetAcquire(DecodeIdle, DecodeClaimed);
+}
+
+void AudioOutputSpeech::releaseDecode() {
+	aiDecodeClaim.fetchAndStoreRelease(DecodeIdle);
+}
 
-		jitter_buffer_put(jbJitter, &jbp);
+/// Waits for a running or queued decode to finish and keeps any other
+/// from starting, so that no thread touches p from decodeFrame() again.
+/// AudioOutput calls this before the user goes away.
+void AudioOutputSpeech::stopDecoding() {
+	while (! claimDecode()) {
+		if (aiDecodeClaim.fetchAndAddAcquire(0) == DecodeStopped)
+			return;
+		QThread::yieldCurrentThread();
 	}
+	aiDecodeClaim.fetchAndStoreRelease(DecodeStopped);
+}
+
+/// Number of decoded samples ready for the mixer.
+unsigned int AudioOutputSpeech::decodedSamples() {
+	return srBuffer->available();
+}
+
+/// Returns the time spent decoding, in microseconds, since the last call.
+unsigned int AudioOutputSpeech::takeDecodeTime() {
+	return static_cast<unsigned int>(aiDecodeTime.fetchAndStoreRelaxed(0));
 }
 
+/// While a speaker is inaudible, its packets are still taken from the
+/// jitter buffer and parsed for talk state, position and the end of the
+/// stream, but silence is played instead of decoding them. Playout thus
+/// stays in step, and decoding picks up with the next packet once the
+/// speaker is audible again.
+///
+/// The silence decoded ahead while inaudible is dropped as soon as the
+/// speaker is audible again, so they are heard without that delay.
+/// Mixer thread only.
+void AudioOutputSpeech::setInaudible(bool inaudible) {
+	if (aiInaudible.fetchAndStoreRelaxed(inaudible ? 1 : 0) && ! inaudible)
+		bDropSilence = true;
+}
+
+bool AudioOutputSpeech::isInaudible() const {
+	return aiInaudible.fetchAndAddRelaxed(0) != 0;
+}
+
+/// Decodes frames until target samples are ready, the ring is full or the
+/// stream has ended. The caller must hold the decode claim.
+void AudioOutputSpeech::decodeAhead(unsigned int target) {
+	QElapsedTimer t;
+	t.start();
+
+	// Packets that arrived since the last call all belong to the current
+	// jitter buffer tick, so moving them over here loses no timing.
+	while (Packet *packet = srPackets.front()) {
+		putFrame(packet->cData, packet->iLen, packet->iSeq);
+		srPackets.pop();
+	}
+
+	while (bLastAlive && (srBuffer->available() < target) && (srBuffer->space() >= iOutputSize))
+		decodeFrame();
+
+	aiDecodeTime.fetchAndAddRelaxed(static_cast<int>(t.nsecsElapsed() / 1000));
+}
+
+/// Points pfBuffer at the next snum decoded samples. Decodes inline only
+/// if no decode job is in flight and the speaker would otherwise run dry;
+/// normally AudioOutput has decoded ahead on AudioDecodePool.
 bool AudioOutputSpeech::prepareSampleBuffer(unsigned int snum) {
-	for (unsigned int i=iLastConsume;i<iBufferFilled;++i)
-		pfBuffer[i-iLastConsume]=pfBuffer[i];
-	iBufferFilled -= iLastConsume;
+	releaseBuffer();
+
+	// Only up to the last silent frame; what a decode worker wrote after
+	// that is the speaker again.
+	if (bDropSilence) {
+		const int end = aiSilenceEnd.fetchAndStoreAcquire(-1);
+		if (end >= 0)
+			srBuffer->discardTo(end);
+		bDropSilence = false;
+	}
 
-	iLastConsume = snum;
+	bUnderrun = false;
+	if ((srBuffer->available() < snum) && claimDecode()) {
+		decodeAhead(snum);
+		releaseDecode();
+	}
 
-	if (iBufferFilled >= snum)
-		return bLastAlive;
+	const unsigned int got = viewBuffer(snum);
+	if (got < snum) {
+		if ((got == 0) && aiDecodeDone.fetchAndAddAcquire(0))
+			return false;
+		bUnderrun = ! aiDecodeDone.fetchAndAddAcquire(0);
+	}
 
-	float *pOut;
-	bool nextalive = bLastAlive;
+	fPos[0] = fDecodedPos[0];
+	fPos[1] = fDecodedPos[1];
+	fPos[2] = fDecodedPos[2];
+
+	return true;
+}
 
-	while (iBufferFilled < snum) {
-		int decodedSamples = iFrameSize;
-		resizeBuffer(iBufferFilled + iOutputSize);
+/// Decodes, fades and resamples one frame into srBuffer. The caller makes
+/// sure there is room for iOutputSize samples.
+void AudioOutputSpeech::decodeFrame() {
+	int decodedSamples = iFrameSize;
+	float *pRing = srBuffer->writeView(iOutputSize);
+	float *pOut = (rsResampler) ? fResamplerBuffer : pRing;
+	bool nextalive = bLastAlive;
+	bool decoded = false;
+	bool buffering = false;
+	const bool inaudible = isInaudible();
 
-		pOut = (srs) ? fResamplerBuffer : (pfBuffer + iBufferFilled);
+	if (qlFrames.isEmpty()) {
+		QByteArray packet;
+		const AdaptiveJitterBuffer::Status status = ajbJitter->get(packet);
 
-		if (! bLastAlive) {
+		if (status == AdaptiveJitterBuffer::Buffering) {
 			memset(pOut, 0, iFrameSize * sizeof(float));
-		} else {
-			if (p == &LoopUser::lpLoopy) {
-				LoopUser::lpLoopy.fetchFrames();
+			buffering = true;
+			goto fade;
+		}
+
+		qbaFec.clear();
+		if (status == AdaptiveJitterBuffer::Ready) {
+			PacketDataStream pds(packet.constData(), packet.size());
+
+			iMissCount = 0;
+			ucFlags = static_cast<unsigned char>(pds.next());
+
+			bHasTerminator = false;
+			if (umtType == MessageHandler::UDPVoiceOpus) {
+				int size;
+				pds >> size;
+
+				bHasTerminator = size & 0x2000;
+				qlFrames << pds.dataBlock(size & 0x1fff);
+			} else {
+				unsigned int header = 0;
+				do {
+					header = static_cast<unsigned int>(pds.next());
+					if (header)
+						qlFrames << pds.dataBlock(header & 0x7f);
+					else
+						bHasTerminator = true;
+				} while ((header & 0x80) && pds.isValid());
 			}
 
-			int avail = 0;
-			int ts = jitter_buffer_get_pointer_timestamp(jbJitter);
-			jitter_buffer_ctl(jbJitter, JITTER_BUFFER_GET_AVAILABLE_COUNT, &avail);
-
-			if (p && (ts == 0)) {
-				int want = iroundf(p->fAverageAvailable);
-				if (avail < want) {
-					++iMissCount;
-					if (iMissCount < 20) {
-						memset(pOut, 0, iFrameSize * sizeof(float));
-						goto nextframe;
-					}
-				}
+			if (pds.left()) {
+				pds >> fDecodedPos[0];
+				pds >> fDecodedPos[1];
+				pds >> fDecodedPos[2];
+			} else {
+				fDecodedPos[0] = fDecodedPos[1] = fDecodedPos[2] = 0.0f;
+			}
+		} else {
+			// The next packet usually carries a low bitrate copy of the
+			// lost one, if its sender enabled Opus in-band FEC.
+			if ((umtType == MessageHandler::UDPVoiceOpus) && (status == AdaptiveJitterBuffer::Lost) && ajbJitter->next(packet)) {
+				PacketDataStream pds(packet.constData(), packet.size());
+				pds.next();
+				int size;
+				pds >> size;
+				qbaFec = pds.dataBlock(size & 0x1fff);
 			}
 
-			if (qlFrames.isEmpty()) {
-				QMutexLocker lock(&qmJitter);
-
-				char data[4096];
-				JitterBufferPacket jbp;
-				jbp.data = data;
-				jbp.len = 4096;
-
-				spx_int32_t startofs = 0;
-
-				if (jitter_buffer_get(jbJitter, &jbp, iFrameSize, &startofs) == JITTER_BUFFER_OK) {
-					PacketDataStream pds(jbp.data, jbp.len);
-
-					iMissCount = 0;
-					ucFlags = static_cast<unsigned char>(pds.next());
-
-					bHasTerminator = false;
-					if (umtType == MessageHandler::UDPVoiceOpus) {
-						int size;
-						pds >> size;
-
-						bHasTerminator = size & 0x2000;
-						qlFrames << pds.dataBlock(size & 0x1fff);
-					} else {
-						unsigned int header = 0;
-						do {
-							header = static_cast<unsigned int>(pds.next());
-							if (header)
-								qlFrames << pds.dataBlock(header & 0x7f);
-							else
-								bHasTerminator = true;
-						} while ((header & 0x80) && pds.isValid());
-					}
-
-					if (pds.left()) {
-						pds >> fPos[0];
-						pds >> fPos[1];
-						pds >> fPos[2];
-					} else {
-						fPos[0] = fPos[1] = fPos[2] = 0.0f;
-					}
-
-					if (p) {
-						float a = static_cast<float>(avail);
-						if (avail >= p->fAverageAvailable)
-							p->fAverageAvailable = a;
-						else
-							p->fAverageAvailable *= 0.99f;
-					}
-				} else {
-					jitter_buffer_update_delay(jbJitter, &jbp, NULL);
+			iMissCount++;
+			if (iMissCount > 10)
+				nextalive = false;
+		}
+	}
 
-					iMissCount++;
-					if (iMissCount > 10)
-						nextalive = false;
+	if (inaudible) {
+		if (! qlFrames.isEmpty()) {
+			const QByteArray qba = qlFrames.takeFirst();
+#ifdef USE_OPUS
+			if ((umtType == MessageHandler::UDPVoiceOpus) && oCodec && ! qba.isEmpty()) {
+				const unsigned char *packet = reinterpret_cast<const unsigned char *>(qba.constData());
+				const int frames = oCodec->opus_packet_get_nb_frames(packet, qba.size());
+				const int samples = frames * oCodec->opus_packet_get_samples_per_frame(packet, SAMPLE_RATE);
+				if ((frames > 0) && (samples > 0) && (static_cast<unsigned int>(samples) <= iAudioBufferSize))
+					decodedSamples = samples;
+			}
+#endif
+			if (qlFrames.isEmpty() && bHasTerminator)
+				nextalive = false;
+		}
+		memset(pOut, 0, decodedSamples * sizeof(float));
+	} else if (! qlFrames.isEmpty()) {
+		QByteArray qba = qlFrames.takeFirst();
+		decoded = ! qba.isEmpty();
+
+		if (umtType == MessageHandler::UDPVoiceCELTAlpha || umtType == MessageHandler::UDPVoiceCELTBeta) {
+			int wantversion = (umtType == MessageHandler::UDPVoiceCELTAlpha) ? g.iCodecAlpha : g.iCodecBeta;
+			if ((p == &LoopUser::lpLoopy) && (! g.qmCodecs.isEmpty())) {
+				QMap<int, CELTCodec *>::const_iterator i = g.qmCodecs.constEnd();
+				--i;
+				wantversion = i.key();
+			}
+			if (cCodec && (cCodec->bitstreamVersion() != wantversion)) {
+				cCodec->celt_decoder_destroy(cdDecoder);
+				cdDecoder = NULL;
+			}
+			if (! cCodec) {
+				cCodec = g.qmCodecs.value(wantversion);
+				if (cCodec) {
+					cdDecoder = cCodec->decoderCreate();
 				}
 			}
-
-			if (! qlFrames.isEmpty()) {
-				QByteArray qba = qlFrames.takeFirst();
-
-				if (umtType == MessageHandler::UDPVoiceCELTAlpha || umtType == MessageHandler::UDPVoiceCELTBeta) {
-					int wantversion = (umtType == MessageHandler::UDPVoiceCELTAlpha) ? g.iCodecAlpha : g.iCodecBeta;
-					if ((p == &LoopUser::lpLoopy) && (! g.qmCodecs.isEmpty())) {
-						QMap<int, CELTCodec *>::const_iterator i = g.qmCodecs.constEnd();
-						--i;
-						wantversion = i.key();
-					}
-					if (cCodec && (cCodec->bitstreamVersion() != wantversion)) {
-						cCodec->celt_decoder_destroy(cdDecoder);
-						cdDecoder = NULL;
-					}
-					if (! cCodec) {
-						cCodec = g.qmCodecs.value(wantversion);
-						if (cCodec) {
-							cdDecoder = cCodec->decoderCreate();
-						}
-					}
-					if (cdDecoder)
-						cCodec->decode_float(cdDecoder, qba.isEmpty() ? NULL : reinterpret_cast<const unsigned char *>(qba.constData()), qba.size(), pOut);
-					else
-						memset(pOut, 0, sizeof(float) * iFrameSize);
-				} else if (umtType == MessageHandler::UDPVoiceOpus) {
+			if (cdDecoder)
+				cCodec->decode_float(cdDecoder, qba.isEmpty() ? NULL : reinterpret_cast<const unsigned char *>(qba.constData()), qba.size(), pOut);
+			else
+				memset(pOut, 0, sizeof(float) * iFrameSize);
+		} else if (umtType == MessageHandler::UDPVoiceOpus) {
 #ifdef USE_OPUS
-					if (oCodec) {
-						decodedSamples = oCodec->opus_decode_float(opusState,
-						                                           qba.isEmpty() ?
-						                                               NULL :
-						                                               reinterpret_cast<const unsigned char *>(qba.constData()),
-						                                           qba.size(),
-						                                           pOut,
-						                                           iAudioBufferSize,
-						                                           0);
-					}
-
-					if (decodedSamples < 0) {
-						decodedSamples = iFrameSize;
-						memset(pOut, 0, iFrameSize * sizeof(float));
-					}
+			if (oCodec) {
+				decodedSamples = oCodec->opus_decode_float(opusState,
+				                                           qba.isEmpty() ?
+				                                               NULL :
+				                                               reinterpret_cast<const unsigned char *>(qba.constData()),
+				                                           qba.size(),
+				                                           pOut,
+				                                           iAudioBufferSize,
+				                                           0);
+			}
+
+			if (decodedSamples < 0) {
+				decodedSamples = iFrameSize;
+				memset(pOut, 0, iFrameSize * sizeof(float));
+			}
 #endif
-				} else if (umtType == MessageHandler::UDPVoiceSpeex) {
-					if (qba.isEmpty()) {
-						speex_decode(dsSpeex, NULL, pOut);
-					} else {
-						speex_bits_read_from(&sbBits, qba.data(), qba.size());
-						speex_decode(dsSpeex, &sbBits, pOut);
-					}
-					for (unsigned int i=0;i<iFrameSize;++i)
-						pOut[i] *= (1.0f / 32767.f);
-				} else {
-					qWarning("AudioOutputSpeech: encountered unknown message type %li in prepareSampleBuffer().", static_cast<long>(umtType));
-				}
+		} else if (umtType == MessageHandler::UDPVoiceSpeex) {
+			if (qba.isEmpty()) {
+				speex_decode(dsSpeex, NULL, pOut);
+			} else {
+				speex_bits_read_from(&sbBits, qba.data(), qba.size());
+				speex_decode(dsSpeex, &sbBits, pOut);
+			}
+			for (unsigned int i=0;i<iFrameSize;++i)
+				pOut[i] *= (1.0f / 32767.f);
+		} else {
+			qWarning("AudioOutputSpeech: encountered unknown message type %li in decodeFrame().", static_cast<long>(umtType));
+		}
 
-				bool update = true;
-				if (p) {
-					float &fPowerMax = p->fPowerMax;
-					float &fPowerMin = p->fPowerMin;
-
-					float pow = 0.0f;
-					for (int i = 0; i < decodedSamples; ++i)
-						pow += pOut[i] * pOut[i];
-					pow = sqrtf(pow / static_cast<float>(decodedSamples));
-
-					if (pow >= fPowerMax) {
-						fPowerMax = pow;
-					} else {
-						if (pow <= fPowerMin) {
-							fPowerMin = pow;
-						} else {
-							fPowerMax = 0.99f * fPowerMax;
-							fPowerMin += 0.0001f * pow;
-						}
-					}
-
-					update = (pow < (fPowerMin + 0.01f * (fPowerMax - fPowerMin)));
-				}
-				if (qlFrames.isEmpty() && update)
-					jitter_buffer_update_delay(jbJitter, NULL, NULL);
+		bool update = true;
+		if (p) {
+			float &fPowerMax = p->fPowerMax;
+			float &fPowerMin = p->fPowerMin;
+
+			float pow = 0.0f;
+			for (int i = 0; i < decodedSamples; ++i)
+				pow += pOut[i] * pOut[i];
+			pow = sqrtf(pow / static_cast<float>(decodedSamples));
 
-				if (qlFrames.isEmpty() && bHasTerminator)
-					nextalive = false;
+			if (LatencyProbe::lpProbe.isActive())
+				LatencyProbe::lpProbe.decoded(p, pow);
+
+			if (pow >= fPowerMax) {
+				fPowerMax = pow;
 			} else {
-				if (umtType == MessageHandler::UDPVoiceCELTAlpha || umtType == MessageHandler::UDPVoiceCELTBeta) {
-					if (cdDecoder)
-						cCodec->decode_float(cdDecoder, NULL, 0, pOut);
-					else
-						memset(pOut, 0, sizeof(float) * iFrameSize);
-				} else if (umtType == MessageHandler::UDPVoiceOpus) {
-#ifdef USE_OPUS
-					if (oCodec) {
-						decodedSamples = oCodec->opus_decode_float(opusState, NULL, 0, pOut, iFrameSize, 0);
-					}
-
-					if (decodedSamples < 0) {
-						decodedSamples = iFrameSize;
-						memset(pOut, 0, iFrameSize * sizeof(float));
-					}
-#endif
+				if (pow <= fPowerMin) {
+					fPowerMin = pow;
 				} else {
-					speex_decode(dsSpeex, NULL, pOut);
-					for (unsigned int i=0;i<iFrameSize;++i)
-						pOut[i] *= (1.0f / 32767.f);
+					fPowerMax = 0.99f * fPowerMax;
+					fPowerMin += 0.0001f * pow;
 				}
 			}
 
-			if (! nextalive) {
-				for (unsigned int i=0;i<iFrameSize;++i)
-					pOut[i] *= fFadeOut[i];
-			} else if (ts == 0) {
-				for (unsigned int i=0;i<iFrameSize;++i)
-					pOut[i] *= fFadeIn[i];
+			update = (pow < (fPowerMin + 0.01f * (fPowerMax - fPowerMin)));
+		}
+		// The buffer measures its delay per packet, so only the last frame
+		// of one is stretched. Voice packets are short enough that the
+		// correction this allows is plenty.
+		if (qlFrames.isEmpty() && decoded && iStretchSize && (decodedSamples > 0)) {
+			const int wanted = ajbJitter->stretch(update);
+			unsigned int n = static_cast<unsigned int>(decodedSamples);
+			if (wanted < 0)
+				n = AdaptiveJitterBuffer::compress(pOut, n, iSampleRate, static_cast<unsigned int>(-wanted));
+			else if (wanted > 0)
+				n = AdaptiveJitterBuffer::expand(pOut, n, iSampleRate, static_cast<unsigned int>(wanted));
+			ajbJitter->stretched(static_cast<int>(n) - decodedSamples);
+			decodedSamples = static_cast<int>(n);
+		}
+
+		if (qlFrames.isEmpty() && bHasTerminator)
+			nextalive = false;
+	} else {
+		if (umtType == MessageHandler::UDPVoiceCELTAlpha || umtType == MessageHandler::UDPVoiceCELTBeta) {
+			if (cdDecoder)
+				cCodec->decode_float(cdDecoder, NULL, 0, pOut);
+			else
+				memset(pOut, 0, sizeof(float) * iFrameSize);
+		} else if (umtType == MessageHandler::UDPVoiceOpus) {
+#ifdef USE_OPUS
+			if (oCodec) {
+				if (qbaFec.isEmpty())
+					decodedSamples = oCodec->opus_decode_float(opusState, NULL, 0, pOut, iFrameSize, 0);
+				else
+					decodedSamples = oCodec->opus_decode_float(opusState, reinterpret_cast<const unsigned char *>(qbaFec.constData()), qbaFec.size(), pOut, iFrameSize, 1);
 			}
 
-			for (int i = decodedSamples / iFrameSize; i > 0; --i) {
-				jitter_buffer_tick(jbJitter);
+			if (decodedSamples < 0) {
+				decodedSamples = iFrameSize;
+				memset(pOut, 0, iFrameSize * sizeof(float));
 			}
+#endif
+		} else {
+			speex_decode(dsSpeex, NULL, pOut);
+			for (unsigned int i=0;i<iFrameSize;++i)
+				pOut[i] *= (1.0f / 32767.f);
 		}
-nextframe:
-		spx_uint32_t inlen = decodedSamples;
-		spx_uint32_t outlen = static_cast<unsigned int>(ceilf(static_cast<float>(decodedSamples * iMixerFreq) / static_cast<float>(iSampleRate)));
-		if (srs && bLastAlive)
-			speex_resampler_process_float(srs, 0, fResamplerBuffer, &inlen, pfBuffer + iBufferFilled, &outlen);
-		iBufferFilled += outlen;
 	}
 
+fade:
+	if (! nextalive) {
+		for (unsigned int i=0;i<iFrameSize;++i)
+			pOut[i] *= fFadeOut[i];
+	} else if (bFadeIn) {
+		for (unsigned int i=0;i<iFrameSize;++i)
+			pOut[i] *= fFadeIn[i];
+	}
+	// Fade back in after silence, and after skipping, where the decoder
+	// missed everything.
+	bFadeIn = buffering || inaudible;
+
+	ajbJitter->advance(static_cast<unsigned int>(decodedSamples));
+	unsigned int outlen = static_cast<unsigned int>(ceilf(static_cast<float>(decodedSamples * iMixerFreq) / static_cast<float>(iSampleRate)));
+	if (rsResampler && inaudible) {
+		rsResampler->reset();
+		memset(pRing, 0, outlen * sizeof(float));
+	} else if (rsResampler) {
+		outlen = rsResampler->process(fResamplerBuffer, static_cast<unsigned int>(decodedSamples), pRing, outlen);
+	}
+	srBuffer->commitWrite(outlen);
+	if (inaudible)
+		aiSilenceEnd.fetchAndStoreRelease(srBuffer->writePosition());
+
 	if (p) {
-		Settings::TalkState ts;
+		Settings::TalkState state;
 		if (! nextalive)
 			ucFlags = 0xFF;
 		switch (ucFlags) {
 			case 0:
-				ts = Settings::Talking;
+				state = Settings::Talking;
 				break;
 			case 1:
-				ts = Settings::Shouting;
+				state = Settings::Shouting;
 				break;
 			case 0xFF:
-				ts = Settings::Passive;
+				state = Settings::Passive;
 				break;
 			default:
-				ts = Settings::Whispering;
+				state = Settings::Whispering;
 				break;
 		}
-		p->setTalking(ts);
+		p->setTalking(state);
 	}
 
-	bool tmp = bLastAlive;
 	bLastAlive = nextalive;
-	return tmp;
+	if (! bLastAlive) {
+		if (p)
+			p->aiJitterSpread.fetchAndStoreRelaxed(static_cast<int>(ajbJitter->spread()));
+		aiDecodeDone.fetchAndStoreRelease(1);
+	}
 }
@@ -8,14 +8,14 @@
 
 #include <stdint.h>
 #include <speex/speex.h>
-#include <speex/speex_resampler.h>
-#include <speex/speex_jitter.h>
 #include <celt.h>
 
-#include <QtCore/QMutex>
-
 #include "AudioOutputUser.h"
 #include "Message.h"
+#include "SPSCRing.h"
+
+class AdaptiveJitterBuffer;
+class Resampler;
 
 class CELTCodec;
 class OpusCodec;
@@ -28,26 +28,66 @@ class AudioOutputSpeech : public AudioOutputUser {
 		Q_DISABLE_COPY(AudioOutputSpeech)
 	protected:
 		unsigned int iAudioBufferSize;
-		unsigned int iBufferOffset;
-		unsigned int iBufferFilled;
 		unsigned int iOutputSize;
-		unsigned int iLastConsume;
 		unsigned int iFrameSize;
 		unsigned int iSampleRate;
 		unsigned int iMixerFreq;
 		bool bLastAlive;
 		bool bHasTerminator;
 		bool bStereo;
+		/// Set until the first frame after buffering has been faded in.
+		bool bFadeIn;
 
 		float *fFadeIn;
 		float *fFadeOut;
 		float *fResamplerBuffer;
 
-		SpeexResamplerState *srs;
-
-		QMutex qmJitter;
-		JitterBuffer *jbJitter;
+		Resampler *rsResampler;
+
+		enum { MaxPacketSize = 1024 };
+
+		/// A voice packet as received from the network, waiting to be
+		/// moved into the jitter buffer by the decoder.
+		struct Packet {
+			unsigned int iSeq;
+			unsigned int iLen;
+			char cData[MaxPacketSize];
+		};
+		/// Hands packets from the network thread to the decoder without
+		/// locking. The jitter buffer itself is only ever touched by the
+		/// thread holding the decode claim.
+		SPSCRing<Packet, 64> srPackets;
+		void putFrame(const char *data, unsigned int len, unsigned int iSeq);
+
+		/// Set while a decode job is queued or running. The jitter buffer,
+		/// the decoders, bLastAlive and the producer side of srBuffer
+		/// belong to the thread holding it. Taken for good by
+		/// stopDecoding().
+		QAtomicInt aiDecodeClaim;
+		enum DecodeState { DecodeIdle, DecodeClaimed, DecodeStopped };
+		/// Set once the stream has ended and nothing more will be decoded.
+		QAtomicInt aiDecodeDone;
+		/// Microseconds spent decoding since the mixer last asked.
+		QAtomicInt aiDecodeTime;
+		/// Set by the mixer while this speaker is mixed too quietly to be
+		/// heard. See setInaudible().
+		mutable QAtomicInt aiInaudible;
+		/// srBuffer position just past the last frame of silence written
+		/// while inaudible, or -1.
+		QAtomicInt aiSilenceEnd;
+		/// Set when the speaker becomes audible again, until the silence
+		/// queued in srBuffer has been dropped. Mixer thread only.
+		bool bDropSilence;
+		/// Position of the speaker as of the last decoded packet.
+		float fDecodedPos[3];
+		void decodeFrame();
+
+		AdaptiveJitterBuffer *ajbJitter;
 		int iMissCount;
+		/// Room left in the decode buffers for expanding a frame.
+		unsigned int iStretchSize;
+		/// Opus payload of the packet following a lost one, for FEC.
+		QByteArray qbaFec;
 
 		CELTCodec *cCodec;
 		CELTDecoder *cdDecoder;
@@ -66,9 +106,22 @@ class AudioOutputSpeech : public AudioOutputUser {
 		int iMissedFrames;
 		ClientUser *p;
 
+		/// Set by prepareSampleBuffer() when a decode job was still
+		/// running and the mixer had to pad with silence. Mixer only.
+		bool bUnderrun;
+
 		virtual bool prepareSampleBuffer(unsigned int snum) Q_DECL_OVERRIDE;
 
-		void addFrameToBuffer(const QByteArray &, unsigned int iBaseSeq);
+		bool claimDecode();
+		void releaseDecode();
+		void stopDecoding();
+		void decodeAhead(unsigned int target);
+		unsigned int decodedSamples();
+		unsigned int takeDecodeTime();
+		void setInaudible(bool inaudible);
+		bool isInaudible() const;
+
+		bool addFrameToBuffer(unsigned int msgFlags, const char *data, unsigned int len, unsigned int iBaseSeq);
 		AudioOutputSpeech(ClientUser *, unsigned int freq, MessageHandler::UDPMessageType type);
 		~AudioOutputSpeech() Q_DECL_OVERRIDE;
 };
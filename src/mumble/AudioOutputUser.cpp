@@ -6,25 +6,64 @@
 #include "AudioOutputUser.h"
 
 AudioOutputUser::AudioOutputUser(const QString& name) : qsName(name) {
-	iBufferSize = 0;
+	uiViewed = 0;
+	pfScratch = NULL;
+	uiScratchSize = 0;
+	srBuffer = NULL;
 	pfBuffer = NULL;
 	pfVolume = NULL;
 	fPos[0]=fPos[1]=fPos[2]=0.0;
 }
 
 AudioOutputUser::~AudioOutputUser() {
-	delete [] pfBuffer;
+	delete srBuffer;
+	delete [] pfScratch;
 	delete [] pfVolume;
 }
 
-void AudioOutputUser::resizeBuffer(unsigned int newsize) {
-	if (newsize > iBufferSize) {
-		float *n = new float[newsize];
-		if (pfBuffer) {
-			memcpy(n, pfBuffer, sizeof(float) * iBufferSize);
-			delete [] pfBuffer;
-		}
-		pfBuffer = n;
-		iBufferSize = newsize;
+/// (Re)creates srBuffer, dropping anything still queued in it. Views of
+/// up to maxview samples come straight out of the ring, or out of the
+/// scratch buffer allocated here if they have to be padded.
+void AudioOutputUser::initBuffer(unsigned int minsize, unsigned int maxview) {
+	delete srBuffer;
+	srBuffer = new SPSCSampleRing<float>(minsize, maxview);
+	uiViewed = 0;
+	pfBuffer = NULL;
+
+	if (uiScratchSize < maxview) {
+		delete [] pfScratch;
+		pfScratch = new float[maxview];
+		uiScratchSize = maxview;
+	}
+}
+
+/// Gives the samples viewed by the last viewBuffer() back to the producer.
+void AudioOutputUser::releaseBuffer() {
+	srBuffer->commitRead(uiViewed);
+	uiViewed = 0;
+}
+
+/// Points pfBuffer at the next snum samples, padding with silence if fewer
+/// are queued. Returns the number of queued samples in the view. The
+/// samples stay in srBuffer until releaseBuffer().
+unsigned int AudioOutputUser::viewBuffer(unsigned int snum) {
+	const float *view = srBuffer->readView(snum);
+	if (view) {
+		pfBuffer = view;
+		uiViewed = snum;
+		return snum;
 	}
+
+	// Only requests beyond the maxview given to initBuffer() get here.
+	if (uiScratchSize < snum) {
+		delete [] pfScratch;
+		pfScratch = new float[snum];
+		uiScratchSize = snum;
+	}
+
+	const unsigned int got = srBuffer->read(pfScratch, snum);
+	memset(pfScratch + got, 0, (snum - got) * sizeof(float));
+	pfBuffer = pfScratch;
+	uiViewed = 0;
+	return got;
 }
@@ -8,18 +8,35 @@
 
 #include <QtCore/QObject>
 
+#include "SPSCRing.h"
+
 class AudioOutputUser : public QObject {
 	private:
 		Q_OBJECT
 		Q_DISABLE_COPY(AudioOutputUser)
+
+		/// Samples handed to the mixer by the last viewBuffer() that are
+		/// still in srBuffer.
+		unsigned int uiViewed;
+		/// Backs views srBuffer cannot provide in place: short reads that
+		/// need padding, or requests larger than its maxView(). Sized by
+		/// initBuffer(), so the mixer does not allocate it.
+		float *pfScratch;
+		unsigned int uiScratchSize;
 	protected:
-		unsigned int iBufferSize;
-		void resizeBuffer(unsigned int newsize);
+		/// Samples at the mixer rate waiting to be mixed. The mixer is
+		/// always the consumer.
+		SPSCSampleRing<float> *srBuffer;
+		void initBuffer(unsigned int minsize, unsigned int maxview);
+		void releaseBuffer();
+		unsigned int viewBuffer(unsigned int snum);
 	public:
 		AudioOutputUser(const QString& name);
 		~AudioOutputUser() Q_DECL_OVERRIDE;
 		const QString qsName;
-		float *pfBuffer;
+		/// The snum samples to mix, as set up by prepareSampleBuffer().
+		/// Valid until the next call.
+		const float *pfBuffer;
 		float *pfVolume;
 		float fPos[3];
 		virtual bool prepareSampleBuffer(unsigned int snum) = 0;
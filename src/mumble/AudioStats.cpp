@@ -7,11 +7,13 @@
 
 #include "AudioInput.h"
 #include "Global.h"
+#include "LatencyProbe.h"
 #include "Utils.h"
 #include "smallft.h"
 
 #include <QtGui/QPainter>
 
+#include <algorithm>
 #include <cmath>
 
 AudioBar::AudioBar(QWidget *p) : QWidget(p) {
@@ -299,9 +301,73 @@ AudioStats::AudioStats(QWidget *p) : QDialog(p) {
 }
 
 AudioStats::~AudioStats() {
+	if (qcbLatency->isChecked())
+		LatencyProbe::lpProbe.stop();
+}
+
+void AudioStats::on_qcbLatency_toggled(bool checked) {
+	if (checked) {
+		LatencyProbe::lpProbe.start();
+		qlLatency->setText(tr("Waiting for the first test tone..."));
+	} else {
+		LatencyProbe::lpProbe.stop();
+	}
+}
+
+/// Returns the value below which pct percent of sorted lie, in ms.
+static double percentile(const QVector<quint64> &sorted, int pct) {
+	const int i = qMin((sorted.count() * pct) / 100, sorted.count() - 1);
+	return static_cast<double>(sorted.at(i)) / 1000.0;
+}
+
+void AudioStats::updateLatency() {
+	if (! qcbLatency->isChecked())
+		return;
+
+	const QList<LatencyProbe::Marker> markers = LatencyProbe::lpProbe.markers();
+	const int lost = LatencyProbe::lpProbe.lost();
+	if (markers.isEmpty()) {
+		if (lost > 0)
+			qlLatency->setText(tr("No test tone has come back yet, %1 lost.").arg(lost));
+		return;
+	}
+
+	// Each row covers the stages from -> to.
+	const struct {
+		LatencyProbe::Stage from, to;
+		QString name;
+	} rows[] = {
+		{ LatencyProbe::Captured, LatencyProbe::Sent, tr("Packet assembly and encoding") },
+		{ LatencyProbe::Sent, LatencyProbe::Received, tr("Network round trip") },
+		{ LatencyProbe::Received, LatencyProbe::Decoded, tr("Jitter buffer and decoding") },
+		{ LatencyProbe::Decoded, LatencyProbe::Mixed, tr("Decoded audio waiting for the mixer") },
+		{ LatencyProbe::Captured, LatencyProbe::Mixed, tr("Total") },
+	};
+
+	QString html = QString::fromLatin1("<table><tr><th></th><th>%1</th><th>%2</th><th>%3</th><th>%4</th></tr>").arg(tr("Median"), tr("90%"), tr("99%"), tr("Maximum"));
+	for (unsigned int r = 0; r < sizeof(rows) / sizeof(rows[0]); ++r) {
+		QVector<quint64> delays;
+		delays.reserve(markers.count());
+		foreach(const LatencyProbe::Marker &m, markers)
+			delays << m.uiTime[rows[r].to] - m.uiTime[rows[r].from];
+		std::sort(delays.begin(), delays.end());
+
+		html += QString::fromLatin1("<tr><td>%1</td><td align=\"right\">%2</td><td align=\"right\">%3</td><td align=\"right\">%4</td><td align=\"right\">%5</td></tr>")
+		        .arg(rows[r].name.toHtmlEscaped(),
+		             tr("%1 ms").arg(percentile(delays, 50), 0, 'f', 1),
+		             tr("%1 ms").arg(percentile(delays, 90), 0, 'f', 1),
+		             tr("%1 ms").arg(percentile(delays, 99), 0, 'f', 1),
+		             tr("%1 ms").arg(static_cast<double>(delays.last()) / 1000.0, 0, 'f', 1));
+	}
+	html += QLatin1String("</table>");
+	html += tr("%1 test tones measured, %2 lost. Sound card buffers are not included.").arg(markers.count()).arg(lost);
+
+	qlLatency->setText(html);
 }
 
 void AudioStats::on_Tick_timeout() {
+	updateLatency();
+
 	AudioInputPtr ai = g.ai;
 
 	if (ai.get() == NULL || ! ai->sppPreprocess)
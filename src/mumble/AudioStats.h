@@ -57,11 +57,13 @@ class AudioStats : public QDialog, public Ui::AudioStats {
 	protected:
 		QTimer *qtTick;
 		bool bTalking;
+		void updateLatency();
 	public:
 		AudioStats(QWidget *parent);
 		~AudioStats() Q_DECL_OVERRIDE;
 	public slots:
 		void on_Tick_timeout();
+		void on_qcbLatency_toggled(bool);
 };
 
 #else
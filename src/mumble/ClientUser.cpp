@@ -22,7 +22,7 @@ ClientUser::ClientUser(QObject *p) : QObject(p),
 		bLocalMute(false),
 		fPowerMin(0.0f),
 		fPowerMax(0.0f),
-		fAverageAvailable(0.0f),
+		aiJitterSpread(0),
 		fLocalVolume(1.0f),
 		iFrames(0),
 		iSequence(0) {
@@ -6,6 +6,7 @@
 #ifndef MUMBLE_MUMBLE_CLIENTUSER_H_
 #define MUMBLE_MUMBLE_CLIENTUSER_H_
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QReadWriteLock>
 
 #include "User.h"
@@ -23,7 +24,10 @@ class ClientUser : public QObject, public User {
 		bool bLocalMute;
 
 		float fPowerMin, fPowerMax;
-		float fAverageAvailable;
+		/// Arrival time spread of this user's last voice stream, so the
+		/// jitter buffer of the next one starts out with it. Written by
+		/// the decode worker that ends a stream.
+		QAtomicInt aiJitterSpread;
 		float fLocalVolume;
 
 		int iFrames;
@@ -29,7 +29,6 @@
 #include <QtWidgets/QMenu>
 #include <QtWidgets/QMessageBox>
 #include <QtWidgets/QShortcut>
-#include <QtXml/QDomDocument>
 
 #include <boost/accumulators/statistics/extended_p_square.hpp>
 #include <boost/array.hpp>
@@ -46,6 +45,10 @@ QList<PublicInfo> ConnectDialog::qlPublicServers;
 QString ConnectDialog::qsUserCountry, ConnectDialog::qsUserCountryCode, ConnectDialog::qsUserContinentCode;
 Timer ConnectDialog::tPublicServers;
 
+/// Number of public servers parsed and added per event loop iteration.
+#define PUBLIC_SLICE 250
+/// Servers on screen are pinged at least this often, in microseconds.
+#define VISIBLE_PING_INTERVAL 5000000ULL
 
 PingStats::PingStats() {
 	init();
@@ -67,6 +70,7 @@ void PingStats::init() {
 	uiBandwidth = 0;
 	uiSent = 0;
 	uiRecv = 0;
+	uiLastPing = 0;
 	uiVersion = 0;
 }
 
@@ -951,6 +955,7 @@ ConnectDialog::ConnectDialog(QWidget *p, bool autoconnect) : QDialog(p), bAutoCo
 	setWindowModality(Qt::WindowModal);
 #endif
 	bPublicInit = false;
+	iLastFoundCount = -1;
 
 	siAutoConnect = NULL;
 
@@ -1100,19 +1105,23 @@ ConnectDialog::ConnectDialog(QWidget *p, bool autoconnect) : QDialog(p), bAutoCo
 ConnectDialog::~ConnectDialog() {
 	ServerItem::qmIcons.clear();
 
+	// The public server list is only kept once it is complete.
+	if (qxsrPublic.tokenType() != QXmlStreamReader::NoToken)
+		qlPublicServers.clear();
+
 	QList<FavoriteServer> ql;
-	qmPingCache.clear();
+	QMap<UnresolvedServerAddress, unsigned int> pings;
 
 	foreach(ServerItem *si, qlItems) {
 		if (si->uiPing)
-			qmPingCache.insert(UnresolvedServerAddress(si->qsHostname, si->usPort), si->uiPing);
+			pings.insert(UnresolvedServerAddress(si->qsHostname, si->usPort), si->uiPing);
 
 		if (si->itType != ServerItem::FavoriteType)
 			continue;
 		ql << si->toFavoriteServer();
 	}
 	g.db->setFavorites(ql);
-	g.db->setPingCache(qmPingCache);
+	g.db->setPingCache(pings);
 
 	g.s.qbaConnectDialogHeader = qtwServers->header()->saveState();
 	g.s.qbaConnectDialogGeometry = saveGeometry();
@@ -1333,7 +1342,7 @@ void ConnectDialog::on_qtwServers_currentItemChanged(QTreeWidgetItem *item, QTre
 void ConnectDialog::on_qtwServers_itemExpanded(QTreeWidgetItem *item) {
 	if (qtwServers->siPublic != NULL && item == qtwServers->siPublic) {
 		initList();
-		fillList();
+		fillList(qlPublicServers);
 	}
 
 	ServerItem *p = static_cast<ServerItem *>(item);
@@ -1413,27 +1422,32 @@ void ConnectDialog::onLanResolveError(BonjourRecord br, DNSServiceErrorType err)
 }
 #endif
 
-void ConnectDialog::fillList() {
+void ConnectDialog::fillList(const QList<PublicInfo> &servers) {
 	QList<QTreeWidgetItem *> ql;
 	QList<QTreeWidgetItem *> qlNew;
 
-	foreach(const PublicInfo &pi, qlPublicServers) {
+	QMultiHash<UnresolvedServerAddress, ServerItem *> items;
+	foreach(ServerItem *si, qlItems)
+		items.insert(UnresolvedServerAddress(si->qsHostname, si->usPort), si);
+
+	foreach(const PublicInfo &pi, servers) {
 		bool found = false;
-		foreach(ServerItem *si, qlItems) {
-			if ((pi.qsIp == si->qsHostname) && (pi.usPort == si->usPort)) {
-				si->qsCountry = pi.qsCountry;
-				si->qsCountryCode = pi.qsCountryCode;
-				si->qsContinentCode = pi.qsContinentCode;
-				si->qsUrl = pi.quUrl.toString();
-				si->bCA = pi.bCA;
-				si->setDatas();
-
-				if (si->itType == ServerItem::PublicType)
-					found = true;
-			}
+		foreach(ServerItem *si, items.values(UnresolvedServerAddress(pi.qsIp, pi.usPort))) {
+			si->qsCountry = pi.qsCountry;
+			si->qsCountryCode = pi.qsCountryCode;
+			si->qsContinentCode = pi.qsContinentCode;
+			si->qsUrl = pi.quUrl.toString();
+			si->bCA = pi.bCA;
+			si->setDatas();
+
+			if (si->itType == ServerItem::PublicType)
+				found = true;
+		}
+		if (! found) {
+			ServerItem *si = new ServerItem(pi);
+			si->uiPingSort = qmPingCache.value(UnresolvedServerAddress(si->qsHostname, si->usPort));
+			ql << si;
 		}
-		if (! found)
-			ql << new ServerItem(pi);
 	}
 
 	while (! ql.isEmpty()) {
@@ -1453,7 +1467,10 @@ void ConnectDialog::fillList() {
 }
 
 void ConnectDialog::timeTick() {
-	if (! bLastFound && ! g.s.qsLastServer.isEmpty()) {
+	// Searching the whole tree is slow with the public list loaded, so
+	// only do it again when items were added.
+	if (! bLastFound && ! g.s.qsLastServer.isEmpty() && (qlItems.count() != iLastFoundCount)) {
+		iLastFoundCount = qlItems.count();
 		QList<QTreeWidgetItem *> items = qtwServers->findItems(g.s.qsLastServer, Qt::MatchExactly | Qt::MatchRecursive);
 		if (!items.isEmpty()) {
 			bLastFound = true;
@@ -1513,6 +1530,9 @@ void ConnectDialog::timeTick() {
 		}
 	}
 
+	if (!si)
+		si = nextVisiblePing();
+
 	if (!si) {
 		if (qlItems.isEmpty())
 			return;
@@ -1543,11 +1563,29 @@ void ConnectDialog::timeTick() {
 	if (si == hover)
 		tHover.restart();
 
+	// Stamp the item even if no ping goes out (no socket for its address
+	// family), or nextVisiblePing() would pick it again on every tick.
+	si->uiLastPing = tPing.elapsed();
+
 	foreach(const ServerAddress &addr, si->qlAddresses) {
 		sendPing(addr.host.toAddress(), addr.port);
 	}
 }
 
+ServerItem *ConnectDialog::nextVisiblePing() {
+	const int height = qtwServers->viewport()->height();
+	const quint64 now = tPing.elapsed();
+
+	QTreeWidgetItem *item = qtwServers->itemAt(0, 0);
+	while (item && (qtwServers->visualItemRect(item).top() < height)) {
+		ServerItem *si = static_cast<ServerItem *>(item);
+		if (! si->bParent && ! si->qlAddresses.isEmpty() && ((si->uiLastPing == 0) || (now - si->uiLastPing >= VISIBLE_PING_INTERVAL)))
+			return si;
+		item = qtwServers->itemBelow(item);
+	}
+	return NULL;
+}
+
 
 void ConnectDialog::startDns(ServerItem *si) {
 	if (!bAllowHostLookup) {
@@ -1702,9 +1740,12 @@ void ConnectDialog::sendPing(const QHostAddress &host, unsigned short port) {
 		return;
 
 	const QSet<ServerItem *> &qs = qhPings.value(addr);
+	const quint64 now = tPing.elapsed();
 
-	foreach(ServerItem *si, qs)
+	foreach(ServerItem *si, qs) {
 		++ si->uiSent;
+		si->uiLastPing = now;
+	}
 }
 
 void ConnectDialog::udpReply() {
@@ -1752,37 +1793,50 @@ void ConnectDialog::fetched(QByteArray xmlData, QUrl, QMap<QString, QString> hea
 		return;
 	}
 
-	QDomDocument doc;
-	doc.setContent(xmlData);
-
 	qlPublicServers.clear();
 	qsUserCountry = headers.value(QLatin1String("Geo-Country"));
 	qsUserCountryCode = headers.value(QLatin1String("Geo-Country-Code")).toLower();
 	qsUserContinentCode = headers.value(QLatin1String("Geo-Continent-Code")).toLower();
 
-	QDomElement root=doc.documentElement();
-	QDomNode n = root.firstChild();
-	while (!n.isNull()) {
-		QDomElement e = n.toElement();
-		if (!e.isNull()) {
-			if (e.tagName() == QLatin1String("server")) {
-				PublicInfo pi;
-				pi.qsName = e.attribute(QLatin1String("name"));
-				pi.quUrl = e.attribute(QLatin1String("url"));
-				pi.qsIp = e.attribute(QLatin1String("ip"));
-				pi.usPort = e.attribute(QLatin1String("port")).toUShort();
-				pi.qsCountry = e.attribute(QLatin1String("country"), tr("Unknown"));
-				pi.qsCountryCode = e.attribute(QLatin1String("country_code")).toLower();
-				pi.qsContinentCode = e.attribute(QLatin1String("continent_code")).toLower();
-				pi.bCA = e.attribute(QLatin1String("ca")).toInt() ? true : false;
-
-				qlPublicServers << pi;
-			}
-		}
-		n = n.nextSibling();
+	qxsrPublic.clear();
+	qxsrPublic.addData(xmlData);
+
+	parsePublicList();
+}
+
+void ConnectDialog::parsePublicList() {
+	QList<PublicInfo> servers;
+
+	while ((servers.count() < PUBLIC_SLICE) && ! qxsrPublic.atEnd()) {
+		if ((qxsrPublic.readNext() != QXmlStreamReader::StartElement) || (qxsrPublic.name() != QLatin1String("server")))
+			continue;
+
+		const QXmlStreamAttributes attrs = qxsrPublic.attributes();
+
+		PublicInfo pi;
+		pi.qsName = attrs.value(QLatin1String("name")).toString();
+		pi.quUrl = attrs.value(QLatin1String("url")).toString();
+		pi.qsIp = attrs.value(QLatin1String("ip")).toString();
+		pi.usPort = attrs.value(QLatin1String("port")).toUShort();
+		pi.qsCountry = attrs.hasAttribute(QLatin1String("country")) ? attrs.value(QLatin1String("country")).toString() : tr("Unknown");
+		pi.qsCountryCode = attrs.value(QLatin1String("country_code")).toString().toLower();
+		pi.qsContinentCode = attrs.value(QLatin1String("continent_code")).toString().toLower();
+		pi.bCA = attrs.value(QLatin1String("ca")).toInt() ? true : false;
+
+		servers << pi;
 	}
 
-	tPublicServers.restart();
+	qlPublicServers << servers;
+	fillList(servers);
+
+	if (! qxsrPublic.atEnd()) {
+		QTimer::singleShot(0, this, SLOT(parsePublicList()));
+		return;
+	}
 
-	fillList();
+	if (qxsrPublic.hasError())
+		qWarning("ConnectDialog: Failed to parse server list: %s", qPrintable(qxsrPublic.errorString()));
+	qxsrPublic.clear();
+
+	tPublicServers.restart();
 }
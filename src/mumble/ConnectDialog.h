@@ -14,6 +14,7 @@
 #include <QtCore/QtGlobal>
 #include <QtCore/QString>
 #include <QtCore/QUrl>
+#include <QtCore/QXmlStreamReader>
 #include <QtWidgets/QStyledItemDelegate>
 #include <QtWidgets/QTreeView>
 #include <QtWidgets/QTreeWidgetItem>
@@ -59,6 +60,8 @@ public:
 	quint32 uiBandwidth;
 	quint32 uiSent;
 	quint32 uiRecv;
+	/// When the last ping was sent, on ConnectDialog::tPing. 0 if never.
+	quint64 uiLastPing;
 
 	double dPing;
 
@@ -259,8 +262,16 @@ class ConnectDialog : public QDialog, public Ui::ConnectDialog {
 		QHash<ServerAddress, quint64> qhPingRand;
 		QHash<ServerAddress, QSet<ServerItem *> > qhPings;
 
+		/// Pings from earlier sessions, used to sort servers before they
+		/// answer. Updated with the pings of this session when closing.
 		QMap<UnresolvedServerAddress, unsigned int> qmPingCache;
 
+		/// The public server list being parsed, a slice per event loop
+		/// iteration, so the dialog stays responsive for long lists.
+		QXmlStreamReader qxsrPublic;
+		/// Number of items when the last server was last searched for.
+		int iLastFoundCount;
+
 		bool bIPv4;
 		bool bIPv6;
 		int iPingIndex;
@@ -288,13 +299,18 @@ class ConnectDialog : public QDialog, public Ui::ConnectDialog {
 		void sendPing(const QHostAddress &, unsigned short port);
 
 		void initList();
-		void fillList();
+		void fillList(const QList<PublicInfo> &servers);
+
+		/// Returns the first server on screen that was not pinged for a
+		/// while, or NULL.
+		ServerItem *nextVisiblePing();
 
 		void startDns(ServerItem *);
 		void stopDns(ServerItem *);
 	public slots:
 		void accept();
 		void fetched(QByteArray xmlData, QUrl, QMap<QString, QString>);
+		void parsePublicList();
 
 		void udpReply();
 		void lookedUp();
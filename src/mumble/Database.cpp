@@ -12,7 +12,10 @@
 #include "Utils.h"
 #include "Version.h"
 
+#include <QtCore/QMutex>
 #include <QtCore/QStandardPaths>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
 #include <QtWidgets/QMessageBox>
@@ -39,8 +42,198 @@ static bool execQueryAndLogFailure(QSqlQuery &query, const QString &queryString)
 	return true;
 }
 
+/// Size of the in-memory blob cache, in bytes.
+#define BLOB_CACHE_BYTES (16 * 1024 * 1024)
+/// Blobs on disk beyond this size are deleted, least recently seen first.
+#define BLOB_QUOTA_BYTES (Q_INT64_C(128) * 1024 * 1024)
+/// How often the writer stores when blobs and comments were last seen, in
+/// milliseconds.
+#define SEEN_INTERVAL 60000
+
+/// A statement for DatabaseWriter, with its bind values.
+struct DatabaseStatement {
+	QString qsQuery;
+	QVariantList qvlValues;
+};
+
+/// Runs the writes of a Database on its own connection and thread, so they
+/// never block the caller. Everything that is pending when it wakes up
+/// goes into one transaction. Updates of when a blob or comment was last
+/// seen are collected and only written every SEEN_INTERVAL.
+class DatabaseWriter : public QThread {
+	private:
+		Q_DISABLE_COPY(DatabaseWriter)
+	protected:
+		const QString qsConnection;
+		const QString qsFileName;
+
+		QMutex qmQueue;
+		QWaitCondition qwcQueue;
+		QList<DatabaseStatement> qlStatements;
+		QSet<QByteArray> qsSeenBlobs;
+		QSet<QPair<QString, QByteArray> > qsSeenComments;
+		bool bRunning;
+		bool bFailed;
+
+		void evictBlobs(QSqlDatabase &wdb);
+		void write(QSqlDatabase &wdb, const QList<DatabaseStatement> &statements, const QSet<QByteArray> &blobs, const QSet<QPair<QString, QByteArray> > &comments);
+	public:
+		DatabaseWriter(const QString &connection, const QString &fileName);
+		/// Writes everything still pending before returning.
+		~DatabaseWriter() Q_DECL_OVERRIDE;
+
+		void enqueue(const QString &query, const QVariantList &values);
+		void seenBlob(const QByteArray &hash);
+		void seenComment(const QString &hash, const QByteArray &commenthash);
+
+		void run() Q_DECL_OVERRIDE;
+};
+
+DatabaseWriter::DatabaseWriter(const QString &connection, const QString &fileName)
+	: qsConnection(connection)
+	, qsFileName(fileName)
+	, bRunning(true)
+	, bFailed(false) {
+}
+
+DatabaseWriter::~DatabaseWriter() {
+	{
+		QMutexLocker l(&qmQueue);
+		bRunning = false;
+		qwcQueue.wakeAll();
+	}
+	wait();
+}
+
+void DatabaseWriter::enqueue(const QString &query, const QVariantList &values) {
+	QMutexLocker l(&qmQueue);
+	if (bFailed)
+		return;
+
+	DatabaseStatement ds;
+	ds.qsQuery = query;
+	ds.qvlValues = values;
+	qlStatements << ds;
+	qwcQueue.wakeAll();
+}
+
+void DatabaseWriter::seenBlob(const QByteArray &hash) {
+	QMutexLocker l(&qmQueue);
+	if (! bFailed)
+		qsSeenBlobs.insert(hash);
+}
 
-Database::Database(const QString &dbname) {
+void DatabaseWriter::seenComment(const QString &hash, const QByteArray &commenthash) {
+	QMutexLocker l(&qmQueue);
+	if (! bFailed)
+		qsSeenComments.insert(qMakePair(hash, commenthash));
+}
+
+void DatabaseWriter::run() {
+	{
+		QSqlDatabase wdb = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), qsConnection);
+		wdb.setDatabaseName(qsFileName);
+
+		if (! wdb.open()) {
+			qWarning("Database: Writer failed to open %s", qPrintable(qsFileName));
+			QMutexLocker l(&qmQueue);
+			bFailed = true;
+			qlStatements.clear();
+			qsSeenBlobs.clear();
+			qsSeenComments.clear();
+		} else {
+			QSqlQuery query(wdb);
+			execQueryAndLogFailure(query, QLatin1String("PRAGMA synchronous = NORMAL"));
+
+			evictBlobs(wdb);
+
+			QMutexLocker l(&qmQueue);
+			forever {
+				if (bRunning && qlStatements.isEmpty())
+					qwcQueue.wait(&qmQueue, SEEN_INTERVAL);
+
+				const bool running = bRunning;
+				const QList<DatabaseStatement> statements = qlStatements;
+				const QSet<QByteArray> blobs = qsSeenBlobs;
+				const QSet<QPair<QString, QByteArray> > comments = qsSeenComments;
+				qlStatements.clear();
+				qsSeenBlobs.clear();
+				qsSeenComments.clear();
+
+				l.unlock();
+				write(wdb, statements, blobs, comments);
+				l.relock();
+
+				if (! running && qlStatements.isEmpty())
+					break;
+			}
+		}
+	}
+	QSqlDatabase::removeDatabase(qsConnection);
+}
+
+void DatabaseWriter::write(QSqlDatabase &wdb, const QList<DatabaseStatement> &statements, const QSet<QByteArray> &blobs, const QSet<QPair<QString, QByteArray> > &comments) {
+	if (statements.isEmpty() && blobs.isEmpty() && comments.isEmpty())
+		return;
+
+	QSqlQuery query(wdb);
+
+	wdb.transaction();
+
+	foreach(const DatabaseStatement &ds, statements) {
+		query.prepare(ds.qsQuery);
+		foreach(const QVariant &v, ds.qvlValues)
+			query.addBindValue(v);
+		execQueryAndLogFailure(query);
+	}
+
+	if (! blobs.isEmpty()) {
+		query.prepare(QLatin1String("UPDATE `blobs` SET `seen` = datetime('now') WHERE `hash` = ?"));
+		foreach(const QByteArray &hash, blobs) {
+			query.addBindValue(hash);
+			execQueryAndLogFailure(query);
+		}
+	}
+
+	if (! comments.isEmpty()) {
+		query.prepare(QLatin1String("UPDATE `comments` SET `seen` = datetime('now') WHERE `who` = ? AND `comment` = ?"));
+		typedef QPair<QString, QByteArray> Comment;
+		foreach(const Comment &c, comments) {
+			query.addBindValue(c.first);
+			query.addBindValue(c.second);
+			execQueryAndLogFailure(query);
+		}
+	}
+
+	wdb.commit();
+}
+
+void DatabaseWriter::evictBlobs(QSqlDatabase &wdb) {
+	QSqlQuery query(wdb);
+	QList<QByteArray> evict;
+	qint64 total = 0;
+
+	query.prepare(QLatin1String("SELECT `hash`, length(`data`) FROM `blobs` ORDER BY `seen` DESC"));
+	execQueryAndLogFailure(query);
+	while (query.next()) {
+		total += query.value(1).toLongLong();
+		if (total > BLOB_QUOTA_BYTES)
+			evict << query.value(0).toByteArray();
+	}
+
+	if (evict.isEmpty())
+		return;
+
+	wdb.transaction();
+	query.prepare(QLatin1String("DELETE FROM `blobs` WHERE `hash` = ?"));
+	foreach(const QByteArray &hash, evict) {
+		query.addBindValue(hash);
+		execQueryAndLogFailure(query);
+	}
+	wdb.commit();
+}
+
+Database::Database(const QString &dbname) : dwWriter(NULL), qcBlobs(BLOB_CACHE_BYTES) {
 	db = QSqlDatabase::addDatabase(QLatin1String("QSQLITE"), dbname);
 	QSettings qs;
 	QStringList datapaths;
@@ -148,9 +341,11 @@ Database::Database(const QString &dbname) {
 
 	execQueryAndLogFailure(query, QLatin1String("CREATE TABLE IF NOT EXISTS `pingcache` (`id` INTEGER PRIMARY KEY AUTOINCREMENT, `hostname` TEXT, `port` INTEGER, `ping` INTEGER)"));
 	execQueryAndLogFailure(query, QLatin1String("CREATE UNIQUE INDEX IF NOT EXISTS `pingcache_host_port` ON `pingcache`(`hostname`,`port`)"));
+	query.exec(QLatin1String("ALTER TABLE `pingcache` ADD COLUMN `seen` DATE")); // Upgrade path, failing this query is not noteworthy
 
 	execQueryAndLogFailure(query, QLatin1String("DELETE FROM `comments` WHERE `seen` < datetime('now', '-1 years')"));
 	execQueryAndLogFailure(query, QLatin1String("DELETE FROM `blobs` WHERE `seen` < datetime('now', '-1 months')"));
+	execQueryAndLogFailure(query, QLatin1String("DELETE FROM `pingcache` WHERE `seen` IS NULL OR `seen` < datetime('now', '-1 months')"));
 
 	execQueryAndLogFailure(query, QLatin1String("VACUUM"));
 
@@ -165,9 +360,41 @@ Database::Database(const QString &dbname) {
 	execQueryAndLogFailure(query, QLatin1String("SELECT sqlite_version()"));
 	while (query.next())
 		qWarning() << "Database SQLite:" << query.value(0).toString();
+
+	// These tables are small, and read while users and channels are shown.
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash` FROM `ignored`"));
+	while (query.next())
+		qsIgnored.insert(query.value(0).toString());
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash` FROM `muted`"));
+	while (query.next())
+		qsMuted.insert(query.value(0).toString());
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash`, `volume` FROM `volume`"));
+	while (query.next())
+		qhVolume.insert(query.value(0).toString(), query.value(1).toString().toFloat());
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `server_cert_digest`, `channel_id` FROM `filtered_channels`"));
+	while (query.next())
+		qsFiltered.insert(qMakePair(query.value(0).toByteArray(), query.value(1).toInt()));
+
+	// Every user and channel with a comment is looked up on join.
+	execQueryAndLogFailure(query, QLatin1String("SELECT `who`, `comment` FROM `comments`"));
+	while (query.next())
+		qsSeenComments.insert(qMakePair(query.value(0).toString(), query.value(1).toByteArray()));
+
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash` FROM `blobs`"));
+	while (query.next())
+		qsBlobs.insert(query.value(0).toByteArray());
+
+	dwWriter = new DatabaseWriter(dbname + QLatin1String("-writer"), db.databaseName());
+	dwWriter->start(QThread::LowPriority);
 }
 
 Database::~Database() {
+	// Finish the pending writes before the file is vacuumed.
+	delete dwWriter;
+
 	QSqlQuery query(db);
 	execQueryAndLogFailure(query, QLatin1String("PRAGMA journal_mode = DELETE"));
 	execQueryAndLogFailure(query, QLatin1String("VACUUM"));
@@ -215,89 +442,64 @@ void Database::setFavorites(const QList<FavoriteServer> &servers) {
 }
 
 bool Database::isLocalIgnored(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `hash` FROM `ignored` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	return query.next();
+	return qsIgnored.contains(hash);
 }
 
 void Database::setLocalIgnored(const QString &hash, bool ignored) {
-	QSqlQuery query(db);
+	if (ignored == qsIgnored.contains(hash))
+		return;
 
-	if (ignored)
-		query.prepare(QLatin1String("INSERT INTO `ignored` (`hash`) VALUES (?)"));
-	else
-		query.prepare(QLatin1String("DELETE FROM `ignored` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+	if (ignored) {
+		qsIgnored.insert(hash);
+		dwWriter->enqueue(QLatin1String("INSERT INTO `ignored` (`hash`) VALUES (?)"), QVariantList() << hash);
+	} else {
+		qsIgnored.remove(hash);
+		dwWriter->enqueue(QLatin1String("DELETE FROM `ignored` WHERE `hash` = ?"), QVariantList() << hash);
+	}
 }
 
 bool Database::isLocalMuted(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `hash` FROM `muted` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	return query.next();
+	return qsMuted.contains(hash);
 }
 
 void Database::setUserLocalVolume(const QString &hash, float volume) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("INSERT OR REPLACE INTO `volume` (`hash`, `volume`) VALUES (?,?)"));
-	query.addBindValue(hash);
-	query.addBindValue(QString::number(volume));
-	execQueryAndLogFailure(query);
+	qhVolume.insert(hash, volume);
+	dwWriter->enqueue(QLatin1String("INSERT OR REPLACE INTO `volume` (`hash`, `volume`) VALUES (?,?)"), QVariantList() << hash << QString::number(volume));
 }
 
 float Database::getUserLocalVolume(const QString &hash) {
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("SELECT `volume` FROM `volume` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
-	if (query.first()) {
-		return query.value(0).toString().toFloat();
-	}
-	return 1.0f;
+	return qhVolume.value(hash, 1.0f);
 }
 
 void Database::setLocalMuted(const QString &hash, bool muted) {
-	QSqlQuery query(db);
+	if (muted == qsMuted.contains(hash))
+		return;
 
-	if (muted)
-		query.prepare(QLatin1String("INSERT INTO `muted` (`hash`) VALUES (?)"));
-	else
-		query.prepare(QLatin1String("DELETE FROM `muted` WHERE `hash` = ?"));
-	query.addBindValue(hash);
-	execQueryAndLogFailure(query);
+	if (muted) {
+		qsMuted.insert(hash);
+		dwWriter->enqueue(QLatin1String("INSERT INTO `muted` (`hash`) VALUES (?)"), QVariantList() << hash);
+	} else {
+		qsMuted.remove(hash);
+		dwWriter->enqueue(QLatin1String("DELETE FROM `muted` WHERE `hash` = ?"), QVariantList() << hash);
+	}
 }
 
 bool Database::isChannelFiltered(const QByteArray &server_cert_digest, const int channel_id) {
-	QSqlQuery query(db);
-	
-	query.prepare(QLatin1String("SELECT `channel_id` FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"));
-	query.addBindValue(server_cert_digest);
-	query.addBindValue(channel_id);
-	execQueryAndLogFailure(query);
-
-	return query.next();
+	return qsFiltered.contains(qMakePair(server_cert_digest, channel_id));
 }
 
 void Database::setChannelFiltered(const QByteArray &server_cert_digest, const int channel_id, const bool hidden) {
-	QSqlQuery query(db);
-	
-	if (hidden)
-		query.prepare(QLatin1String("INSERT INTO `filtered_channels` (`server_cert_digest`, `channel_id`) VALUES (?, ?)"));
-	else
-		query.prepare(QLatin1String("DELETE FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"));
-
-	query.addBindValue(server_cert_digest);
-	query.addBindValue(channel_id);
+	const QPair<QByteArray, int> key(server_cert_digest, channel_id);
+	if (hidden == qsFiltered.contains(key))
+		return;
 
-	execQueryAndLogFailure(query);
+	if (hidden) {
+		qsFiltered.insert(key);
+		dwWriter->enqueue(QLatin1String("INSERT INTO `filtered_channels` (`server_cert_digest`, `channel_id`) VALUES (?, ?)"), QVariantList() << server_cert_digest << channel_id);
+	} else {
+		qsFiltered.remove(key);
+		dwWriter->enqueue(QLatin1String("DELETE FROM `filtered_channels` WHERE `server_cert_digest` = ? AND `channel_id` = ?"), QVariantList() << server_cert_digest << channel_id);
+	}
 }
 
 QMap<UnresolvedServerAddress, unsigned int> Database::getPingCache() {
@@ -313,54 +515,47 @@ QMap<UnresolvedServerAddress, unsigned int> Database::getPingCache() {
 }
 
 void Database::setPingCache(const QMap<UnresolvedServerAddress, unsigned int> &map) {
-	QSqlQuery query(db);
 	QMap<UnresolvedServerAddress, unsigned int>::const_iterator i;
 
-	QSqlDatabase::database().transaction();
-
-	query.prepare(QLatin1String("DELETE FROM `pingcache`"));
-	execQueryAndLogFailure(query);
-
-	query.prepare(QLatin1String("REPLACE INTO `pingcache` (`hostname`, `port`, `ping`) VALUES (?,?,?)"));
-	for (i = map.constBegin(); i != map.constEnd(); ++i) {
-		query.addBindValue(i.key().hostname);
-		query.addBindValue(i.key().port);
-		query.addBindValue(i.value());
-		execQueryAndLogFailure(query);
-	}
-
-	QSqlDatabase::database().commit();
+	for (i = map.constBegin(); i != map.constEnd(); ++i)
+		dwWriter->enqueue(QLatin1String("REPLACE INTO `pingcache` (`hostname`, `port`, `ping`, `seen`) VALUES (?,?,?,datetime('now'))"), QVariantList() << i.key().hostname << i.key().port << i.value());
 }
 
 bool Database::seenComment(const QString &hash, const QByteArray &commenthash) {
-	QSqlQuery query(db);
+	if (! qsSeenComments.contains(qMakePair(hash, commenthash)))
+		return false;
 
-	query.prepare(QLatin1String("SELECT COUNT(*) FROM `comments` WHERE `who` = ? AND `comment` = ?"));
-	query.addBindValue(hash);
-	query.addBindValue(commenthash);
-	execQueryAndLogFailure(query);
-	if (query.next()) {
-		if (query.value(0).toInt() > 0) {
-			query.prepare(QLatin1String("UPDATE `comments` SET `seen` = datetime('now') WHERE `who` = ? AND `comment` = ?"));
-			query.addBindValue(hash);
-			query.addBindValue(commenthash);
-			execQueryAndLogFailure(query);
-			return true;
-		}
-	}
-	return false;
+	dwWriter->seenComment(hash, commenthash);
+	return true;
 }
 
 void Database::setSeenComment(const QString &hash, const QByteArray &commenthash) {
+	qsSeenComments.insert(qMakePair(hash, commenthash));
+	dwWriter->enqueue(QLatin1String("REPLACE INTO `comments` (`who`, `comment`, `seen`) VALUES (?, ?, datetime('now'))"), QVariantList() << hash << commenthash);
+}
+
+void Database::warmBlobCache() {
 	QSqlQuery query(db);
+	int cached = 0;
 
-	query.prepare(QLatin1String("REPLACE INTO `comments` (`who`, `comment`, `seen`) VALUES (?, ?, datetime('now'))"));
-	query.addBindValue(hash);
-	query.addBindValue(commenthash);
-	execQueryAndLogFailure(query);
+	execQueryAndLogFailure(query, QLatin1String("SELECT `hash`, `data` FROM `blobs` ORDER BY `seen` DESC"));
+	while ((cached < BLOB_CACHE_BYTES) && query.next()) {
+		const QByteArray data = query.value(1).toByteArray();
+		cached += data.size();
+		qcBlobs.insert(query.value(0).toByteArray(), new QByteArray(data), data.size());
+	}
 }
 
 QByteArray Database::blob(const QByteArray &hash) {
+	const QByteArray *cached = qcBlobs.object(hash);
+	if (cached) {
+		dwWriter->seenBlob(hash);
+		return *cached;
+	}
+
+	if (! qsBlobs.contains(hash))
+		return QByteArray();
+
 	QSqlQuery query(db);
 
 	query.prepare(QLatin1String("SELECT `data` FROM `blobs` WHERE `hash` = ?"));
@@ -369,12 +564,14 @@ QByteArray Database::blob(const QByteArray &hash) {
 	if (query.next()) {
 		QByteArray qba = query.value(0).toByteArray();
 
-		query.prepare(QLatin1String("UPDATE `blobs` SET `seen` = datetime('now') WHERE `hash` = ?"));
-		query.addBindValue(hash);
-		execQueryAndLogFailure(query);
+		qcBlobs.insert(hash, new QByteArray(qba), qba.size());
+		dwWriter->seenBlob(hash);
 
 		return qba;
 	}
+
+	// Evicted by the writer since startup.
+	qsBlobs.remove(hash);
 	return QByteArray();
 }
 
@@ -382,12 +579,9 @@ void Database::setBlob(const QByteArray &hash, const QByteArray &data) {
 	if (hash.isEmpty() || data.isEmpty())
 		return;
 
-	QSqlQuery query(db);
-
-	query.prepare(QLatin1String("REPLACE INTO `blobs` (`hash`, `data`, `seen`) VALUES (?, ?, datetime('now'))"));
-	query.addBindValue(hash);
-	query.addBindValue(data);
-	execQueryAndLogFailure(query);
+	qsBlobs.insert(hash);
+	qcBlobs.insert(hash, new QByteArray(data), data.size());
+	dwWriter->enqueue(QLatin1String("REPLACE INTO `blobs` (`hash`, `data`, `seen`) VALUES (?, ?, datetime('now'))"), QVariantList() << hash << data);
 }
 
 QStringList Database::getTokens(const QByteArray &digest) {
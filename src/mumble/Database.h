@@ -7,6 +7,9 @@
 #define MUMBLE_MUMBLE_DATABASE_H_
 
 #include <QSqlDatabase>
+#include <QtCore/QCache>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
 #include "Settings.h"
 #include "UnresolvedServerAddress.h"
 
@@ -19,12 +22,38 @@ struct FavoriteServer {
 	unsigned short usPort;
 };
 
+class DatabaseWriter;
+
+/// The client's SQLite database.
+///
+/// Lookups made while users and channels are shown (local mutes and
+/// volumes, filtered channels, seen comments and blobs) are answered from
+/// memory: the small tables are loaded once, and blobs go through a
+/// size-bounded LRU cache, warmed at startup with the most recently seen
+/// ones. Only a blob that is stored but has dropped out of the cache is
+/// read from disk. Writes to these tables, and the updates of when a blob
+/// or comment was last seen, are handed to a DatabaseWriter, which runs
+/// them in batches on its own connection and thread.
+///
+/// Instances do not share their caches, so these tables must only be
+/// used through g.db.
 class Database : public QObject {
 	private:
 		Q_OBJECT
 		Q_DISABLE_COPY(Database)
 
 		QSqlDatabase db;
+		DatabaseWriter *dwWriter;
+
+		QCache<QByteArray, QByteArray> qcBlobs;
+		/// Hashes of all stored blobs, so a blob that was never stored is
+		/// not looked for on disk.
+		QSet<QByteArray> qsBlobs;
+		QSet<QString> qsIgnored;
+		QSet<QString> qsMuted;
+		QHash<QString, float> qhVolume;
+		QSet<QPair<QByteArray, int> > qsFiltered;
+		QSet<QPair<QString, QByteArray> > qsSeenComments;
 	public:
 		Database(const QString &dbname);
 		~Database() Q_DECL_OVERRIDE;
@@ -47,11 +76,16 @@ class Database : public QObject {
 		void setChannelFiltered(const QByteArray &server_cert_digest, const int channel_id, bool hidden);
 
 		QMap<UnresolvedServerAddress, unsigned int> getPingCache();
+		/// Stores the pings of the servers in cache, leaving other entries
+		/// alone. Entries not updated for a month are dropped at startup.
 		void setPingCache(const QMap<UnresolvedServerAddress, unsigned int> &cache);
 
 		bool seenComment(const QString &hash, const QByteArray &commenthash);
 		void setSeenComment(const QString &hash, const QByteArray &commenthash);
 
+		/// Fills the blob cache with the most recently seen blobs, which
+		/// are the most likely to be shown again.
+		void warmBlobCache();
 		QByteArray blob(const QByteArray &hash);
 		void setBlob(const QByteArray &hash, const QByteArray &blob);
 
@@ -0,0 +1,157 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "LatencyProbe.h"
+
+#include "Audio.h"
+#include "ClientUser.h"
+
+#include <cmath>
+#include <cstring>
+
+// We define a global macro called 'g'. This can lead to issues when included code uses 'g' as a type or parameter name (like protobuf 3.7 does). As such, for now, we have to make this our last include.
+#include "Global.h"
+
+/// Time between markers, in microseconds.
+#define MARKER_INTERVAL 500000ULL
+/// Time after which a marker is given up, in microseconds.
+#define MARKER_TIMEOUT 2000000ULL
+/// Number of round trips kept for the report.
+#define MARKER_HISTORY 500
+/// RMS level, relative to full scale, above which decoded audio counts as
+/// the marker. The marker is sent at about -12 dB; silence stays far below.
+#define MARKER_THRESHOLD 0.05f
+
+LatencyProbe LatencyProbe::lpProbe;
+
+LatencyProbe::LatencyProbe() : aiActive(0), aiStage(Idle), cuTarget(NULL), lmPrevious(Settings::None), iMarkerSeq(0), iPacketSeq(0), uiLastMarker(0), uiPhase(0), iLost(0) {
+	for (int i = 0; i < StageCount; ++i)
+		mCurrent.uiTime[i] = 0;
+}
+
+void LatencyProbe::start() {
+	if (isActive())
+		return;
+
+	lmPrevious = g.s.lmLoopMode;
+	if (g.uiSession == 0)
+		g.s.lmLoopMode = Settings::Local;
+	else if (g.s.lmLoopMode == Settings::None)
+		g.s.lmLoopMode = Settings::Server;
+
+	if (g.s.lmLoopMode == Settings::Local)
+		cuTarget = &LoopUser::lpLoopy;
+	else
+		cuTarget = ClientUser::get(g.uiSession);
+
+	{
+		QMutexLocker l(&qmResults);
+		qlResults.clear();
+		iLost = 0;
+	}
+
+	uiLastMarker = 0;
+	aiStage.fetchAndStoreOrdered(Idle);
+	aiActive.fetchAndStoreOrdered(1);
+}
+
+void LatencyProbe::stop() {
+	if (! isActive())
+		return;
+
+	aiActive.fetchAndStoreOrdered(0);
+	g.s.lmLoopMode = lmPrevious;
+}
+
+bool LatencyProbe::isActive() const {
+	return aiActive.fetchAndAddRelaxed(0) != 0;
+}
+
+QList<LatencyProbe::Marker> LatencyProbe::markers() const {
+	QMutexLocker l(&qmResults);
+	return qlResults;
+}
+
+int LatencyProbe::lost() const {
+	QMutexLocker l(&qmResults);
+	return iLost;
+}
+
+void LatencyProbe::advance(Stage s) {
+	mCurrent.uiTime[s] = tClock.elapsed();
+	aiStage.testAndSetOrdered(s - 1, s);
+}
+
+void LatencyProbe::processInput(short *pcm, unsigned int nsamp, int seq) {
+	const quint64 now = tClock.elapsed();
+	int stage = aiStage.fetchAndAddAcquire(0);
+
+	if (stage == Mixed) {
+		QMutexLocker l(&qmResults);
+		qlResults << mCurrent;
+		while (qlResults.count() > MARKER_HISTORY)
+			qlResults.removeFirst();
+		stage = Idle;
+		aiStage.fetchAndStoreRelease(Idle);
+	} else if ((stage != Idle) && (now - mCurrent.uiTime[Captured] > MARKER_TIMEOUT)) {
+		// A stage that reports after this finds no marker and does nothing.
+		if (aiStage.testAndSetOrdered(stage, Idle)) {
+			QMutexLocker l(&qmResults);
+			++iLost;
+			stage = Idle;
+		}
+	}
+
+	if ((stage != Idle) || (now - uiLastMarker < MARKER_INTERVAL)) {
+		memset(pcm, 0, nsamp * sizeof(short));
+		return;
+	}
+
+	// A 1 kHz tone, continuous across markers.
+	for (unsigned int i = 0; i < nsamp; ++i) {
+		pcm[i] = static_cast<short>(12000.0f * sinf(static_cast<float>(uiPhase) * static_cast<float>(2.0 * M_PI * 1000.0 / SAMPLE_RATE)));
+		uiPhase = (uiPhase + 1) % (SAMPLE_RATE / 1000);
+	}
+
+	uiLastMarker = now;
+	iMarkerSeq = seq;
+	mCurrent.uiTime[Captured] = now;
+	aiStage.fetchAndStoreRelease(Captured);
+}
+
+void LatencyProbe::sent(int seq, int frames) {
+	if ((aiStage.fetchAndAddAcquire(0) != Captured) || (iMarkerSeq < seq) || (iMarkerSeq >= seq + frames))
+		return;
+
+	iPacketSeq = seq;
+	advance(Sent);
+}
+
+void LatencyProbe::received(const ClientUser *user, unsigned int seq) {
+	if ((user != cuTarget) || (aiStage.fetchAndAddAcquire(0) != Sent) || (static_cast<int>(seq) != iPacketSeq))
+		return;
+
+	advance(Received);
+}
+
+void LatencyProbe::decoded(const ClientUser *user, float rms) {
+	if ((user != cuTarget) || (rms < MARKER_THRESHOLD) || (aiStage.fetchAndAddAcquire(0) != Received))
+		return;
+
+	advance(Decoded);
+}
+
+void LatencyProbe::mixed(const ClientUser *user, const float *pcm, unsigned int nsamp) {
+	if ((user != cuTarget) || (aiStage.fetchAndAddAcquire(0) != Decoded))
+		return;
+
+	float sum = 0.0f;
+	for (unsigned int i = 0; i < nsamp; ++i)
+		sum += pcm[i] * pcm[i];
+	if (sqrtf(sum / static_cast<float>(nsamp)) < MARKER_THRESHOLD)
+		return;
+
+	advance(Mixed);
+}
@@ -0,0 +1,106 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_LATENCYPROBE_H_
+#define MUMBLE_MUMBLE_LATENCYPROBE_H_
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+
+#include "Settings.h"
+#include "Timer.h"
+
+class ClientUser;
+
+/// LatencyProbe measures the mouth-to-ear latency of the voice path.
+///
+/// While it runs, AudioInput replaces the microphone with silence and,
+/// twice a second, with one frame of a loud tone: the marker. The marker
+/// goes through the server loopback, or local loopback when not
+/// connected, and every stage it passes records the time. Only one
+/// marker is in flight at a time. A marker that has not come back after
+/// two seconds is counted as lost.
+///
+/// The hooks are called from the audio and network threads. They are
+/// cheap unless the probe is running.
+class LatencyProbe {
+	private:
+		Q_DISABLE_COPY(LatencyProbe)
+	public:
+		enum Stage {
+			/// AudioInput::addMic() replaced a frame with the marker.
+			Captured,
+			/// The packet carrying the marker was sent.
+			Sent,
+			/// The packet came back and was queued for decoding.
+			Received,
+			/// The marker was decoded.
+			Decoded,
+			/// The mixer picked up the marker.
+			Mixed,
+			StageCount
+		};
+
+		/// Times in microseconds at which one marker passed each stage.
+		struct Marker {
+			quint64 uiTime[StageCount];
+		};
+
+		static LatencyProbe lpProbe;
+
+		LatencyProbe();
+
+		/// Starts measuring, switching to server loopback if no loopback
+		/// is set. Main thread only.
+		void start();
+		/// Stops measuring and restores the loopback mode. Main thread only.
+		void stop();
+		bool isActive() const;
+
+		/// The most recent markers that made the round trip, oldest first.
+		QList<Marker> markers() const;
+		/// Number of markers that never came back.
+		int lost() const;
+
+		/// Overwrites one frame of the microphone with silence or the
+		/// marker. seq is the sequence number the frame will be sent with.
+		/// Input thread only.
+		void processInput(short *pcm, unsigned int nsamp, int seq);
+		/// A packet carrying the frames seq to seq + frames - 1 was sent.
+		/// Input thread only.
+		void sent(int seq, int frames);
+		void received(const ClientUser *user, unsigned int seq);
+		/// rms is the level of the frames just decoded for user.
+		void decoded(const ClientUser *user, float rms);
+		void mixed(const ClientUser *user, const float *pcm, unsigned int nsamp);
+	protected:
+		enum { Idle = -1 };
+
+		mutable QAtomicInt aiActive;
+		/// Last stage the marker in flight has passed, or Idle.
+		QAtomicInt aiStage;
+
+		Timer tClock;
+		const ClientUser *cuTarget;
+		Settings::LoopMode lmPrevious;
+
+		Marker mCurrent;
+		int iMarkerSeq;
+		int iPacketSeq;
+		/// When the last marker was sent, so they keep their distance.
+		quint64 uiLastMarker;
+		unsigned int uiPhase;
+
+		mutable QMutex qmResults;
+		QList<Marker> qlResults;
+		int iLost;
+
+		/// Records that the marker reached s, if it had reached the stage
+		/// before.
+		void advance(Stage s);
+};
+
+#endif
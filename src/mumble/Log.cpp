@@ -384,9 +384,7 @@ QString Log::imageToImg(QImage img) {
 	return QString();
 }
 
-QString Log::validHtml(const QString &html, QTextCursor *tc) {
-	LogDocument qtd;
-
+void Log::prepareHtml(LogDocument &qtd, const QString &html) {
 	QRectF qr = Screen::screenFromWidget(*g.mw)->availableGeometry();
 	qtd.setTextWidth(qr.width() / 2);
 	qtd.setDefaultStyleSheet(qApp->styleSheet());
@@ -399,7 +397,15 @@ QString Log::validHtml(const QString &html, QTextCursor *tc) {
 	// data URL images to run.
 	(void) qtd.documentLayout();
 	qtd.setHtml(html);
+}
 
+QString Log::validHtml(const QString &html, QTextCursor *tc) {
+	LogDocument qtd;
+	prepareHtml(qtd, html);
+	return validHtml(qtd, tc);
+}
+
+QString Log::validHtml(LogDocument &qtd, QTextCursor *tc) {
 	QStringList qslAllowed = allowedSchemes();
 	for (QTextBlock qtb = qtd.begin(); qtb != qtd.end(); qtb = qtb.next()) {
 		for (QTextBlock::iterator qtbi = qtb.begin(); qtbi != qtb.end(); ++qtbi) {
@@ -446,6 +452,10 @@ QString Log::validHtml(const QString &html, QTextCursor *tc) {
 	}
 
 	if (tc) {
+		LogDocument *ld = qobject_cast<LogDocument *>(tc->document());
+		if (ld)
+			ld->adoptImages(&qtd);
+
 		QTextCursor tcNew(&qtd);
 		tcNew.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
 		tc->insertFragment(tcNew.selection());
@@ -465,10 +475,18 @@ void Log::log(MsgType mt, const QString &console, const QString &terse, bool own
 		return;
 	}
 
-	QString plain = QTextDocumentFragment::fromHtml(console).toPlainText();
-
 	quint32 flags = g.s.qmMessages.value(mt);
 
+	// Parse the message only once. The console shows it after validation,
+	// which needs it laid out; everything else only needs the plain text.
+	LogDocument qtd;
+	if (flags & Settings::LogConsole)
+		prepareHtml(qtd, console);
+	else
+		qtd.setHtml(console);
+
+	QString plain = qtd.toPlainText();
+
 	// Message output on console
 	if ((flags & Settings::LogConsole)) {
 		QTextCursor tc = g.mw->qteLog->textCursor();
@@ -499,7 +517,7 @@ void Log::log(MsgType mt, const QString &console, const QString &terse, bool own
 		const QString timeString = dt.time().toString(QLatin1String(g.s.bLog24HourClock ? "HH:mm:ss" : "hh:mm:ss AP"));
 		tc.insertHtml(Log::msgColor(QString::fromLatin1("[%1] ").arg(timeString.toHtmlEscaped()), Log::Time));
 
-		validHtml(console, &tc);
+		validHtml(qtd, &tc);
 		tc.movePosition(QTextCursor::End);
 		g.mw->qteLog->setTextCursor(tc);
 
@@ -610,11 +628,110 @@ void Log::postQtNotification(MsgType mt, const QString &plain) {
 	}
 }
 
+/// Budget for the encoded images of the log, in bytes.
+#define LOG_IMAGE_BYTES (16 * 1024 * 1024)
+/// Budget for the decoded images of the log, in bytes.
+#define LOG_DECODED_BYTES (32 * 1024 * 1024)
+
+/// The cost of a decoded image in qcDecoded, in bytes.
+static int imageCost(const QImage &qi) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+	return static_cast<int>(qi.sizeInBytes());
+#else
+	return qi.byteCount();
+#endif
+}
+
+/// Returns the payload of a data URL, or an empty array.
+static QByteArray dataUrlPayload(const QString &url) {
+	const int comma = url.indexOf(QLatin1Char(','));
+	if (! url.startsWith(QLatin1String("data:"), Qt::CaseInsensitive) || (comma < 0))
+		return QByteArray();
+
+	const QByteArray payload = QByteArray::fromPercentEncoding(url.mid(comma + 1).toLatin1());
+	if (url.leftRef(comma).endsWith(QLatin1String(";base64"), Qt::CaseInsensitive))
+		return QByteArray::fromBase64(payload);
+	return payload;
+}
+
 LogDocument::LogDocument(QObject *p)
-	: QTextDocument(p) {
+	: QTextDocument(p)
+	, qcEncoded(LOG_IMAGE_BYTES)
+	, qcDecoded(LOG_DECODED_BYTES)
+	, uiImageId(0) {
+}
+
+void LogDocument::clear() {
+	qcEncoded.clear();
+	qcDecoded.clear();
+	QTextDocument::clear();
+}
+
+void LogDocument::adoptImages(QTextDocument *message) {
+	QHash<QString, QString> names;
+	QList<QPair<int, QTextImageFormat> > renamed;
+
+	for (QTextBlock qtb = message->begin(); qtb != message->end(); qtb = qtb.next()) {
+		for (QTextBlock::iterator qtbi = qtb.begin(); qtbi != qtb.end(); ++qtbi) {
+			const QTextFragment &qtf = qtbi.fragment();
+			if (! qtf.charFormat().isImageFormat())
+				continue;
+
+			QTextImageFormat qtif = qtf.charFormat().toImageFormat();
+			const QString name = qtif.name();
+			if (! name.startsWith(QLatin1String("data:"), Qt::CaseInsensitive))
+				continue;
+
+			if (! names.contains(name)) {
+				const QString stored = QString::fromLatin1("logimage:%1").arg(++uiImageId);
+				names.insert(name, stored);
+
+				const QByteArray payload = dataUrlPayload(name);
+				qcEncoded.insert(stored, new QByteArray(payload), payload.size());
+
+				// The message was laid out to validate it, so the image has
+				// been decoded already.
+				const QImage qi = message->resource(QTextDocument::ImageResource, QUrl(name)).value<QImage>();
+				if (! qi.isNull())
+					qcDecoded.insert(stored, new QImage(qi), imageCost(qi));
+			}
+
+			qtif.setName(names.value(name));
+			renamed << qMakePair(qtf.position(), qtif);
+		}
+	}
+
+	typedef QPair<int, QTextImageFormat> Rename;
+	foreach(const Rename &r, renamed) {
+		QTextCursor qtc(message);
+		qtc.setPosition(r.first, QTextCursor::MoveAnchor);
+		qtc.setPosition(r.first + 1, QTextCursor::KeepAnchor);
+		qtc.setCharFormat(r.second);
+	}
 }
 
 QVariant LogDocument::loadResource(int type, const QUrl &url) {
+	// Images moved to the store by adoptImages() are decoded when the
+	// layout asks for them, and never become resources of the document.
+	if ((type == QTextDocument::ImageResource) && (url.scheme() == QLatin1String("logimage"))) {
+		const QString name = url.toString();
+
+		const QImage *decoded = qcDecoded.object(name);
+		if (decoded)
+			return *decoded;
+
+		const QByteArray *encoded = qcEncoded.object(name);
+		QByteArray fmt;
+		QImage qi;
+		if (encoded && RichTextImage::isValidImage(*encoded, fmt) && qi.loadFromData(*encoded, fmt)) {
+			qcDecoded.insert(name, new QImage(qi), imageCost(qi));
+			return qi;
+		}
+
+		// Dropped from the store; the message is long out of view.
+		return QImage(1, 1, QImage::Format_Mono);
+	}
+
 	// Ignore requests for all external resources
 	// that aren't images. We don't support any of them.
 	if (type != QTextDocument::ImageResource) {
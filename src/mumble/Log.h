@@ -6,7 +6,9 @@
 #ifndef MUMBLE_MUMBLE_LOG_H_
 #define MUMBLE_MUMBLE_LOG_H_
 
+#include <QtCore/QCache>
 #include <QtCore/QDate>
+#include <QtGui/QImage>
 #include <QtGui/QTextCursor>
 #include <QtGui/QTextDocument>
 
@@ -37,6 +39,7 @@ class LogConfig : public ConfigWidget, public Ui::LogConfig {
 
 class ClientUser;
 class Channel;
+class LogDocument;
 
 class Log : public QObject {
 		friend class LogConfig;
@@ -62,6 +65,10 @@ class Log : public QObject {
 		static const QStringList allowedSchemes();
 		void postNotification(MsgType mt, const QString &plain);
 		void postQtNotification(MsgType mt, const QString &plain);
+		/// Parses html into qtd, laid out the way validHtml() needs it.
+		static void prepareHtml(LogDocument &qtd, const QString &html);
+		/// Validates the message prepared in qtd. See validHtml().
+		static QString validHtml(LogDocument &qtd, QTextCursor *tc);
 	public:
 		Log(QObject *p = NULL);
 		QString msgName(MsgType t) const;
@@ -84,6 +91,21 @@ class LogDocument : public QTextDocument {
 	public:
 		LogDocument(QObject *p = NULL);
 		QVariant loadResource(int, const QUrl &) Q_DECL_OVERRIDE;
+		void clear() Q_DECL_OVERRIDE;
+
+		/// Moves the data URL images of message, which is about to be
+		/// inserted, into the image store and renames them to match.
+		/// This keeps the images out of the resources of the document,
+		/// which are never released.
+		void adoptImages(QTextDocument *message);
+	protected:
+		/// Encoded images of recent messages, by name. The least recently
+		/// used are dropped once over budget.
+		QCache<QString, QByteArray> qcEncoded;
+		/// Decoded images, on a smaller budget. Filled when the layout
+		/// asks for an image.
+		QCache<QString, QImage> qcDecoded;
+		quint64 uiImageId;
 	public slots:
 		void finished();
 };
@@ -101,6 +101,10 @@ void MainWindow::msgServerSync(const MumbleProto::ServerSync &msg) {
 		g.sh->disconnect();
 		return;
 	}
+
+	// The whole tree has been received.
+	pmModel->endBulkSync();
+
 	g.uiSession = msg.session();
 
 	g.sh->sendPing(); // Send initial ping to establish UDP connection
@@ -290,6 +294,10 @@ void MainWindow::msgUserState(const MumbleProto::UserState &msg) {
 			return;
 		}
 
+		// Until ServerSync, the server is sending us the initial tree.
+		if (!g.uiSession)
+			pmModel->beginBulkSync();
+
 		pDst = pmModel->addUser(msg.session(), u8(msg.name()));
 
 		if (channel) {
@@ -618,6 +626,10 @@ void MainWindow::msgChannelState(const MumbleProto::ChannelState &msg) {
 	if (!c) {
 		// Addresses channel does not exist so create it
 		if (p && msg.has_name()) {
+			// Until ServerSync, the server is sending us the initial tree.
+			if (!g.uiSession)
+				pmModel->beginBulkSync();
+
 			c = pmModel->addChannel(msg.channel_id(), p, u8(msg.name()));
 			c->bTemporary = msg.temporary();
 			p = NULL; // No need to move it later
@@ -0,0 +1,191 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "NullAudio.h"
+
+#include "AudioOutputSample.h"
+
+#include <QtCore/QElapsedTimer>
+#include <algorithm>
+#include <vector>
+
+// We define a global macro called 'g'. This can lead to issues when included code uses 'g' as a type or parameter name (like protobuf 3.7 does). As such, for now, we have to make this our last include.
+#include "Global.h"
+
+class NullInputRegistrar : public AudioInputRegistrar {
+	public:
+		NullInputRegistrar();
+		virtual AudioInput *create();
+		virtual const QList<audioDevice> getDeviceChoices();
+		virtual void setDeviceChoice(const QVariant &, Settings &);
+		virtual bool canEcho(const QString &) const;
+};
+
+
+class NullOutputRegistrar : public AudioOutputRegistrar {
+	public:
+		NullOutputRegistrar();
+		virtual AudioOutput *create();
+		virtual const QList<audioDevice> getDeviceChoices();
+		virtual void setDeviceChoice(const QVariant &, Settings &);
+};
+
+static NullInputRegistrar airNull;
+static NullOutputRegistrar aorNull;
+
+// Below every real backend, so it is only picked if chosen or if there
+// is nothing else.
+NullInputRegistrar::NullInputRegistrar() : AudioInputRegistrar(QLatin1String("Null"), -1) {
+}
+
+AudioInput *NullInputRegistrar::create() {
+	return new NullInput();
+}
+
+const QList<audioDevice> NullInputRegistrar::getDeviceChoices() {
+	QList<audioDevice> qlReturn;
+
+	if (! g.s.qsNullInput.isEmpty())
+		qlReturn << audioDevice(g.s.qsNullInput, g.s.qsNullInput);
+	qlReturn << audioDevice(NullInput::tr("Silence"), QString());
+
+	return qlReturn;
+}
+
+void NullInputRegistrar::setDeviceChoice(const QVariant &choice, Settings &s) {
+	s.qsNullInput = choice.toString();
+}
+
+bool NullInputRegistrar::canEcho(const QString &) const {
+	return false;
+}
+
+NullOutputRegistrar::NullOutputRegistrar() : AudioOutputRegistrar(QLatin1String("Null"), -1) {
+}
+
+AudioOutput *NullOutputRegistrar::create() {
+	return new NullOutput();
+}
+
+const QList<audioDevice> NullOutputRegistrar::getDeviceChoices() {
+	QList<audioDevice> qlReturn;
+
+	qlReturn << audioDevice(NullOutput::tr("Discard"), QString());
+
+	return qlReturn;
+}
+
+void NullOutputRegistrar::setDeviceChoice(const QVariant &, Settings &) {
+}
+
+NullInput::NullInput() {
+	bRunning = true;
+}
+
+NullInput::~NullInput() {
+	// Signal input thread to end
+	bRunning = false;
+	wait();
+}
+
+void NullInput::run() {
+	SoundFile *sf = NULL;
+	if (! g.s.qsNullInput.isEmpty()) {
+		sf = AudioOutputSample::loadSndfile(g.s.qsNullInput);
+		if (! sf)
+			qWarning("NullInput: Failed to load %s, capturing silence", qPrintable(g.s.qsNullInput));
+	}
+
+	eMicFormat = SampleFloat;
+	iMicChannels = sf ? static_cast<unsigned int>(sf->channels()) : 1;
+	iMicFreq = sf ? static_cast<unsigned int>(sf->samplerate()) : SAMPLE_RATE;
+	initializeMixer();
+
+	qWarning("NullInput: Starting capture");
+
+	const unsigned int items = iMicLength * iMicChannels;
+	std::vector<float> buffer(items, 0.0f);
+
+	QElapsedTimer t;
+	t.start();
+	qint64 due = 0;
+
+	while (bRunning) {
+		if (sf) {
+			unsigned int got = 0;
+			bool rewound = false;
+			while (got < items) {
+				const sf_count_t l = sf->read(&buffer[got], items - got);
+				if (l > 0) {
+					got += static_cast<unsigned int>(l);
+					rewound = false;
+				} else if (! rewound) {
+					// Loop the file.
+					sf->seek(0, SEEK_SET);
+					rewound = true;
+				} else {
+					std::fill(buffer.begin() + got, buffer.end(), 0.0f);
+					break;
+				}
+			}
+		}
+
+		addMic(&buffer[0], iMicLength);
+
+		due += (static_cast<qint64>(iFrameSize) * 1000000LL) / SAMPLE_RATE;
+		const qint64 left = due - t.nsecsElapsed() / 1000;
+		if (left > 0)
+			usleep(static_cast<unsigned long>(left));
+	}
+
+	delete sf;
+
+	qWarning("NullInput: Releasing.");
+}
+
+NullOutput::NullOutput() {
+	bRunning = true;
+
+	qWarning("NullOutput: Initialized");
+}
+
+NullOutput::~NullOutput() {
+	bRunning = false;
+	// Call destructor of all children
+	wipe();
+	// Wait for terminate
+	wait();
+	qWarning("NullOutput: Destroyed");
+}
+
+void NullOutput::run() {
+	const unsigned int chanmasks[32] = {
+		SPEAKER_FRONT_LEFT,
+		SPEAKER_FRONT_RIGHT
+	};
+
+	iChannels = g.s.doPositionalAudio() ? 2 : 1;
+	iMixerFreq = SAMPLE_RATE;
+	eSampleFormat = SampleFloat;
+
+	initializeMixer(chanmasks);
+
+	qWarning("NullOutput: Starting playback");
+
+	std::vector<float> buffer(iFrameSize * iChannels);
+
+	QElapsedTimer t;
+	t.start();
+	qint64 due = 0;
+
+	while (bRunning) {
+		mix(&buffer[0], iFrameSize);
+
+		due += (static_cast<qint64>(iFrameSize) * 1000000LL) / iMixerFreq;
+		const qint64 left = due - t.nsecsElapsed() / 1000;
+		if (left > 0)
+			usleep(static_cast<unsigned long>(left));
+	}
+}
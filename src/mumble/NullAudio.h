@@ -0,0 +1,35 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_NULLAUDIO_H_
+#define MUMBLE_MUMBLE_NULLAUDIO_H_
+
+#include "AudioInput.h"
+#include "AudioOutput.h"
+
+/// Captures from the sound file in Settings::qsNullInput, looping it, or
+/// silence if none is set. Paced in real time; needs no sound card.
+class NullInput : public AudioInput {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(NullInput)
+	public:
+		NullInput();
+		~NullInput() Q_DECL_OVERRIDE;
+		void run() Q_DECL_OVERRIDE;
+};
+
+/// Mixes in real time and discards the result.
+class NullOutput : public AudioOutput {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(NullOutput)
+	public:
+		NullOutput();
+		~NullOutput() Q_DECL_OVERRIDE;
+		void run() Q_DECL_OVERRIDE;
+};
+
+#endif
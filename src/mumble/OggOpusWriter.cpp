@@ -0,0 +1,226 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "OggOpusWriter.h"
+
+#include <QtCore/QIODevice>
+
+/// A page is written out once it holds this many bytes...
+#define PAGE_BYTES 4096
+/// ...or this many samples, so a player can seek in about one second steps.
+#define PAGE_SAMPLES 48000
+/// Largest packet allowed by RFC 6716: 120 ms.
+#define MAX_PACKET_SAMPLES 5760
+
+/// Ogg's CRC-32: polynomial 0x04c11db7, unreflected, zero initial value.
+/// Pages are small and few, so it is computed bitwise.
+static quint32 oggChecksum(const QByteArray &page) {
+	quint32 crc = 0;
+	for (int i = 0; i < page.size(); ++i) {
+		crc ^= static_cast<quint32>(static_cast<unsigned char>(page.at(i))) << 24;
+		for (int b = 0; b < 8; ++b)
+			crc = (crc & 0x80000000U) ? ((crc << 1) ^ 0x04c11db7U) : (crc << 1);
+	}
+	return crc;
+}
+
+static void appendLE16(QByteArray &out, quint16 v) {
+	out.append(static_cast<char>(v & 0xff));
+	out.append(static_cast<char>((v >> 8) & 0xff));
+}
+
+static void appendLE32(QByteArray &out, quint32 v) {
+	for (int i = 0; i < 4; ++i)
+		out.append(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+static void appendLE64(QByteArray &out, quint64 v) {
+	for (int i = 0; i < 8; ++i)
+		out.append(static_cast<char>((v >> (8 * i)) & 0xff));
+}
+
+OggOpusWriter::OggOpusWriter(QIODevice *device, quint32 serial)
+	: m_device(device)
+	, m_serial(serial)
+	, m_pageSequence(0)
+	, m_granule(0)
+	, m_pageSamples(0)
+	, m_finished(false)
+	, m_ok(true) {
+}
+
+OggOpusWriter::~OggOpusWriter() {
+	finish();
+}
+
+bool OggOpusWriter::writeHeaders(const QString &title) {
+	Q_ASSERT(m_pageSequence == 0);
+
+	QByteArray head("OpusHead");
+	head.append(static_cast<char>(1)); // Version
+	head.append(static_cast<char>(1)); // Channels
+	// No pre-skip: the files of all users share one timeline starting at
+	// zero, and the encoder delay is the same everywhere.
+	appendLE16(head, 0);
+	appendLE32(head, 48000); // Original sample rate
+	appendLE16(head, 0); // Output gain
+	head.append(static_cast<char>(0)); // Mapping family: mono or stereo
+	addToPage(reinterpret_cast<const unsigned char *>(head.constData()), head.size(), 0);
+	if (! flushPage(false))
+		return false;
+
+	const QByteArray vendor("Mumble");
+	const QByteArray comment = QByteArray("TITLE=") + title.toUtf8();
+	QByteArray tags("OpusTags");
+	appendLE32(tags, static_cast<quint32>(vendor.size()));
+	tags.append(vendor);
+	appendLE32(tags, 1);
+	appendLE32(tags, static_cast<quint32>(comment.size()));
+	tags.append(comment);
+	addToPage(reinterpret_cast<const unsigned char *>(tags.constData()), tags.size(), 0);
+	return flushPage(false);
+}
+
+bool OggOpusWriter::writePacket(const unsigned char *data, int len) {
+	if (m_finished)
+		return false;
+
+	const int samples = packetSamples(data, len);
+	if (samples == 0)
+		return m_ok;
+
+	// A packet of len bytes takes len / 255 + 1 lacing values.
+	if (m_segments.size() + len / 255 + 1 > 255 && ! flushPage(false))
+		return false;
+
+	addToPage(data, len, samples);
+
+	if ((m_body.size() >= PAGE_BYTES) || (m_pageSamples >= PAGE_SAMPLES))
+		return flushPage(false);
+	return m_ok;
+}
+
+bool OggOpusWriter::writeSilence(quint64 samples) {
+	// CELT packets whose frames are all empty, which decoders treat as
+	// discontinuous transmission. 0xFB 0x06 is six 20 ms frames in one
+	// packet; 0xF8 is one 20 ms frame and 0xF0 one 10 ms frame.
+	static const unsigned char long_silence[2] = { 0xFB, 0x06 };
+	static const unsigned char frame20[1] = { 0xF8 };
+	static const unsigned char frame10[1] = { 0xF0 };
+
+	while (m_ok && (samples >= 5760)) {
+		writePacket(long_silence, 2);
+		samples -= 5760;
+	}
+	while (m_ok && (samples >= 960)) {
+		writePacket(frame20, 1);
+		samples -= 960;
+	}
+	if (m_ok && (samples >= 480))
+		writePacket(frame10, 1);
+
+	return m_ok;
+}
+
+bool OggOpusWriter::finish() {
+	if (m_finished)
+		return m_ok;
+
+	m_finished = true;
+	return flushPage(true);
+}
+
+quint64 OggOpusWriter::samplesWritten() const {
+	return m_granule;
+}
+
+int OggOpusWriter::packetSamples(const unsigned char *data, int len) {
+	if (len < 1)
+		return 0;
+
+	const unsigned int config = data[0] >> 3;
+	int frameSamples;
+	if (config < 12) {
+		// SILK: 10, 20, 40 or 60 ms
+		static const int silk[4] = { 480, 960, 1920, 2880 };
+		frameSamples = silk[config & 3];
+	} else if (config < 16) {
+		// Hybrid: 10 or 20 ms
+		frameSamples = (config & 1) ? 960 : 480;
+	} else {
+		// CELT: 2.5, 5, 10 or 20 ms
+		frameSamples = 120 << (config & 3);
+	}
+
+	int frames;
+	switch (data[0] & 3) {
+		case 0:
+			frames = 1;
+			break;
+		case 1:
+		case 2:
+			frames = 2;
+			break;
+		default:
+			if (len < 2)
+				return 0;
+			frames = data[1] & 0x3f;
+			break;
+	}
+
+	const int samples = frames * frameSamples;
+	if (samples > MAX_PACKET_SAMPLES)
+		return 0;
+	return samples;
+}
+
+void OggOpusWriter::addToPage(const unsigned char *data, int len, int samples) {
+	int left = len;
+	while (left >= 255) {
+		m_segments.append(static_cast<char>(255));
+		left -= 255;
+	}
+	m_segments.append(static_cast<char>(left));
+
+	m_body.append(reinterpret_cast<const char *>(data), len);
+	m_granule += static_cast<quint64>(samples);
+	m_pageSamples += static_cast<quint64>(samples);
+}
+
+bool OggOpusWriter::flushPage(bool eos) {
+	if (! m_ok)
+		return false;
+	if (m_segments.isEmpty() && ! eos)
+		return true;
+
+	unsigned char flags = 0;
+	if (m_pageSequence == 0)
+		flags |= 0x02; // Beginning of stream
+	if (eos)
+		flags |= 0x04; // End of stream
+
+	QByteArray page("OggS");
+	page.append(static_cast<char>(0)); // Version
+	page.append(static_cast<char>(flags));
+	appendLE64(page, m_granule);
+	appendLE32(page, m_serial);
+	appendLE32(page, m_pageSequence++);
+	appendLE32(page, 0); // Checksum, filled in below
+	page.append(static_cast<char>(m_segments.size()));
+	page.append(m_segments);
+	page.append(m_body);
+
+	const quint32 crc = oggChecksum(page);
+	for (int i = 0; i < 4; ++i)
+		page[22 + i] = static_cast<char>((crc >> (8 * i)) & 0xff);
+
+	m_segments.clear();
+	m_body.clear();
+	m_pageSamples = 0;
+
+	if (m_device->write(page) != page.size())
+		m_ok = false;
+	return m_ok;
+}
@@ -0,0 +1,72 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_OGGOPUSWRITER_H_
+#define MUMBLE_MUMBLE_OGGOPUSWRITER_H_
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+class QIODevice;
+
+/// Writes Opus packets, as they are, into an Ogg Opus stream (RFC 7845).
+///
+/// This is a minimal muxer for a single mono logical stream at 48 kHz.
+/// Packets are never split across pages. Timestamps are implicit: every
+/// packet starts where the previous one ended, and gaps are filled with
+/// writeSilence().
+class OggOpusWriter {
+	private:
+		Q_DISABLE_COPY(OggOpusWriter)
+	public:
+		/// @param device Open, writable device. Not owned.
+		/// @param serial Serial number of the logical stream.
+		OggOpusWriter(QIODevice *device, quint32 serial);
+		~OggOpusWriter();
+
+		/// Writes the OpusHead and OpusTags pages. Must be called first.
+		/// @param title Stored as the TITLE comment.
+		bool writeHeaders(const QString &title);
+
+		/// Appends one Opus packet.
+		bool writePacket(const unsigned char *data, int len);
+
+		/// Appends about |samples| samples of silence, rounded down to 10 ms.
+		bool writeSilence(quint64 samples);
+
+		/// Writes the last page, marked as the end of the stream. Nothing
+		/// can be written afterwards.
+		bool finish();
+
+		/// Number of samples written so far, at 48 kHz.
+		quint64 samplesWritten() const;
+
+		/// Returns the number of 48 kHz samples in an Opus packet, or 0 if
+		/// the packet is malformed.
+		static int packetSamples(const unsigned char *data, int len);
+	private:
+		/// Appends a packet to the current page.
+		void addToPage(const unsigned char *data, int len, int samples);
+		/// Writes out the current page.
+		bool flushPage(bool eos);
+
+		QIODevice *m_device;
+		const quint32 m_serial;
+		quint32 m_pageSequence;
+
+		/// Granule position at the end of the last packet added.
+		quint64 m_granule;
+
+		/// Segment table and body of the page being built.
+		QByteArray m_segments;
+		QByteArray m_body;
+		/// Samples in the packets of the page being built.
+		quint64 m_pageSamples;
+
+		bool m_finished;
+		bool m_ok;
+};
+
+#endif
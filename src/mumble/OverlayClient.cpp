@@ -32,6 +32,51 @@
 // We define a global macro called 'g'. This can lead to issues when included code uses 'g' as a type or parameter name (like protobuf 3.7 does). As such, for now, we have to make this our last include.
 #include "Global.h"
 
+/// Above this many damaged rectangles, a frame is sent as their union.
+#define MAX_DAMAGE_RECTS 16
+
+static qint64 area(const QRect &r) {
+	return static_cast<qint64>(r.width()) * static_cast<qint64>(r.height());
+}
+
+/// Turns the regions reported by the scene into a short list of
+/// rectangles within bounds. Rectangles are merged when they overlap, or
+/// when their bounding box is not much larger than the two of them, as
+/// every rectangle costs the helper a separate texture upload.
+static QList<QRect> damageRects(const QList<QRectF> &region, const QRect &bounds) {
+	QList<QRect> rects;
+
+	foreach(const QRectF &rf, region) {
+		QRect r = rf.toAlignedRect().intersected(bounds);
+		if (r.isEmpty())
+			continue;
+
+		int i = 0;
+		while (i < rects.count()) {
+			const QRect &o = rects.at(i);
+			const QRect u = r.united(o);
+			if (r.intersects(o) || (area(u) * 4 <= (area(r) + area(o)) * 5)) {
+				r = u;
+				rects.removeAt(i);
+				i = 0;
+			} else {
+				++i;
+			}
+		}
+		rects << r;
+	}
+
+	if (rects.count() > MAX_DAMAGE_RECTS) {
+		QRect u;
+		foreach(const QRect &r, rects)
+			u |= r;
+		rects.clear();
+		rects << u;
+	}
+
+	return rects;
+}
+
 OverlayClient::OverlayClient(QLocalSocket *socket, QObject *p)
 	: QObject(p)
 	, framesPerSecond(0)
@@ -583,51 +628,38 @@ void OverlayClient::render() {
 		return;
 
 	QRect active;
-	QRectF dirtyf;
 
-	if (region.isEmpty())
-		return;
-
-	foreach(const QRectF &r, region) {
-		dirtyf |= r;
-	}
-
-
-	QRect dirty = dirtyf.toAlignedRect();
-	dirty = dirty.intersected(QRect(0,0,uiWidth, uiHeight));
-
-	if ((dirty.width() <= 0) || (dirty.height() <= 0))
+	const QList<QRect> dirty = damageRects(region, QRect(0, 0, uiWidth, uiHeight));
+	if (dirty.isEmpty())
 		return;
 
-	QRect target = dirty;
-	target.moveTo(0,0);
-
+	// Render straight into the shared memory, one damaged rectangle at
+	// a time: clear it, then draw the scene over it.
 	QImage img(reinterpret_cast<unsigned char *>(smMem->data()), uiWidth, uiHeight, QImage::Format_ARGB32_Premultiplied);
-	QImage qi(target.size(), QImage::Format_ARGB32_Premultiplied);
-	qi.fill(0);
 
 	QPainter p;
-	p.begin(&qi);
-	p.setRenderHints(p.renderHints(), false);
-	p.setCompositionMode(QPainter::CompositionMode_SourceOver);
-	qgs.render(&p, target, dirty, Qt::IgnoreAspectRatio);
-	p.end();
-
 	p.begin(&img);
 	p.setRenderHints(p.renderHints(), false);
-	p.setCompositionMode(QPainter::CompositionMode_Source);
-	p.drawImage(dirty.x(), dirty.y(), qi);
+	foreach(const QRect &r, dirty) {
+		p.setClipRect(r);
+		p.setCompositionMode(QPainter::CompositionMode_Source);
+		p.fillRect(r, Qt::transparent);
+		p.setCompositionMode(QPainter::CompositionMode_SourceOver);
+		qgs.render(&p, r, r, Qt::IgnoreAspectRatio);
+	}
 	p.end();
 
-	if (dirty.isValid()) {
+	// The helpers collect the rectangles of all BLIT messages they read
+	// before uploading, so each one is sent on its own.
+	foreach(const QRect &r, dirty) {
 		OverlayMsg om;
 		om.omh.uiMagic = OVERLAY_MAGIC_NUMBER;
 		om.omh.uiType = OVERLAY_MSGTYPE_BLIT;
 		om.omh.iLength = sizeof(OverlayMsgBlit);
-		om.omb.x = dirty.x();
-		om.omb.y = dirty.y();
-		om.omb.w = dirty.width();
-		om.omb.h = dirty.height();
+		om.omb.x = r.x();
+		om.omb.y = r.y();
+		om.omb.w = r.width();
+		om.omb.h = r.height();
 		qlsSocket->write(om.headerbuffer, sizeof(OverlayMsgHeader) + sizeof(OverlayMsgBlit));
 	}
 
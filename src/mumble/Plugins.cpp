@@ -16,6 +16,7 @@
 #include "Utils.h"
 
 #include <QtCore/QLibrary>
+#include <QtCore/QThread>
 #include <QtCore/QUrlQuery>
 
 #ifdef Q_OS_WIN
@@ -207,6 +208,60 @@ void PluginConfig::on_qtwPlugins_currentItemChanged(QTreeWidgetItem *current, QT
 	}
 }
 
+/// Fetches positional data every Settings::iPositionalPollInterval
+/// milliseconds and publishes it for the audio threads.
+class PluginPoller : public QThread {
+	private:
+		Q_DISABLE_COPY(PluginPoller)
+	protected:
+		Plugins *pPlugins;
+		bool bRunning;
+	public:
+		PluginPoller(Plugins *p);
+		~PluginPoller() Q_DECL_OVERRIDE;
+		void run() Q_DECL_OVERRIDE;
+};
+
+PluginPoller::PluginPoller(Plugins *p) : pPlugins(p), bRunning(true) {
+}
+
+PluginPoller::~PluginPoller() {
+	bRunning = false;
+	wait();
+}
+
+void PluginPoller::run() {
+	while (bRunning) {
+		pPlugins->fetch();
+		pPlugins->publish();
+
+		msleep(static_cast<unsigned long>(qBound(1, g.s.iPositionalPollInterval, 1000)));
+	}
+}
+
+static void lerp3(const float *a, const float *b, float t, float *out) {
+	for (int i = 0; i < 3; ++i)
+		out[i] = a[i] + t * (b[i] - a[i]);
+}
+
+void PositionalSnapshot::interpolate(quint64 time, PositionalSample &out) const {
+	float t = 1.0f;
+	if ((psCurrent.uiTime > psPrevious.uiTime) && (time < psCurrent.uiTime)) {
+		if (time <= psPrevious.uiTime)
+			t = 0.0f;
+		else
+			t = static_cast<float>(time - psPrevious.uiTime) / static_cast<float>(psCurrent.uiTime - psPrevious.uiTime);
+	}
+
+	out.uiTime = time;
+	lerp3(psPrevious.fPosition, psCurrent.fPosition, t, out.fPosition);
+	lerp3(psPrevious.fFront, psCurrent.fFront, t, out.fFront);
+	lerp3(psPrevious.fTop, psCurrent.fTop, t, out.fTop);
+	lerp3(psPrevious.fCameraPosition, psCurrent.fCameraPosition, t, out.fCameraPosition);
+	lerp3(psPrevious.fCameraFront, psCurrent.fCameraFront, t, out.fCameraFront);
+	lerp3(psPrevious.fCameraTop, psCurrent.fCameraTop, t, out.fCameraTop);
+}
+
 Plugins::Plugins(QObject *p) : QObject(p) {
 	QTimer *timer=new QTimer(this);
 	timer->setObjectName(QLatin1String("Timer"));
@@ -215,9 +270,11 @@ Plugins::Plugins(QObject *p) : QObject(p) {
 	bValid = false;
 	iPluginTry = 0;
 	for (int i=0;i<3;i++)
-		fPosition[i]=fFront[i]=fTop[i]= 0.0;
+		fPosition[i]=fFront[i]=fTop[i]=fCameraPosition[i]=fCameraFront[i]=fCameraTop[i]= 0.0;
 	QMetaObject::connectSlotsByName(this);
 
+	psSnapshot[0].bValid = psSnapshot[1].bValid = false;
+
 #ifdef QT_NO_DEBUG
 #ifndef PLUGIN_PATH
 	qsSystemPlugins=QString::fromLatin1("%1/plugins").arg(MumbleApplication::instance()->applicationVersionRootPath());
@@ -258,9 +315,14 @@ Plugins::Plugins(QObject *p) : QObject(p) {
 
 	AdjustTokenPrivileges(hToken, FALSE, &tp, sizeof(TOKEN_PRIVILEGES), &tpPrevious, &cbPrevious);
 #endif
+
+	ppPoller = new PluginPoller(this);
+	ppPoller->start();
 }
 
 Plugins::~Plugins() {
+	delete ppPoller;
+
 	clearPlugins();
 
 #ifdef Q_OS_WIN
@@ -419,9 +481,62 @@ bool Plugins::fetch() {
 	return bValid;
 }
 
-void Plugins::on_Timer_timeout() {
-	fetch();
+void Plugins::publish() {
+	PositionalSample ps;
+	ps.uiTime = tClock.elapsed();
+	for (int i=0;i<3;++i) {
+		ps.fPosition[i] = fPosition[i];
+		ps.fFront[i] = fFront[i];
+		ps.fTop[i] = fTop[i];
+		ps.fCameraPosition[i] = fCameraPosition[i];
+		ps.fCameraFront[i] = fCameraFront[i];
+		ps.fCameraTop[i] = fCameraTop[i];
+	}
+
+	// Only this thread publishes, so the generation can't change here.
+	const int gen = aiSnapshotGen.fetchAndAddRelaxed(0);
+	const PositionalSnapshot &latest = psSnapshot[gen & 1];
+	const int slot = (gen + 1) & 1;
+	PositionalSnapshot &next = psSnapshot[slot];
 
+	aiSnapshotSeq[slot].fetchAndAddOrdered(1);
+	// Don't interpolate from before the plugin was linked.
+	next.psPrevious = (bValid && latest.bValid) ? latest.psCurrent : ps;
+	next.psCurrent = ps;
+	next.bValid = bValid;
+	aiSnapshotSeq[slot].fetchAndAddRelease(1);
+
+	aiSnapshotGen.fetchAndAddRelease(1);
+}
+
+bool Plugins::snapshot(PositionalSnapshot &ps) const {
+	forever {
+		const int slot = aiSnapshotGen.fetchAndAddAcquire(0) & 1;
+		const int seq = aiSnapshotSeq[slot].fetchAndAddAcquire(0);
+		// Only if a second publish() started since the generation was
+		// read. The other slot is complete by now, so just look again.
+		if (seq & 1)
+			continue;
+
+		ps = psSnapshot[slot];
+		if (aiSnapshotSeq[slot].fetchAndAddRelease(0) == seq)
+			return ps.bValid;
+	}
+}
+
+bool Plugins::position(PositionalSample &out) const {
+	PositionalSnapshot ps;
+	if (! snapshot(ps))
+		return false;
+
+	// Look one poll back, so there is a later sample to interpolate to.
+	const quint64 delay = static_cast<quint64>(qMax(g.s.iPositionalPollInterval, 0)) * 1000ULL;
+	const quint64 now = tClock.elapsed();
+	ps.interpolate((now > delay) ? (now - delay) : 0, out);
+	return true;
+}
+
+void Plugins::on_Timer_timeout() {
 	QReadLocker lock(&qrwlPlugins);
 
 	if (prevlocked) {
@@ -14,12 +14,36 @@
 # include "win.h"
 #endif
 
+#include <QtCore/QAtomicInt>
 #include <QtCore/QObject>
 #include <QtCore/QMutex>
 #include <QtCore/QReadWriteLock>
 #include <QtCore/QUrl>
 
+#include "Timer.h"
+
 struct PluginInfo;
+class PluginPoller;
+
+/// Positional data from one fetch.
+struct PositionalSample {
+	/// When it was fetched, in microseconds on Plugins::tClock.
+	quint64 uiTime;
+	float fPosition[3], fFront[3], fTop[3];
+	float fCameraPosition[3], fCameraFront[3], fCameraTop[3];
+};
+
+/// The positional data the audio threads see: the last two fetches, so
+/// positions can be interpolated between them.
+struct PositionalSnapshot {
+	bool bValid;
+	PositionalSample psPrevious;
+	PositionalSample psCurrent;
+
+	/// Returns the position at time, linearly interpolated between the
+	/// two samples and clamped to them.
+	void interpolate(quint64 time, PositionalSample &out) const;
+};
 
 class PluginConfig : public ConfigWidget, public Ui::PluginConfig {
 	private:
@@ -45,6 +69,7 @@ struct PluginFetchMeta;
 
 class Plugins : public QObject {
 		friend class PluginConfig;
+		friend class PluginPoller;
 	private:
 		Q_OBJECT
 		Q_DISABLE_COPY(Plugins)
@@ -59,6 +84,19 @@ class Plugins : public QObject {
 		QMap<QString, PluginFetchMeta> qmPluginFetchMeta;
 		QString qsSystemPlugins;
 		QString qsUserPlugins;
+
+		/// Polls the linked plugin, so the audio threads never call into it.
+		PluginPoller *ppPoller;
+		/// Number of snapshots published. The latest is in
+		/// psSnapshot[aiSnapshotGen & 1]; publish() writes the other slot
+		/// and then increments this, so readers rarely meet a write.
+		mutable QAtomicInt aiSnapshotGen;
+		/// Sequence lock for each slot: odd while it is being written.
+		mutable QAtomicInt aiSnapshotSeq[2];
+		PositionalSnapshot psSnapshot[2];
+
+		/// Publishes the result of the last fetch(). Poller thread only.
+		void publish();
 #ifdef Q_OS_WIN
 		HANDLE hToken;
 		TOKEN_PRIVILEGES tpPrevious;
@@ -69,14 +107,27 @@ class Plugins : public QObject {
 		std::wstring swsIdentity, swsIdentitySent;
 		bool bValid;
 		bool bUnlink;
+		/// Written by fetch() on the poller thread. Other threads read
+		/// the positional data with snapshot() or position().
 		float fPosition[3], fFront[3], fTop[3];
 		float fCameraPosition[3], fCameraFront[3], fCameraTop[3];
 
+		Timer tClock;
+
 		Plugins(QObject *p = NULL);
 		~Plugins() Q_DECL_OVERRIDE;
+
+		/// Copies the last published positional data without locking.
+		/// Returns whether it is valid.
+		bool snapshot(PositionalSnapshot &ps) const;
+		/// Returns the positional data as of one poll interval ago,
+		/// interpolated between polls, without locking or system calls.
+		/// Returns whether it is valid.
+		bool position(PositionalSample &out) const;
 	public slots:
 		void on_Timer_timeout();
 		void rescanPlugins();
+		/// Fetches from the linked plugin. Poller thread only.
 		bool fetch();
 		void checkUpdates();
 		void fetchedUpdatePAPlugins(QByteArray, QUrl);
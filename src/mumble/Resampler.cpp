@@ -0,0 +1,323 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "Resampler.h"
+
+#include "AudioMixKernels.h"
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QPair>
+#include <QtCore/QWeakPointer>
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+# define RESAMPLE_X86
+# include <emmintrin.h>
+# include <immintrin.h>
+# if defined(__GNUC__)
+#  define RESAMPLE_TARGET_SSE2 __attribute__((target("sse2")))
+#  define RESAMPLE_TARGET_AVX2 __attribute__((target("avx2")))
+# else
+#  define RESAMPLE_TARGET_SSE2
+#  define RESAMPLE_TARGET_AVX2
+# endif
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+# define RESAMPLE_NEON
+# include <arm_neon.h>
+#endif
+
+/// Phases above this are approximated by the nearest stored one.
+#define MAX_PHASES 1024
+
+/// Filter length, cutoff relative to the lower Nyquist frequency, and
+/// Kaiser window beta for each quality.
+static const unsigned int qualityTaps[11] = { 8, 16, 32, 48, 64, 80, 96, 128, 160, 192, 256 };
+static const double qualityCutoff[11] = { 0.830, 0.850, 0.882, 0.895, 0.910, 0.922, 0.940, 0.940, 0.945, 0.950, 0.975 };
+static const double qualityBeta[11] = { 4.0, 5.0, 6.0, 6.5, 7.0, 7.5, 8.0, 8.5, 9.0, 9.5, 10.0 };
+
+struct ResamplerFilter {
+	unsigned int uiTaps;
+	/// Output steps uiStep / uiPhases input samples; both reduced by
+	/// their greatest common divisor.
+	unsigned int uiStep;
+	unsigned int uiPhases;
+	/// Phases actually stored; less than uiPhases for odd rate pairs.
+	unsigned int uiStored;
+	/// uiStored phases of uiTaps coefficients each. When phases are
+	/// approximated, one more follows with a delay of a whole sample, for
+	/// those that round up past the last one.
+	std::vector<float> vCoeffs;
+
+	const float *coeffs(unsigned int phase) const {
+		if (uiStored == uiPhases)
+			return &vCoeffs[phase * uiTaps];
+		const quint64 p = (static_cast<quint64>(phase) * uiStored + uiPhases / 2) / uiPhases;
+		return &vCoeffs[static_cast<unsigned int>(p) * uiTaps];
+	}
+};
+
+typedef QPair<QPair<unsigned int, unsigned int>, int> FilterKey;
+
+static QMutex qmFilters;
+static QHash<FilterKey, QWeakPointer<const ResamplerFilter> > qhFilters;
+
+static unsigned int gcd(unsigned int a, unsigned int b) {
+	while (b) {
+		const unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/// Zeroth order modified Bessel function of the first kind.
+static double besselI0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 50; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+static QSharedPointer<const ResamplerFilter> makeFilter(unsigned int inRate, unsigned int outRate, int quality) {
+	ResamplerFilter *f = new ResamplerFilter();
+
+	const unsigned int d = gcd(inRate, outRate);
+	f->uiTaps = qualityTaps[quality];
+	f->uiStep = inRate / d;
+	f->uiPhases = outRate / d;
+	f->uiStored = qMin(f->uiPhases, static_cast<unsigned int>(MAX_PHASES));
+	const unsigned int rows = (f->uiStored == f->uiPhases) ? f->uiStored : (f->uiStored + 1);
+	f->vCoeffs.resize(rows * f->uiTaps);
+
+	// Windowed sinc, cut off below the lower of the two Nyquist
+	// frequencies. Phase p is the kernel delayed by p / uiStored samples.
+	const double cutoff = qualityCutoff[quality] * qMin(1.0, static_cast<double>(outRate) / static_cast<double>(inRate));
+	const double beta = qualityBeta[quality];
+	const double half = static_cast<double>(f->uiTaps) / 2.0;
+	const double norm = besselI0(beta);
+
+	for (unsigned int p = 0; p < rows; ++p) {
+		float *c = &f->vCoeffs[p * f->uiTaps];
+		const double frac = static_cast<double>(p) / static_cast<double>(f->uiStored);
+		double sum = 0.0;
+		for (unsigned int k = 0; k < f->uiTaps; ++k) {
+			const double x = static_cast<double>(k) - (half - 1.0) - frac;
+			const double y = cutoff * x;
+			const double sinc = (fabs(y) < 1e-9) ? 1.0 : sin(M_PI * y) / (M_PI * y);
+			const double r = x / half;
+			const double w = (fabs(r) < 1.0) ? besselI0(beta * sqrt(1.0 - r * r)) / norm : 0.0;
+			const double v = cutoff * sinc * w;
+			c[k] = static_cast<float>(v);
+			sum += v;
+		}
+		// Unity gain at DC for every phase.
+		for (unsigned int k = 0; k < f->uiTaps; ++k)
+			c[k] = static_cast<float>(c[k] / sum);
+	}
+
+	return QSharedPointer<const ResamplerFilter>(f);
+}
+
+static QSharedPointer<const ResamplerFilter> sharedFilter(unsigned int inRate, unsigned int outRate, int quality) {
+	const FilterKey key(qMakePair(inRate, outRate), quality);
+
+	QMutexLocker l(&qmFilters);
+	QSharedPointer<const ResamplerFilter> f = qhFilters.value(key).toStrongRef();
+	if (! f) {
+		f = makeFilter(inRate, outRate, quality);
+		qhFilters.insert(key, f);
+	}
+	return f;
+}
+
+static float dotScalar(const float * RESTRICT in, const float * RESTRICT coeffs, unsigned int taps) {
+	float sum = 0.0f;
+	for (unsigned int i = 0; i < taps; ++i)
+		sum += in[i] * coeffs[i];
+	return sum;
+}
+
+#ifdef RESAMPLE_X86
+static RESAMPLE_TARGET_SSE2 float dotSSE2(const float * RESTRICT in, const float * RESTRICT coeffs, unsigned int taps) {
+	__m128 a = _mm_setzero_ps();
+	__m128 b = _mm_setzero_ps();
+	for (unsigned int i = 0; i < taps; i += 8) {
+		a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(in + i), _mm_loadu_ps(coeffs + i)));
+		b = _mm_add_ps(b, _mm_mul_ps(_mm_loadu_ps(in + i + 4), _mm_loadu_ps(coeffs + i + 4)));
+	}
+	a = _mm_add_ps(a, b);
+	a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+	a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+	return _mm_cvtss_f32(a);
+}
+
+static RESAMPLE_TARGET_AVX2 float dotAVX2(const float * RESTRICT in, const float * RESTRICT coeffs, unsigned int taps) {
+	__m256 a = _mm256_setzero_ps();
+	for (unsigned int i = 0; i < taps; i += 8)
+		a = _mm256_add_ps(a, _mm256_mul_ps(_mm256_loadu_ps(in + i), _mm256_loadu_ps(coeffs + i)));
+	__m128 s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+	s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+	return _mm_cvtss_f32(s);
+}
+#endif
+
+#ifdef RESAMPLE_NEON
+static float dotNEON(const float * RESTRICT in, const float * RESTRICT coeffs, unsigned int taps) {
+	float32x4_t a = vdupq_n_f32(0.0f);
+	float32x4_t b = vdupq_n_f32(0.0f);
+	for (unsigned int i = 0; i < taps; i += 8) {
+		a = vmlaq_f32(a, vld1q_f32(in + i), vld1q_f32(coeffs + i));
+		b = vmlaq_f32(b, vld1q_f32(in + i + 4), vld1q_f32(coeffs + i + 4));
+	}
+	return vaddvq_f32(vaddq_f32(a, b));
+}
+#endif
+
+static const ResamplerKernels kScalar = { "scalar", dotScalar };
+#ifdef RESAMPLE_X86
+static const ResamplerKernels kSSE2 = { "sse2", dotSSE2 };
+static const ResamplerKernels kAVX2 = { "avx2", dotAVX2 };
+#endif
+#ifdef RESAMPLE_NEON
+static const ResamplerKernels kNEON = { "neon", dotNEON };
+#endif
+
+const ResamplerKernels &ResamplerKernels::scalar() {
+	return kScalar;
+}
+
+QList<const ResamplerKernels *> ResamplerKernels::available() {
+	QList<const ResamplerKernels *> ql;
+	ql << &kScalar;
+#ifdef RESAMPLE_X86
+	if (AudioMixKernels::cpuHasSSE2()) {
+		ql << &kSSE2;
+		if (AudioMixKernels::cpuHasAVX2())
+			ql << &kAVX2;
+	}
+#endif
+#ifdef RESAMPLE_NEON
+	ql << &kNEON;
+#endif
+	return ql;
+}
+
+const ResamplerKernels &ResamplerKernels::best() {
+	static const ResamplerKernels *k = available().last();
+	return *k;
+}
+
+Resampler::Resampler(unsigned int channels, unsigned int inRate, unsigned int outRate, int quality)
+	: qspFilter(sharedFilter(inRate, outRate, qBound(0, quality, 10)))
+	, rkKernels(&ResamplerKernels::best())
+	, uiChannels(qMax(channels, 1U))
+	, uiCapacity(0)
+	, uiFill(0)
+	, uiIndex(0)
+	, uiPhase(0) {
+	// Room for 100ms of input without growing.
+	reserve(qspFilter->uiTaps + inRate / 10);
+	reset();
+}
+
+Resampler::~Resampler() {
+}
+
+void Resampler::reserve(unsigned int samples) {
+	if (samples <= uiCapacity)
+		return;
+
+	std::vector<float> v(samples * uiChannels, 0.0f);
+	for (unsigned int c = 0; c < uiChannels; ++c)
+		if (uiFill)
+			memcpy(&v[c * samples], &vHistory[c * uiCapacity], uiFill * sizeof(float));
+	vHistory.swap(v);
+	uiCapacity = samples;
+}
+
+void Resampler::reset() {
+	// Start with a filter's worth of silence, so every call yields as
+	// much output as its input allows. This delays the output by
+	// latency() samples.
+	uiFill = qspFilter->uiTaps - 1;
+	for (unsigned int c = 0; c < uiChannels; ++c)
+		memset(&vHistory[c * uiCapacity], 0, uiFill * sizeof(float));
+	uiIndex = 0;
+	uiPhase = 0;
+}
+
+unsigned int Resampler::latency() const {
+	return qspFilter->uiTaps / 2;
+}
+
+void Resampler::setKernels(const ResamplerKernels &k) {
+	rkKernels = &k;
+}
+
+int Resampler::sharedFilters() {
+	QMutexLocker l(&qmFilters);
+	int n = 0;
+	foreach(const QWeakPointer<const ResamplerFilter> &f, qhFilters)
+		if (f.toStrongRef())
+			++n;
+	return n;
+}
+
+unsigned int Resampler::process(const float *in, unsigned int nin, float *out, unsigned int nout) {
+	const ResamplerFilter *f = qspFilter.data();
+	const unsigned int taps = f->uiTaps;
+	const unsigned int advance = f->uiStep / f->uiPhases;
+	const unsigned int step = f->uiStep % f->uiPhases;
+	const ResamplerKernels::dotFunc dot = rkKernels->dot;
+
+	reserve(uiFill + nin);
+
+	// Deinterleave the input after the history.
+	for (unsigned int c = 0; c < uiChannels; ++c) {
+		float *h = &vHistory[c * uiCapacity + uiFill];
+		for (unsigned int i = 0; i < nin; ++i)
+			h[i] = in[i * uiChannels + c];
+	}
+	uiFill += nin;
+
+	unsigned int produced = 0;
+	while ((produced < nout) && (uiIndex + taps <= uiFill)) {
+		const float *coeffs = f->coeffs(uiPhase);
+		for (unsigned int c = 0; c < uiChannels; ++c)
+			out[produced * uiChannels + c] = dot(&vHistory[c * uiCapacity + uiIndex], coeffs, taps);
+		++produced;
+
+		uiIndex += advance;
+		uiPhase += step;
+		if (uiPhase >= f->uiPhases) {
+			uiPhase -= f->uiPhases;
+			++uiIndex;
+		}
+	}
+
+	// Drop the input no later output needs.
+	const unsigned int drop = qMin(uiIndex, uiFill);
+	if (drop) {
+		for (unsigned int c = 0; c < uiChannels; ++c) {
+			float *h = &vHistory[c * uiCapacity];
+			memmove(h, h + drop, (uiFill - drop) * sizeof(float));
+		}
+		uiFill -= drop;
+		uiIndex -= drop;
+	}
+
+	return produced;
+}
@@ -0,0 +1,87 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_RESAMPLER_H_
+#define MUMBLE_MUMBLE_RESAMPLER_H_
+
+#include <QtCore/QList>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QtGlobal>
+
+#include <vector>
+
+struct ResamplerFilter;
+
+/// ResamplerKernels holds the inner loop of Resampler: one filter phase
+/// applied to the input history. Unlike AudioMixKernels, the vector
+/// implementations sum in a different order than the scalar one, so
+/// results differ in the last bits.
+struct ResamplerKernels {
+	/// Returns the sum of in[i] * coeffs[i] for i < taps. taps is always
+	/// a multiple of 8.
+	typedef float (*dotFunc)(const float * RESTRICT in, const float * RESTRICT coeffs, unsigned int taps);
+
+	const char *name;
+	dotFunc dot;
+
+	/// The portable reference implementation.
+	static const ResamplerKernels &scalar();
+	/// The fastest implementation supported by this CPU.
+	static const ResamplerKernels &best();
+	/// All implementations supported by this CPU, slowest first.
+	static QList<const ResamplerKernels *> available();
+};
+
+/// A polyphase FIR sample rate converter for interleaved float audio.
+///
+/// The filter bank depends only on the two rates and the quality, so it
+/// is computed once and shared by all resamplers converting between the
+/// same rates. A Resampler only holds the input history and the phase.
+///
+/// quality goes from 0 to 10, like speex_resampler_init(). Higher
+/// qualities use longer filters: 8 taps at 0, 48 at 3 and 256 at 10. The
+/// delay is half the filter length, in input samples.
+class Resampler {
+	private:
+		Q_DISABLE_COPY(Resampler)
+	protected:
+		QSharedPointer<const ResamplerFilter> qspFilter;
+		const ResamplerKernels *rkKernels;
+		const unsigned int uiChannels;
+
+		/// Input history, one run of uiFill samples per channel, each
+		/// uiCapacity apart.
+		std::vector<float> vHistory;
+		unsigned int uiCapacity;
+		unsigned int uiFill;
+		/// Position of the next output: the first history sample of its
+		/// window, and the phase between it and the next one.
+		unsigned int uiIndex;
+		unsigned int uiPhase;
+
+		void reserve(unsigned int samples);
+	public:
+		Resampler(unsigned int channels, unsigned int inRate, unsigned int outRate, int quality);
+		~Resampler();
+
+		/// Reads nin interleaved input frames and writes at most nout
+		/// output frames. Returns the number of frames written. Input that
+		/// could not be used yet is kept for the next call.
+		unsigned int process(const float *in, unsigned int nin, float *out, unsigned int nout);
+
+		/// Forgets the input history.
+		void reset();
+
+		/// Delay in input frames.
+		unsigned int latency() const;
+
+		/// Uses the given kernels instead of ResamplerKernels::best().
+		void setKernels(const ResamplerKernels &k);
+
+		/// Number of distinct filter banks in use, for the benchmark.
+		static int sharedFilters();
+};
+
+#endif
@@ -0,0 +1,242 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MUMBLE_SPSCRING_H_
+#define MUMBLE_MUMBLE_SPSCRING_H_
+
+#include <QtCore/QAtomicInt>
+
+#include <string.h>
+
+static inline int spscLoadAcquire(QAtomicInt &ai) {
+#if QT_VERSION >= 0x050000
+	return ai.loadAcquire();
+#else
+	return ai.fetchAndAddAcquire(0);
+#endif
+}
+
+static inline void spscStoreRelease(QAtomicInt &ai, int v) {
+#if QT_VERSION >= 0x050000
+	ai.storeRelease(v);
+#else
+	ai.fetchAndStoreRelease(v);
+#endif
+}
+
+/// SPSCRing is a bounded, wait-free queue for exactly one producer and one
+/// consumer thread. All N slots are allocated up front, and neither side
+/// ever blocks or allocates, which makes it safe to use from real-time
+/// audio callbacks.
+///
+/// N must be a power of two. The head and tail indices run modulo 2*N so
+/// that a full ring can be told apart from an empty one without wasting a
+/// slot.
+///
+/// The producer fills a slot returned by beginPush() in place and publishes
+/// it with commitPush(). The consumer reads the slot returned by front()
+/// in place and releases it with pop().
+template <typename T, unsigned int N>
+class SPSCRing {
+	private:
+		Q_DISABLE_COPY(SPSCRing)
+
+		T tSlots[N];
+		/// Index of the next slot to be written. Only the producer writes it.
+		QAtomicInt aiHead;
+		/// Index of the next slot to be read. Only the consumer writes it.
+		QAtomicInt aiTail;
+
+		static int used(int head, int tail) {
+			return (head - tail) & (2 * N - 1);
+		}
+	public:
+		enum { Capacity = N };
+
+		SPSCRing() : aiHead(0), aiTail(0) {
+			Q_ASSERT((N & (N - 1)) == 0);
+		}
+
+		/// Returns the next free slot, or NULL if the ring is full.
+		/// Producer only.
+		T *beginPush() {
+			const int head = spscLoadAcquire(aiHead);
+			if (used(head, spscLoadAcquire(aiTail)) == static_cast<int>(N))
+				return NULL;
+			return &tSlots[head & (N - 1)];
+		}
+
+		/// Makes the slot returned by beginPush() visible to the consumer.
+		/// Producer only.
+		void commitPush() {
+			spscStoreRelease(aiHead, (spscLoadAcquire(aiHead) + 1) & (2 * N - 1));
+		}
+
+		/// Copies v into the ring. Returns false if the ring is full.
+		/// Producer only.
+		bool push(const T &v) {
+			T *slot = beginPush();
+			if (! slot)
+				return false;
+			*slot = v;
+			commitPush();
+			return true;
+		}
+
+		/// Returns the oldest queued slot, or NULL if the ring is empty.
+		/// Consumer only.
+		T *front() {
+			const int tail = spscLoadAcquire(aiTail);
+			if (used(spscLoadAcquire(aiHead), tail) == 0)
+				return NULL;
+			return &tSlots[tail & (N - 1)];
+		}
+
+		/// Releases the slot returned by front() back to the producer.
+		/// Consumer only.
+		void pop() {
+			spscStoreRelease(aiTail, (spscLoadAcquire(aiTail) + 1) & (2 * N - 1));
+		}
+};
+
+/// SPSCSampleRing is the bulk counterpart of SPSCRing for audio samples of
+/// type T: one producer writes runs of samples, one consumer reads them,
+/// and neither ever blocks or allocates.
+///
+/// The ring is followed by a mirror of its first maxView() samples. Every
+/// write of up to maxView() samples that wraps around lands in the mirror
+/// and is copied back, and every write near the start is copied to the
+/// mirror, so both sides can always get a contiguous view of up to
+/// maxView() samples without copying the audio itself.
+template <typename T>
+class SPSCSampleRing {
+	private:
+		Q_DISABLE_COPY(SPSCSampleRing)
+
+		T *ptData;
+		unsigned int uiSize;
+		unsigned int uiMirror;
+		/// Both indices run modulo 2 * uiSize; see SPSCRing.
+		QAtomicInt aiHead;
+		QAtomicInt aiTail;
+
+		unsigned int used(int head, int tail) const {
+			return static_cast<unsigned int>(head - tail) & (2 * uiSize - 1);
+		}
+
+		int advance(int index, unsigned int count) const {
+			return static_cast<int>((static_cast<unsigned int>(index) + count) & (2 * uiSize - 1));
+		}
+	public:
+		/// Holds at least minsize samples; the capacity is rounded up to a
+		/// power of two, and to at least twice maxview.
+		SPSCSampleRing(unsigned int minsize, unsigned int maxview) : aiHead(0), aiTail(0) {
+			uiMirror = maxview;
+			uiSize = 1;
+			while ((uiSize < minsize) || (uiSize < 2 * maxview))
+				uiSize <<= 1;
+			ptData = new T[uiSize + uiMirror];
+		}
+
+		~SPSCSampleRing() {
+			delete [] ptData;
+		}
+
+		unsigned int capacity() const {
+			return uiSize;
+		}
+
+		/// Largest number of samples a view can span.
+		unsigned int maxView() const {
+			return uiMirror;
+		}
+
+		/// Number of samples that can be read.
+		unsigned int available() {
+			return used(spscLoadAcquire(aiHead), spscLoadAcquire(aiTail));
+		}
+
+		/// Number of samples that can be written.
+		unsigned int space() {
+			return uiSize - available();
+		}
+
+		/// Returns room for count contiguous samples, or NULL if there is
+		/// not enough space or count exceeds maxView(). Producer only.
+		T *writeView(unsigned int count) {
+			if ((count > uiMirror) || (space() < count))
+				return NULL;
+			return ptData + (static_cast<unsigned int>(spscLoadAcquire(aiHead)) & (uiSize - 1));
+		}
+
+		/// Publishes count samples written through writeView(). Producer
+		/// only.
+		void commitWrite(unsigned int count) {
+			const int head = spscLoadAcquire(aiHead);
+			const unsigned int pos = static_cast<unsigned int>(head) & (uiSize - 1);
+
+			if (pos + count > uiSize)
+				memcpy(ptData, ptData + uiSize, (pos + count - uiSize) * sizeof(T));
+			else if (pos < uiMirror)
+				memcpy(ptData + uiSize + pos, ptData + pos, (qMin(pos + count, uiMirror) - pos) * sizeof(T));
+
+			spscStoreRelease(aiHead, advance(head, count));
+		}
+
+		/// Returns the next count samples in one piece, or NULL if fewer
+		/// are available or count exceeds maxView(). They stay valid
+		/// until commitRead(). Consumer only.
+		const T *readView(unsigned int count) {
+			if ((count > uiMirror) || (available() < count))
+				return NULL;
+			return ptData + (static_cast<unsigned int>(spscLoadAcquire(aiTail)) & (uiSize - 1));
+		}
+
+		/// Releases count samples back to the producer. Consumer only.
+		void commitRead(unsigned int count) {
+			spscStoreRelease(aiTail, advance(spscLoadAcquire(aiTail), count));
+		}
+
+		/// Position just past the last committed sample, for discardTo().
+		/// Producer only.
+		int writePosition() {
+			return spscLoadAcquire(aiHead);
+		}
+
+		/// Drops the samples before position, a writePosition() that has
+		/// not been read past yet; otherwise does nothing. Consumer only.
+		void discardTo(int position) {
+			if (used(position, spscLoadAcquire(aiTail)) <= available())
+				spscStoreRelease(aiTail, position);
+		}
+
+		/// Appends up to count samples and returns how many were written.
+		/// Producer only.
+		unsigned int write(const T *in, unsigned int count) {
+			count = qMin(count, space());
+			for (unsigned int done = 0; done < count; ) {
+				const unsigned int n = qMin(count - done, uiMirror);
+				memcpy(writeView(n), in + done, n * sizeof(T));
+				commitWrite(n);
+				done += n;
+			}
+			return count;
+		}
+
+		/// Removes up to count samples into out and returns how many were
+		/// read. Consumer only.
+		unsigned int read(T *out, unsigned int count) {
+			count = qMin(count, available());
+			for (unsigned int done = 0; done < count; ) {
+				const unsigned int n = qMin(count - done, uiMirror);
+				memcpy(out + done, readView(n), n * sizeof(T));
+				commitRead(n);
+				done += n;
+			}
+			return count;
+		}
+};
+
+#endif
@@ -54,6 +54,9 @@
 # endif
 # include <netinet/ip.h>
 # include <sys/socket.h>
+# ifdef Q_OS_LINUX
+#  include <errno.h>
+# endif
 #endif
 
 // We define a global macro called 'g'. This can lead to issues when included code uses 'g' as a type or parameter name (like protobuf 3.7 does). As such, for now, we have to make this our last include.
@@ -65,6 +68,51 @@ ServerHandlerMessageEvent::ServerHandlerMessageEvent(const QByteArray &msg, unsi
 	bFlush = flush;
 }
 
+/// A slab of UDP receive buffers, so that reading a packet never touches
+/// the heap. On Linux a single recvmmsg() fills up to Packets of them.
+struct UDPReadBuffers {
+	enum { Packets = 32, PacketSize = 2048 };
+
+	char cData[Packets][PacketSize];
+	/// Decrypted packet being handled.
+	char cPlain[PacketSize];
+#ifdef Q_OS_LINUX
+	sockaddr_storage ssFrom[Packets];
+	struct iovec iov[Packets];
+	struct mmsghdr mmsg[Packets];
+#endif
+
+	UDPReadBuffers();
+};
+
+UDPReadBuffers::UDPReadBuffers() {
+#ifdef Q_OS_LINUX
+	memset(mmsg, 0, sizeof(mmsg));
+	for (int i = 0; i < Packets; ++i) {
+		iov[i].iov_base = cData[i];
+		iov[i].iov_len = PacketSize;
+		mmsg[i].msg_hdr.msg_name = &ssFrom[i];
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+}
+
+#ifdef Q_OS_LINUX
+/// Whether from is ha:port. IPv4 sources on a dual stack socket arrive
+/// as mapped IPv6 addresses, which is also how HostAddress stores IPv4.
+static inline bool isSource(const sockaddr_storage &from, const HostAddress &ha, quint16 port) {
+	if (from.ss_family == AF_INET6) {
+		const struct sockaddr_in6 *in6 = reinterpret_cast<const struct sockaddr_in6 *>(&from);
+		return (in6->sin6_port == htons(port)) && (memcmp(in6->sin6_addr.s6_addr, ha.qip6.c, 16) == 0);
+	} else if (from.ss_family == AF_INET) {
+		const struct sockaddr_in *in = reinterpret_cast<const struct sockaddr_in *>(&from);
+		return (in->sin_port == htons(port)) && ! ha.isV6() && (in->sin_addr.s_addr == ha.hash[3]);
+	}
+	return false;
+}
+#endif
+
 #ifdef Q_OS_WIN
 static HANDLE loadQoS() {
 	HANDLE hQoS = NULL;
@@ -104,6 +152,10 @@ ServerHandler::ServerHandler()
     : database(new Database(QLatin1String("ServerHandler"))) {
 	cConnection.reset();
 	qusUdp = NULL;
+	urbUdp = NULL;
+#ifdef Q_OS_LINUX
+	bRecvmmsg = true;
+#endif
 	bStrong = false;
 	usPort = 0;
 	bUdp = true;
@@ -180,59 +232,105 @@ void ServerHandler::customEvent(QEvent *evt) {
 }
 
 void ServerHandler::udpReady() {
-	while (qusUdp->hasPendingDatagrams()) {
-		char encrypted[2048];
-		char buffer[2048];
-		unsigned int buflen = static_cast<unsigned int>(qusUdp->pendingDatagramSize());
+	ConnectionPtr connection(cConnection);
+
+#ifdef Q_OS_LINUX
+	if (bRecvmmsg)
+		readUdpBatches(connection);
+#endif
+
+	// QUdpSocket stops watching the socket after readyRead() until it has
+	// read a datagram itself, so the last read always goes through Qt, even
+	// if the batches above already drained the socket.
+	do {
+		char *encrypted = urbUdp->cData[0];
 		QHostAddress senderAddr;
 		quint16 senderPort;
-		qusUdp->readDatagram(encrypted, qMin(2048U, buflen), &senderAddr, &senderPort);
-
-		if (!(HostAddress(senderAddr) == HostAddress(qhaRemote)) || (senderPort != usResolvedPort))
-			continue;
+		const qint64 len = qusUdp->readDatagram(encrypted, UDPReadBuffers::PacketSize, &senderAddr, &senderPort);
+		if (len < 0)
+			break;
 
-		ConnectionPtr connection(cConnection);
-		if (! connection)
+		if (!(HostAddress(senderAddr) == haRemote) || (senderPort != usResolvedPort))
 			continue;
 
-		if (! connection->csCrypt.isValid())
-			continue;
+		handleUdpPacket(connection, encrypted, static_cast<unsigned int>(len));
+	} while (qusUdp->hasPendingDatagrams());
+}
 
-		if (buflen < 5)
-			continue;
+#ifdef Q_OS_LINUX
+/// Drains the UDP socket, up to UDPReadBuffers::Packets datagrams per
+/// system call.
+void ServerHandler::readUdpBatches(const ConnectionPtr &connection) {
+	UDPReadBuffers *b = urbUdp;
+	const int sock = static_cast<int>(qusUdp->socketDescriptor());
+	int n;
 
-		if (! connection->csCrypt.decrypt(reinterpret_cast<const unsigned char *>(encrypted), reinterpret_cast<unsigned char *>(buffer), buflen)) {
-			if (connection->csCrypt.tLastGood.elapsed() > 5000000ULL) {
-				if (connection->csCrypt.tLastRequest.elapsed() > 5000000ULL) {
-					connection->csCrypt.tLastRequest.restart();
-					MumbleProto::CryptSetup mpcs;
-					sendMessage(mpcs);
-				}
+	do {
+		for (int i = 0; i < UDPReadBuffers::Packets; ++i)
+			b->mmsg[i].msg_hdr.msg_namelen = sizeof(b->ssFrom[i]);
+
+		n = ::recvmmsg(sock, b->mmsg, UDPReadBuffers::Packets, MSG_DONTWAIT, NULL);
+		if (n < 0) {
+			if (errno == ENOSYS) {
+				qWarning("ServerHandler: recvmmsg() is not supported, reading UDP packets one by one");
+				bRecvmmsg = false;
 			}
-			continue;
+			return;
 		}
 
-		PacketDataStream pds(buffer + 1, buflen-5);
+		for (int i = 0; i < n; ++i) {
+			if (b->mmsg[i].msg_hdr.msg_flags & MSG_TRUNC)
+				continue;
+			if (! isSource(b->ssFrom[i], haRemote, usResolvedPort))
+				continue;
+			handleUdpPacket(connection, b->cData[i], b->mmsg[i].msg_len);
+		}
+	} while (n == UDPReadBuffers::Packets);
+}
+#endif
 
-		MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((buffer[0] >> 5) & 0x7);
-		unsigned int msgFlags = buffer[0] & 0x1f;
+void ServerHandler::handleUdpPacket(const ConnectionPtr &connection, const char *encrypted, unsigned int buflen) {
+	if (! connection)
+		return;
 
-		switch (msgType) {
-			case MessageHandler::UDPPing: {
-					quint64 t;
-					pds >> t;
-					accUDP(static_cast<double>(tTimestamp.elapsed() - t) / 1000.0);
-				}
-				break;
-			case MessageHandler::UDPVoiceCELTAlpha:
-			case MessageHandler::UDPVoiceCELTBeta:
-			case MessageHandler::UDPVoiceSpeex:
-			case MessageHandler::UDPVoiceOpus:
-				handleVoicePacket(msgFlags, pds, msgType);
-				break;
-			default:
-				break;
+	if (! connection->csCrypt.isValid())
+		return;
+
+	if (buflen < 5)
+		return;
+
+	char *buffer = urbUdp->cPlain;
+	if (! connection->csCrypt.decrypt(reinterpret_cast<const unsigned char *>(encrypted), reinterpret_cast<unsigned char *>(buffer), buflen)) {
+		if (connection->csCrypt.tLastGood.elapsed() > 5000000ULL) {
+			if (connection->csCrypt.tLastRequest.elapsed() > 5000000ULL) {
+				connection->csCrypt.tLastRequest.restart();
+				MumbleProto::CryptSetup mpcs;
+				sendMessage(mpcs);
+			}
 		}
+		return;
+	}
+
+	PacketDataStream pds(buffer + 1, buflen-5);
+
+	MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((buffer[0] >> 5) & 0x7);
+	unsigned int msgFlags = buffer[0] & 0x1f;
+
+	switch (msgType) {
+		case MessageHandler::UDPPing: {
+				quint64 t;
+				pds >> t;
+				accUDP(static_cast<double>(tTimestamp.elapsed() - t) / 1000.0);
+			}
+			break;
+		case MessageHandler::UDPVoiceCELTAlpha:
+		case MessageHandler::UDPVoiceCELTBeta:
+		case MessageHandler::UDPVoiceSpeex:
+		case MessageHandler::UDPVoiceOpus:
+			handleVoicePacket(msgFlags, pds, msgType);
+			break;
+		default:
+			break;
 	}
 }
 
@@ -244,11 +342,7 @@ void ServerHandler::handleVoicePacket(unsigned int msgFlags, PacketDataStream &p
 	if (ao && p && ! p->bLocalMute && !(((msgFlags & 0x1f) == 2) && g.s.bWhisperFriends && p->qsFriendName.isEmpty())) {
 		unsigned int iSeq;
 		pds >> iSeq;
-		QByteArray qba;
-		qba.reserve(pds.left() + 1);
-		qba.append(static_cast<char>(msgFlags));
-		qba.append(pds.dataBlock(pds.left()));
-		ao->addFrameToBuffer(p, qba, iSeq, type);
+		ao->addFrameToBuffer(p, msgFlags, pds.charPtr(), pds.left(), iSeq, type);
 	}
 }
 
@@ -420,6 +514,8 @@ void ServerHandler::run() {
 	#endif
 			delete qusUdp;
 			qusUdp = NULL;
+			delete urbUdp;
+			urbUdp = NULL;
 		}
 
 		ticker->stop();
@@ -731,6 +827,7 @@ void ServerHandler::serverConnectionConnected() {
 		QMutexLocker qml(&qmUdp);
 
 		qhaRemote = connection->peerAddress();
+		haRemote = HostAddress(qhaRemote);
 		qhaLocal = connection->localAddress();
 		usResolvedPort = connection->peerPort();
 		if (qhaLocal.isNull()) {
@@ -741,6 +838,7 @@ void ServerHandler::serverConnectionConnected() {
 		if (! qusUdp) {
 			qFatal("ServerHandler: qusUdp is unexpectedly a null addr");
 		}
+		urbUdp = new UDPReadBuffers();
 		if (g.s.bUdpForceTcpAddr) {
 			qusUdp->bind(qhaLocal, 0);
 		} else {
@@ -945,7 +1043,7 @@ void ServerHandler::setUserTexture(unsigned int uiSession, const QByteArray &qba
 	sendMessage(mpus);
 
 	if (! texture.isEmpty()) {
-		database->setBlob(sha1(texture), texture);
+		g.db->setBlob(sha1(texture), texture);
 	}
 }
 
@@ -32,6 +32,7 @@
 #define SERVERSEND_EVENT 3501
 
 #include "Timer.h"
+#include "HostAddress.h"
 #include "Message.h"
 #include "Mumble.pb.h"
 #include "ServerAddress.h"
@@ -43,6 +44,7 @@ class PacketDataStream;
 class QUdpSocket;
 class QSslSocket;
 class VoiceRecorder;
+struct UDPReadBuffers;
 
 class ServerHandlerMessageEvent : public QEvent {
 	public:
@@ -78,7 +80,18 @@ class ServerHandler : public QThread {
 		QHostAddress qhaLocal;
 		QUdpSocket *qusUdp;
 		QMutex qmUdp;
+		/// qhaRemote in the form it is compared against the source of
+		/// every UDP packet.
+		HostAddress haRemote;
+		/// Buffers the UDP socket is read into, allocated with it.
+		UDPReadBuffers *urbUdp;
+#ifdef Q_OS_LINUX
+		/// Cleared if the kernel turns out not to support recvmmsg().
+		bool bRecvmmsg;
+		void readUdpBatches(const ConnectionPtr &connection);
+#endif
 
+		void handleUdpPacket(const ConnectionPtr &connection, const char *encrypted, unsigned int buflen);
 		void handleVoicePacket(unsigned int msgFlags, PacketDataStream &pds, MessageHandler::UDPMessageType type);
 	public:
 		Timer tTimestamp;
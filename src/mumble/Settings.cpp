@@ -247,6 +247,7 @@ Settings::Settings() {
 	iMinLoudness = 1000;
 	iVoiceHold = 50;
 	iJitterBufferSize = 1;
+	iJitterPercentile = 98;
 	iFramesPerPacket = 2;
 	iNoiseSuppress = -30;
 	bDenoise = false;
@@ -327,6 +328,7 @@ Settings::Settings() {
 
 	bEcho = false;
 	bEchoMulti = true;
+	iResampleQuality = 3;
 
 	bExclusiveInput = false;
 	bExclusiveOutput = false;
@@ -340,6 +342,7 @@ Settings::Settings() {
 	fAudioMaxDistance = 15.0f;
 	fAudioMaxDistVolume = 0.80f;
 	fAudioBloom = 0.5f;
+	iPositionalPollInterval = 20;
 
 	// OverlayPrivateWin
 	iOverlayWinHelperRestartCooldownMsec = 10000;
@@ -398,7 +401,7 @@ Settings::Settings() {
 	
 	requireRestartToApply = false;
 
-	iMaxLogBlocks = 0;
+	iMaxLogBlocks = 10000;
 	bLog24HourClock = true;
 
 	bShortcutEnable = true;
@@ -637,6 +640,7 @@ void Settings::load(QSettings* settings_ptr) {
 	SAVELOAD(fAudioBloom, "audio/bloom");
 	SAVELOAD(bEcho, "audio/echo");
 	SAVELOAD(bEchoMulti, "audio/echomulti");
+	SAVELOAD(iResampleQuality, "audio/resamplequality");
 	SAVELOAD(bExclusiveInput, "audio/exclusiveinput");
 	SAVELOAD(bExclusiveOutput, "audio/exclusiveoutput");
 	SAVELOAD(bPositionalAudio, "audio/positional");
@@ -645,8 +649,10 @@ void Settings::load(QSettings* settings_ptr) {
 	SAVELOAD(qsAudioOutput, "audio/output");
 	SAVELOAD(bWhisperFriends, "audio/whisperfriends");
 	SAVELOAD(bTransmitPosition, "audio/postransmit");
+	SAVELOAD(iPositionalPollInterval, "audio/pospollinterval");
 
 	SAVELOAD(iJitterBufferSize, "net/jitterbuffer");
+	SAVELOAD(iJitterPercentile, "net/jitterpercentile");
 	SAVELOAD(iFramesPerPacket, "net/framesperpacket");
 
 	SAVELOAD(bASIOEnable, "asio/enable");
@@ -670,6 +676,7 @@ void Settings::load(QSettings* settings_ptr) {
 
 	SAVELOAD(qsOSSInput, "oss/input");
 	SAVELOAD(qsOSSOutput, "oss/output");
+	SAVELOAD(qsNullInput, "null/input");
 
 	SAVELOAD(qsCoreAudioInput, "coreaudio/input");
 	SAVELOAD(qsCoreAudioOutput, "coreaudio/output");
@@ -977,6 +984,7 @@ void Settings::save() {
 	SAVELOAD(fAudioBloom, "audio/bloom");
 	SAVELOAD(bEcho, "audio/echo");
 	SAVELOAD(bEchoMulti, "audio/echomulti");
+	SAVELOAD(iResampleQuality, "audio/resamplequality");
 	SAVELOAD(bExclusiveInput, "audio/exclusiveinput");
 	SAVELOAD(bExclusiveOutput, "audio/exclusiveoutput");
 	SAVELOAD(bPositionalAudio, "audio/positional");
@@ -985,8 +993,10 @@ void Settings::save() {
 	SAVELOAD(qsAudioOutput, "audio/output");
 	SAVELOAD(bWhisperFriends, "audio/whisperfriends");
 	SAVELOAD(bTransmitPosition, "audio/postransmit");
+	SAVELOAD(iPositionalPollInterval, "audio/pospollinterval");
 
 	SAVELOAD(iJitterBufferSize, "net/jitterbuffer");
+	SAVELOAD(iJitterPercentile, "net/jitterpercentile");
 	SAVELOAD(iFramesPerPacket, "net/framesperpacket");
 
 	SAVELOAD(bASIOEnable, "asio/enable");
@@ -1010,6 +1020,7 @@ void Settings::save() {
 
 	SAVELOAD(qsOSSInput, "oss/input");
 	SAVELOAD(qsOSSOutput, "oss/output");
+	SAVELOAD(qsNullInput, "null/input");
 
 	SAVELOAD(qsCoreAudioInput, "coreaudio/input");
 	SAVELOAD(qsCoreAudioOutput, "coreaudio/output");
@@ -184,6 +184,9 @@ struct Settings {
 	///backend.
 	QString qsTTSLanguage;
 	int iQuality, iMinLoudness, iVoiceHold, iJitterBufferSize;
+	/// Percentage of voice packets the jitter buffer waits for. The rest
+	/// arrive too late and are concealed.
+	int iJitterPercentile;
 	int iNoiseSuppress;
 	bool bAllowLowDelay;
 	bool bDenoise;
@@ -212,6 +215,8 @@ struct Settings {
 	QString qsJackClientName, qsJackAudioOutput;
 	bool bJackStartServer, bJackAutoConnect;
 	QString qsOSSInput, qsOSSOutput;
+	/// Sound file the null backend captures from; empty for silence.
+	QString qsNullInput;
 	int iPortAudioInput, iPortAudioOutput;
 
 	bool bASIOEnable;
@@ -247,10 +252,14 @@ struct Settings {
 	bool bExclusiveInput, bExclusiveOutput;
 	bool bEcho;
 	bool bEchoMulti;
+	/// Quality of the sample rate converters, 0 to 10. See Resampler.
+	int iResampleQuality;
 	bool bPositionalAudio;
 	bool bPositionalHeadphone;
 	float fAudioMinDistance, fAudioMaxDistance, fAudioMaxDistVolume, fAudioBloom;
 	QMap<QString, bool> qmPositionalAudioPlugins;
+	/// Time between two fetches of positional data, in milliseconds.
+	int iPositionalPollInterval;
 
 	OverlaySettings os;
 
@@ -134,43 +134,81 @@ int ModelItem::rows() const {
 	return qlChildren.count();
 }
 
-int ModelItem::insertIndex(Channel *c) const {
-	QList<Channel*> qlpc;
-	ModelItem *item;
+/// Returns the number of rows at the start of children that hold users if
+/// users is true, or channels otherwise. The two kinds are never mixed.
+static int leadingRows(const QList<ModelItem *> &children, bool users) {
+	int lo = 0;
+	int hi = children.count();
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		if ((children.at(mid)->pUser != NULL) == users)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/// Binary search for key among the sorted rows [first, last) of children,
+/// leaving out row skip. Returns the row key goes at once skip is removed.
+template <typename T, typename Compare>
+static int sortedRow(const QList<ModelItem *> &children, T *ModelItem::*member, int first, int last, int skip, T *key, Compare lessThan) {
+	const bool skipping = (skip >= first) && (skip < last);
+	int lo = 0;
+	int hi = last - first - (skipping ? 1 : 0);
+	while (lo < hi) {
+		const int mid = (lo + hi) / 2;
+		int row = first + mid;
+		if (skipping && (row >= skip))
+			++row;
+		if (lessThan(children.at(row)->*member, key))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return first + lo;
+}
 
-	int ocount = 0;
+int ModelItem::insertIndex(Channel *c, int skip) const {
+	Q_ASSERT((skip < 0) || (qlChildren.at(skip)->cChan == c));
 
-	foreach(item, qlChildren) {
-		if (item->cChan) {
-			if (item->cChan != c) {
-				qlpc << item->cChan;
-			}
-		} else
-			ocount++;
-	}
-	qlpc << c;
-	std::sort(qlpc.begin(), qlpc.end(), Channel::lessThan);
-	return qlpc.indexOf(c) + (bUsersTop ? ocount : 0);
+	int first = 0;
+	int last = qlChildren.count();
+	if (bUsersTop)
+		first = leadingRows(qlChildren, true);
+	else
+		last = leadingRows(qlChildren, false);
+
+	return sortedRow(qlChildren, &ModelItem::cChan, first, last, skip, c, Channel::lessThan);
 }
 
-int ModelItem::insertIndex(ClientUser *p) const {
-	QList<ClientUser*> qlclientuser;
-	ModelItem *item;
+int ModelItem::insertIndex(ClientUser *p, int skip) const {
+	Q_ASSERT((skip < 0) || (qlChildren.at(skip)->pUser == p));
 
-	int ocount = 0;
+	int first = 0;
+	int last = qlChildren.count();
+	if (bUsersTop)
+		last = leadingRows(qlChildren, true);
+	else
+		first = leadingRows(qlChildren, false);
 
-	foreach(item, qlChildren) {
-		if (item->pUser) {
-			if (item->pUser != p)
-				qlclientuser << item->pUser;
-		} else
-			ocount++;
-	}
+	return sortedRow(qlChildren, &ModelItem::pUser, first, last, skip, p, ClientUser::lessThan);
+}
 
-	qlclientuser << p;
-	std::sort(qlclientuser.begin(), qlclientuser.end(), ClientUser::lessThan);
+bool ModelItem::lessThan(const ModelItem *first, const ModelItem *second) {
+	if ((first->pUser == NULL) != (second->pUser == NULL))
+		return (first->pUser != NULL) == bUsersTop;
+	if (first->pUser)
+		return ClientUser::lessThan(first->pUser, second->pUser);
+	return Channel::lessThan(first->cChan, second->cChan);
+}
 
-	return qlclientuser.indexOf(p) + (bUsersTop ? 0 : ocount);
+void ModelItem::sortChildren() {
+	std::sort(qlChildren.begin(), qlChildren.end(), ModelItem::lessThan);
+	foreach(ModelItem *i, qlChildren) {
+		if (i->cChan)
+			i->sortChildren();
+	}
 }
 
 QString ModelItem::hash() const {
@@ -224,6 +262,7 @@ UserModel::UserModel(QObject *p) : QAbstractItemModel(p) {
 	uiSessionComment = 0;
 	iChannelDescription = -1;
 	bClicked = false;
+	bBulkSync = false;
 
 	miRoot = new ModelItem(Channel::get(0));
 }
@@ -266,6 +305,9 @@ QModelIndex UserModel::index(int row, int column, const QModelIndex &p) const {
 }
 
 QModelIndex UserModel::index(ClientUser *p, int column) const {
+	if (bBulkSync)
+		return QModelIndex();
+
 	ModelItem *item = ModelItem::c_qhUsers.value(p);
 	Q_ASSERT(p);
 	Q_ASSERT(item);
@@ -276,6 +318,9 @@ QModelIndex UserModel::index(ClientUser *p, int column) const {
 }
 
 QModelIndex UserModel::index(Channel *c, int column) const {
+	if (bBulkSync)
+		return QModelIndex();
+
 	ModelItem *item = ModelItem::c_qhChannels.value(c);
 	Q_ASSERT(c);
 	Q_ASSERT(item);
@@ -286,6 +331,9 @@ QModelIndex UserModel::index(Channel *c, int column) const {
 }
 
 QModelIndex UserModel::index(ModelItem *item) const {
+	if (bBulkSync)
+		return QModelIndex();
+
 	return createIndex(item->rowOfSelf(), 0, item);
 }
 
@@ -696,15 +744,21 @@ void UserModel::recursiveClone(const ModelItem *old, ModelItem *item, QModelInde
 }
 
 ModelItem *UserModel::moveItem(ModelItem *oldparent, ModelItem *newparent, ModelItem *item) {
+	if (bBulkSync) {
+		moveItemBulk(oldparent, newparent, item);
+		return item;
+	}
+
 	// Here's the idea. We insert the item, update persistent indexes, THEN remove it.
 
 	int oldrow = oldparent->qlChildren.indexOf(item);
 	int newrow = -1;
+	const int skip = (oldparent == newparent) ? oldrow : -1;
 
 	if (item->cChan)
-		newrow = newparent->insertIndex(item->cChan);
+		newrow = newparent->insertIndex(item->cChan, skip);
 	else
-		newrow = newparent->insertIndex(item->pUser);
+		newrow = newparent->insertIndex(item->pUser, skip);
 
 	if ((oldparent == newparent) && (newrow == oldrow)) {
 		emit dataChanged(index(item),index(item));
@@ -779,7 +833,28 @@ ModelItem *UserModel::moveItem(ModelItem *oldparent, ModelItem *newparent, Model
 	return t;
 }
 
+void UserModel::moveItemBulk(ModelItem *oldparent, ModelItem *newparent, ModelItem *item) {
+	// endBulkSync() sorts everything, so only a new parent matters.
+	if (oldparent == newparent)
+		return;
+
+	// Items are appended, and most are moved right after being added.
+	oldparent->qlChildren.removeAt(oldparent->qlChildren.lastIndexOf(item));
+	newparent->qlChildren.append(item);
+	item->parent = newparent;
+
+	if (item->cChan) {
+		oldparent->cChan->removeChannel(item->cChan);
+		newparent->cChan->addChannel(item->cChan);
+	} else {
+		newparent->cChan->addClientUser(item->pUser);
+	}
+}
+
 void UserModel::expandAll(Channel *c) {
+	if (bBulkSync)
+		return;
+
 	QStack<Channel *> chans;
 
 	while (c) {
@@ -793,6 +868,9 @@ void UserModel::expandAll(Channel *c) {
 }
 
 void UserModel::collapseEmpty(Channel *c) {
+	if (bBulkSync)
+		return;
+
 	while (c) {
 		ModelItem *mi = ModelItem::c_qhChannels.value(c);
 		if (mi->iUsers == 0)
@@ -804,7 +882,7 @@ void UserModel::collapseEmpty(Channel *c) {
 }
 
 void UserModel::ensureSelfVisible() {
-	if (! g.uiSession)
+	if (! g.uiSession || bBulkSync)
 		return;
 
 	g.mw->qtvUsers->scrollTo(index(ClientUser::get(g.uiSession)));
@@ -860,12 +938,17 @@ ClientUser *UserModel::addUser(unsigned int id, const QString &name) {
 
 	item->parent = citem;
 
-	int row = citem->insertIndex(p);
+	if (bBulkSync) {
+		citem->qlChildren.append(item);
+		c->addClientUser(p);
+	} else {
+		int row = citem->insertIndex(p);
 
-	beginInsertRows(index(citem), row, row);
-	citem->qlChildren.insert(row, item);
-	c->addClientUser(p);
-	endInsertRows();
+		beginInsertRows(index(citem), row, row);
+		citem->qlChildren.insert(row, item);
+		c->addClientUser(p);
+		endInsertRows();
+	}
 
 	while (citem) {
 		citem->iUsers++;
@@ -886,10 +969,12 @@ void UserModel::removeUser(ClientUser *p) {
 
 	int row = citem->qlChildren.indexOf(item);
 
-	beginRemoveRows(index(citem), row, row);
+	if (! bBulkSync)
+		beginRemoveRows(index(citem), row, row);
 	c->removeUser(p);
 	citem->qlChildren.removeAt(row);
-	endRemoveRows();
+	if (! bBulkSync)
+		endRemoveRows();
 
 	p->cChannel = NULL;
 
@@ -1148,6 +1233,12 @@ Channel *UserModel::addChannel(int id, Channel *p, const QString &name) {
 
 	item->parent = citem;
 
+	if (bBulkSync) {
+		p->addChannel(c);
+		citem->qlChildren.append(item);
+		return c;
+	}
+
 	int row = citem->insertIndex(c);
 
 	beginInsertRows(index(citem), row, row);
@@ -1182,11 +1273,13 @@ bool UserModel::removeChannel(Channel *c, const bool onlyIfUnoccupied) {
 
 	int row = citem->rowOf(c);
 
-	beginRemoveRows(index(citem), row, row);
+	if (! bBulkSync)
+		beginRemoveRows(index(citem), row, row);
 	p->removeChannel(c);
 	citem->qlChildren.removeAt(row);
 	qsLinked.remove(c);
-	endRemoveRows();
+	if (! bBulkSync)
+		endRemoveRows();
 
 	Channel::remove(c);
 
@@ -1239,6 +1332,8 @@ void UserModel::removeAll() {
 	ModelItem *item = miRoot;
 	ModelItem *i;
 
+	endBulkSync();
+
 	uiSessionComment = 0;
 	iChannelDescription = -1;
 	bClicked = false;
@@ -1255,6 +1350,47 @@ void UserModel::removeAll() {
 	updateOverlay();
 }
 
+void UserModel::beginBulkSync() {
+	if (bBulkSync)
+		return;
+
+	beginResetModel();
+	bBulkSync = true;
+}
+
+void UserModel::endBulkSync() {
+	if (! bBulkSync)
+		return;
+
+	miRoot->sortChildren();
+	bBulkSync = false;
+	endResetModel();
+
+	// Expand what addChannel() and moveUser() would have expanded.
+	if (g.s.ceExpand != Settings::NoChannels) {
+		const bool all = (g.s.ceExpand == Settings::AllChannels);
+		QTreeView *v = g.mw->qtvUsers;
+
+		if (all || miRoot->iUsers > 0)
+			v->setExpanded(index(miRoot), true);
+
+		QStack<ModelItem *> items;
+		items.push(miRoot);
+		while (! items.isEmpty()) {
+			const ModelItem *item = items.pop();
+			for (int row = 0; row < item->qlChildren.count(); ++row) {
+				ModelItem *child = item->qlChildren.at(row);
+				if (child->cChan && (all || child->iUsers > 0)) {
+					v->setExpanded(createIndex(row, 0, child), true);
+					items.push(child);
+				}
+			}
+		}
+	}
+
+	updateOverlay();
+}
+
 ClientUser *UserModel::getUser(const QModelIndex &idx) const {
 	if (! idx.isValid())
 		return NULL;
@@ -1541,6 +1677,9 @@ bool UserModel::dropMimeData(const QMimeData *md, Qt::DropAction, int row, int c
 }
 
 void UserModel::updateOverlay() const {
+	if (bBulkSync)
+		return;
+
 	g.o->updateOverlay();
 	g.lcd->updateUserView();
 }
@@ -51,10 +51,19 @@ public:
 	int rowOf(ClientUser *p) const;
 	int rowOfSelf() const;
 	int rows() const;
-	int insertIndex(Channel *c) const;
-	int insertIndex(ClientUser *p) const;
+	/// Returns the row at which c or p goes among the children, which are
+	/// kept sorted. skip is the row the item is at now if it already is a
+	/// child, and the result is then the row after removing it.
+	int insertIndex(Channel *c, int skip = -1) const;
+	int insertIndex(ClientUser *p, int skip = -1) const;
 	QString hash() const;
 	void wipe();
+
+	/// Order of the children: users and channels grouped as set by
+	/// bUsersTop, each group sorted.
+	static bool lessThan(const ModelItem *first, const ModelItem *second);
+	/// Sorts the children of this item and all below it.
+	void sortChildren();
 };
 
 class UserModel : public QAbstractItemModel {
@@ -78,8 +87,12 @@ class UserModel : public QAbstractItemModel {
 
 		bool bClicked;
 
+		/// True between beginBulkSync() and endBulkSync().
+		bool bBulkSync;
+
 		void recursiveClone(const ModelItem *old, ModelItem *item, QModelIndexList &from, QModelIndexList &to);
 		ModelItem *moveItem(ModelItem *oldparent, ModelItem *newparent, ModelItem *item);
+		void moveItemBulk(ModelItem *oldparent, ModelItem *newparent, ModelItem *item);
 
 		QString stringIndex(const QModelIndex &index) const;
 	public:
@@ -135,6 +148,14 @@ class UserModel : public QAbstractItemModel {
 
 		void removeAll();
 
+		/// While connecting, the server sends the whole tree before
+		/// ServerSync. Between these two calls items are appended as they
+		/// come, unsorted and without notifying the view, and
+		/// endBulkSync() sorts the tree once and resets the model.
+		/// index() returns invalid indexes in the meantime.
+		void beginBulkSync();
+		void endBulkSync();
+
 		void expandAll(Channel *c);
 		void collapseEmpty(Channel *c);
 
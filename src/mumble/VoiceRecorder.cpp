@@ -7,6 +7,8 @@
 
 #include "AudioOutput.h"
 #include "ClientUser.h"
+#include "OggOpusWriter.h"
+#include "PacketDataStream.h"
 #include "ServerHandler.h"
 
 #include "../Timer.h"
@@ -30,10 +32,27 @@ VoiceRecorder::RecordBuffer::RecordBuffer(
 	// Nothing
 }
 
+VoiceRecorder::RecordPacket::RecordPacket(
+		int recordInfoIndex_,
+		const QByteArray &data_,
+		unsigned int seq_,
+		quint64 arrivalSample_)
+
+	: recordInfoIndex(recordInfoIndex_)
+	, data(data_)
+	, seq(seq_)
+	, arrivalSample(arrivalSample_) {
+
+	// Nothing
+}
+
 VoiceRecorder::RecordInfo::RecordInfo(const QString& userName_)
     : userName(userName_)
     , soundFile(NULL)
-    , lastWrittenAbsoluteSample(0) {
+    , lastWrittenAbsoluteSample(0)
+    , hasRun(false)
+    , runStartSeq(0)
+    , runStartSample(0) {
 }
 
 VoiceRecorder::RecordInfo::~RecordInfo() {
@@ -41,6 +60,10 @@ VoiceRecorder::RecordInfo::~RecordInfo() {
 		// Close libsndfile's handle if we have one.
 		sf_close(soundFile);
 	}
+	if (oggWriter) {
+		// Write the end of stream page before the file is closed.
+		oggWriter->finish();
+	}
 }
 
 VoiceRecorder::VoiceRecorder(QObject *p, const Config& config)
@@ -230,12 +253,7 @@ SF_INFO VoiceRecorder::createSoundFileInfo() const {
 	return sfinfo;
 }
 
-bool VoiceRecorder::ensureFileIsOpenedFor(SF_INFO& soundFileInfo, boost::shared_ptr<RecordInfo>& ri) {
-	if (ri->soundFile != NULL) {
-		// Nothing to do
-		return true;
-	}
-	
+QString VoiceRecorder::createFileNameFor(const boost::shared_ptr<RecordInfo>& ri) {
 	QString filename = expandTemplateVariables(m_config.fileName, ri->userName);
 
 	// Try to find a unique filename.
@@ -263,9 +281,22 @@ bool VoiceRecorder::ensureFileIsOpenedFor(SF_INFO& soundFileInfo, boost::shared_
 		m_recording = false;
 		emit error(CreateDirectoryFailed, tr("Recorder failed to create directory '%1'").arg(fi.absolutePath()));
 		emit recording_stopped();
-		return false;
+		return QString();
 	}
 
+	return filename;
+}
+
+bool VoiceRecorder::ensureFileIsOpenedFor(SF_INFO& soundFileInfo, boost::shared_ptr<RecordInfo>& ri) {
+	if (ri->soundFile != NULL) {
+		// Nothing to do
+		return true;
+	}
+
+	const QString filename = createFileNameFor(ri);
+	if (filename.isEmpty())
+		return false;
+
 #ifdef Q_OS_WIN
 	// This is needed for unicode filenames on Windows.
 	ri->soundFile = sf_wchar_open(filename.toStdWString().c_str(), SFM_WRITE, &soundFileInfo);
@@ -293,13 +324,86 @@ bool VoiceRecorder::ensureFileIsOpenedFor(SF_INFO& soundFileInfo, boost::shared_
 	return true;
 }
 
+bool VoiceRecorder::ensureOggFileIsOpenedFor(boost::shared_ptr<RecordInfo>& ri) {
+	if (ri->oggWriter) {
+		// Nothing to do
+		return true;
+	}
+
+	const QString filename = createFileNameFor(ri);
+	if (filename.isEmpty())
+		return false;
+
+	ri->oggFile.setFileName(filename);
+	if (!ri->oggFile.open(QIODevice::WriteOnly)) {
+		qWarning() << "Failed to open file for recorder: " << ri->oggFile.errorString();
+		m_recording = false;
+		emit error(CreateFileFailed, tr("Recorder failed to open file '%1'").arg(filename));
+		emit recording_stopped();
+		return false;
+	}
+
+	// Every file holds a single stream, so any serial number will do.
+	ri->oggWriter.reset(new OggOpusWriter(&ri->oggFile, qHash(filename)));
+	ri->oggWriter->writeHeaders(ri->userName);
+
+	return true;
+}
+
+bool VoiceRecorder::writePacket(const boost::shared_ptr<RecordPacket>& rp) {
+	boost::shared_ptr<RecordInfo> ri;
+	{
+		QMutexLocker l(&m_bufferLock);
+		Q_ASSERT(m_recordInfo.contains(rp->recordInfoIndex));
+		ri = m_recordInfo.value(rp->recordInfoIndex);
+	}
+
+	if (!ensureOggFileIsOpenedFor(ri)) {
+		return false;
+	}
+
+	// Sequence numbers count 10ms frames since the sender started its
+	// current run of speech, and restart after a few seconds of silence.
+	// Inside a run they give each packet its exact place, however the
+	// network delayed it; the arrival time is only used to place the run.
+	static const quint64 frameSamples = 480;
+	static const quint64 maxDrift = 48000; // 1s
+
+	const quint64 written = ri->oggWriter->samplesWritten();
+	quint64 position = 0;
+	bool newRun = !ri->hasRun || rp->seq < ri->runStartSeq;
+	if (!newRun) {
+		position = ri->runStartSample + (rp->seq - ri->runStartSeq) * frameSamples;
+		// The sender restarted at a sequence number that happens to be
+		// above the start of the old run.
+		newRun = position + maxDrift < rp->arrivalSample || position > rp->arrivalSample + maxDrift;
+	}
+	if (newRun) {
+		position = std::max(rp->arrivalSample, written);
+		ri->hasRun = true;
+		ri->runStartSeq = rp->seq;
+		ri->runStartSample = position;
+	}
+
+	if (position < written) {
+		// Late or duplicate packet: its place has already been written.
+		return true;
+	}
+
+	ri->oggWriter->writeSilence(position - written);
+	ri->oggWriter->writePacket(reinterpret_cast<const unsigned char *>(rp->data.constData()), rp->data.size());
+	return true;
+}
+
 void VoiceRecorder::run() {
 	Q_ASSERT(!m_recording);
 	
 	if (g.sh && g.sh->uiVersion < 0x010203)
 		return;
 
-	SF_INFO soundFileInfo = createSoundFileInfo();
+	SF_INFO soundFileInfo = SF_INFO();
+	if (!isInPassthroughMode())
+		soundFileInfo = createSoundFileInfo();
 	
 	m_recording = true;
 	emit recording_started();
@@ -314,18 +418,30 @@ void VoiceRecorder::run() {
 			break;
 		}
 
+		while (!m_abort && !m_recordPacket.isEmpty()) {
+			boost::shared_ptr<RecordPacket> rp;
+			{
+				QMutexLocker l(&m_bufferLock);
+				rp = m_recordPacket.takeFirst();
+			}
+
+			if (!writePacket(rp)) {
+				return;
+			}
+		}
+
 		while (!m_abort && !m_recordBuffer.isEmpty()) {
 			boost::shared_ptr<RecordBuffer> rb;
+			boost::shared_ptr<RecordInfo> ri;
 			{
 				QMutexLocker l(&m_bufferLock);
 				rb = m_recordBuffer.takeFirst();
+				Q_ASSERT(m_recordInfo.contains(rb->recordInfoIndex));
+				ri = m_recordInfo.value(rb->recordInfoIndex);
 			}
 			
 			// Create the file for this RecordInfo instance if it's not yet open.
 			
-			Q_ASSERT(m_recordInfo.contains(rb->recordInfoIndex));
-			boost::shared_ptr<RecordInfo> ri = m_recordInfo.value(rb->recordInfoIndex);
-			
 			if (!ensureFileIsOpenedFor(soundFileInfo, ri)) {
 				return;
 			}
@@ -373,6 +489,7 @@ void VoiceRecorder::run() {
 		QMutexLocker l(&m_bufferLock);
 		m_recordInfo.clear();
 		m_recordBuffer.clear();
+		m_recordPacket.clear();
 	}
 	
 	emit recording_stopped();
@@ -402,20 +519,13 @@ void VoiceRecorder::addBuffer(const ClientUser *clientUser,
 	if (!m_recording)
 		return;
 	
-	// Create a new RecordInfo object if this is a new user.
 	const int index = indexForUser(clientUser);
-	
-	if (!m_recordInfo.contains(index)) {
-		boost::shared_ptr<RecordInfo> ri = boost::make_shared<RecordInfo>(
-		            m_config.mixDownMode ? QLatin1String("Mixdown")
-		                                 : clientUser->qsName);
-		
-		m_recordInfo.insert(index, ri);
-	}
 
 	{
-		// Save the buffer in |qlRecordBuffer|.
+		// Save the buffer in |qlRecordBuffer|, creating a new RecordInfo
+		// object if this is a new user.
 		QMutexLocker l(&m_bufferLock);
+		ensureRecordInfoExistsFor(index, clientUser);
 		boost::shared_ptr<RecordBuffer> rb = boost::make_shared<RecordBuffer>(
 		            index, buffer, samples, m_absoluteSampleEstimation);
 		
@@ -426,6 +536,52 @@ void VoiceRecorder::addBuffer(const ClientUser *clientUser,
 	m_sleepCondition.wakeAll();
 }
 
+void VoiceRecorder::addPacket(const ClientUser *clientUser,
+                              const char *data,
+                              unsigned int len,
+                              unsigned int iSeq,
+                              MessageHandler::UDPMessageType type) {
+
+	Q_ASSERT(isInPassthroughMode());
+
+	// Only Opus packets can go into an Ogg Opus file.
+	if (!m_recording || type != MessageHandler::UDPVoiceOpus)
+		return;
+
+	PacketDataStream pds(data, static_cast<int>(len));
+	int size;
+	pds >> size;
+	size &= 0x1fff;
+	if (size == 0 || static_cast<unsigned int>(size) > pds.left() || !pds.isValid())
+		return;
+
+	const QByteArray packet(pds.charPtr(), size);
+
+	const int index = indexForUser(clientUser);
+
+	{
+		QMutexLocker l(&m_bufferLock);
+		ensureRecordInfoExistsFor(index, clientUser);
+		boost::shared_ptr<RecordPacket> rp = boost::make_shared<RecordPacket>(
+		            index, packet, iSeq, (m_timestamp->elapsed() / 1000) * 48);
+
+		m_recordPacket << rp;
+	}
+
+	// Tell the main loop that we have new audio data.
+	m_sleepCondition.wakeAll();
+}
+
+void VoiceRecorder::ensureRecordInfoExistsFor(int index, const ClientUser *clientUser) {
+	if (!m_recordInfo.contains(index)) {
+		boost::shared_ptr<RecordInfo> ri = boost::make_shared<RecordInfo>(
+		            m_config.mixDownMode ? QLatin1String("Mixdown")
+		                                 : clientUser->qsName);
+		
+		m_recordInfo.insert(index, ri);
+	}
+}
+
 quint64 VoiceRecorder::getElapsedTime() const {
 	return m_timestamp->elapsed();
 }
@@ -438,6 +594,10 @@ bool VoiceRecorder::isInMixDownMode() const {
 	return m_config.mixDownMode;
 }
 
+bool VoiceRecorder::isInPassthroughMode() const {
+	return m_config.recordingFormat == VoiceRecorderFormat::OPUS;
+}
+
 QString VoiceRecorderFormat::getFormatDescription(VoiceRecorderFormat::Format fm) {
 	switch (fm) {
 		case VoiceRecorderFormat::WAV:
@@ -450,6 +610,8 @@ QString VoiceRecorderFormat::getFormatDescription(VoiceRecorderFormat::Format fm
 			return VoiceRecorder::tr(".au - Uncompressed");
 		case VoiceRecorderFormat::FLAC:
 			return VoiceRecorder::tr(".flac - Lossless compressed");
+		case VoiceRecorderFormat::OPUS:
+			return VoiceRecorder::tr(".opus - Received audio, not re-encoded");
 		default:
 			return QString();
 	}
@@ -467,6 +629,8 @@ QString VoiceRecorderFormat::getFormatDefaultExtension(VoiceRecorderFormat::Form
 			return QLatin1String("au");
 		case VoiceRecorderFormat::FLAC:
 			return QLatin1String("flac");
+		case VoiceRecorderFormat::OPUS:
+			return QLatin1String("opus");
 		default:
 			return QString();
 	}
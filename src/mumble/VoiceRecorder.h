@@ -18,6 +18,7 @@
 #endif
 
 #include <QtCore/QDateTime>
+#include <QtCore/QFile>
 #include <QtCore/QHash>
 #include <QtCore/QMutex>
 #include <QtCore/QObject>
@@ -30,7 +31,10 @@
 
 #include <sndfile.h>
 
+#include "Message.h"
+
 class ClientUser;
+class OggOpusWriter;
 class RecordUser;
 class Timer;
 
@@ -51,6 +55,9 @@ namespace VoiceRecorderFormat {
 		AU,
 		/// FLAC Format
 		FLAC,
+		/// Ogg Opus, written from the received packets without re-encoding.
+		/// Always multichannel.
+		OPUS,
 		kEnd
 	};
 
@@ -68,6 +75,11 @@ namespace VoiceRecorderFormat {
 /// which is then encoded using one of the formats of VoiceRecordingFormat::Format
 /// and written to disk.
 ///
+/// In passthrough mode (VoiceRecorderFormat::OPUS) it takes the received
+/// Opus packets through addPacket instead, and writes them unchanged into
+/// one Ogg Opus file per user. Nothing is decoded or encoded for the
+/// recording; mixing the files down is left to a separate, offline step.
+///
 class VoiceRecorder : public QThread {
 		Q_OBJECT
 	public:
@@ -109,6 +121,13 @@ class VoiceRecorder : public QThread {
 		/// @param clientUser User for which to add the audio data. NULL in mixdown mode.
 		void addBuffer(const ClientUser *clientUser, boost::shared_array<float> buffer, int samples);
 		
+		/// Adds a received voice packet to the recorder. Only used in
+		/// passthrough mode.
+		/// @param data The packet after its sequence number, as passed to
+		///             AudioOutput::addFrameToBuffer.
+		/// @param iSeq The sequence number of the first frame in the packet.
+		void addPacket(const ClientUser *clientUser, const char *data, unsigned int len, unsigned int iSeq, MessageHandler::UDPMessageType type);
+
 		/// Returns the elapsed time since the recording started.
 		quint64 getElapsedTime() const;
 
@@ -117,6 +136,10 @@ class VoiceRecorder : public QThread {
 
 		/// Returns true if the recorder is recording mixed down data instead of multichannel
 		bool isInMixDownMode() const;
+
+		/// Returns true if the recorder takes packets through addPacket
+		/// instead of audio through addBuffer.
+		bool isInPassthroughMode() const;
 signals:
 		/// Emitted if an error is encountered
 		void error(int err, QString strerr);
@@ -149,6 +172,26 @@ signals:
 			quint64 absoluteStartSample;
 		};
 
+		/// Stores a received Opus packet in passthrough mode.
+		struct RecordPacket {
+			RecordPacket(int recordInfoIndex_,
+			             const QByteArray &data_,
+			             unsigned int seq_,
+			             quint64 arrivalSample_);
+
+			/// Hashmap index for the user
+			const int recordInfoIndex;
+
+			/// The Opus packet.
+			const QByteArray data;
+
+			/// Sequence number of the first frame in the packet.
+			const unsigned int seq;
+
+			/// Absolute sample number at which the packet was received
+			const quint64 arrivalSample;
+		};
+
 		/// Stores the recording state for one user.
 		struct RecordInfo {
 			RecordInfo(const QString& userName_);
@@ -162,6 +205,18 @@ signals:
 
 			/// The last absolute sample we wrote for this users
 			quint64 lastWrittenAbsoluteSample;
+
+			/// The Ogg Opus file in passthrough mode.
+			QFile oggFile;
+			boost::scoped_ptr<OggOpusWriter> oggWriter;
+
+			/// In passthrough mode, a packet is placed by its sequence
+			/// number relative to the first packet of its run: that one's
+			/// sequence number and position. A new run starts when the
+			/// sender reset its sequence numbers.
+			bool hasRun;
+			unsigned int runStartSeq;
+			quint64 runStartSample;
 		};
 
 		typedef QHash< int, boost::shared_ptr<RecordInfo> > RecordInfoMap;
@@ -178,9 +233,26 @@ signals:
 		/// Create a sndfile SF_INFO structure describing the currently configured recording format
 		SF_INFO createSoundFileInfo() const;
 		
+		/// Creates the RecordInfo for the given index if there is none yet.
+		/// The caller must hold |m_bufferLock|.
+		void ensureRecordInfoExistsFor(int index, const ClientUser *clientUser);
+
+		/// Returns a file name that is not taken yet for the given recording
+		/// information and creates its directory. Will abort recording on
+		/// failure and return an empty string.
+		QString createFileNameFor(const boost::shared_ptr<RecordInfo> &ri);
+
 		/// Opens the file for the given recording information
 		/// Helper function for run method. Will abort recording on failure.
 		bool ensureFileIsOpenedFor(SF_INFO &soundFileInfo, boost::shared_ptr<RecordInfo> &ri);
+
+		/// Opens the Ogg Opus file for the given recording information.
+		/// Helper function for run method. Will abort recording on failure.
+		bool ensureOggFileIsOpenedFor(boost::shared_ptr<RecordInfo> &ri);
+
+		/// Writes one packet, with the silence before it, in passthrough
+		/// mode. Returns false if recording was aborted.
+		bool writePacket(const boost::shared_ptr<RecordPacket> &rp);
 		
 		/// Hash which maps the |uiSession| of all users for which we have to keep a recording state to the corresponding RecordInfo object.
 		RecordInfoMap m_recordInfo;
@@ -188,13 +260,18 @@ signals:
 		/// List containing all unprocessed RecordBuffer objects.
 		QList< boost::shared_ptr<RecordBuffer> > m_recordBuffer;
 
+		/// List containing all unprocessed RecordPacket objects.
+		QList< boost::shared_ptr<RecordPacket> > m_recordPacket;
+
 		/// The user which is used to record local audio.
 		boost::scoped_ptr<RecordUser> m_recordUser;
 
 		/// High precision timer for buffer timestamps.
 		boost::scoped_ptr<Timer> m_timestamp;
 
-		/// Protects the buffer list |qlRecordBuffer|.
+		/// Protects the lists |m_recordBuffer| and |m_recordPacket| and the
+		/// hash |m_recordInfo|, which the network, input and audio threads
+		/// all add to.
 		QMutex m_bufferLock;
 
 		/// Wait condition and mutex to block until there is new data.
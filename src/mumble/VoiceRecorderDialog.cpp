@@ -65,6 +65,7 @@ VoiceRecorderDialog::VoiceRecorderDialog(QWidget *p) : QDialog(p), qtTimer(new Q
 		g.s.iRecordingFormat = 0;
 
 	qcbFormat->setCurrentIndex(g.s.iRecordingFormat);
+	on_qcbFormat_currentIndexChanged(qcbFormat->currentIndex());
 }
 
 VoiceRecorderDialog::~VoiceRecorderDialog() {
@@ -173,7 +174,7 @@ void VoiceRecorderDialog::on_qpbStart_clicked() {
 	VoiceRecorder::Config config;
 	config.sampleRate = ao->getMixerFreq();
 	config.fileName = dir.absoluteFilePath(basename + QLatin1Char('.') + suffix);
-	config.mixDownMode = qrbDownmix->isChecked();
+	config.mixDownMode = qrbDownmix->isChecked() && (ifm != VoiceRecorderFormat::OPUS);
 	config.recordingFormat = static_cast<VoiceRecorderFormat::Format>(ifm);
 
 	g.sh->recorder.reset(new VoiceRecorder(this, config));
@@ -243,6 +244,15 @@ void VoiceRecorderDialog::on_qpbTargetDirectoryBrowse_clicked() {
 		qleTargetDirectory->setText(dir);
 }
 
+void VoiceRecorderDialog::on_qcbFormat_currentIndexChanged(int index) {
+	// Received packets can only be written per user; a mixdown would have
+	// to decode them.
+	const bool passthrough = (index == VoiceRecorderFormat::OPUS);
+	qrbDownmix->setDisabled(passthrough);
+	if (passthrough)
+		qrbMultichannel->setChecked(true);
+}
+
 void VoiceRecorderDialog::reset(bool resettimer) {
 	qtTimer->stop();
 
@@ -26,6 +26,7 @@ class VoiceRecorderDialog : public QDialog, private Ui::VoiceRecorderDialog {
 		void on_qpbStop_clicked();
 		void on_qtTimer_timeout();
 		void on_qpbTargetDirectoryBrowse_clicked();
+		void on_qcbFormat_currentIndexChanged(int index);
 
 		void onRecorderStopped();
 		void onRecorderStarted();
@@ -8,6 +8,7 @@
 #include "ServerHandler.h"
 #include "AudioInput.h"
 #include "AudioOutput.h"
+#include "AudioBenchmark.h"
 #include "AudioWizard.h"
 #include "Cert.h"
 #include "Database.h"
@@ -136,6 +137,8 @@ int main(int argc, char **argv) {
 	bool customJackClientName = false;
 	bool bRpcMode = false;
 	QString rpcCommand;
+	QString qsAudioBenchmark;
+	int iBenchmarkSpeakers = 1;
 	QUrl url;
 	if (a.arguments().count() > 1) {
 		QStringList args = a.arguments();
@@ -169,6 +172,12 @@ int main(int argc, char **argv) {
 					"                Show the Mumble authors.\n"
 					"  --third-party-licenses\n"
 					"                Show licenses for third-party software used by Mumble.\n"
+					"  --audio-benchmark <file>\n"
+					"                Run the sound file through the audio pipeline as fast\n"
+					"                as possible, print the time spent in each stage and exit.\n"
+					"                Needs no sound card.\n"
+					"  --speakers <n>\n"
+					"                Number of speakers the audio benchmark mixes (default 1).\n"
 					"\n"
 				);
 				QString rpcHelpBanner = MainWindow::tr(
@@ -225,6 +234,18 @@ int main(int argc, char **argv) {
 			} else if (args.at(i) == QLatin1String("-third-party-licenses") || args.at(i) == QLatin1String("--third-party-licenses")) {
 				printf("%s", qPrintable(License::printableThirdPartyLicenseInfo()));
 				return 0;
+			} else if (args.at(i) == QLatin1String("--audio-benchmark") || args.at(i) == QLatin1String("--speakers")) {
+				if (i + 1 >= args.count()) {
+					printf("%s\n", qPrintable(MainWindow::tr("Error: %1 needs an argument").arg(args.at(i))));
+					return 1;
+				}
+				if (args.at(i) == QLatin1String("--speakers")) {
+					iBenchmarkSpeakers = qMax(args.at(i + 1).toInt(), 1);
+				} else {
+					qsAudioBenchmark = args.at(i + 1);
+					bAllowMultiple = true;
+				}
+				++i;
 			} else if (args.at(i) == QLatin1String("rpc")) {
 				bRpcMode = true;
 				if (args.count() - 1 > i) {
@@ -364,6 +385,21 @@ int main(int argc, char **argv) {
 
 	DeferInit::run_initializers();
 
+	// The benchmark needs the codecs, but no window or audio device.
+	if (! qsAudioBenchmark.isEmpty()) {
+		res = AudioBenchmark::run(qsAudioBenchmark, iBenchmarkSpeakers);
+
+		delete g.c;
+		g.le.clear();
+
+		DeferInit::run_destroyers();
+
+		delete Global::g_global_struct;
+		Global::g_global_struct = NULL;
+
+		return res;
+	}
+
 	ApplicationPalette applicationPalette;
 	
 	Themes::apply();
@@ -423,6 +459,7 @@ int main(int argc, char **argv) {
 
 	// Initialize database
 	g.db = new Database(QLatin1String("main"));
+	g.db->warmBlobCache();
 
 #ifdef USE_BONJOUR
 	// Initialize bonjour
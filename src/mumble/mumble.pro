@@ -84,7 +84,15 @@ HEADERS *= BanEditor.h \
     AudioOutput.h \
     AudioOutputSample.h \
     AudioOutputSpeech.h \
+    AdaptiveJitterBuffer.h \
     AudioOutputUser.h \
+    AudioMixKernels.h \
+    Resampler.h \
+    AudioInputKernels.h \
+    AudioDecodePool.h \
+    AudioBenchmark.h \
+    LatencyProbe.h \
+    SPSCRing.h \
     CELTCodec.h \
     CustomElements.h \
     MainWindow.h \
@@ -123,6 +131,7 @@ HEADERS *= BanEditor.h \
     UserInformation.h \
     SocketRPC.h \
     VoiceRecorder.h \
+    OggOpusWriter.h \
     VoiceRecorderDialog.h \
     WebFetch.h \
     ../SignalCurry.h \
@@ -154,7 +163,14 @@ SOURCES *= BanEditor.cpp \
     AudioOutput.cpp \
     AudioOutputSample.cpp \
     AudioOutputSpeech.cpp \
+    AdaptiveJitterBuffer.cpp \
     AudioOutputUser.cpp \
+    AudioMixKernels.cpp \
+    Resampler.cpp \
+    AudioInputKernels.cpp \
+    AudioDecodePool.cpp \
+    AudioBenchmark.cpp \
+    LatencyProbe.cpp \
     main.cpp \
     CELTCodec.cpp \
     CustomElements.cpp \
@@ -200,6 +216,7 @@ SOURCES *= BanEditor.cpp \
     UserInformation.cpp \
     SocketRPC.cpp \
     VoiceRecorder.cpp \
+    OggOpusWriter.cpp \
     VoiceRecorderDialog.cpp \
     WebFetch.cpp \
     MumbleApplication.cpp \
@@ -350,6 +367,10 @@ CONFIG(sbcelt) {
   CONFIG *= bonjour
 }
 
+!CONFIG(no-null-audio) {
+  CONFIG *= null-audio
+}
+
 CONFIG(no-vorbis-recording) {
   DEFINES *= NO_VORBIS_RECORDING
 }
@@ -579,6 +600,11 @@ oss {
   INCLUDEPATH *= /usr/lib/oss/include
 }
 
+null-audio {
+  HEADERS *= NullAudio.h
+  SOURCES *= NullAudio.cpp
+}
+
 pulseaudio {
   DEFINES *= USE_PULSEAUDIO
   must_pkgconfig(libpulse)
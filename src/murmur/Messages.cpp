@@ -948,7 +948,7 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 			a->pDeny=ChanACL::None;
 			a->pAllow=ChanACL::Write | ChanACL::Traverse;
 
-			clearACLCache();
+			clearChannelACLCache(c);
 		}
 		updateChannel(c);
 
@@ -1079,6 +1079,9 @@ void Server::msgChannelState(ServerUser *uSource, MumbleProto::ChannelState &msg
 
 			{
 				QWriteLocker wl(&qrwlVoiceThread);
+				invalidateWhisperTargets(c, true);
+				invalidateWhisperTargets(c->cParent);
+				invalidateWhisperTargets(p);
 				c->cParent->removeChannel(c);
 				p->addChannel(c);
 			}
@@ -1399,7 +1402,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 			}
 		}
 
-		clearACLCache();
+		clearChannelACLCache(c);
 
 		if (! hasPermission(uSource, c, ChanACL::Write) && ((uSource->iId >= 0) || !uSource->qsHash.isEmpty())) {
 			{
@@ -1417,7 +1420,7 @@ void Server::msgACL(ServerUser *uSource, MumbleProto::ACL &msg) {
 				a->pAllow = ChanACL::Write | ChanACL::Traverse;
 			}
 
-			clearACLCache();
+			clearChannelACLCache(c);
 		}
 
 
@@ -1652,6 +1655,8 @@ void Server::msgVoiceTarget(ServerUser *uSource, MumbleProto::VoiceTarget &msg)
 		else
 			uSource->qmTargets.insert(target, wt);
 	}
+
+	queueWhisperTargetRebuild(uSource->uiSession, target);
 }
 
 void Server::msgPermissionQuery(ServerUser *uSource, MumbleProto::PermissionQuery &msg) {
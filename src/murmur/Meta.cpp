@@ -66,6 +66,8 @@ MetaParams::MetaParams() {
 
 	iLogDays = 31;
 
+	iGRPCEventQueueSize = 1000;
+
 	iObfuscate = 0;
 	bSendVersion = true;
 	bBonjour = true;
@@ -303,6 +305,9 @@ void MetaParams::read(QString fname) {
 	qsGRPCAddress = typeCheckedFromSettings("grpc", qsGRPCAddress);
 	qsGRPCCert = typeCheckedFromSettings("grpccert", qsGRPCCert);
 	qsGRPCKey = typeCheckedFromSettings("grpckey", qsGRPCKey);
+	iGRPCEventQueueSize = typeCheckedFromSettings("grpceventqueuesize", iGRPCEventQueueSize);
+
+	qsMetricsAddress = typeCheckedFromSettings("metrics", qsMetricsAddress);
 
 	iLogDays = typeCheckedFromSettings("logdays", iLogDays);
 
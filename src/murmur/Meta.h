@@ -84,6 +84,13 @@ public:
 	QString qsGRPCAddress;
 	QString qsGRPCCert;
 	QString qsGRPCKey;
+	/// The maximum number of undelivered messages that are
+	/// queued for a single gRPC event stream subscriber.
+	int iGRPCEventQueueSize;
+
+	/// Address ("host:port") of the Prometheus metrics
+	/// endpoint. Disabled when empty.
+	QString qsMetricsAddress;
 
 	QString qsRegName;
 	QString qsRegPassword;
@@ -20,6 +20,8 @@
 
 #include <QtCore/QStack>
 
+#include <limits>
+
 #include "MurmurRPC.proto.Wrapper.cpp"
 
 // GRPC system overview
@@ -723,28 +725,89 @@ void MurmurRPCImpl::idToTextureSlot(QByteArray &res, int id) {
 	}
 }
 
+// Does the event match the given subscriber filter?
+static bool MatchesFilter(const ::MurmurRPC::Server_Event_Filter &filter, const ::MurmurRPC::Server_Event &e) {
+	if (filter.types_size() > 0) {
+		bool found = false;
+		for (int i = 0; i < filter.types_size() && !found; i++) {
+			found = filter.types(i) == e.type();
+		}
+		if (!found) {
+			return false;
+		}
+	}
+	if (filter.channels_size() > 0) {
+		for (int i = 0; i < filter.channels_size(); i++) {
+			const auto id = filter.channels(i).id();
+			if (e.has_channel() && e.channel().id() == id) {
+				return true;
+			}
+			if (e.has_user() && e.user().has_channel() && e.user().channel().id() == id) {
+				return true;
+			}
+		}
+		return false;
+	}
+	return true;
+}
+
+// Are there any listeners subscribed to events of the given server? Used to
+// avoid converting events that nobody will receive.
+bool MurmurRPCImpl::hasServerEventListeners(const ::Server *s) const {
+	return m_serverServiceListeners.contains(s->iServerNum) || m_serverServiceFilteredListeners.contains(s->iServerNum);
+}
+
 // Sends a server event to subscribed listeners.
+//
+// The event is only copied once; all subscribers' write queues share it.
 void MurmurRPCImpl::sendServerEvent(const ::Server *s, const ::MurmurRPC::Server_Event &e) {
-	auto listeners = m_serverServiceListeners;
 	auto serverID = s->iServerNum;
-	auto i = listeners.find(serverID);
+	auto shared = std::make_shared<const ::MurmurRPC::Server_Event>(e);
 
-	for ( ; i != listeners.end() && i.key() == serverID; ++i) {
-		auto listener = i.value();
-		listener->ref();
-		auto cb = [this, listener, serverID] (::MurmurRPC::Wrapper::V1_ServerEvents *, bool ok) {
-			if (!ok && m_serverServiceListeners.remove(serverID, listener) > 0) {
+	{
+		auto listeners = m_serverServiceListeners;
+		auto i = listeners.find(serverID);
+
+		for ( ; i != listeners.end() && i.key() == serverID; ++i) {
+			auto listener = i.value();
+			listener->ref();
+			auto cb = [this, listener, serverID] (::MurmurRPC::Wrapper::V1_ServerEvents *, bool ok) {
+				if (!ok && m_serverServiceListeners.remove(serverID, listener) > 0) {
+					listener->deref();
+				}
 				listener->deref();
+			};
+			listener->write(shared, listener->callback(cb));
+		}
+	}
+
+	{
+		auto listeners = m_serverServiceFilteredListeners;
+		auto i = listeners.find(serverID);
+
+		for ( ; i != listeners.end() && i.key() == serverID; ++i) {
+			auto listener = i.value();
+			if (!MatchesFilter(listener->request, e)) {
+				continue;
 			}
-			listener->deref();
-		};
-		listener->write(e, listener->callback(cb));
+			listener->ref();
+			auto cb = [this, listener, serverID] (::MurmurRPC::Wrapper::V1_ServerEventsFiltered *, bool ok) {
+				if (!ok && m_serverServiceFilteredListeners.remove(serverID, listener) > 0) {
+					listener->deref();
+				}
+				listener->deref();
+			};
+			listener->write(shared, listener->callback(cb));
+		}
 	}
 }
 
 // Called when a user's state changes.
 void MurmurRPCImpl::userStateChanged(const ::User *user) {
 	::Server *s = qobject_cast< ::Server *> (sender());
+	if (!hasServerEventListeners(s)) {
+		return;
+	}
 
 	::MurmurRPC::Server_Event event;
 	event.mutable_server()->set_id(s->iServerNum);
@@ -756,6 +819,9 @@ void MurmurRPCImpl::userStateChanged(const ::User *user) {
 // Called when a user sends a text message.
 void MurmurRPCImpl::userTextMessage(const ::User *user, const ::TextMessage &message) {
 	::Server *s = qobject_cast< ::Server *> (sender());
+	if (!hasServerEventListeners(s)) {
+		return;
+	}
 
 	::MurmurRPC::Server_Event event;
 	event.mutable_server()->set_id(s->iServerNum);
@@ -768,6 +834,9 @@ void MurmurRPCImpl::userTextMessage(const ::User *user, const ::TextMessage &mes
 // Called when a user successfully connects to a server.
 void MurmurRPCImpl::userConnected(const ::User *user) {
 	::Server *s = qobject_cast< ::Server *> (sender());
+	if (!hasServerEventListeners(s)) {
+		return;
+	}
 
 	::MurmurRPC::Server_Event event;
 	event.mutable_server()->set_id(s->iServerNum);
@@ -781,6 +850,9 @@ void MurmurRPCImpl::userDisconnected(const ::User *user) {
 	::Server *s = qobject_cast< ::Server *> (sender());
 
 	removeUserActiveContextActions(s, user);
+	if (!hasServerEventListeners(s)) {
+		return;
+	}
 
 	::MurmurRPC::Server_Event event;
 	event.mutable_server()->set_id(s->iServerNum);
@@ -792,6 +864,9 @@ void MurmurRPCImpl::userDisconnected(const ::User *user) {
 // Called when a channel's state changes.
 void MurmurRPCImpl::channelStateChanged(const ::Channel *channel) {
 	::Server *s = qobject_cast< ::Server *> (sender());
+	if (!hasServerEventListeners(s)) {
+		return;
+	}
 
 	::MurmurRPC::Server_Event event;
 	event.mutable_server()->set_id(s->iServerNum);
@@ -803,6 +878,9 @@ void MurmurRPCImpl::channelStateChanged(const ::Channel *channel) {
 // Called when a channel is created.
 void MurmurRPCImpl::channelCreated(const ::Channel *channel) {
 	::Server *s = qobject_cast< ::Server *> (sender());
+	if (!hasServerEventListeners(s)) {
+		return;
+	}
 
 	::MurmurRPC::Server_Event event;
 	event.mutable_server()->set_id(s->iServerNum);
@@ -814,6 +892,9 @@ void MurmurRPCImpl::channelCreated(const ::Channel *channel) {
 // Called when a channel is removed.
 void MurmurRPCImpl::channelRemoved(const ::Channel *channel) {
 	::Server *s = qobject_cast< ::Server *> (sender());
+	if (!hasServerEventListeners(s)) {
+		return;
+	}
 
 	::MurmurRPC::Server_Event event;
 	event.mutable_server()->set_id(s->iServerNum);
@@ -1124,6 +1205,122 @@ void MurmurRPCImpl::run() {
 // do not have to complete the call during the lifetime of the method (although
 // this is only used for streaming calls).
 
+// Page size used by the streaming queries if the request does not set a limit.
+static const uint32_t DefaultStreamPageSize = 1000;
+
+// Fills list with the log page described by the query's cursor and limit,
+// and sets list's next cursor if more entries may follow.
+static void LogPage(int serverID, const ::MurmurRPC::Log_Query &query, ::MurmurRPC::Log_List *list, const ::MurmurRPC::Log_Cursor *cursor = NULL) {
+	if (!cursor) {
+		cursor = &query.cursor();
+	}
+	const uint32_t limit = query.has_limit() ? query.limit() : DefaultStreamPageSize;
+	if (limit == 0) {
+		return;
+	}
+
+	auto dblog = ::ServerDB::getLogPage(serverID, static_cast<unsigned int>(cursor->before()), cursor->skip(), limit);
+	foreach(const ::ServerDB::LogRecord &record, dblog) {
+		auto rpcLog = list->add_entries();
+		ToRPC(serverID, record, rpcLog);
+	}
+
+	if (static_cast<uint32_t>(dblog.count()) < limit) {
+		return;
+	}
+
+	// Count the entries that share the last entry's timestamp, so the next
+	// page can skip past them.
+	const unsigned int last = dblog.last().first;
+	uint32_t skip = 0;
+	for (int i = dblog.count() - 1; i >= 0 && dblog.at(i).first == last; i--) {
+		skip++;
+	}
+	if (cursor->has_before() && static_cast<unsigned int>(cursor->before()) == last) {
+		skip += cursor->skip();
+	}
+	list->mutable_next()->set_before(last);
+	list->mutable_next()->set_skip(skip);
+}
+
+// Fills list with at most limit registered users with an ID greater than
+// after, and sets list's next value if more users may follow.
+static void DatabaseUserPage(::Server *server, const ::MurmurRPC::DatabaseUser_Query &query, int after, ::MurmurRPC::DatabaseUser_List *list) {
+	QString filter;
+	if (query.has_filter()) {
+		filter = u8(query.filter());
+	}
+	const uint32_t limit = query.has_limit() ? query.limit() : DefaultStreamPageSize;
+
+	list->mutable_server()->set_id(server->iServerNum);
+
+	auto users = server->getRegisteredUsersPage(filter, after, static_cast<int>(qMin<uint32_t>(limit, std::numeric_limits<int>::max())));
+	for (auto itr = users.constBegin(); itr != users.constEnd(); ++itr) {
+		auto user = list->add_users();
+		user->mutable_server()->set_id(server->iServerNum);
+		user->set_id(itr.key());
+		user->set_name(u8(itr.value()));
+	}
+
+	if (limit > 0 && static_cast<uint32_t>(users.count()) == limit) {
+		list->set_next(users.lastKey());
+	}
+}
+
+// Writes the next page of a LogStream call, and schedules the page after it
+// once the write has completed.
+static void StreamLogPage(::MurmurRPC::Wrapper::V1_LogStream *call, int serverID, const ::MurmurRPC::Log_Cursor &cursor) {
+	::MurmurRPC::Log_List list;
+	list.mutable_server()->set_id(serverID);
+	LogPage(serverID, call->request, &list, &cursor);
+
+	const bool more = list.has_next();
+	const auto next = list.next();
+
+	call->ref();
+	auto cb = [serverID, more, next] (::MurmurRPC::Wrapper::V1_LogStream *c, bool ok) {
+		if (ok) {
+			if (more) {
+				StreamLogPage(c, serverID, next);
+			} else {
+				c->end();
+			}
+		}
+		c->deref();
+	};
+	call->write(list, call->callback(cb));
+}
+
+// Writes the next page of a DatabaseUserStream call, and schedules the page
+// after it once the write has completed.
+static void StreamDatabaseUserPage(::MurmurRPC::Wrapper::V1_DatabaseUserStream *call, int serverID, int after) {
+	auto server = meta->qhServers.value(serverID);
+	if (!server) {
+		// The server was stopped while streaming.
+		call->end();
+		return;
+	}
+
+	::MurmurRPC::DatabaseUser_List list;
+	DatabaseUserPage(server, call->request, after, &list);
+
+	const bool more = list.has_next();
+	const int next = static_cast<int>(list.next());
+
+	call->ref();
+	auto cb = [serverID, more, next] (::MurmurRPC::Wrapper::V1_DatabaseUserStream *c, bool ok) {
+		if (ok) {
+			if (more) {
+				StreamDatabaseUserPage(c, serverID, next);
+			} else {
+				c->end();
+			}
+		}
+		c->deref();
+	};
+	call->write(list, call->callback(cb));
+}
+
 namespace MurmurRPC {
 namespace Wrapper {
 
@@ -1208,6 +1405,23 @@ void V1_ServerEvents::done(bool) {
 	deref();
 }
 
+void V1_ServerEventsFiltered::impl(bool) {
+	auto server = MustServer(request);
+	if (request.overflow() == ::MurmurRPC::Server_Event_Filter_Overflow_Disconnect) {
+		setOverflowPolicy(Disconnect);
+	}
+	rpc->m_serverServiceFilteredListeners.insert(server->iServerNum, this);
+}
+
+void V1_ServerEventsFiltered::done(bool) {
+	auto &ssls = rpc->m_serverServiceFilteredListeners;
+	auto i = std::find(ssls.begin(), ssls.end(), this);
+	if (i != ssls.end()) {
+		ssls.erase(i);
+	}
+	deref();
+}
+
 void V1_GetUptime::impl(bool) {
 	::MurmurRPC::Uptime uptime;
 	uptime.set_secs(meta->tUptime.elapsed()/1000000LL);
@@ -1375,6 +1589,20 @@ void V1_TextMessageFilter::done(bool) {
 	deref();
 }
 
+void V1_LogStream::impl(bool) {
+	auto serverID = MustServerID(request);
+
+	::MurmurRPC::Log_Cursor cursor;
+	if (request.has_cursor()) {
+		cursor = request.cursor();
+	}
+	StreamLogPage(this, serverID, cursor);
+}
+
+void V1_LogStream::done(bool) {
+	deref();
+}
+
 void V1_LogQuery::impl(bool) {
 	auto serverID = MustServerID(request);
 
@@ -1387,6 +1615,12 @@ void V1_LogQuery::impl(bool) {
 	list.mutable_server()->set_id(serverID);
 	list.set_total(total);
 
+	if (request.has_limit()) {
+		LogPage(serverID, request, &list);
+		end(list);
+		return;
+	}
+
 	if (!request.has_min() || !request.has_max()) {
 		end(list);
 		return;
@@ -1465,6 +1699,24 @@ void V1_ChannelQuery::impl(bool) {
 	::MurmurRPC::Channel_List list;
 	list.mutable_server()->set_id(server->iServerNum);
 
+	if (request.has_limit() || request.has_after()) {
+		const auto &ids = server->qmChannelsById;
+		auto i = ids.constBegin();
+		if (request.has_after()) {
+			i = ids.upperBound(request.after());
+		}
+		const auto limit = request.has_limit() ? request.limit() : std::numeric_limits<uint32_t>::max();
+		for ( ; i != ids.constEnd() && static_cast<uint32_t>(list.channels_size()) < limit; ++i) {
+			auto rpcChannel = list.add_channels();
+			ToRPC(server, i.value(), rpcChannel);
+		}
+		if (i != ids.constEnd() && list.channels_size() > 0) {
+			list.set_next(list.channels(list.channels_size() - 1).id());
+		}
+		end(list);
+		return;
+	}
+
 	foreach(const ::Channel *channel, server->qhChannels) {
 		auto rpcChannel = list.add_channels();
 		ToRPC(server, channel, rpcChannel);
@@ -1584,6 +1836,28 @@ void V1_UserQuery::impl(bool) {
 	::MurmurRPC::User_List list;
 	list.mutable_server()->set_id(server->iServerNum);
 
+	if (request.has_limit() || request.has_after()) {
+		const auto &sessions = server->qmUsersBySession;
+		auto i = sessions.constBegin();
+		if (request.has_after()) {
+			i = sessions.upperBound(request.after());
+		}
+		const auto limit = request.has_limit() ? request.limit() : std::numeric_limits<uint32_t>::max();
+		for ( ; i != sessions.constEnd() && static_cast<uint32_t>(list.users_size()) < limit; ++i) {
+			const ::ServerUser *user = i.value();
+			if (user->sState != ServerUser::Authenticated) {
+				continue;
+			}
+			auto rpcUser = list.add_users();
+			ToRPC(server, user, rpcUser);
+		}
+		if (i != sessions.constEnd() && list.users_size() > 0) {
+			list.set_next(list.users(list.users_size() - 1).session());
+		}
+		end(list);
+		return;
+	}
+
 	foreach(const ::ServerUser *user, server->qhUsers) {
 		if (user->sState != ServerUser::Authenticated) {
 			continue;
@@ -1726,9 +2000,18 @@ void V1_BansGet::impl(bool) {
 
 	::MurmurRPC::Ban_List list;
 	list.mutable_server()->set_id(server->iServerNum);
-	foreach(const ::Ban &ban, server->qlBans) {
+
+	const int offset = static_cast<int>(qMin<uint32_t>(request.offset(), server->qlBans.count()));
+	int count = server->qlBans.count() - offset;
+	if (request.has_limit()) {
+		count = static_cast<int>(qMin<uint32_t>(request.limit(), count));
+	}
+	for (int i = offset; i < offset + count; i++) {
 		auto rpcBan = list.add_bans();
-		ToRPC(server, ban, rpcBan);
+		ToRPC(server, server->qlBans.at(i), rpcBan);
+	}
+	if (offset + count < server->qlBans.count()) {
+		list.set_next(offset + count);
 	}
 
 	end(list);
@@ -1876,7 +2159,7 @@ void V1_ACLSet::impl(bool) {
 		}
 	}
 
-	server->clearACLCache();
+	server->clearChannelACLCache(channel);
 	server->updateChannel(channel);
 
 	end();
@@ -1979,9 +2262,25 @@ void V1_AuthenticatorStream::done(bool) {
 	deref();
 }
 
+void V1_DatabaseUserStream::impl(bool) {
+	auto server = MustServer(request);
+	StreamDatabaseUserPage(this, server->iServerNum, request.has_after() ? static_cast<int>(request.after()) : -1);
+}
+
+void V1_DatabaseUserStream::done(bool) {
+	deref();
+}
+
 void V1_DatabaseUserQuery::impl(bool) {
 	auto server = MustServer(request);
 
+	if (request.has_limit()) {
+		::MurmurRPC::DatabaseUser_List list;
+		DatabaseUserPage(server, request, request.has_after() ? static_cast<int>(request.after()) : -1, &list);
+		end(list);
+		return;
+	}
+
 	QString filter;
 	if (request.has_filter()) {
 		filter = u8(request.filter());
@@ -20,6 +20,7 @@
 #include "Meta.h"
 
 #include <atomic>
+#include <memory>
 
 #include <QMultiHash>
 
@@ -32,6 +33,7 @@ namespace MurmurRPC {
 		class V1_ContextActionEvents;
 		class V1_Events;
 		class V1_ServerEvents;
+		class V1_ServerEventsFiltered;
 		class V1_AuthenticatorStream;
 		class V1_TextMessageFilter;
 	}
@@ -57,6 +59,7 @@ class MurmurRPCImpl : public QThread {
 		QSet<::MurmurRPC::Wrapper::V1_Events *> m_metaServiceListeners;
 
 		QMultiHash<int, ::MurmurRPC::Wrapper::V1_ServerEvents *> m_serverServiceListeners;
+		QMultiHash<int, ::MurmurRPC::Wrapper::V1_ServerEventsFiltered *> m_serverServiceFilteredListeners;
 
 		QMutex qmAuthenticatorsLock;
 		QHash<int, ::MurmurRPC::Wrapper::V1_AuthenticatorStream *> m_authenticators;
@@ -76,6 +79,7 @@ class MurmurRPCImpl : public QThread {
 		void removeTextMessageFilter(const ::Server *s);
 		void removeAuthenticator(const ::Server *s);
 		void sendMetaEvent(const ::MurmurRPC::Event &e);
+		bool hasServerEventListeners(const ::Server *s) const;
 		void sendServerEvent(const ::Server *s, const ::MurmurRPC::Server_Event &e);
 
 	public slots:
@@ -192,27 +196,73 @@ public:
 /// The helper method "write" automatically queues writes to the stream. Without
 /// write queuing, the grpc crashes if a stream.Write is called before a
 /// previous stream.Write completes.
+///
+/// Queued messages are shared, so a single event that is fanned out to many
+/// subscribers is only converted and stored once. The queue is bounded (see
+/// the grpceventqueuesize setting); when a slow subscriber fills it up, either
+/// the oldest undelivered message is dropped or the stream is cancelled,
+/// depending on the call's overflow policy.
 template <class InType, class OutType>
 class RPCSingleStreamCall : public RPCCall {
+public:
+	enum OverflowPolicy { DropOldest, Disconnect };
+private:
 	QMutex m_writeLock;
-	QQueue< QPair<OutType, void *> > m_writeQueue;
+	QQueue< QPair<std::shared_ptr<const OutType>, void *> > m_writeQueue;
+	int m_queueLimit;
+	OverflowPolicy m_overflowPolicy;
+	bool m_cancelled;
 public:
 	InType request;
 	::grpc::ServerAsyncWriter < OutType > stream;
-	RPCSingleStreamCall(MurmurRPCImpl *rpcImpl) : RPCCall(rpcImpl), stream(&context) {
+	RPCSingleStreamCall(MurmurRPCImpl *rpcImpl) : RPCCall(rpcImpl), m_queueLimit(Meta::mp.iGRPCEventQueueSize), m_overflowPolicy(DropOldest), m_cancelled(false), stream(&context) {
 	}
 
 	virtual void error(const ::grpc::Status &err) {
 		stream.Finish(err, done());
 	}
 
+	/// Successfully finishes the stream. Must only be called once all
+	/// writes have completed.
+	///
+	/// Both the finish and the done notification release a reference, so
+	/// an extra one is taken here.
+	virtual void end() {
+		ref();
+		stream.Finish(::grpc::Status::OK, done());
+	}
+
+	void setOverflowPolicy(OverflowPolicy policy) {
+		QMutexLocker l(&m_writeLock);
+		m_overflowPolicy = policy;
+	}
+
 	void write(const OutType &msg, void *tag) {
+		write(std::make_shared<const OutType>(msg), tag);
+	}
+
+	void write(const std::shared_ptr<const OutType> &msg, void *tag) {
 		QMutexLocker l(&m_writeLock);
+		if (m_cancelled) {
+			complete(tag, false);
+			return;
+		}
 		if (m_writeQueue.size() > 0) {
+			// The head of the queue is the write that is currently in
+			// flight, so it does not count against the limit.
+			if (m_queueLimit > 0 && m_writeQueue.size() > m_queueLimit) {
+				if (m_overflowPolicy == Disconnect) {
+					m_cancelled = true;
+					context.TryCancel();
+					complete(tag, false);
+					return;
+				}
+				complete(m_writeQueue.takeAt(1).second, true);
+			}
 			m_writeQueue.enqueue(qMakePair(msg, tag));
 		} else {
-			m_writeQueue.enqueue(qMakePair(OutType(), tag));
-			stream.Write(msg, writeCB());
+			m_writeQueue.enqueue(qMakePair(std::shared_ptr<const OutType>(), tag));
+			stream.Write(*msg, writeCB());
 		}
 	}
 
@@ -222,16 +272,22 @@ private:
 		return new ::boost::function<void(bool)>(callback);
 	}
 
-	void writeCallback(bool ok) {
-		QMutexLocker l(&m_writeLock);
-		auto processed = m_writeQueue.dequeue();
-		if (processed.second) {
-			auto cb = static_cast< ::boost::function<void(bool)> *>(processed.second);
+	static void complete(void *tag, bool ok) {
+		if (tag) {
+			auto cb = static_cast< ::boost::function<void(bool)> *>(tag);
 			(*cb)(ok);
 			delete cb;
 		}
+	}
+
+	void writeCallback(bool ok) {
+		QMutexLocker l(&m_writeLock);
+		auto processed = m_writeQueue.dequeue();
+		complete(processed.second, ok);
 		if (m_writeQueue.size() > 0) {
-			stream.Write(m_writeQueue.head().first, writeCB());
+			auto &next = m_writeQueue.head();
+			stream.Write(*next.first, writeCB());
+			next.first.reset();
 		}
 	}
 };
@@ -57,12 +57,28 @@ namespace Murmur {
 			virtual void getLogLen_async(const ::Murmur::AMD_Server_getLogLenPtr&,
 			                             const Ice::Current&);
 
+			virtual void getLogPage_async(const ::Murmur::AMD_Server_getLogPagePtr&,
+			                              ::Ice::Int,
+			                              ::Ice::Int,
+			                              ::Ice::Int,
+			                              const Ice::Current&);
+
 			virtual void getUsers_async(const ::Murmur::AMD_Server_getUsersPtr&,
 			                            const Ice::Current&);
 
 			virtual void getChannels_async(const ::Murmur::AMD_Server_getChannelsPtr&,
 			                               const Ice::Current&);
 
+			virtual void getUsersPage_async(const ::Murmur::AMD_Server_getUsersPagePtr&,
+			                                ::Ice::Int,
+			                                ::Ice::Int,
+			                                const Ice::Current&);
+
+			virtual void getChannelsPage_async(const ::Murmur::AMD_Server_getChannelsPagePtr&,
+			                                   ::Ice::Int,
+			                                   ::Ice::Int,
+			                                   const Ice::Current&);
+
 			virtual void getTree_async(const ::Murmur::AMD_Server_getTreePtr&,
 			                           const Ice::Current&);
 
@@ -73,6 +89,11 @@ namespace Murmur {
 			virtual void getBans_async(const ::Murmur::AMD_Server_getBansPtr&,
 			                           const Ice::Current&);
 
+			virtual void getBansPage_async(const ::Murmur::AMD_Server_getBansPagePtr&,
+			                               ::Ice::Int,
+			                               ::Ice::Int,
+			                               const Ice::Current&);
+
 			virtual void setBans_async(const ::Murmur::AMD_Server_setBansPtr&,
 			                           const ::Murmur::BanList&,
 			                           const Ice::Current&);
@@ -170,6 +191,12 @@ namespace Murmur {
 			                                      const ::std::string&,
 			                                      const Ice::Current&);
 
+			virtual void getRegisteredUsersPage_async(const ::Murmur::AMD_Server_getRegisteredUsersPagePtr&,
+			                                          const ::std::string&,
+			                                          ::Ice::Int,
+			                                          ::Ice::Int,
+			                                          const Ice::Current&);
+
 			virtual void verifyPassword_async(const ::Murmur::AMD_Server_verifyPasswordPtr&,
 			                                  const ::std::string&,
 			                                  const ::std::string&,
@@ -1009,6 +1009,23 @@ static void impl_Server_getLogLen(const ::Murmur::AMD_Server_getLogLenPtr cb, in
 	cb->ice_response(len);
 }
 
+#define ACCESS_Server_getLogPage_READ
+static void impl_Server_getLogPage(const ::Murmur::AMD_Server_getLogPagePtr cb, int server_id,  ::Ice::Int before,  ::Ice::Int skip,  ::Ice::Int count) {
+	NEED_SERVER_EXISTS;
+
+	::Murmur::LogList ll;
+
+	if (before >= 0 && skip >= 0 && count > 0) {
+		QList<ServerDB::LogRecord> dblog = ServerDB::getLogPage(server_id, before, skip, count);
+		foreach(const ServerDB::LogRecord &e, dblog) {
+			::Murmur::LogEntry le;
+			logToLog(e, le);
+			ll.push_back(le);
+		}
+	}
+	cb->ice_response(ll);
+}
+
 #define ACCESS_Server_getUsers_READ
 static void impl_Server_getUsers(const ::Murmur::AMD_Server_getUsersPtr cb, int server_id) {
 	NEED_SERVER;
@@ -1035,6 +1052,39 @@ static void impl_Server_getChannels(const ::Murmur::AMD_Server_getChannelsPtr cb
 	cb->ice_response(cm);
 }
 
+#define ACCESS_Server_getUsersPage_READ
+static void impl_Server_getUsersPage(const ::Murmur::AMD_Server_getUsersPagePtr cb, int server_id,  ::Ice::Int after,  ::Ice::Int count) {
+	NEED_SERVER;
+	::Murmur::UserList ul;
+
+	QMap<unsigned int, ServerUser *>::const_iterator i = server->qmUsersBySession.upperBound(static_cast<unsigned int>(qMax(after, 0)));
+	for (; i != server->qmUsersBySession.constEnd() && static_cast<int>(ul.size()) < count; ++i) {
+		const ServerUser *p = i.value();
+		if (p->sState == ::ServerUser::Authenticated) {
+			::Murmur::User mp;
+			userToUser(p, mp);
+			ul.push_back(mp);
+		}
+	}
+	cb->ice_response(ul);
+}
+
+#define ACCESS_Server_getChannelsPage_READ
+static void impl_Server_getChannelsPage(const ::Murmur::AMD_Server_getChannelsPagePtr cb, int server_id,  ::Ice::Int after,  ::Ice::Int count) {
+	NEED_SERVER;
+	::Murmur::ChannelList cl;
+
+	QMap<unsigned int, Channel *>::const_iterator i = server->qmChannelsById.constBegin();
+	if (after >= 0)
+		i = server->qmChannelsById.upperBound(static_cast<unsigned int>(after));
+	for (; i != server->qmChannelsById.constEnd() && static_cast<int>(cl.size()) < count; ++i) {
+		::Murmur::Channel mc;
+		channelToChannel(i.value(), mc);
+		cl.push_back(mc);
+	}
+	cb->ice_response(cl);
+}
+
 static bool userSort(const ::User *a, const ::User *b) {
 	return ::User::lessThan(a, b);
 }
@@ -1105,6 +1155,18 @@ static void impl_Server_getBans(const ::Murmur::AMD_Server_getBansPtr cb, int se
 	cb->ice_response(bl);
 }
 
+#define ACCESS_Server_getBansPage_READ
+static void impl_Server_getBansPage(const ::Murmur::AMD_Server_getBansPagePtr cb, int server_id,  ::Ice::Int first,  ::Ice::Int count) {
+	NEED_SERVER;
+	::Murmur::BanList bl;
+	for (int i = qMax(first, 0); i < server->qlBans.count() && static_cast<int>(bl.size()) < count; ++i) {
+		::Murmur::Ban mb;
+		banToBan(server->qlBans.at(i), mb);
+		bl.push_back(mb);
+	}
+	cb->ice_response(bl);
+}
+
 static void impl_Server_setBans(const ::Murmur::AMD_Server_setBansPtr cb, int server_id,  const ::Murmur::BanList& bans) {
 	NEED_SERVER;
 	server->qlBans.clear();
@@ -1424,7 +1486,7 @@ static void impl_Server_setACL(const ::Murmur::AMD_Server_setACLPtr cb, int serv
 		acl->pAllow = static_cast<ChanACL::Permissions>(ai.allow) & ChanACL::All;
 	}
 
-	server->clearACLCache();
+	server->clearChannelACLCache(channel);
 	server->updateChannel(channel);
 	cb->ice_response();
 }
@@ -1527,6 +1589,20 @@ static void impl_Server_getRegisteredUsers(const ::Murmur::AMD_Server_getRegiste
 	cb->ice_response(rpl);
 }
 
+#define ACCESS_Server_getRegisteredUsersPage_READ
+static void impl_Server_getRegisteredUsersPage(const ::Murmur::AMD_Server_getRegisteredUsersPagePtr cb, int server_id,  const ::std::string& filter,  ::Ice::Int after,  ::Ice::Int count) {
+	NEED_SERVER;
+	Murmur::NameMap rpl;
+
+	const QMap<int, QString> l = server->getRegisteredUsersPage(u8(filter), after, count);
+	QMap<int, QString>::const_iterator i;
+	for (i = l.constBegin(); i != l.constEnd(); ++i) {
+		rpl[i.key()] = u8(i.value());
+	}
+
+	cb->ice_response(rpl);
+}
+
 #define ACCESS_Server_verifyPassword_READ
 static void impl_Server_verifyPassword(const ::Murmur::AMD_Server_verifyPasswordPtr cb, int server_id,  const ::std::string& name,  const ::std::string& pw) {
 	NEED_SERVER;
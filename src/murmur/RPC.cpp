@@ -142,6 +142,9 @@ bool Server::setChannelStateGRPC(const MumbleProto::ChannelState &cs, QString &e
 
 			{
 				QWriteLocker wl(&qrwlVoiceThread);
+				invalidateWhisperTargets(channel, true);
+				invalidateWhisperTargets(channel->cParent);
+				invalidateWhisperTargets(parent);
 				channel->cParent->removeChannel(channel);
 				parent->addChannel(channel);
 			}
@@ -248,6 +251,9 @@ bool Server::setChannelState(Channel *cChannel, Channel *cParent, const QString
 
 		{
 			QWriteLocker wl(&qrwlVoiceThread);
+			invalidateWhisperTargets(cChannel, true);
+			invalidateWhisperTargets(cChannel->cParent);
+			invalidateWhisperTargets(cParent);
 			cChannel->cParent->removeChannel(cChannel);
 			cParent->addChannel(cChannel);
 		}
@@ -109,6 +109,7 @@ QSslSocket *SslServer::nextPendingSSLConnection() {
 
 Server::Server(int snum, QObject *p) : QThread(p) {
 	bValid = true;
+	bWhisperRebuildPending = false;
 	iServerNum = snum;
 #ifdef USE_BONJOUR
 	bsRegistration = NULL;
@@ -878,6 +879,9 @@ void Server::run() {
 				}
 				len -= 4;
 
+				++smMetrics.sVoice.uiPacketsIn;
+				smMetrics.sVoice.uiBytesIn += len;
+
 				MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((buffer[0] >> 5) & 0x7);
 
 				if (msgType == MessageHandler::UDPVoiceSpeex ||
@@ -915,11 +919,14 @@ void Server::run() {
 }
 
 bool Server::checkDecrypt(ServerUser *u, const char *encrypt, char *plain, unsigned int len) {
+	MetricTimer mt(smMetrics.sVoice.hStage[ServerMetrics::StageDecrypt]);
 	QMutexLocker l(&u->qmCrypt);
 
 	if (u->csCrypt.isValid() && u->csCrypt.decrypt(reinterpret_cast<const unsigned char *>(encrypt), reinterpret_cast<unsigned char *>(plain), len))
 		return true;
 
+	++smMetrics.sVoice.uiDecryptFailures;
+
 	if (u->csCrypt.tLastGood.elapsed() > 5000000ULL) {
 		if (u->csCrypt.tLastRequest.elapsed() > 5000000ULL) {
 			u->csCrypt.tLastRequest.restart();
@@ -930,6 +937,13 @@ bool Server::checkDecrypt(ServerUser *u, const char *encrypt, char *plain, unsig
 }
 
 void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force) {
+#ifdef MURMUR_VOICE_BENCHMARK
+	Q_UNUSED(cache);
+	Q_UNUSED(force);
+	voiceBenchmarkSink(u, data, len);
+#else
+	ServerMetrics::Shard &shard = smMetrics.shard(this);
+
 	if ((u->aiUdpFlag.load() == 1 || force) && (u->sUdpSocket != INVALID_SOCKET)) {
 #if defined(__LP64__)
 		STACKVAR(char, ebuffer, len+4+16);
@@ -938,6 +952,7 @@ void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &c
 		STACKVAR(char, buffer, len+4);
 #endif
 		{
+			MetricTimer mt(shard.hStage[ServerMetrics::StageEncrypt]);
 			QMutexLocker wl(&u->qmCrypt);
 
 			if (!u->csCrypt.isValid()) {
@@ -989,12 +1004,18 @@ void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &c
 				return;
 			pktinfo->ipi_spec_dst.s_addr = tcpha.hash[3];
 		}
+#endif
 
-
-		::sendmsg(u->sUdpSocket, &msg, 0);
+		{
+			MetricTimer mt(shard.hStage[ServerMetrics::StageSend]);
+#ifdef Q_OS_LINUX
+			::sendmsg(u->sUdpSocket, &msg, 0);
 #else
-		::sendto(u->sUdpSocket, buffer, len+4, 0, reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress), (u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+			::sendto(u->sUdpSocket, buffer, len+4, 0, reinterpret_cast<struct sockaddr *>(& u->saiUdpAddress), (u->saiUdpAddress.ss_family == AF_INET6) ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
 #endif
+		}
+		++shard.uiPacketsOut;
+		shard.uiBytesOut += len + 4;
 #ifdef Q_OS_WIN
 		if (Meta::hQoS && dwFlow)
 			QOSRemoveSocketFromFlow(Meta::hQoS, 0, dwFlow, 0);
@@ -1003,8 +1024,11 @@ void Server::sendMessage(ServerUser *u, const char *data, int len, QByteArray &c
 	} else {
 		if (cache.isEmpty())
 			cache = QByteArray(data, len);
+		++shard.uiTunnelPacketsOut;
+		shard.uiTunnelBytesOut += len;
 		emit tcpTransmit(cache,u->uiSession);
 	}
+#endif
 }
 
 #define SENDTO \
@@ -1019,6 +1043,9 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 	if (u->sState != ServerUser::Authenticated || u->bMute || u->bSuppress || u->bSelfMute)
 		return;
 
+	ServerMetrics::Shard &shard = smMetrics.shard(this);
+	MetricTimer mt(shard.hStage[ServerMetrics::StageRoute]);
+
 	QByteArray qba, qba_npos;
 	unsigned int counter;
 	char buffer[UDP_PACKET_SIZE];
@@ -1028,7 +1055,9 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 	unsigned int target = data[0] & 0x1f;
 	unsigned int poslen;
 
-	// Check the voice data rate limit.
+	// Check the voice data rate limit. The voice benchmark sends far
+	// faster than real time, so it skips this.
+#ifndef MURMUR_VOICE_BENCHMARK
 	{
 		BandwidthRecord *bw = &u->bwr;
 
@@ -1037,9 +1066,11 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 
 		if (! bw->addFrame(packetsize, iMaxBandwidth / 8)) {
 			// Suppress packet.
-			 return;
+			++shard.uiBandwidthDrops;
+			return;
 		}
 	}
+#endif
 
 	// Read the sequence number.
 	pdi >> counter;
@@ -1098,73 +1129,19 @@ void Server::processMsg(ServerUser *u, const char *data, int len) {
 		QSet<ServerUser *> channel;
 		QSet<ServerUser *> direct;
 
-		if (u->qmTargetCache.contains(target)) {
-			const ServerUser::TargetCache &cache = u->qmTargetCache.value(target);
-			channel = cache.first;
-			direct = cache.second;
+		QMap<int, WhisperTargetCache>::const_iterator i = u->qmTargetCache.constFind(target);
+		if (i != u->qmTargetCache.constEnd()) {
+			channel = i.value().qsChannel;
+			direct = i.value().qsDirect;
 		} else {
-			const WhisperTarget &wt = u->qmTargets.value(target);
-			if (! wt.qlChannels.isEmpty()) {
-				QMutexLocker qml(&qmCache);
-
-				foreach(const WhisperTarget::Channel &wtc, wt.qlChannels) {
-					Channel *wc = qhChannels.value(wtc.iId);
-					if (wc) {
-						bool link = wtc.bLinks && ! wc->qhLinks.isEmpty();
-						bool dochildren = wtc.bChildren && ! wc->qlChannels.isEmpty();
-						bool group = ! wtc.qsGroup.isEmpty();
-						if (!link && !dochildren && ! group) {
-							// Common case
-							if (ChanACL::hasPermission(u, wc, ChanACL::Whisper, &acCache)) {
-								foreach(User *p, wc->qlUsers) {
-									channel.insert(static_cast<ServerUser *>(p));
-								}
-							}
-						} else {
-							QSet<Channel *> channels;
-							if (link)
-								channels = wc->allLinks();
-							else
-								channels.insert(wc);
-							if (dochildren)
-								channels.unite(wc->allChildren());
-							const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
-							const QString &qsg = redirect.isEmpty() ? wtc.qsGroup : redirect;
-							foreach(Channel *tc, channels) {
-								if (ChanACL::hasPermission(u, tc, ChanACL::Whisper, &acCache)) {
-									foreach(User *p, tc->qlUsers) {
-										ServerUser *su = static_cast<ServerUser *>(p);
-										if (! group || Group::isMember(tc, tc, qsg, su)) {
-											channel.insert(su);
-										}
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-
-			{
-				QMutexLocker qml(&qmCache);
-
-				foreach(unsigned int id, wt.qlSessions) {
-					ServerUser *pDst = qhUsers.value(id);
-					if (pDst && ChanACL::hasPermission(u, pDst->cChannel, ChanACL::Whisper, &acCache) && !channel.contains(pDst))
-						direct.insert(pDst);
-				}
-			}
-
-			int uiSession = u->uiSession;
-			qrwlVoiceThread.unlock();
-			qrwlVoiceThread.lockForWrite();
-
-			if (qhUsers.contains(uiSession))
-				u->qmTargetCache.insert(target, ServerUser::TargetCache(channel, direct));
-			qrwlVoiceThread.unlock();
-			qrwlVoiceThread.lockForRead();
-			if (! qhUsers.contains(uiSession))
-				return;
+			// Resolve the target for this packet only. The cache itself
+			// is owned by the main thread, which fills it in later.
+			WhisperTargetCache cache;
+			buildWhisperTarget(u, u->qmTargets.value(target), cache);
+			channel = cache.qsChannel;
+			direct = cache.qsDirect;
+
+			queueWhisperTargetRebuild(u->uiSession, target);
 		}
 		if (! channel.isEmpty()) {
 			buffer[0] = static_cast<char>(type | 1);
@@ -1279,6 +1256,7 @@ void Server::newClient() {
 			qhUsers.insert(u->uiSession, u);
 			qhHostUsers[ha].insert(u);
 		}
+		qmUsersBySession.insert(u->uiSession, u);
 
 		connect(u, SIGNAL(connectionClosed(QAbstractSocket::SocketError, const QString &)), this, SLOT(connectionClosed(QAbstractSocket::SocketError, const QString &)));
 		connect(u, SIGNAL(message(unsigned int, const QByteArray &)), this, SLOT(message(unsigned int, const QByteArray &)));
@@ -1440,7 +1418,16 @@ void Server::connectionClosed(QAbstractSocket::SocketError err, const QString &r
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 
+		// Drop every whisper target that could still point at u.
+		QSet<int> channels;
+		if (old)
+			channels.insert(old->iId);
+		QSet<unsigned int> sessions;
+		sessions.insert(u->uiSession);
+		invalidateWhisperTargets(channels, sessions, u);
+
 		qhUsers.remove(u->uiSession);
+		qmUsersBySession.remove(u->uiSession);
 		qhHostUsers[u->haAddress].remove(u);
 
 		quint16 port = (u->saiUdpAddress.ss_family == AF_INET6) ? (reinterpret_cast<sockaddr_in6 *>(&u->saiUdpAddress)->sin6_port) : (reinterpret_cast<sockaddr_in *>(&u->saiUdpAddress)->sin_port);
@@ -1486,6 +1473,9 @@ void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *
 
 		u->aiUdpFlag = 0;
 
+		++smMetrics.sMain.uiPacketsIn;
+		smMetrics.sMain.uiBytesIn += len;
+
 		const char *buffer = qbaMsg.constData();
 
 		MessageHandler::UDPMessageType msgType = static_cast<MessageHandler::UDPMessageType>((buffer[0] >> 5) & 0x7);
@@ -1534,6 +1524,11 @@ void Server::message(unsigned int uiType, const QByteArray &qbaMsg, ServerUser *
 	}
 #endif
 
+	if (uiType >= ServerMetrics::MessageTypeCount)
+		return;
+
+	MetricTimer mt(smMetrics.hHandler[uiType]);
+
 	switch (uiType) {
 			MUMBLE_MH_ALL
 	}
@@ -1612,6 +1607,11 @@ void Server::removeChannel(Channel *chan, Channel *dest) {
 
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
+		QSet<int> channels;
+		channels.insert(chan->iId);
+		if (chan->cParent)
+			channels.insert(chan->cParent->iId);
+		invalidateWhisperTargets(channels);
 		chan->unlink(NULL);
 	}
 
@@ -1704,6 +1704,11 @@ void Server::userEnterChannel(User *p, Channel *c, MumbleProto::UserState &mpus)
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->addUser(p);
 
+		// The new channel and the user's own targets are taken care of
+		// by clearACLCache below.
+		if (old)
+			invalidateWhisperTargets(old);
+
 		bool mayspeak = ChanACL::hasPermission(static_cast<ServerUser *>(p), c, ChanACL::Speak, NULL);
 		bool sup = p->bSuppress;
 
@@ -1833,9 +1838,198 @@ void Server::clearACLCache(User *p) {
 	{
 		QWriteLocker lock(&qrwlVoiceThread);
 
+		if (p) {
+			// A user's permissions and group memberships only affect the
+			// targets they whisper to, and the targets that may reach them
+			// in their current channel or by session.
+			QSet<int> channels;
+			if (p->cChannel)
+				channels.insert(p->cChannel->iId);
+			QSet<unsigned int> sessions;
+			sessions.insert(p->uiSession);
+			invalidateWhisperTargets(channels, sessions, static_cast<ServerUser *>(p));
+		} else {
+			invalidateWhisperTargets(qhChannels.keys().toSet());
+		}
+	}
+}
+
+/// Clears the permission caches after the ACLs or groups of c changed.
+/// Since both are inherited, only whisper targets that depend on c or one
+/// of its subchannels are dropped.
+void Server::clearChannelACLCache(Channel *c) {
+	MumbleProto::PermissionQuery mppq;
+
+	{
+		QMutexLocker qml(&qmCache);
+
+		foreach(ChanACL::ChanCache *h, acCache)
+			delete h;
+		acCache.clear();
+
 		foreach(ServerUser *u, qhUsers)
-			u->qmTargetCache.clear();
+			if (u->sState == ServerUser::Authenticated)
+				flushClientPermissionCache(u, mppq);
+	}
+
+	{
+		QWriteLocker lock(&qrwlVoiceThread);
+		invalidateWhisperTargets(c, true);
+	}
+}
+
+/// Resolves wt, as whispered to by u, into its recipients and records the
+/// channels and sessions the result depends on.
+///
+/// Called both from the voice thread, with a read lock on qrwlVoiceThread,
+/// and from the main thread.
+void Server::buildWhisperTarget(ServerUser *u, const WhisperTarget &wt, WhisperTargetCache &cache) {
+	QMutexLocker qml(&qmCache);
+
+	foreach(const WhisperTarget::Channel &wtc, wt.qlChannels) {
+		cache.qsChannels.insert(wtc.iId);
+
+		Channel *wc = qhChannels.value(wtc.iId);
+		if (! wc)
+			continue;
+
+		bool link = wtc.bLinks && ! wc->qhLinks.isEmpty();
+		bool dochildren = wtc.bChildren && ! wc->qlChannels.isEmpty();
+		bool group = ! wtc.qsGroup.isEmpty();
+		if (!link && !dochildren && ! group) {
+			// Common case
+			if (ChanACL::hasPermission(u, wc, ChanACL::Whisper, &acCache)) {
+				foreach(User *p, wc->qlUsers) {
+					cache.qsChannel.insert(static_cast<ServerUser *>(p));
+				}
+			}
+		} else {
+			QSet<Channel *> channels;
+			if (link)
+				channels = wc->allLinks();
+			else
+				channels.insert(wc);
+			if (dochildren)
+				channels.unite(wc->allChildren());
+			const QString &redirect = u->qmWhisperRedirect.value(wtc.qsGroup);
+			const QString &qsg = redirect.isEmpty() ? wtc.qsGroup : redirect;
+			foreach(Channel *tc, channels) {
+				cache.qsChannels.insert(tc->iId);
+				if (ChanACL::hasPermission(u, tc, ChanACL::Whisper, &acCache)) {
+					foreach(User *p, tc->qlUsers) {
+						ServerUser *su = static_cast<ServerUser *>(p);
+						if (! group || Group::isMember(tc, tc, qsg, su)) {
+							cache.qsChannel.insert(su);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	foreach(unsigned int id, wt.qlSessions) {
+		cache.qsSessions.insert(id);
+
+		ServerUser *pDst = qhUsers.value(id);
+		if (! pDst || ! pDst->cChannel)
+			continue;
+		cache.qsChannels.insert(pDst->cChannel->iId);
+		if (ChanACL::hasPermission(u, pDst->cChannel, ChanACL::Whisper, &acCache) && !cache.qsChannel.contains(pDst))
+			cache.qsDirect.insert(pDst);
+	}
+}
+
+/// Asks the main thread to fill in the cache entry for the given whisper
+/// target. Safe to call from any thread.
+void Server::queueWhisperTargetRebuild(unsigned int session, int target) {
+	QMutexLocker qml(&qmWhisperRebuild);
+
+	qsWhisperRebuild.insert(QPair<unsigned int, int>(session, target));
+	if (! bWhisperRebuildPending) {
+		bWhisperRebuildPending = true;
+		QCoreApplication::instance()->postEvent(this, new ExecEvent(boost::bind(&Server::rebuildWhisperTargets, this)));
+	}
+}
+
+/// Resolves all queued whisper targets on the main thread and publishes
+/// them to the voice thread under a single write lock.
+void Server::rebuildWhisperTargets() {
+	QSet<QPair<unsigned int, int> > pending;
+	{
+		QMutexLocker qml(&qmWhisperRebuild);
+		pending = qsWhisperRebuild;
+		qsWhisperRebuild.clear();
+		bWhisperRebuildPending = false;
+	}
+
+	QList<QPair<ServerUser *, int> > targets;
+	QList<WhisperTargetCache> caches;
+
+	typedef QPair<unsigned int, int> SessionTarget;
+	foreach(const SessionTarget &st, pending) {
+		ServerUser *u = qhUsers.value(st.first);
+		if (! u || ! u->qmTargets.contains(st.second) || u->qmTargetCache.contains(st.second))
+			continue;
+
+		WhisperTargetCache cache;
+		buildWhisperTarget(u, u->qmTargets.value(st.second), cache);
+		targets << QPair<ServerUser *, int>(u, st.second);
+		caches << cache;
+	}
+
+	if (targets.isEmpty())
+		return;
+
+	QWriteLocker lock(&qrwlVoiceThread);
+	for (int i = 0; i < targets.count(); ++i)
+		targets.at(i).first->qmTargetCache.insert(targets.at(i).second, caches.at(i));
+}
+
+void Server::invalidateWhisperTargets(const QSet<int> &channels, const QSet<unsigned int> &sessions, ServerUser *owner) {
+	foreach(ServerUser *u, qhUsers) {
+		QMap<int, WhisperTargetCache>::iterator i = u->qmTargetCache.begin();
+		while (i != u->qmTargetCache.end()) {
+			const WhisperTargetCache &cache = i.value();
+			bool stale = (u == owner);
+
+			// Test the smaller of the two sets against the larger one.
+			if (! stale) {
+				const QSet<int> &small = (channels.count() < cache.qsChannels.count()) ? channels : cache.qsChannels;
+				const QSet<int> &large = (&small == &channels) ? cache.qsChannels : channels;
+				foreach(int id, small) {
+					if (large.contains(id)) {
+						stale = true;
+						break;
+					}
+				}
+			}
+			if (! stale) {
+				foreach(unsigned int id, sessions) {
+					if (cache.qsSessions.contains(id)) {
+						stale = true;
+						break;
+					}
+				}
+			}
+
+			if (stale) {
+				queueWhisperTargetRebuild(u->uiSession, i.key());
+				i = u->qmTargetCache.erase(i);
+			} else {
+				++i;
+			}
+		}
+	}
+}
+
+void Server::invalidateWhisperTargets(Channel *c, bool recurse) {
+	QSet<int> channels;
+	channels.insert(c->iId);
+	if (recurse) {
+		foreach(Channel *child, c->allChildren())
+			channels.insert(child->iId);
 	}
+	invalidateWhisperTargets(channels);
 }
 
 QString Server::addressToString(const QHostAddress &adr, unsigned short port) {
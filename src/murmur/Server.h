@@ -19,6 +19,7 @@
 #include "Timer.h"
 #include "HostAddress.h"
 #include "Ban.h"
+#include "ServerMetrics.h"
 
 #ifndef Q_MOC_RUN
 # include <boost/function.hpp>
@@ -51,6 +52,14 @@ class PacketDataStream;
 class ServerUser;
 class User;
 class QNetworkAccessManager;
+struct WhisperTarget;
+struct WhisperTargetCache;
+
+#ifdef MURMUR_VOICE_BENCHMARK
+/// Receives every packet Server::sendMessage would have sent.
+/// Defined by the voice benchmark (VoiceBenchmark.cpp).
+void voiceBenchmarkSink(ServerUser *u, const char *data, int len);
+#endif
 
 struct TextMessage {
 	QList<unsigned int> qlSessions;
@@ -274,15 +283,27 @@ class Server : public QThread {
 		QHash<QPair<HostAddress, quint16>, ServerUser *> qhPeerUsers;
 		QHash<HostAddress, QSet<ServerUser *> > qhHostUsers;
 		QHash<unsigned int, Channel *> qhChannels;
+		/// qhUsers and qhChannels ordered by session and channel ID, so the
+		/// paged RPC queries can seek to their cursor. Main thread only.
+		QMap<unsigned int, ServerUser *> qmUsersBySession;
+		QMap<unsigned int, Channel *> qmChannelsById;
 
 		QMutex qmCache;
 		ChanACL::ACLCache acCache;
 
 		QHash<int, QString> qhUserNameCache;
 		QHash<QString, int> qhUserIDCache;
+		/// The authenticator's registered users for the filter of the
+		/// current getRegisteredUsersPage() walk, fetched on its first page.
+		QString qsRegisteredPageFilter;
+		QMap<int, QString> qmRegisteredPage;
 
 		QList<Ban> qlBans;
 
+		/// Voice path, message handler and queue metrics. See ServerMetrics
+		/// for which thread may write which part.
+		ServerMetrics smMetrics;
+
 		void processMsg(ServerUser *u, const char *data, int len);
 		void sendMessage(ServerUser *u, const char *data, int len, QByteArray &cache, bool force = false);
 		void run();
@@ -297,6 +318,23 @@ class Server : public QThread {
 		void sendClientPermission(ServerUser *u, Channel *c, bool updatelast = false);
 		void flushClientPermissionCache(ServerUser *u, MumbleProto::PermissionQuery &mpqq);
 		void clearACLCache(User *p = NULL);
+		void clearChannelACLCache(Channel *c);
+
+		/// Whisper target caches are only ever filled on the main thread;
+		/// the voice thread resolves a missing target for the packet at
+		/// hand and queues it here for rebuilding.
+		QMutex qmWhisperRebuild;
+		QSet<QPair<unsigned int, int> > qsWhisperRebuild;
+		bool bWhisperRebuildPending;
+
+		void buildWhisperTarget(ServerUser *u, const WhisperTarget &wt, WhisperTargetCache &cache);
+		void queueWhisperTargetRebuild(unsigned int session, int target);
+		void rebuildWhisperTargets();
+		/// Drops the whisper target caches that depend on any of the
+		/// given channels or sessions, or that belong to owner. The
+		/// caller must hold qrwlVoiceThread for write.
+		void invalidateWhisperTargets(const QSet<int> &channels, const QSet<unsigned int> &sessions = QSet<unsigned int>(), ServerUser *owner = NULL);
+		void invalidateWhisperTargets(Channel *c, bool recurse = false);
 
 		void sendProtoAll(const ::google::protobuf::Message &msg, unsigned int msgType, unsigned int minversion);
 		void sendProtoExcept(ServerUser *, const ::google::protobuf::Message &msg, unsigned int msgType, unsigned int minversion);
@@ -415,6 +453,7 @@ class Server : public QThread {
 		bool unregisterUserDB(int id);
 		QList<UserInfo> getRegisteredUsersEx();
 		QMap<int, QString > getRegisteredUsers(const QString &filter = QString());
+		QMap<int, QString > getRegisteredUsersPage(const QString &filter, int after, int count);
 		bool setInfo(int id, const QMap<int, QString> &info);
 		bool setTexture(int id, const QByteArray &texture);
 		bool isUserId(int id);
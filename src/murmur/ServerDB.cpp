@@ -18,6 +18,7 @@
 #include "Group.h"
 #include "Meta.h"
 #include "Server.h"
+#include "ServerMetrics.h"
 #include "ServerUser.h"
 #include "User.h"
 #include "PBKDF2.h"
@@ -608,6 +609,20 @@ ServerDB::ServerDB() {
 			SQLDO("UPDATE `%1meta` SET `value` = '6' WHERE `keystring` = 'version'");
 		}
 	}
+
+	if (version < 7) {
+		// Log pages are ordered by time and then by insertion order, which
+		// getLogPage() needs an index for. SQLite indexes carry the rowid
+		// already; the other databases get a column for it.
+		if (Meta::mp.qsDBDriver == "QPSQL") {
+			SQLQUERY("ALTER TABLE `%1slog` ADD COLUMN `log_id` BIGSERIAL");
+			SQLQUERY("CREATE INDEX `%1slog_time_id` ON `%1slog`(`msgtime`, `log_id`)");
+		} else if (Meta::mp.qsDBDriver != "QSQLITE") {
+			SQLDO("ALTER TABLE `%1slog` ADD COLUMN `log_id` BIGINT NOT NULL AUTO_INCREMENT UNIQUE");
+			SQLDO("CREATE INDEX `%1slog_time_id` ON `%1slog`(`msgtime`, `log_id`)");
+		}
+		SQLDO("UPDATE `%1meta` SET `value` = '7' WHERE `keystring` = 'version'");
+	}
 	query.clear();
 }
 
@@ -678,10 +693,16 @@ bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn
 		if (Meta::mp.qsDBDriver == "QPSQL") {
 			q.replace("`", "\"");
 		}
-		
-		if (query.exec(q)) {
+
+		bool ok;
+		{
+			MetricTimer mt(SQLMetrics::histogram(q));
+			ok = query.exec(q);
+		}
+		if (ok) {
 			return true;
 		} else {
+			++SQLMetrics::uiFailures;
 			if (fatal) {
 				*db = QSqlDatabase();
 				qFatal("SQL Error [%s]: %s", qPrintable(query.lastQuery()), qPrintable(query.lastError().text()));
@@ -698,9 +719,16 @@ bool ServerDB::query(QSqlQuery &query, const QString &str, bool fatal, bool warn
 bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn) {
 	if (! str.isEmpty())
 		prepare(query, str, fatal, warn);
-	if (query.exec()) {
+
+	bool ok;
+	{
+		MetricTimer mt(SQLMetrics::histogram(query.lastQuery()));
+		ok = query.exec();
+	}
+	if (ok) {
 		return true;
 	} else {
+		++SQLMetrics::uiFailures;
 
 		if (fatal) {
 			*db = QSqlDatabase();
@@ -715,9 +743,16 @@ bool ServerDB::exec(QSqlQuery &query, const QString &str, bool fatal, bool warn)
 bool ServerDB::execBatch(QSqlQuery &query, const QString &str, bool fatal) {
 	if (! str.isEmpty())
 		prepare(query, str, fatal);
-	if (query.execBatch()) {
+
+	bool ok;
+	{
+		MetricTimer mt(SQLMetrics::histogram(query.lastQuery()));
+		ok = query.execBatch();
+	}
+	if (ok) {
 		return true;
 	} else {
+		++SQLMetrics::uiFailures;
 
 		if (fatal) {
 			*db = QSqlDatabase();
@@ -983,6 +1018,56 @@ QMap<int, QString > Server::getRegisteredUsers(const QString &filter) {
 	return m;
 }
 
+/// Fetch at most \p count registered users whose user id is greater than \p after,
+/// ordered by user id. Unlike getRegisteredUsers, this only reads one page from the
+/// database, using the (server_id, user_id) index as the pagination key.
+QMap<int, QString > Server::getRegisteredUsersPage(const QString &filter, int after, int count) {
+	QMap<int, QString > m;
+
+	if (count <= 0)
+		return m;
+
+	// Authenticators only support fetching the full list, so fetch it once
+	// per walk and seek into it for the later pages.
+	if ((after < 0) || (filter != qsRegisteredPageFilter)) {
+		qsRegisteredPageFilter = filter;
+		qmRegisteredPage.clear();
+		emit getRegisteredUsersSig(filter, qmRegisteredPage);
+	}
+	for (QMap<int, QString >::const_iterator i = qmRegisteredPage.upperBound(after); i != qmRegisteredPage.constEnd() && m.count() < count; ++i)
+		m.insert(i.key(), i.value());
+
+	TransactionHolder th;
+
+	QSqlQuery &query = *th.qsqQuery;
+	if (filter.isEmpty()) {
+		SQLPREP("SELECT `user_id`, `name` FROM `%1users` WHERE `server_id` = ? AND `user_id` > ? ORDER BY `user_id` LIMIT ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(after);
+		query.addBindValue(count);
+	} else {
+		SQLPREP("SELECT `user_id`, `name` FROM `%1users` WHERE `server_id` = ? AND `user_id` > ? AND `name` LIKE ? ORDER BY `user_id` LIMIT ?");
+		query.addBindValue(iServerNum);
+		query.addBindValue(after);
+		query.addBindValue(filter);
+		query.addBindValue(count);
+	}
+	SQLEXEC();
+
+	while (query.next()) {
+		int id = query.value(0).toInt();
+		QString name = query.value(1).toString();
+		m.insert(id, name);
+	}
+
+	// Both sources are ordered by id, so the page is the first count entries
+	// of the merged result.
+	while (m.count() > count)
+		m.erase(m.end() - 1);
+
+	return m;
+}
+
 bool Server::isUserId(int id) {
 	QMap<int, QString> info;
 	int res = -2;
@@ -1495,6 +1580,11 @@ void Server::addLink(Channel *c, Channel *l) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->link(l);
+
+		QSet<int> channels;
+		channels.insert(c->iId);
+		channels.insert(l->iId);
+		invalidateWhisperTargets(channels);
 	}
 
 	if (c->bTemporary || l->bTemporary)
@@ -1518,6 +1608,11 @@ void Server::removeLink(Channel *c, Channel *l) {
 	{
 		QWriteLocker wl(&qrwlVoiceThread);
 		c->unlink(l);
+
+		QSet<int> channels;
+		channels.insert(c->iId);
+		channels.insert(l->iId);
+		invalidateWhisperTargets(channels);
 	}
 
 	if (c->bTemporary || l->bTemporary)
@@ -1589,6 +1684,15 @@ Channel *Server::addChannel(Channel *p, const QString &name, bool temporary, int
 	c->iPosition = position;
 	c->uiMaxUsers = maxUsers;
 	qhChannels.insert(id, c);
+	qmChannelsById.insert(id, c);
+
+	{
+		QWriteLocker wl(&qrwlVoiceThread);
+		QSet<int> channels;
+		channels.insert(p->iId);
+		channels.insert(id);
+		invalidateWhisperTargets(channels);
+	}
 	return c;
 }
 
@@ -1603,6 +1707,7 @@ void Server::removeChannelDB(const Channel *c) {
 		SQLEXEC();
 	}
 	qhChannels.remove(c->iId);
+	qmChannelsById.remove(c->iId);
 }
 
 void Server::updateChannel(const Channel *c) {
@@ -1847,6 +1952,7 @@ void Server::readChannels(Channel *p) {
 			if (! p)
 				c->setParent(this);
 			qhChannels.insert(c->iId, c);
+			qmChannelsById.insert(c->iId, c);
 			c->bInheritACL = query.value(2).toBool();
 			kids << c;
 		}
@@ -2100,6 +2206,51 @@ QList<QPair<unsigned int, QString> > ServerDB::getLog(int server_id, unsigned in
 	return ql;
 }
 
+/// Fetch at most \p count log entries that are not newer than \p before (a
+/// timestamp as returned in LogRecord, or 0 for the newest entry), newest first.
+///
+/// Log entries only have second resolution, so \p skip is the number of entries
+/// with timestamp \p before that were already returned by the previous page.
+/// Entries of the same second are ordered by insertion, newest first, so every
+/// page sees them in the same order. Both keys are covered by an index, so each
+/// page is a bounded index scan instead of a sort of the whole log.
+QList<ServerDB::LogRecord> ServerDB::getLogPage(int server_id, unsigned int before, unsigned int skip, unsigned int count) {
+	TransactionHolder th;
+	QSqlQuery &query = *th.qsqQuery;
+
+	QString qsQuery = QLatin1String("SELECT `msgtime`, `msg` FROM `%1slog` WHERE `server_id` = ?");
+	if (before != 0)
+		qsQuery += QLatin1String(" AND `msgtime` <= ?");
+	if (Meta::mp.qsDBDriver == "QSQLITE")
+		qsQuery += QLatin1String(" ORDER BY `msgtime` DESC, `rowid` DESC LIMIT ?, ?");
+	else if (Meta::mp.qsDBDriver == "QPSQL")
+		qsQuery += QLatin1String(" ORDER BY `msgtime` DESC, `log_id` DESC LIMIT ? OFFSET ?");
+	else
+		qsQuery += QLatin1String(" ORDER BY `msgtime` DESC, `log_id` DESC LIMIT ?, ?");
+	ServerDB::prepare(query, qsQuery);
+
+	query.addBindValue(server_id);
+	// Inverse of the conversion done when reading msgtime below.
+	if (before != 0)
+		query.addBindValue(QDateTime::fromTime_t(before).toString(QLatin1String("yyyy-MM-dd HH:mm:ss")));
+	if (Meta::mp.qsDBDriver == "QPSQL") {
+		query.addBindValue(count);
+		query.addBindValue(skip);
+	} else {
+		query.addBindValue(skip);
+		query.addBindValue(count);
+	}
+	SQLEXEC();
+
+	QList<LogRecord> ql;
+	while (query.next()) {
+		QDateTime qdt = query.value(0).toDateTime();
+		QString msg = query.value(1).toString();
+		ql << LogRecord(qdt.toLocalTime().toTime_t(), msg);
+	}
+	return ql;
+}
+
 int ServerDB::getLogLen(int server_id) {
 	TransactionHolder th;
 	QSqlQuery &query = *th.qsqQuery;
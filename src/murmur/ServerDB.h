@@ -37,6 +37,7 @@ class ServerDB {
 		static QVariant getConf(int server_id, const QString &key, QVariant def = QVariant());
 		static void setConf(int server_id, const QString &key, const QVariant &value = QVariant());
 		static QList<LogRecord> getLog(int server_id, unsigned int offs_min, unsigned int offs_max);
+		static QList<LogRecord> getLogPage(int server_id, unsigned int before, unsigned int skip, unsigned int count);
 		static QString getLegacySHA1Hash(const QString &password);
 		static int getLogLen(int server_id);
 		static void wipeLogs();
@@ -0,0 +1,268 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#include "ServerMetrics.h"
+
+#include "Meta.h"
+#include "Server.h"
+#include "ServerUser.h"
+
+#include <QtCore/QThread>
+#include <QtNetwork/QTcpSocket>
+
+bool ServerMetrics::bEnabled = false;
+
+MetricHistogram SQLMetrics::hQuery[SQLMetrics::KindCount];
+MetricCounter SQLMetrics::uiFailures;
+
+void MetricHistogram::record(quint64 ns) {
+	int idx;
+
+	if (ns < (Q_UINT64_C(1) << MinShift)) {
+		idx = 0;
+	} else {
+		// Find the most significant bit without relying on compiler builtins.
+		int msb = 0;
+		quint64 v = ns;
+		if (v >> 32) { v >>= 32; msb += 32; }
+		if (v >> 16) { v >>= 16; msb += 16; }
+		if (v >> 8) { v >>= 8; msb += 8; }
+		if (v >> 4) { v >>= 4; msb += 4; }
+		if (v >> 2) { v >>= 2; msb += 2; }
+		if (v >> 1) { msb += 1; }
+
+		// The bit below the most significant one selects the sub-bucket.
+		idx = 1 + (msb - MinShift) * SubBuckets + static_cast<int>((ns >> (msb - 1)) & 1);
+		if (idx > Buckets - 1)
+			idx = Buckets - 1;
+	}
+
+	++uiBuckets[idx];
+	++uiCount;
+	uiSum += ns;
+}
+
+void MetricHistogram::merge(const MetricHistogram &other) {
+	for (int i = 0; i < Buckets; ++i)
+		uiBuckets[i] += other.uiBuckets[i].value();
+	uiCount += other.uiCount.value();
+	uiSum += other.uiSum.value();
+}
+
+quint64 MetricHistogram::upperBound(int idx) {
+	if (idx <= 0)
+		return Q_UINT64_C(1) << MinShift;
+	if (idx >= Buckets - 1)
+		return 0;
+
+	const int octave = (idx - 1) / SubBuckets;
+	const int sub = (idx - 1) % SubBuckets;
+	const quint64 base = Q_UINT64_C(1) << (MinShift + octave);
+	return base + (base * static_cast<quint64>(sub + 1)) / SubBuckets;
+}
+
+void ServerMetrics::Shard::merge(const Shard &other) {
+	uiPacketsIn += other.uiPacketsIn.value();
+	uiBytesIn += other.uiBytesIn.value();
+	uiPacketsOut += other.uiPacketsOut.value();
+	uiBytesOut += other.uiBytesOut.value();
+	uiTunnelPacketsOut += other.uiTunnelPacketsOut.value();
+	uiTunnelBytesOut += other.uiTunnelBytesOut.value();
+	uiDecryptFailures += other.uiDecryptFailures.value();
+	uiBandwidthDrops += other.uiBandwidthDrops.value();
+	for (int i = 0; i < StageCount; ++i)
+		hStage[i].merge(other.hStage[i]);
+}
+
+ServerMetrics::Shard &ServerMetrics::shard(const QThread *voiceThread) {
+	return (QThread::currentThread() == voiceThread) ? sVoice : sMain;
+}
+
+const char *ServerMetrics::messageTypeName(unsigned int type) {
+#define MUMBLE_MH_MSG(x) #x,
+	static const char *names[] = {
+		MUMBLE_MH_ALL
+	};
+#undef MUMBLE_MH_MSG
+	if (type >= MessageTypeCount)
+		return "Unknown";
+	return names[type];
+}
+
+SQLMetrics::Kind SQLMetrics::classify(const QString &query) {
+	const QString verb = query.trimmed().section(QLatin1Char(' '), 0, 0).toUpper();
+	if (verb == QLatin1String("SELECT"))
+		return Select;
+	if (verb == QLatin1String("INSERT") || verb == QLatin1String("REPLACE"))
+		return Insert;
+	if (verb == QLatin1String("UPDATE"))
+		return Update;
+	if (verb == QLatin1String("DELETE"))
+		return Delete;
+	return Other;
+}
+
+const char *SQLMetrics::kindName(int kind) {
+	static const char *names[] = { "select", "insert", "update", "delete", "other" };
+	if (kind < 0 || kind >= KindCount)
+		return "other";
+	return names[kind];
+}
+
+MetricHistogram &SQLMetrics::histogram(const QString &query) {
+	return hQuery[ServerMetrics::bEnabled ? classify(query) : Other];
+}
+
+MetricsServer::MetricsServer(const QHostAddress &address, quint16 port, QObject *p) : QTcpServer(p) {
+	connect(this, SIGNAL(newConnection()), this, SLOT(newConnectionPending()));
+	if (! listen(address, port))
+		qFatal("Metrics: Failed to bind to %s:%d: %s", qPrintable(address.toString()), port, qPrintable(errorString()));
+	qWarning("Metrics: Endpoint running on %s:%d", qPrintable(address.toString()), port);
+	ServerMetrics::bEnabled = true;
+}
+
+void MetricsServer::newConnectionPending() {
+	while (hasPendingConnections()) {
+		QTcpSocket *sock = nextPendingConnection();
+		connect(sock, SIGNAL(readyRead()), this, SLOT(clientReadyRead()));
+		connect(sock, SIGNAL(disconnected()), sock, SLOT(deleteLater()));
+	}
+}
+
+void MetricsServer::clientReadyRead() {
+	QTcpSocket *sock = qobject_cast<QTcpSocket *>(sender());
+	if (! sock)
+		return;
+
+	// We serve a single document, so the request line and headers are
+	// only read to find where the request ends.
+	if (! sock->canReadLine() || ! sock->peek(65536).contains("\r\n\r\n")) {
+		if (sock->bytesAvailable() > 65536)
+			sock->abort();
+		return;
+	}
+	sock->readAll();
+
+	const QByteArray body = exposition();
+	QByteArray response;
+	response.append("HTTP/1.0 200 OK\r\n");
+	response.append("Content-Type: text/plain; version=0.0.4\r\n");
+	response.append("Content-Length: " + QByteArray::number(body.size()) + "\r\n");
+	response.append("Connection: close\r\n\r\n");
+	response.append(body);
+
+	sock->write(response);
+	sock->disconnectFromHost();
+}
+
+namespace {
+
+struct ServerSnapshot {
+	int iServerNum;
+	ServerMetrics::Shard sVoice;
+	int iUsers;
+	int iChannels;
+	qint64 iTcpQueue;
+};
+
+void appendFamily(QByteArray &out, const char *name, const char *type, const char *help) {
+	out.append("# HELP ").append(name).append(' ').append(help).append('\n');
+	out.append("# TYPE ").append(name).append(' ').append(type).append('\n');
+}
+
+void appendSample(QByteArray &out, const char *name, const QByteArray &labels, quint64 value) {
+	out.append(name).append('{').append(labels).append("} ").append(QByteArray::number(value)).append('\n');
+}
+
+void appendHistogram(QByteArray &out, const char *name, const QByteArray &labels, const MetricHistogram &h) {
+	const QByteArray bucket = QByteArray(name) + "_bucket{" + labels + ",le=\"";
+	quint64 cumulative = 0;
+	for (int i = 0; i < MetricHistogram::Buckets - 1; ++i) {
+		cumulative += h.uiBuckets[i].value();
+		const double le = static_cast<double>(MetricHistogram::upperBound(i)) / 1e9;
+		out.append(bucket).append(QByteArray::number(le, 'g', 6)).append("\"} ").append(QByteArray::number(cumulative)).append('\n');
+	}
+	out.append(bucket).append("+Inf\"} ").append(QByteArray::number(h.uiCount.value())).append('\n');
+	out.append(name).append("_sum{").append(labels).append("} ").append(QByteArray::number(static_cast<double>(h.uiSum.value()) / 1e9, 'g', 12)).append('\n');
+	out.append(name).append("_count{").append(labels).append("} ").append(QByteArray::number(h.uiCount.value())).append('\n');
+}
+
+QByteArray serverLabel(int num) {
+	return "server=\"" + QByteArray::number(num) + "\"";
+}
+
+}
+
+QByteArray MetricsServer::exposition() {
+	static const char *stageNames[] = { "decrypt", "route", "encrypt", "send" };
+
+	QList<ServerSnapshot> snapshots;
+	QList<const ServerMetrics *> metrics;
+
+	foreach(Server *s, meta->qhServers) {
+		ServerSnapshot ss;
+		ss.iServerNum = s->iServerNum;
+		ss.sVoice = s->smMetrics.sVoice;
+		ss.sVoice.merge(s->smMetrics.sMain);
+		ss.iUsers = s->qhUsers.count();
+		ss.iChannels = s->qhChannels.count();
+		ss.iTcpQueue = 0;
+		foreach(ServerUser *u, s->qhUsers)
+			ss.iTcpQueue += u->bytesToWrite();
+		snapshots << ss;
+		metrics << &s->smMetrics;
+	}
+
+	QByteArray out;
+
+#define MURMUR_COUNTER(name, field, help) \
+	appendFamily(out, name, "counter", help); \
+	foreach(const ServerSnapshot &ss, snapshots) \
+		appendSample(out, name, serverLabel(ss.iServerNum), ss.sVoice.field.value());
+
+	MURMUR_COUNTER("murmur_voice_packets_received_total", uiPacketsIn, "UDP packets decrypted and voice packets received through the TCP tunnel.")
+	MURMUR_COUNTER("murmur_voice_bytes_received_total", uiBytesIn, "Plaintext bytes of received UDP and tunneled voice packets.")
+	MURMUR_COUNTER("murmur_udp_packets_sent_total", uiPacketsOut, "Packets sent over UDP.")
+	MURMUR_COUNTER("murmur_udp_bytes_sent_total", uiBytesOut, "Encrypted bytes sent over UDP.")
+	MURMUR_COUNTER("murmur_tunnel_packets_sent_total", uiTunnelPacketsOut, "Voice packets sent through the TCP tunnel.")
+	MURMUR_COUNTER("murmur_tunnel_bytes_sent_total", uiTunnelBytesOut, "Bytes of voice sent through the TCP tunnel.")
+	MURMUR_COUNTER("murmur_udp_decrypt_failures_total", uiDecryptFailures, "UDP decryption attempts that failed.")
+	MURMUR_COUNTER("murmur_voice_bandwidth_drops_total", uiBandwidthDrops, "Voice packets dropped by the bandwidth limit.")
+#undef MURMUR_COUNTER
+
+	appendFamily(out, "murmur_users", "gauge", "Connected users.");
+	foreach(const ServerSnapshot &ss, snapshots)
+		appendSample(out, "murmur_users", serverLabel(ss.iServerNum), ss.iUsers);
+	appendFamily(out, "murmur_channels", "gauge", "Channels.");
+	foreach(const ServerSnapshot &ss, snapshots)
+		appendSample(out, "murmur_channels", serverLabel(ss.iServerNum), ss.iChannels);
+	appendFamily(out, "murmur_tcp_send_queue_bytes", "gauge", "Bytes queued for sending on control connections.");
+	foreach(const ServerSnapshot &ss, snapshots)
+		appendSample(out, "murmur_tcp_send_queue_bytes", serverLabel(ss.iServerNum), static_cast<quint64>(ss.iTcpQueue));
+
+	appendFamily(out, "murmur_voice_stage_seconds", "histogram", "Time spent in each stage of the voice path. The route stage includes the encrypt and send stages of the packets it sends.");
+	foreach(const ServerSnapshot &ss, snapshots) {
+		for (int i = 0; i < ServerMetrics::StageCount; ++i)
+			appendHistogram(out, "murmur_voice_stage_seconds", serverLabel(ss.iServerNum) + ",stage=\"" + stageNames[i] + "\"", ss.sVoice.hStage[i]);
+	}
+
+	appendFamily(out, "murmur_message_handler_seconds", "histogram", "Time spent handling control messages.");
+	for (int n = 0; n < snapshots.count(); ++n) {
+		for (unsigned int t = 0; t < ServerMetrics::MessageTypeCount; ++t) {
+			const MetricHistogram &h = metrics.at(n)->hHandler[t];
+			if (h.uiCount.value() == 0)
+				continue;
+			appendHistogram(out, "murmur_message_handler_seconds", serverLabel(snapshots.at(n).iServerNum) + ",type=\"" + ServerMetrics::messageTypeName(t) + "\"", h);
+		}
+	}
+
+	appendFamily(out, "murmur_sql_query_seconds", "histogram", "Time spent executing SQL statements.");
+	for (int k = 0; k < SQLMetrics::KindCount; ++k)
+		appendHistogram(out, "murmur_sql_query_seconds", QByteArray("kind=\"") + SQLMetrics::kindName(k) + "\"", SQLMetrics::hQuery[k]);
+	appendFamily(out, "murmur_sql_failures_total", "counter", "SQL statements that failed.");
+	out.append("murmur_sql_failures_total ").append(QByteArray::number(SQLMetrics::uiFailures.value())).append('\n');
+
+	return out;
+}
@@ -0,0 +1,196 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+#ifndef MUMBLE_MURMUR_SERVERMETRICS_H_
+#define MUMBLE_MURMUR_SERVERMETRICS_H_
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QString>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QTcpServer>
+#if QT_VERSION >= 0x050000
+# include <QtCore/QAtomicInteger>
+#endif
+
+#include "Message.h"
+
+class QThread;
+
+/// A 64-bit counter with a single writer that any thread may read. The
+/// writer updates it with a relaxed load and store instead of a locked
+/// read-modify-write, which suffices with one writer, so counting stays
+/// as cheap as with a plain integer. Readers never see a torn value.
+///
+/// Qt 4 has no 64-bit atomics, so there it is a plain integer and reads
+/// may tear on 32-bit platforms.
+class MetricCounter {
+	private:
+#if QT_VERSION >= 0x050000
+		QAtomicInteger<quint64> aiValue;
+#else
+		volatile quint64 aiValue;
+#endif
+	public:
+		MetricCounter() : aiValue(0) {}
+		MetricCounter(const MetricCounter &other) : aiValue(other.value()) {}
+		MetricCounter &operator =(const MetricCounter &other) {
+			set(other.value());
+			return *this;
+		}
+
+		void add(quint64 v) {
+			set(value() + v);
+		}
+		void operator ++() {
+			add(1);
+		}
+		void operator +=(quint64 v) {
+			add(v);
+		}
+#if QT_VERSION >= 0x050000
+		quint64 value() const {
+			return aiValue.load();
+		}
+		void set(quint64 v) {
+			aiValue.store(v);
+		}
+#else
+		quint64 value() const {
+			return aiValue;
+		}
+		void set(quint64 v) {
+			aiValue = v;
+		}
+#endif
+};
+
+/// MetricHistogram is a latency histogram with log-linear buckets in the
+/// spirit of HdrHistogram. Every power of two between 256ns and ~4.3s is
+/// split into two sub-buckets, so a recorded value is never off by more
+/// than half its magnitude, and recording is a handful of shifts and one
+/// increment.
+///
+/// Each instance must only ever be written by a single thread. Other
+/// threads may read it at any time, but may see a count that does not yet
+/// include the latest sample in every field.
+class MetricHistogram {
+	public:
+		enum { MinShift = 8, Octaves = 24, SubBuckets = 2, Buckets = Octaves * SubBuckets + 2 };
+
+		MetricCounter uiBuckets[Buckets];
+		MetricCounter uiCount;
+		MetricCounter uiSum;
+
+		void record(quint64 ns);
+		void merge(const MetricHistogram &other);
+
+		/// The inclusive upper bound of bucket idx in nanoseconds.
+		/// The last bucket is unbounded and returns 0.
+		static quint64 upperBound(int idx);
+};
+
+/// ServerMetrics holds the counters and latency histograms for a single
+/// virtual server.
+///
+/// The voice path runs both on the Server's voice thread and on the main
+/// thread (for voice tunneled through TCP), so the voice counters are kept
+/// in one shard per thread. Each shard has exactly one writer, so its
+/// counters need no locked updates; the shards are summed when the metrics
+/// are exported.
+class ServerMetrics {
+	public:
+		/// StageRoute covers all of Server::processMsg, so it includes the
+		/// StageEncrypt and StageSend time of the packets it fans out.
+		enum Stage { StageDecrypt, StageRoute, StageEncrypt, StageSend, StageCount };
+
+#define MUMBLE_MH_MSG(x) + 1
+		enum { MessageTypeCount = 0 MUMBLE_MH_ALL };
+#undef MUMBLE_MH_MSG
+
+		struct Shard {
+			MetricCounter uiPacketsIn, uiBytesIn;
+			MetricCounter uiPacketsOut, uiBytesOut;
+			MetricCounter uiTunnelPacketsOut, uiTunnelBytesOut;
+			MetricCounter uiDecryptFailures;
+			MetricCounter uiBandwidthDrops;
+			MetricHistogram hStage[StageCount];
+
+			void merge(const Shard &other);
+		};
+
+		/// Written by the Server's voice thread only.
+		Shard sVoice;
+		/// Written by the main thread only.
+		Shard sMain;
+
+		/// Control message handler timings, indexed by
+		/// MessageHandler::MessageType. Main thread only.
+		MetricHistogram hHandler[MessageTypeCount];
+
+		/// Set when a metrics endpoint is configured. Histograms are
+		/// only fed while this is set; plain counters are always kept.
+		static bool bEnabled;
+
+		/// Returns the shard owned by the calling thread, given the
+		/// Server's voice thread.
+		Shard &shard(const QThread *voiceThread);
+
+		/// Message type names, indexed by MessageHandler::MessageType.
+		static const char *messageTypeName(unsigned int type);
+};
+
+/// Scoped latency probe for a MetricHistogram. Does nothing unless
+/// ServerMetrics::bEnabled is set.
+class MetricTimer {
+	private:
+		Q_DISABLE_COPY(MetricTimer)
+		QElapsedTimer qetTimer;
+		MetricHistogram *phHistogram;
+	public:
+		MetricTimer(MetricHistogram &h) : phHistogram(ServerMetrics::bEnabled ? &h : NULL) {
+			if (phHistogram)
+				qetTimer.start();
+		}
+		~MetricTimer() {
+			if (phHistogram)
+				phHistogram->record(static_cast<quint64>(qetTimer.nsecsElapsed()));
+		}
+};
+
+/// SQL statement timings, shared by all virtual servers. ServerDB is only
+/// used from the main thread.
+class SQLMetrics {
+	public:
+		enum Kind { Select, Insert, Update, Delete, Other, KindCount };
+
+		static MetricHistogram hQuery[KindCount];
+		static MetricCounter uiFailures;
+
+		static Kind classify(const QString &query);
+		static const char *kindName(int kind);
+
+		/// The histogram a statement is recorded in. Only classifies the
+		/// statement while metrics are enabled.
+		static MetricHistogram &histogram(const QString &query);
+};
+
+/// MetricsServer is a minimal HTTP listener that answers every request
+/// with the Prometheus text exposition of all running virtual servers.
+/// It runs on the main thread, so it may read server state directly.
+class MetricsServer : public QTcpServer {
+	private:
+		Q_OBJECT
+		Q_DISABLE_COPY(MetricsServer)
+	protected slots:
+		void newConnectionPending();
+		void clientReadyRead();
+	public:
+		MetricsServer(const QHostAddress &address, quint16 port, QObject *parent = NULL);
+
+		/// Renders all metrics in the Prometheus text format (version 0.0.4).
+		static QByteArray exposition();
+};
+
+#endif
@@ -60,6 +60,24 @@ struct WhisperTarget {
 	QList<WhisperTarget::Channel> qlChannels;
 };
 
+class ServerUser;
+
+/// The resolved recipients of a whisper target, together with what they
+/// were resolved from. A cached entry is only dropped when one of the
+/// channels or sessions it depends on changes.
+struct WhisperTargetCache {
+	/// Recipients reached through a channel target.
+	QSet<ServerUser *> qsChannel;
+	/// Recipients addressed directly by session.
+	QSet<ServerUser *> qsDirect;
+	/// Ids of every channel visited while resolving the target,
+	/// including the channels of direct recipients.
+	QSet<int> qsChannels;
+	/// Sessions addressed directly, whether or not they were
+	/// connected at the time.
+	QSet<unsigned int> qsSessions;
+};
+
 class Server;
 
 // Simple algorithm for rate limiting
@@ -120,8 +138,7 @@ class ServerUser : public Connection, public User {
 		QStringList qslAccessTokens;
 
 		QMap<int, WhisperTarget> qmTargets;
-		typedef QPair<QSet<ServerUser *>, QSet<ServerUser *> > TargetCache;
-		QMap<int, TargetCache> qmTargetCache;
+		QMap<int, WhisperTargetCache> qmTargetCache;
 		QMap<QString, QString> qmWhisperRedirect;
 
 		LeakyBucket leakyBucket;
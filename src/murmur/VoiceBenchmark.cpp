@@ -0,0 +1,287 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+// In-process benchmark of Murmur's voice routing core.
+//
+// Built instead of main.cpp when qmake is run with CONFIG+=voice-benchmark.
+// A virtual server is booted on an in-memory SQLite database and populated
+// with synthetic channel trees, users, links, ACLs, groups and whisper
+// targets. Voice packets are then fed straight into Server::processMsg;
+// Server::sendMessage hands every outgoing packet to a sink instead of the
+// network, so only routing is measured.
+//
+// For each scenario the benchmark reports the time and the number of heap
+// allocations per processed packet.
+
+#include "ACL.h"
+#include "Channel.h"
+#include "Group.h"
+#include "Message.h"
+#include "Meta.h"
+#include "PacketDataStream.h"
+#include "Server.h"
+#include "ServerDB.h"
+#include "ServerUser.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+
+#ifdef __GLIBC__
+extern "C" {
+	void *__libc_malloc(size_t);
+	void *__libc_calloc(size_t, size_t);
+	void *__libc_realloc(void *, size_t);
+	void __libc_free(void *);
+}
+#else
+# include <new>
+#endif
+
+QFile *qfLog = NULL;
+Meta *meta = NULL;
+
+static quint64 uiAllocations = 0;
+static quint64 uiSinkPackets = 0;
+static quint64 uiSinkBytes = 0;
+
+#ifdef __GLIBC__
+// Interpose the C allocator so that allocations made by Qt containers,
+// which do not go through operator new, are counted as well.
+extern "C" {
+	void *malloc(size_t size) {
+		++uiAllocations;
+		return __libc_malloc(size);
+	}
+
+	void *calloc(size_t n, size_t size) {
+		++uiAllocations;
+		return __libc_calloc(n, size);
+	}
+
+	void *realloc(void *ptr, size_t size) {
+		++uiAllocations;
+		return __libc_realloc(ptr, size);
+	}
+
+	void free(void *ptr) {
+		__libc_free(ptr);
+	}
+}
+#else
+void *operator new(size_t size) {
+	++uiAllocations;
+	void *ptr = ::malloc(size ? size : 1);
+	if (! ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void operator delete(void *ptr) throw() {
+	::free(ptr);
+}
+#endif
+
+void voiceBenchmarkSink(ServerUser *u, const char *data, int len) {
+	Q_UNUSED(u);
+	Q_UNUSED(data);
+	++uiSinkPackets;
+	uiSinkBytes += static_cast<quint64>(len);
+}
+
+class VoiceBenchmark {
+	private:
+		Q_DISABLE_COPY(VoiceBenchmark)
+	public:
+		Server *s;
+		unsigned int uiNextSession;
+		int iNextChannel;
+		int iNextUserId;
+
+		VoiceBenchmark(Server *srv);
+		Channel *addChannel(Channel *parent, const QString &name);
+		ServerUser *addUser(Channel *c);
+		void populate(Channel *c, int count);
+		QByteArray voicePacket(unsigned int target);
+		void run(const char *name, ServerUser *speaker, unsigned int target, int iterations, bool cold);
+};
+
+VoiceBenchmark::VoiceBenchmark(Server *srv) : s(srv), uiNextSession(1), iNextChannel(1), iNextUserId(1) {
+}
+
+Channel *VoiceBenchmark::addChannel(Channel *parent, const QString &name) {
+	Channel *c = new Channel(iNextChannel++, name, parent);
+	s->qhChannels.insert(c->iId, c);
+	s->qmChannelsById.insert(c->iId, c);
+	return c;
+}
+
+ServerUser *VoiceBenchmark::addUser(Channel *c) {
+	ServerUser *u = new ServerUser(s, new QSslSocket());
+	u->uiSession = uiNextSession++;
+	u->iId = iNextUserId++;
+	u->qsName = QString::fromLatin1("bench%1").arg(u->uiSession);
+	u->sState = ServerUser::Authenticated;
+	u->bOpus = true;
+	c->addUser(u);
+	s->qhUsers.insert(u->uiSession, u);
+	s->qmUsersBySession.insert(u->uiSession, u);
+	return u;
+}
+
+void VoiceBenchmark::populate(Channel *c, int count) {
+	for (int i = 0; i < count; ++i)
+		addUser(c);
+}
+
+QByteArray VoiceBenchmark::voicePacket(unsigned int target) {
+	char buffer[1024];
+	buffer[0] = static_cast<char>((MessageHandler::UDPVoiceOpus << 5) | target);
+
+	// The server never looks inside the Opus payload, so any bytes do.
+	char payload[60];
+	for (unsigned int i = 0; i < sizeof(payload); ++i)
+		payload[i] = static_cast<char>(i);
+
+	PacketDataStream pds(buffer + 1, sizeof(buffer) - 1);
+	pds << 1;
+	pds << static_cast<int>(sizeof(payload));
+	pds.append(payload, sizeof(payload));
+	return QByteArray(buffer, pds.size() + 1);
+}
+
+void VoiceBenchmark::run(const char *name, ServerUser *speaker, unsigned int target, int iterations, bool cold) {
+	const QByteArray packet = voicePacket(target);
+
+	// Warm up the ACL cache and, for warm runs, the whisper target cache.
+	{
+		QReadLocker rl(&s->qrwlVoiceThread);
+		s->processMsg(speaker, packet.constData(), packet.size());
+	}
+	// There is no event loop, so run the queued rebuild by hand.
+	s->rebuildWhisperTargets();
+
+	const quint64 packetsBefore = uiSinkPackets;
+	const quint64 allocsBefore = uiAllocations;
+	quint64 elapsed = 0;
+
+	for (int i = 0; i < iterations; ++i) {
+		if (cold)
+			speaker->qmTargetCache.clear();
+
+		QElapsedTimer t;
+		t.start();
+		{
+			QReadLocker rl(&s->qrwlVoiceThread);
+			s->processMsg(speaker, packet.constData(), packet.size());
+		}
+		elapsed += static_cast<quint64>(t.nsecsElapsed());
+	}
+
+	const quint64 allocs = uiAllocations - allocsBefore;
+	const quint64 recipients = uiSinkPackets - packetsBefore;
+
+	printf("%-28s %6.1f %10.1f %10.2f %10.2f\n", name,
+	       static_cast<double>(recipients) / iterations,
+	       static_cast<double>(elapsed) / iterations,
+	       recipients ? static_cast<double>(elapsed) / recipients : 0.0,
+	       static_cast<double>(allocs) / iterations);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	int iterations = 100000;
+	if (argc > 1)
+		iterations = qMax(1, atoi(argv[1]));
+
+	Meta::mp.qsDBDriver = QLatin1String("QSQLITE");
+	Meta::mp.qsDatabase = QLatin1String(":memory:");
+	Meta::mp.qlBind = QList<QHostAddress>() << QHostAddress(QHostAddress::LocalHost);
+	Meta::mp.usPort = 0;
+	Meta::mp.kdfIterations = 1000;
+
+	ServerDB db;
+	meta = new Meta();
+
+	Server *s = new Server(1, meta);
+
+	VoiceBenchmark vb(s);
+	Channel *root = s->qhChannels.value(0);
+
+	// Normal speech: one busy channel.
+	Channel *lobby = vb.addChannel(root, QLatin1String("Lobby"));
+	ServerUser *lobbySpeaker = vb.addUser(lobby);
+	vb.populate(lobby, 50);
+
+	// Linked channels, one of which denies Speak to everyone.
+	Channel *linked = vb.addChannel(root, QLatin1String("Linked"));
+	QList<Channel *> links;
+	for (int i = 0; i < 5; ++i) {
+		Channel *c = vb.addChannel(linked, QString::fromLatin1("Link%1").arg(i));
+		vb.populate(c, 20);
+		foreach(Channel *l, links)
+			c->link(l);
+		links << c;
+	}
+	ChanACL *deny = new ChanACL(links.last());
+	deny->qsGroup = QLatin1String("all");
+	deny->pDeny = ChanACL::Speak;
+	ServerUser *linkSpeaker = vb.addUser(links.first());
+
+	// Whisper to a channel and its children: a tree three levels deep.
+	Channel *tree = vb.addChannel(root, QLatin1String("Tree"));
+	QList<Channel *> level;
+	level << tree;
+	for (int depth = 0; depth < 3; ++depth) {
+		QList<Channel *> next;
+		foreach(Channel *p, level) {
+			vb.populate(p, 5);
+			for (int i = 0; i < 3; ++i)
+				next << vb.addChannel(p, QString::fromLatin1("Sub%1").arg(i));
+		}
+		level = next;
+	}
+	foreach(Channel *p, level)
+		vb.populate(p, 5);
+
+	WhisperTarget wtTree;
+	WhisperTarget::Channel wtcTree;
+	wtcTree.iId = tree->iId;
+	wtcTree.bChildren = true;
+	wtcTree.bLinks = false;
+	wtTree.qlChannels << wtcTree;
+	lobbySpeaker->qmTargets.insert(1, wtTree);
+
+	// Whisper to a group: half of a channel's users are members.
+	Channel *grouped = vb.addChannel(root, QLatin1String("Grouped"));
+	Group *g = new Group(grouped, QLatin1String("bench"));
+	for (int i = 0; i < 40; ++i) {
+		ServerUser *u = vb.addUser(grouped);
+		if (i % 2)
+			g->qsAdd.insert(u->iId);
+	}
+
+	WhisperTarget wtGroup;
+	WhisperTarget::Channel wtcGroup;
+	wtcGroup.iId = grouped->iId;
+	wtcGroup.bChildren = false;
+	wtcGroup.bLinks = false;
+	wtcGroup.qsGroup = QLatin1String("bench");
+	wtGroup.qlChannels << wtcGroup;
+	lobbySpeaker->qmTargets.insert(2, wtGroup);
+
+	printf("%d iterations per scenario\n", iterations);
+	printf("%-28s %6s %10s %10s %10s\n", "scenario", "fanout", "ns/packet", "ns/recip", "allocs/pkt");
+
+	vb.run("speech", lobbySpeaker, 0, iterations, false);
+	vb.run("speech-linked", linkSpeaker, 0, iterations, false);
+	vb.run("whisper-children-cached", lobbySpeaker, 1, iterations, false);
+	vb.run("whisper-children-cold", lobbySpeaker, 1, iterations, true);
+	vb.run("whisper-group-cached", lobbySpeaker, 2, iterations, false);
+	vb.run("whisper-group-cold", lobbySpeaker, 2, iterations, true);
+
+	return 0;
+}
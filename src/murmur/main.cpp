@@ -9,6 +9,7 @@
 
 #include "Server.h"
 #include "ServerDB.h"
+#include "ServerMetrics.h"
 #include "Meta.h"
 #include "Version.h"
 #include "SSL.h"
@@ -570,6 +571,19 @@ int main(int argc, char **argv) {
 	}
 #endif
 
+	MetricsServer *metricsServer = NULL;
+	if (! Meta::mp.qsMetricsAddress.isEmpty()) {
+		const QString &address = Meta::mp.qsMetricsAddress;
+		const int sep = address.lastIndexOf(QLatin1Char(':'));
+		bool ok = false;
+		const quint16 port = static_cast<quint16>(address.mid(sep + 1).toUInt(&ok));
+		QString host = address.left(sep);
+		host.remove(QLatin1Char('[')).remove(QLatin1Char(']'));
+		if (sep < 0 || ! ok || port == 0)
+			qFatal("Metrics: Invalid address '%s', expected host:port", qPrintable(address));
+		metricsServer = new MetricsServer(QHostAddress(host), port);
+	}
+
 	meta->getOSInfo();
 
 	int major, minor, patch;
@@ -588,6 +602,8 @@ int main(int argc, char **argv) {
 
 	qWarning("Shutting down");
 
+	delete metricsServer;
+
 #ifdef USE_DBUS
 	delete MurmurDBus::qdbc;
 	MurmurDBus::qdbc = NULL;
@@ -16,11 +16,22 @@ TARGET = murmur
 DBFILE = murmur.db
 LANGUAGE = C++
 FORMS =
-HEADERS *= Server.h ServerUser.h Meta.h PBKDF2.h
-SOURCES *= main.cpp Server.cpp ServerUser.cpp ServerDB.cpp Register.cpp Cert.cpp Messages.cpp Meta.cpp RPC.cpp PBKDF2.cpp
+HEADERS *= Server.h ServerUser.h Meta.h PBKDF2.h ServerMetrics.h
+SOURCES *= main.cpp Server.cpp ServerUser.cpp ServerDB.cpp Register.cpp Cert.cpp Messages.cpp Meta.cpp RPC.cpp PBKDF2.cpp ServerMetrics.cpp
 
 PRECOMPILED_HEADER = murmur_pch.h
 
+# CONFIG+=voice-benchmark builds murmur-voicebench instead of murmurd.
+# It replaces main() with an in-process benchmark of Server::processMsg
+# that sends all voice into a sink. See VoiceBenchmark.cpp.
+CONFIG(voice-benchmark) {
+  CONFIG *= no-ice no-dbus no-bonjour
+  CONFIG -= grpc
+  DEFINES *= MURMUR_VOICE_BENCHMARK
+  SOURCES -= main.cpp
+  SOURCES *= VoiceBenchmark.cpp
+}
+
 !CONFIG(no-ice) {
   CONFIG *= ice
 }
@@ -265,3 +276,7 @@ bonjour {
 }
 
 include(../../qmake/symbols.pri)
+
+CONFIG(voice-benchmark) {
+  TARGET = murmur-voicebench
+}
@@ -1,25 +1,28 @@
 /**
- * Provided a target address spawns a specified number of senders/speakers,
- * UDP-listeners and TCP-listeners.
+ * Headless load generator for Murmur.
+ *
+ * Connects a configurable population of clients to a server and lets a
+ * fraction of them talk, either to their channel or to a whisper target.
+ * Clients are spread over a number of worker threads, each running its own
+ * event loop, so that thousands of clients can be simulated from a single
+ * process.
+ *
+ * Every voice packet carries the sender's send timestamp. Since senders and
+ * receivers share a clock, receivers can measure the end-to-end forwarding
+ * latency through the server. Loss is derived from gaps in the per-stream
+ * sequence numbers.
+ *
+ * Results are printed as one JSON object per line (one per reporting
+ * interval plus a final summary), which makes the output easy to diff
+ * between server versions.
+ *
+ * Run without arguments for usage.
  */
 
 #include <QtCore>
 #include <QtNetwork>
 
-#ifndef Q_OS_WIN
-#include <unistd.h>
-#endif
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/types.h>
-#ifndef Q_OS_WIN
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <netinet/ip.h>
-#include <sys/utsname.h>
-#endif
-#include <errno.h>
+#include <math.h>
 
 #include "PacketDataStream.h"
 #include "Timer.h"
@@ -27,91 +30,371 @@
 #include "CryptState.h"
 #include "Mumble.pb.h"
 
-class Client : public QThread {
+struct Options {
+	QHostAddress qhaServer;
+	unsigned short usPort;
+	QString qsPassword;
+
+	/// Total number of simulated clients.
+	int iClients;
+	/// Fraction of clients that transmit voice.
+	double dSpeakers;
+	/// Fraction of speakers that whisper to another channel instead of
+	/// talking to their own.
+	double dWhisper;
+	/// Fraction of clients that never use UDP.
+	double dTcpOnly;
+	/// Number of server channels to spread clients over, 0 for all.
+	int iChannels;
+	/// Zipf exponent of the channel distribution, 0 for uniform.
+	double dZipf;
+	/// Number of clients sharing one source address, 0 to let the OS
+	/// choose. Only available for IPv4 loopback servers.
+	int iNatGroup;
+	/// Clients per second that leave and rejoin once everyone is connected.
+	double dChurn;
+
+	int iFrameMs;
+	int iPayload;
+	int iThreads;
+	int iSpawnRate;
+	int iDuration;
+	int iInterval;
+	unsigned int uiSeed;
+	QString qsOutput;
+
+	Options();
+	bool parse(const QStringList &args);
+	static void usage();
+};
+
+Options::Options() : usPort(64738), iClients(100), dSpeakers(0.1), dWhisper(0.0), dTcpOnly(0.0), iChannels(0), dZipf(0.0), iNatGroup(1), dChurn(0.0), iFrameMs(20), iPayload(60), iThreads(QThread::idealThreadCount()), iSpawnRate(200), iDuration(60), iInterval(5), uiSeed(1) {
+	if (iThreads < 1)
+		iThreads = 1;
+}
+
+void Options::usage() {
+	qWarning("Usage: Benchmark <host> <port> [options]");
+	qWarning("  --clients=N        simulated clients (100)");
+	qWarning("  --speakers=F       fraction of clients that talk (0.1)");
+	qWarning("  --whisper=F        fraction of speakers that whisper (0)");
+	qWarning("  --tcponly=F        fraction of clients without UDP (0)");
+	qWarning("  --channels=N       spread clients over N channels, 0 for all (0)");
+	qWarning("  --zipf=S           channel popularity exponent, 0 for uniform (0)");
+	qWarning("  --nat=K            clients sharing a source address, 0 for OS default (1)");
+	qWarning("  --churn=R          clients per second that leave and rejoin (0)");
+	qWarning("  --frame=MS         voice frame length (20)");
+	qWarning("  --payload=BYTES    voice payload size (60)");
+	qWarning("  --threads=N        worker threads (ideal thread count)");
+	qWarning("  --spawnrate=N      connections per second while ramping up (200)");
+	qWarning("  --duration=S       measurement time after ramp-up (60)");
+	qWarning("  --interval=S       reporting interval (5)");
+	qWarning("  --seed=N           seed for role and channel assignment (1)");
+	qWarning("  --password=PW      server password");
+	qWarning("  --output=FILE      write JSON results to FILE instead of stdout");
+	qWarning("Legacy form: Benchmark <host> <port> <numsend> <numudp> <numtcp>");
+}
+
+bool Options::parse(const QStringList &args) {
+	QStringList positional;
+
+	foreach(const QString &arg, args) {
+		if (! arg.startsWith(QLatin1String("--"))) {
+			positional << arg;
+			continue;
+		}
+
+		const int eq = arg.indexOf(QLatin1Char('='));
+		if (eq < 0)
+			return false;
+		const QString key = arg.mid(2, eq - 2);
+		const QString value = arg.mid(eq + 1);
+		bool ok = true;
+
+		if (key == QLatin1String("clients"))
+			iClients = value.toInt(&ok);
+		else if (key == QLatin1String("speakers"))
+			dSpeakers = value.toDouble(&ok);
+		else if (key == QLatin1String("whisper"))
+			dWhisper = value.toDouble(&ok);
+		else if (key == QLatin1String("tcponly"))
+			dTcpOnly = value.toDouble(&ok);
+		else if (key == QLatin1String("channels"))
+			iChannels = value.toInt(&ok);
+		else if (key == QLatin1String("zipf"))
+			dZipf = value.toDouble(&ok);
+		else if (key == QLatin1String("nat"))
+			iNatGroup = value.toInt(&ok);
+		else if (key == QLatin1String("churn"))
+			dChurn = value.toDouble(&ok);
+		else if (key == QLatin1String("frame"))
+			iFrameMs = value.toInt(&ok);
+		else if (key == QLatin1String("payload"))
+			iPayload = value.toInt(&ok);
+		else if (key == QLatin1String("threads"))
+			iThreads = value.toInt(&ok);
+		else if (key == QLatin1String("spawnrate"))
+			iSpawnRate = value.toInt(&ok);
+		else if (key == QLatin1String("duration"))
+			iDuration = value.toInt(&ok);
+		else if (key == QLatin1String("interval"))
+			iInterval = value.toInt(&ok);
+		else if (key == QLatin1String("seed"))
+			uiSeed = value.toUInt(&ok);
+		else if (key == QLatin1String("password"))
+			qsPassword = value;
+		else if (key == QLatin1String("output"))
+			qsOutput = value;
+		else
+			return false;
+
+		if (! ok)
+			return false;
+	}
+
+	if (positional.count() == 5) {
+		// Legacy invocation: <host> <port> <numsend> <numudp> <numtcp>
+		const int send = positional.at(2).toInt();
+		const int udp = positional.at(3).toInt();
+		const int tcp = positional.at(4).toInt();
+		iClients = send + udp + tcp;
+		if (iClients <= 0)
+			return false;
+		dSpeakers = static_cast<double>(send) / iClients;
+		dTcpOnly = static_cast<double>(tcp) / iClients;
+	} else if (positional.count() != 2) {
+		return false;
+	}
+
+	qhaServer = QHostAddress(positional.at(0));
+	usPort = static_cast<unsigned short>(positional.at(1).toUInt());
+
+	if (qhaServer.isNull() || usPort == 0 || iClients <= 0 || iFrameMs <= 0 || iPayload < 12 || iPayload > 900 || iThreads <= 0 || iSpawnRate <= 0 || iInterval <= 0)
+		return false;
+
+	if (iNatGroup > 0 && qhaServer != QHostAddress(QHostAddress::LocalHost)) {
+		qWarning("NAT sharing needs an IPv4 loopback server, letting the OS choose source addresses");
+		iNatGroup = 0;
+	}
+
+	return true;
+}
+
+static Options g_options;
+
+/// Monotonic clock shared by all threads; voice timestamps are taken from it.
+static QElapsedTimer g_clock;
+
+static quint64 nowUsec() {
+	return static_cast<quint64>(g_clock.nsecsElapsed() / 1000);
+}
+
+/// Deterministic value in [0, 1) for a client index, so that runs with the
+/// same seed assign the same roles and channels.
+static double unitValue(unsigned int index, unsigned int salt) {
+	quint32 x = g_options.uiSeed * 0x9E3779B9U + index * 0x85EBCA6BU + salt * 0xC2B2AE35U;
+	x ^= x >> 16;
+	x *= 0x7FEB352DU;
+	x ^= x >> 15;
+	x *= 0x846CA68BU;
+	x ^= x >> 16;
+	return static_cast<double>(x) / 4294967296.0;
+}
+
+/// Log-linear latency histogram in microseconds with 32 sub-buckets per
+/// power of two, i.e. a relative error of about 3%.
+class LatencyHistogram {
+	public:
+		enum { SubBits = 5, Sub = 1 << SubBits, Buckets = Sub * 60 };
+		QVector<quint64> qvBuckets;
+		quint64 uiCount;
+		quint64 uiMax;
+
+		LatencyHistogram() : qvBuckets(Buckets), uiCount(0), uiMax(0) {}
+
+		void record(quint64 us) {
+			int idx;
+			if (us < Sub) {
+				idx = static_cast<int>(us);
+			} else {
+				int msb = 0;
+				for (quint64 v = us; v > 1; v >>= 1)
+					++msb;
+				const int shift = msb - SubBits;
+				idx = (shift + 1) * Sub + static_cast<int>((us >> shift) & (Sub - 1));
+			}
+			++qvBuckets[idx];
+			++uiCount;
+			if (us > uiMax)
+				uiMax = us;
+		}
+
+		void merge(const LatencyHistogram &other) {
+			for (int i = 0; i < Buckets; ++i)
+				qvBuckets[i] += other.qvBuckets.at(i);
+			uiCount += other.uiCount;
+			uiMax = qMax(uiMax, other.uiMax);
+		}
+
+		quint64 percentile(double q) const {
+			if (uiCount == 0)
+				return 0;
+			const quint64 target = qMax(static_cast<quint64>(1), static_cast<quint64>(ceil(q * static_cast<double>(uiCount))));
+			quint64 seen = 0;
+			for (int i = 0; i < Buckets; ++i) {
+				seen += qvBuckets.at(i);
+				if (seen >= target) {
+					if (i < Sub)
+						return static_cast<quint64>(i);
+					const int shift = i / Sub - 1;
+					const quint64 upper = ((static_cast<quint64>(Sub + (i % Sub) + 1)) << shift) - 1;
+					return qMin(upper, uiMax);
+				}
+			}
+			return uiMax;
+		}
+
+		QString toJson() const {
+			return QString::fromLatin1("{\"count\":%1,\"p50\":%2,\"p90\":%3,\"p99\":%4,\"p999\":%5,\"max\":%6}")
+			       .arg(uiCount).arg(percentile(0.5)).arg(percentile(0.9)).arg(percentile(0.99)).arg(percentile(0.999)).arg(uiMax);
+		}
+};
+
+struct Stats {
+	quint64 uiSent;
+	quint64 uiReceived;
+	quint64 uiExpected;
+	quint64 uiConnects;
+	quint64 uiDisconnects;
+	quint64 uiRejects;
+	LatencyHistogram lhVoice;
+	LatencyHistogram lhConnect;
+
+	Stats() : uiSent(0), uiReceived(0), uiExpected(0), uiConnects(0), uiDisconnects(0), uiRejects(0) {}
+
+	void merge(const Stats &other) {
+		uiSent += other.uiSent;
+		uiReceived += other.uiReceived;
+		uiExpected += other.uiExpected;
+		uiConnects += other.uiConnects;
+		uiDisconnects += other.uiDisconnects;
+		uiRejects += other.uiRejects;
+		lhVoice.merge(other.lhVoice);
+		lhConnect.merge(other.lhConnect);
+	}
+};
+
+class Worker;
+
+class Client : public QObject {
 		Q_OBJECT
 	public:
-		bool udp;
-		bool sender;
-		struct sockaddr_in srv;
+		Worker *wWorker;
+		unsigned int uiIndex;
+		bool bSpeaker;
+		bool bWhisper;
+		bool bTcpOnly;
+		bool bSynced;
 		unsigned int uiSession;
+		quint64 uiSeq;
+		Timer tConnect;
 		CryptState crypt;
-		int rcvd;
-		int socket;
-		int seq;
-		void run();
-		void ping();
-		void sendVoice();
+		QSslSocket *ssl;
+		QUdpSocket *udp;
+		QList<unsigned int> qlChannels;
 		int numbytes;
 		int ptype;
-		QSslSocket *ssl;
-		Client(QObject *parent, QHostAddress srvaddr, unsigned short prt, bool send, bool tcponly);
-		void doUdp(const unsigned char *buffer, int size);
-		void sendMessage(const ::google::protobuf::Message &msg, unsigned int msgType);
+
+		struct Stream {
+			quint64 uiLast;
+		};
+		QHash<unsigned int, Stream> qhStreams;
+
+		Client(Worker *w, unsigned int index);
 		~Client();
+		void sendMessage(const ::google::protobuf::Message &msg, unsigned int msgType);
+		void sendVoice();
+		void ping();
+		void handleVoice(const unsigned char *buffer, int len);
+		unsigned int pickChannel(unsigned int salt) const;
+		void joinChannel();
 	public slots:
 		void readyRead();
+		void udpReadyRead();
 		void disconnected();
 };
 
-Client::Client(QObject *p, QHostAddress qha, unsigned short prt, bool send, bool tcponly) : QThread(p) {
-	srv.sin_family = AF_INET;
-	srv.sin_addr.s_addr = htonl(qha.toIPv4Address());
-	srv.sin_port = htons(prt);
+class Worker : public QObject {
+		Q_OBJECT
+	public:
+		QList<Client *> qlClients;
+		QTimer *qtVoice;
+		QTimer *qtPing;
+		QMutex qmStats;
+		Stats sInterval;
+
+		Worker();
+		/// Takes the statistics gathered since the last call. Thread safe.
+		Stats takeStats();
+	public slots:
+		void start();
+		void spawn(unsigned int index);
+		void churn(int count);
+		void voiceTick();
+		void pingTick();
+		void clientGone(Client *c);
+};
 
-	udp = ! tcponly;
-	sender = send;
+Client::Client(Worker *w, unsigned int index) : QObject(w), wWorker(w), uiIndex(index), bSynced(false), uiSession(0), uiSeq(0), udp(NULL), numbytes(-1), ptype(0) {
+	bSpeaker = unitValue(index, 1) < g_options.dSpeakers;
+	bWhisper = bSpeaker && unitValue(index, 2) < g_options.dWhisper;
+	bTcpOnly = unitValue(index, 3) < g_options.dTcpOnly;
+
+	QHostAddress local;
+	if (g_options.iNatGroup > 0) {
+		// Spread groups over 127.0.0.0/8, skipping 127.0.0.0 and
+		// 127.0.0.1 so no group shares the server's own address.
+		const quint32 group = 2 + index / static_cast<unsigned int>(g_options.iNatGroup);
+		local = QHostAddress((127U << 24) | (group & 0xffffff));
+	}
 
 	ssl = new QSslSocket(this);
-
 	connect(ssl, SIGNAL(readyRead()), this, SLOT(readyRead()));
 	connect(ssl, SIGNAL(disconnected()), this, SLOT(disconnected()));
+	connect(ssl, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(disconnected()));
 
-	ssl->setProtocol(QSsl::TlsV1);
-	ssl->connectToHostEncrypted(qha.toString(), prt);
-	ssl->ignoreSslErrors();
-	if (! ssl->waitForEncrypted())
-		qFatal("Connection failure");
-
-	static int ctr = 1;
-
-#ifdef Q_OS_WIN
-	DWORD pid = GetCurrentProcessId();
-	wchar_t buf[64];
-	DWORD bufsize = 64;
-	GetComputerName(buf, &bufsize);
-
-	QString name = QString("%1.%2").arg(QString::fromWCharArray(buf)).arg(pid * 1000 + ctr);
-#else
-	struct utsname uts;
-	uname(&uts);
+	if (! bTcpOnly) {
+		udp = new QUdpSocket(this);
+		if (! udp->bind(local.isNull() ? QHostAddress(g_options.qhaServer.protocol() == QAbstractSocket::IPv6Protocol ? QHostAddress::AnyIPv6 : QHostAddress::Any) : local, 0))
+			qWarning("Client %u: UDP bind failed: %s", index, qPrintable(udp->errorString()));
+		connect(udp, SIGNAL(readyRead()), this, SLOT(udpReadyRead()));
+	}
 
-	QString name = QString("%1.%2").arg(uts.nodename).arg(getpid() * 1000 + ctr);
+#if QT_VERSION >= 0x050000
+	if (! local.isNull())
+		ssl->bind(local, 0);
 #endif
+	ssl->setPeerVerifyMode(QSslSocket::VerifyNone);
+	ssl->connectToHostEncrypted(g_options.qhaServer.toString(), g_options.usPort);
 
-	ctr++;
+	tConnect.restart();
 
-	MumbleProto::Version mpv;
-	mpv.set_release(u8(QLatin1String("1.2.1 Benchmark")));
-	mpv.set_version(0x010203);
+	const QString name = QString::fromLatin1("bench-%1-%2").arg(QCoreApplication::applicationPid()).arg(index);
 
+	MumbleProto::Version mpv;
+	mpv.set_release(u8(QLatin1String("1.3.0 Benchmark")));
+	mpv.set_version(0x010300);
 	sendMessage(mpv, MessageHandler::Version);
 
 	MumbleProto::Authenticate mpa;
 	mpa.set_username(u8(name));
-
+	if (! g_options.qsPassword.isEmpty())
+		mpa.set_password(u8(g_options.qsPassword));
+	mpa.set_opus(true);
 	sendMessage(mpa, MessageHandler::Authenticate);
-
-	if (udp)
-		socket = ::socket(PF_INET, SOCK_DGRAM, 0);
-
-	seq = 0;
-	rcvd = 0;
-	numbytes = -1;
 }
 
 Client::~Client() {
-	terminate();
-	wait();
 }
 
 void Client::sendMessage(const ::google::protobuf::Message &msg, unsigned int msgType) {
@@ -128,66 +411,140 @@ void Client::sendMessage(const ::google::protobuf::Message &msg, unsigned int ms
 }
 
 void Client::ping() {
-	unsigned char buffer[256];
-	buffer[0] = MessageHandler::UDPPing << 5;
-	PacketDataStream pds(buffer + 1, 255);
-	pds << 123;
-
-	doUdp(buffer, pds.size() + 1);
-
 	MumbleProto::Ping mpp;
-	mpp.set_timestamp(123);
+	mpp.set_timestamp(nowUsec());
 	sendMessage(mpp, MessageHandler::Ping);
+
+	if (! udp || ! crypt.isValid())
+		return;
+
+	// Also lets the server learn our UDP address before we talk.
+	unsigned char buffer[64];
+	unsigned char crypted[64];
+	buffer[0] = MessageHandler::UDPPing << 5;
+	PacketDataStream pds(buffer + 1, 63);
+	pds << nowUsec();
+	const int size = pds.size() + 1;
+	crypt.encrypt(buffer, crypted, size);
+	udp->writeDatagram(reinterpret_cast<const char *>(crypted), size + 4, g_options.qhaServer, g_options.usPort);
 }
 
 void Client::sendVoice() {
 	unsigned char buffer[1024];
-	int len = 32 + (qrand() & 0x3f);
-
-	// Regular voice, nothing special
-	buffer[0] = 0;
+	const quint64 ts = nowUsec();
+
+	buffer[0] = static_cast<unsigned char>((MessageHandler::UDPVoiceOpus << 5) | (bWhisper ? 1 : 0));
+
+	PacketDataStream pds(buffer + 1, 1023);
+	pds << ++uiSeq;
+	pds << g_options.iPayload;
+
+	// The payload starts with the send timestamp, the rest is padding.
+	unsigned char payload[1024];
+	memset(payload, 0, g_options.iPayload);
+	memcpy(payload, &ts, sizeof(ts));
+	pds.append(reinterpret_cast<const char *>(payload), g_options.iPayload);
+
+	const int size = pds.size() + 1;
+
+	if (udp && crypt.isValid()) {
+		unsigned char crypted[1100];
+		crypt.encrypt(buffer, crypted, size);
+		udp->writeDatagram(reinterpret_cast<const char *>(crypted), size + 4, g_options.qhaServer, g_options.usPort);
+	} else {
+		unsigned char uc[1100];
+		* reinterpret_cast<quint16 *>(& uc[0]) = qToBigEndian(static_cast<quint16>(MessageHandler::UDPTunnel));
+		* reinterpret_cast<quint32 *>(& uc[2]) = qToBigEndian(static_cast<quint32>(size));
+		memcpy(uc + 6, buffer, size);
+		ssl->write(reinterpret_cast<const char *>(uc), size + 6);
+	}
+}
 
-	PacketDataStream ods(buffer + 1, 1024);
-	ods << 1;
-	ods.append(len);
-	ods.skip(len);
+void Client::handleVoice(const unsigned char *buffer, int len) {
+	const unsigned int type = (buffer[0] >> 5) & 0x7;
+	if (type != MessageHandler::UDPVoiceOpus)
+		return;
 
-	doUdp(buffer, ods.size() + 1);
-}
+	PacketDataStream pds(buffer + 1, len - 1);
+	unsigned int session;
+	quint64 seq;
+	int size;
+	pds >> session;
+	pds >> seq;
+	pds >> size;
 
-void Client::doUdp(const unsigned char *buffer, int size) {
-	if (! udp || ! crypt.isValid())
+	if (! pds.isValid() || pds.left() < sizeof(quint64))
 		return;
 
-	unsigned char crypted[2048];
+	quint64 ts;
+	memcpy(&ts, buffer + len - pds.left(), sizeof(ts));
+	const quint64 now = nowUsec();
+
+	QMutexLocker lock(&wWorker->qmStats);
+	Stats &s = wWorker->sInterval;
+
+	s.lhVoice.record(now > ts ? now - ts : 0);
+	++s.uiReceived;
+
+	QHash<unsigned int, Stream>::iterator i = qhStreams.find(session);
+	if (i == qhStreams.end()) {
+		Stream st;
+		st.uiLast = seq;
+		qhStreams.insert(session, st);
+		++s.uiExpected;
+	} else if (seq > i->uiLast) {
+		s.uiExpected += seq - i->uiLast;
+		i->uiLast = seq;
+	}
+}
 
-	crypt.encrypt(reinterpret_cast<const unsigned char *>(buffer), crypted, size);
-	::sendto(socket, reinterpret_cast<const char *>(crypted), size+4, 0, reinterpret_cast<struct sockaddr *>(&srv), sizeof(srv));
+unsigned int Client::pickChannel(unsigned int salt) const {
+	int n = qlChannels.count();
+	if (g_options.iChannels > 0)
+		n = qMin(n, g_options.iChannels);
+	if (n <= 1)
+		return qlChannels.isEmpty() ? 0 : qlChannels.first();
+
+	double total = 0.0;
+	for (int i = 0; i < n; ++i)
+		total += pow(i + 1.0, -g_options.dZipf);
+
+	double pick = unitValue(uiIndex, salt) * total;
+	for (int i = 0; i < n; ++i) {
+		pick -= pow(i + 1.0, -g_options.dZipf);
+		if (pick < 0.0)
+			return qlChannels.at(i);
+	}
+	return qlChannels.at(n - 1);
 }
 
+void Client::joinChannel() {
+	qSort(qlChannels);
 
-void Client::run() {
-	unsigned char buffer[1024];
-	struct sockaddr_in addr;
-	socklen_t sz;
-	int len;
+	const unsigned int channel = pickChannel(4);
 
-	if (! udp)
-		return;
+	MumbleProto::UserState mpus;
+	mpus.set_session(uiSession);
+	mpus.set_channel_id(channel);
+	sendMessage(mpus, MessageHandler::UserState);
 
-	forever {
-		sz = sizeof(addr);
-		len = ::recvfrom(socket, reinterpret_cast<char *>(buffer), 1024, 0, reinterpret_cast<struct sockaddr *>(&addr), &sz);
-		if (len <= 0)
-			break;
-		if (len >= 32)
-			rcvd++;
+	if (bWhisper) {
+		unsigned int target = pickChannel(5);
+		// Whisper to a channel other than our own where possible.
+		for (unsigned int salt = 6; target == channel && salt < 16 && qlChannels.count() > 1; ++salt)
+			target = pickChannel(salt);
+
+		MumbleProto::VoiceTarget mpvt;
+		mpvt.set_id(1);
+		MumbleProto::VoiceTarget_Target *t = mpvt.add_targets();
+		t->set_channel_id(target);
+		sendMessage(mpvt, MessageHandler::VoiceTarget);
 	}
 }
 
 void Client::readyRead() {
 	forever {
-		int avail = ssl->bytesAvailable();
+		qint64 avail = ssl->bytesAvailable();
 		if (numbytes == -1) {
 			if (avail < 6)
 				break;
@@ -202,18 +559,14 @@ void Client::readyRead() {
 		if ((numbytes >= 0) && (avail >= numbytes)) {
 			int want = numbytes;
 			numbytes = -1;
-			unsigned char buff[65536];
-			Q_ASSERT(want < 65536);
-			ssl->read(reinterpret_cast<char *>(buff), want);
-
-
-			avail = ssl->bytesAvailable();
+			QByteArray qba = ssl->read(want);
+			const unsigned char *buff = reinterpret_cast<const unsigned char *>(qba.constData());
 
 			switch (ptype) {
 				case MessageHandler::CryptSetup: {
 						MumbleProto::CryptSetup msg;
 						if (! msg.ParseFromArray(buff, want))
-							qFatal("Failed parse crypt");
+							break;
 
 						if (msg.has_key() && msg.has_client_nonce() && msg.has_server_nonce()) {
 							const std::string &key = msg.key();
@@ -234,19 +587,39 @@ void Client::readyRead() {
 						}
 						break;
 					}
+				case MessageHandler::ChannelState: {
+						MumbleProto::ChannelState msg;
+						if (msg.ParseFromArray(buff, want) && msg.has_channel_id() && ! qlChannels.contains(msg.channel_id()))
+							qlChannels << msg.channel_id();
+						break;
+					}
 				case MessageHandler::ServerSync: {
 						MumbleProto::ServerSync msg;
 						if (! msg.ParseFromArray(buff, want))
-							qFatal("Failed parse sync");
+							break;
 						uiSession = msg.session();
+						bSynced = true;
+						{
+							QMutexLocker lock(&wWorker->qmStats);
+							wWorker->sInterval.lhConnect.record(tConnect.elapsed());
+							++wWorker->sInterval.uiConnects;
+						}
+						joinChannel();
+						ping();
 						break;
 					}
-				case MessageHandler::UDPTunnel: {
-						unsigned int msgUDPType = (buff[0] >> 5) & 0x7;
-						if (msgUDPType == MessageHandler::UDPVoiceCELTAlpha)
-							rcvd++;
+				case MessageHandler::Reject: {
+						MumbleProto::Reject msg;
+						if (msg.ParseFromArray(buff, want))
+							qWarning("Client %u rejected: %s", uiIndex, msg.reason().c_str());
+						QMutexLocker lock(&wWorker->qmStats);
+						++wWorker->sInterval.uiRejects;
 						break;
 					}
+				case MessageHandler::UDPTunnel:
+					if (want > 1)
+						handleVoice(buff, want);
+					break;
 			}
 		} else {
 			break;
@@ -254,142 +627,250 @@ void Client::readyRead() {
 	}
 }
 
+void Client::udpReadyRead() {
+	unsigned char crypted[2048];
+	unsigned char plain[2048];
+
+	while (udp->hasPendingDatagrams()) {
+		const qint64 len = udp->readDatagram(reinterpret_cast<char *>(crypted), sizeof(crypted));
+		if (len < 5 || ! crypt.isValid())
+			continue;
+		if (! crypt.decrypt(crypted, plain, static_cast<unsigned int>(len)))
+			continue;
+		handleVoice(plain, static_cast<int>(len - 4));
+	}
+}
+
 void Client::disconnected() {
-	qWarning("SSL Socket disconnected");
-	QCoreApplication::instance()->quit();
+	if (! bSynced && ssl->state() != QAbstractSocket::UnconnectedState)
+		return;
+	wWorker->clientGone(this);
+}
+
+Worker::Worker() : qtVoice(NULL), qtPing(NULL) {
+}
+
+Stats Worker::takeStats() {
+	QMutexLocker lock(&qmStats);
+	Stats s = sInterval;
+	sInterval = Stats();
+	return s;
+}
+
+void Worker::start() {
+	qtVoice = new QTimer(this);
+#if QT_VERSION >= 0x050000
+	qtVoice->setTimerType(Qt::PreciseTimer);
+#endif
+	connect(qtVoice, SIGNAL(timeout()), this, SLOT(voiceTick()));
+	qtVoice->start(g_options.iFrameMs);
+
+	qtPing = new QTimer(this);
+	connect(qtPing, SIGNAL(timeout()), this, SLOT(pingTick()));
+	qtPing->start(5000);
+}
+
+void Worker::spawn(unsigned int index) {
+	qlClients << new Client(this, index);
+}
+
+void Worker::churn(int count) {
+	for (int n = 0; n < count && ! qlClients.isEmpty(); ++n) {
+		Client *c = qlClients.at(qrand() % qlClients.count());
+		if (! c->bSynced)
+			continue;
+		// Rejoin with the same index, and thus the same role.
+		const unsigned int index = c->uiIndex;
+		qlClients.removeOne(c);
+		c->ssl->disconnect(c);
+		c->ssl->disconnectFromHost();
+		c->deleteLater();
+		spawn(index);
+
+		QMutexLocker lock(&qmStats);
+		++sInterval.uiDisconnects;
+	}
+}
+
+void Worker::voiceTick() {
+	quint64 sent = 0;
+	foreach(Client *c, qlClients) {
+		if (c->bSpeaker && c->bSynced) {
+			c->sendVoice();
+			++sent;
+		}
+	}
+
+	QMutexLocker lock(&qmStats);
+	sInterval.uiSent += sent;
+}
+
+void Worker::pingTick() {
+	foreach(Client *c, qlClients)
+		if (c->bSynced)
+			c->ping();
+}
+
+void Worker::clientGone(Client *c) {
+	if (! qlClients.removeOne(c))
+		return;
+
+	qWarning("Client %u disconnected: %s", c->uiIndex, qPrintable(c->ssl->errorString()));
+	c->deleteLater();
+
+	QMutexLocker lock(&qmStats);
+	++sInterval.uiDisconnects;
 }
 
 class Container : public QObject {
 		Q_OBJECT
 	public:
-		int sent;
-		int numsender, numudplistener, numtcplistener;
-		int isender, iudplistener, itcplistener;
-		bool live, forceping;
-		QHostAddress qha;
-		unsigned short port;
-		QTimer qtTick;
-		Timer tickPing, tickVoice, tickGo, tickSpawn;
-		QList<Client *> speakers;
-		QList<Client *> clients;
-		Container(QHostAddress srvaddr, unsigned short port, int nsend, int nudp, int ntcp);
+		QList<QThread *> qlThreads;
+		QList<Worker *> qlWorkers;
+		QTimer qtSpawn;
+		QTimer qtReport;
+		QTimer qtChurn;
+		Timer tStart;
+		Timer tLive;
+		unsigned int uiSpawned;
+		bool bLive;
+		double dChurnDebt;
+		Stats sTotal;
+		QFile qfOutput;
+		QTextStream qtsOutput;
+
+		Container();
+		~Container();
+		void emitRecord(const char *type, const Stats &s, quint64 usec);
 	public slots:
-		void tick();
-		void go();
+		void spawnTick();
+		void reportTick();
+		void churnTick();
 };
 
-Container::Container(QHostAddress qha, unsigned short port, int numsend, int numudp, int numtcp) {
-	isender = iudplistener = itcplistener = 0;
-	live = false;
-	forceping = false;
-	sent = 0;
+Container::Container() : uiSpawned(0), bLive(false), dChurnDebt(0.0) {
+	if (g_options.qsOutput.isEmpty()) {
+		qfOutput.open(stdout, QIODevice::WriteOnly);
+	} else {
+		qfOutput.setFileName(g_options.qsOutput);
+		if (! qfOutput.open(QIODevice::WriteOnly | QIODevice::Truncate))
+			qFatal("Failed to open %s", qPrintable(g_options.qsOutput));
+	}
+	qtsOutput.setDevice(&qfOutput);
+
+	for (int i = 0; i < g_options.iThreads; ++i) {
+		QThread *t = new QThread(this);
+		Worker *w = new Worker();
+		w->moveToThread(t);
+		connect(t, SIGNAL(finished()), w, SLOT(deleteLater()));
+		t->start();
+		QMetaObject::invokeMethod(w, "start", Qt::QueuedConnection);
+		qlThreads << t;
+		qlWorkers << w;
+	}
+
+	qWarning("Spawning %d clients on %d threads", g_options.iClients, g_options.iThreads);
 
-	Timer t;
+	connect(&qtSpawn, SIGNAL(timeout()), this, SLOT(spawnTick()));
+	qtSpawn.start(10);
 
-	qWarning("Spawning %d speakers and %d listeners (%d UDP, %d TCP)", numsend, numudp+numtcp, numudp, numtcp);
+	connect(&qtReport, SIGNAL(timeout()), this, SLOT(reportTick()));
+	qtReport.start(g_options.iInterval * 1000);
 
-	this->qha = qha;
-	this->port = port;
+	connect(&qtChurn, SIGNAL(timeout()), this, SLOT(churnTick()));
+}
 
-	numsender = numsend;
-	numudplistener = numudp;
-	numtcplistener = numtcp;
+Container::~Container() {
+	foreach(QThread *t, qlThreads) {
+		t->quit();
+		t->wait();
+	}
+}
 
+void Container::spawnTick() {
+	// Pace connection attempts so the server's TLS handshakes, not our
+	// SYN backlog, are what gets measured.
+	const quint64 due = qMin(static_cast<quint64>(g_options.iClients), 1 + tStart.elapsed() * static_cast<quint64>(g_options.iSpawnRate) / 1000000ULL);
 
-	connect(&qtTick, SIGNAL(timeout()), this, SLOT(tick()));
-	qtTick.start(0);
+	while (uiSpawned < due) {
+		Worker *w = qlWorkers.at(uiSpawned % qlWorkers.count());
+		QMetaObject::invokeMethod(w, "spawn", Qt::QueuedConnection, Q_ARG(unsigned int, uiSpawned));
+		++uiSpawned;
+	}
 
-	tickSpawn.restart();
+	if (uiSpawned >= static_cast<unsigned int>(g_options.iClients))
+		qtSpawn.stop();
 }
 
-void Container::tick() {
-	if (forceping || tickPing.isElapsed(5000000ULL)) {
-		forceping = false;
+void Container::churnTick() {
+	dChurnDebt += g_options.dChurn / 10.0;
+	int count = static_cast<int>(dChurnDebt);
+	dChurnDebt -= count;
 
-		foreach(Client *c, clients)
-			c->ping();
+	for (int i = 0; i < count; ++i) {
+		Worker *w = qlWorkers.at(qrand() % qlWorkers.count());
+		QMetaObject::invokeMethod(w, "churn", Qt::QueuedConnection, Q_ARG(int, 1));
+	}
+}
 
-		if (live) {
+void Container::emitRecord(const char *type, const Stats &s, quint64 usec) {
+	const double loss = (s.uiExpected > 0 && s.uiExpected > s.uiReceived) ? 1.0 - static_cast<double>(s.uiReceived) / static_cast<double>(s.uiExpected) : 0.0;
 
-			int lost = 0;
-			quint64 totrcv = 0;
-			int nrcv = 0;
-			foreach(Client *c, clients) {
-				if (! c->sender) {
-					totrcv += c->rcvd;
-					lost += sent - c->rcvd;
-					nrcv++;
-				}
-			}
-			qWarning("Sent: %8d  Rcvd: %8lld  Lost: %8d   BW: %6.1fMbit/s", sent, totrcv / nrcv, (lost + nrcv - 1) / nrcv, (totrcv * 8.0 * 123.0) / (tickGo.elapsed() * 1.0));
-		} else {
-			qWarning("Spawned %3d/%3d", isender + iudplistener + itcplistener, numsender + numudplistener + numtcplistener);
-		}
-	}
+	qtsOutput << QString::fromLatin1("{\"type\":\"%1\",\"elapsed_ms\":%2,\"clients\":%3,\"speakers\":%4,\"sent\":%5,\"received\":%6,\"expected\":%7,\"loss\":%8,\"connects\":%9,")
+	          .arg(QLatin1String(type)).arg(usec / 1000ULL).arg(g_options.iClients).arg(g_options.dSpeakers).arg(s.uiSent).arg(s.uiReceived).arg(s.uiExpected).arg(loss, 0, 'g', 6).arg(s.uiConnects);
+	qtsOutput << QString::fromLatin1("\"disconnects\":%1,\"rejects\":%2,\"latency_us\":%3,\"connect_us\":%4}\n")
+	          .arg(s.uiDisconnects).arg(s.uiRejects).arg(s.lhVoice.toJson()).arg(s.lhConnect.toJson());
+	qtsOutput.flush();
 
-	if (live && tickVoice.isElapsed(10000ULL)) {
-		foreach(Client *c, speakers) {
-			sent++;
-			c->sendVoice();
-		}
-	}
-	if (! live) {
-		if (isender < numsender) {
-			// Spawn a sender
-			Client *c = new Client(this, qha, port, true, false);
-			speakers << c;
-			c->start();
-			clients << c;
-			isender++;
-		} else if (iudplistener < numudplistener) {
-			// Spawn a listener which uses UDP
-			Client *c = new Client(this, qha, port, false, false);
-			c->start();
-			clients << c;
-			iudplistener++;
-		} else if (itcplistener < numtcplistener) {
-			// Spawn a listener which uses TCP-only
-			Client *c = new Client(this, qha, port, false, true);
-			c->start();
-			clients << c;
-			itcplistener++;
-		} else {
-			live = true;
-			quint64 elapsed = tickSpawn.elapsed();
-			qWarning("Spawning took %lld ms (%lld us per client)", elapsed / 1000ULL, elapsed / (numsender+numudplistener+numtcplistener));
-			foreach(Client *c, clients)
-				c->rcvd = 0;
-			sent = 0;
-			forceping = true;
-			qtTick.start(10);
+	qWarning("%-8s sent %8llu rcvd %9llu loss %6.3f%%  latency p50 %6llu us p99 %7llu us max %8llu us",
+	         type, s.uiSent, s.uiReceived, loss * 100.0, s.lhVoice.percentile(0.5), s.lhVoice.percentile(0.99), s.lhVoice.uiMax);
+}
+
+void Container::reportTick() {
+	Stats interval;
+	foreach(Worker *w, qlWorkers)
+		interval.merge(w->takeStats());
+
+	sTotal.merge(interval);
+
+	if (! bLive) {
+		qWarning("Connected %llu/%d", sTotal.uiConnects, g_options.iClients);
+		if (sTotal.uiConnects >= static_cast<quint64>(g_options.iClients) || (uiSpawned >= static_cast<unsigned int>(g_options.iClients) && tStart.elapsed() > 60000000ULL)) {
+			// Ramp-up is over; measure from a clean slate.
+			emitRecord("rampup", sTotal, tStart.elapsed());
+			sTotal = Stats();
+			bLive = true;
+			tLive.restart();
+			if (g_options.dChurn > 0.0)
+				qtChurn.start(100);
 		}
+		return;
 	}
-}
 
-void Container::go() {
-	foreach(Client *c, clients)
-		c->start();
-	qtTick.start(10);
-	tickGo.restart();
+	emitRecord("interval", interval, tLive.elapsed());
+
+	if (tLive.elapsed() >= static_cast<quint64>(g_options.iDuration) * 1000000ULL) {
+		emitRecord("summary", sTotal, tLive.elapsed());
+		QCoreApplication::instance()->quit();
+	}
 }
 
 int main(int argc, char **argv) {
 	QCoreApplication a(argc, argv);
 
-	qWarning("Maximum # sockets is %d", FD_SETSIZE);
+	QStringList args = a.arguments();
+	args.removeFirst();
 
-	if (argc != 6)
-		qFatal("Invalid number of arguments. These need to be passed: <host address> <port> <numsend> <numudp> <numtcp>");
+	if (! g_options.parse(args)) {
+		Options::usage();
+		return 1;
+	}
 
-	QHostAddress qha = QHostAddress(argv[1]);
-	int port = atoi(argv[2]);
-	int numsender = atoi(argv[3]);
-	int numudplistener = atoi(argv[4]);
-	int numtcplistener = atoi(argv[5]);
+	g_clock.start();
+	qsrand(g_options.uiSeed);
 
-	Container c(qha, port, numsender, numudplistener, numtcplistener);
-	c.go();
-	a.exec();
+	Container c;
+	return a.exec();
 }
 
 #include "Benchmark.moc"
@@ -0,0 +1,224 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+/**
+ * Checks every AudioInputKernels implementation supported by this CPU
+ * against the scalar reference, bit for bit, and times the downmix of a
+ * device buffer and the conversion and metering of a finished frame.
+ */
+
+#include "AudioInputKernels.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#define FRAMESIZE 480
+
+static quint32 uiSeed = 1;
+
+static float randomFloat(float lo, float hi) {
+	uiSeed = uiSeed * 1664525U + 1013904223U;
+	return lo + (hi - lo) * static_cast<float>(uiSeed >> 8) / static_cast<float>(1 << 24);
+}
+
+/// Interleaved device input. Float samples overshoot [-1, 1] so that
+/// conversion clamps, and include signed zeros, NaN and infinities.
+static QVector<float> makeFloatInput(unsigned int count) {
+	QVector<float> qv(count);
+	for (unsigned int i = 0; i < count; ++i)
+		qv[i] = randomFloat(-1.2f, 1.2f);
+	qv[0] = -0.0f;
+	qv[count / 3] = std::numeric_limits<float>::denorm_min();
+	qv[count / 2] = std::numeric_limits<float>::infinity();
+	qv[count - 1] = std::numeric_limits<float>::quiet_NaN();
+	return qv;
+}
+
+static QVector<short> makeShortInput(unsigned int count) {
+	QVector<short> qv(count);
+	for (unsigned int i = 0; i < count; ++i)
+		qv[i] = static_cast<short>(randomFloat(-32768.f, 32767.f));
+	qv[0] = -32768;
+	qv[1] = 32767;
+	return qv;
+}
+
+struct Layout {
+	unsigned int nchan;
+	quint64 mask;
+};
+
+template <typename T>
+static void runTimed(const char *what, const AudioInputKernels *k, const AudioInputKernels &ref, int iterations, double &refTime, bool same, bool &ok, const Layout &l, unsigned int nsamp, T f) {
+	ok = ok && same;
+
+	QElapsedTimer t;
+	t.start();
+	for (int i = 0; i < iterations; ++i)
+		f();
+	const double us = static_cast<double>(t.nsecsElapsed()) / 1000.0 / iterations;
+	if (k == &ref)
+		refTime = us;
+
+	printf("%-8s %-14s %5u %#18llx %5u %10.3f %7.2fx %s\n", k->name, what, l.nchan, static_cast<unsigned long long>(l.mask), nsamp, us, refTime / us, same ? "identical" : "MISMATCH");
+	fflush(stdout);
+}
+
+struct DownmixFloat {
+	AudioInputKernels::downmixFunc f;
+	float *out;
+	const float *in;
+	unsigned int nsamp, nchan;
+	quint64 mask;
+	void operator()() const {
+		f(out, in, nsamp, nchan, mask);
+	}
+};
+
+struct DownmixShort {
+	AudioInputKernels::downmixFunc f;
+	float *out;
+	const short *in;
+	unsigned int nsamp, nchan;
+	quint64 mask;
+	void operator()() const {
+		f(out, in, nsamp, nchan, mask);
+	}
+};
+
+struct ToShortLevels {
+	AudioInputKernels::toShortLevelsFunc f;
+	const float *in;
+	short *out;
+	unsigned int count;
+	quint64 *energy;
+	int *peak;
+	void operator()() const {
+		f(in, out, count, energy, peak);
+	}
+};
+
+struct Levels {
+	AudioInputKernels::levelsFunc f;
+	const short *in;
+	unsigned int count;
+	quint64 *energy;
+	int *peak;
+	void operator()() const {
+		f(in, count, energy, peak);
+	}
+};
+
+struct ToFloat {
+	AudioInputKernels::toFloatFunc f;
+	const short *in;
+	float *out;
+	unsigned int count;
+	void operator()() const {
+		f(in, out, count);
+	}
+};
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	int iterations = 100000;
+	if (argc > 1)
+		iterations = qMax(1, atoi(argv[1]));
+
+	const QList<const AudioInputKernels *> kernels = AudioInputKernels::available();
+	const AudioInputKernels &ref = AudioInputKernels::scalar();
+	const Layout layouts[] = {
+		{ 1, 0xffffffffffffffffULL },
+		{ 2, 0xffffffffffffffffULL },
+		{ 2, 0x1ULL },
+		{ 4, 0xffffffffffffffffULL },
+		{ 6, 0xffffffffffffffffULL },
+		{ 8, 0x5ULL },
+		{ 10, 0xffffffffffffffffULL },
+	};
+	// FRAMESIZE - 3 exercises the scalar tails of the vector loops.
+	const unsigned int sizes[] = { FRAMESIZE, FRAMESIZE - 3 };
+	bool ok = true;
+
+	printf("%d iterations per run\n", iterations);
+	printf("%-8s %-14s %5s %18s %5s %10s %8s %s\n", "kernel", "op", "chan", "mask", "nsamp", "us/call", "speedup", "result");
+
+	for (unsigned int n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+		const unsigned int nsamp = sizes[n];
+
+		for (unsigned int c = 0; c < sizeof(layouts) / sizeof(layouts[0]); ++c) {
+			const Layout &l = layouts[c];
+			const QVector<float> fin = makeFloatInput(nsamp * l.nchan);
+			const QVector<short> sin = makeShortInput(nsamp * l.nchan);
+
+			QVector<float> refFloat(nsamp), refShort(nsamp);
+			ref.downmixFloat(refFloat.data(), fin.constData(), nsamp, l.nchan, l.mask);
+			ref.downmixShort(refShort.data(), sin.constData(), nsamp, l.nchan, l.mask);
+
+			double refTime = 0.0;
+			foreach(const AudioInputKernels *k, kernels) {
+				QVector<float> out(nsamp);
+				DownmixFloat df = { k->downmixFloat, out.data(), fin.constData(), nsamp, l.nchan, l.mask };
+				df();
+				runTimed("downmixFloat", k, ref, iterations, refTime, memcmp(out.constData(), refFloat.constData(), sizeof(float) * nsamp) == 0, ok, l, nsamp, df);
+			}
+			foreach(const AudioInputKernels *k, kernels) {
+				QVector<float> out(nsamp);
+				DownmixShort ds = { k->downmixShort, out.data(), sin.constData(), nsamp, l.nchan, l.mask };
+				ds();
+				runTimed("downmixShort", k, ref, iterations, refTime, memcmp(out.constData(), refShort.constData(), sizeof(float) * nsamp) == 0, ok, l, nsamp, ds);
+			}
+		}
+
+		const Layout mono = { 1, 0xffffffffffffffffULL };
+		const QVector<float> fin = makeFloatInput(nsamp);
+		const QVector<short> sin = makeShortInput(nsamp);
+
+		QVector<short> refOut16(nsamp);
+		quint64 refEnergy;
+		int refPeak;
+		ref.toShortLevels(fin.constData(), refOut16.data(), nsamp, &refEnergy, &refPeak);
+
+		double refTime = 0.0;
+		foreach(const AudioInputKernels *k, kernels) {
+			QVector<short> out16(nsamp);
+			quint64 energy;
+			int peak;
+			ToShortLevels tsl = { k->toShortLevels, fin.constData(), out16.data(), nsamp, &energy, &peak };
+			tsl();
+			const bool same = (memcmp(out16.constData(), refOut16.constData(), sizeof(short) * nsamp) == 0) && (energy == refEnergy) && (peak == refPeak);
+			runTimed("toShortLevels", k, ref, iterations, refTime, same, ok, mono, nsamp, tsl);
+		}
+
+		ref.levels(sin.constData(), nsamp, &refEnergy, &refPeak);
+		foreach(const AudioInputKernels *k, kernels) {
+			quint64 energy;
+			int peak;
+			Levels lv = { k->levels, sin.constData(), nsamp, &energy, &peak };
+			lv();
+			const bool same = (energy == refEnergy) && (peak == refPeak) && (peak == 32768);
+			runTimed("levels", k, ref, iterations, refTime, same, ok, mono, nsamp, lv);
+		}
+
+		QVector<float> refOut(nsamp);
+		ref.toFloat(sin.constData(), refOut.data(), nsamp);
+		foreach(const AudioInputKernels *k, kernels) {
+			QVector<float> out(nsamp);
+			ToFloat tf = { k->toFloat, sin.constData(), out.data(), nsamp };
+			tf();
+			runTimed("toFloat", k, ref, iterations, refTime, memcmp(out.constData(), refOut.constData(), sizeof(float) * nsamp) == 0, ok, mono, nsamp, tf);
+		}
+	}
+
+	return ok ? 0 : 1;
+}
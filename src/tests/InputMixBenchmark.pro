@@ -0,0 +1,19 @@
+include(../../qmake/compiler.pri)
+TEMPLATE = app
+CONFIG += qt thread warn_on release console
+CONFIG -= app_bundle
+QT -= gui
+LANGUAGE = C++
+TARGET = InputMixBenchmark
+SOURCES = InputMixBenchmark.cpp AudioInputKernels.cpp AudioMixKernels.cpp
+HEADERS = AudioInputKernels.h AudioMixKernels.h
+VPATH += ../mumble
+INCLUDEPATH *= .. ../mumble
+
+CONFIG(debug, debug|release) {
+  DESTDIR = ../../debug
+}
+
+CONFIG(release, debug|release) {
+  DESTDIR = ../../release
+}
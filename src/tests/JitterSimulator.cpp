@@ -0,0 +1,259 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+/**
+ * Replays packet traces through AdaptiveJitterBuffer and reports the delay
+ * and concealment a listener would have experienced, with and without
+ * time-stretching.
+ *
+ * Usage: JitterSimulator [-p percentile] [-f frames] [trace ...]
+ *
+ * The percentile defaults to 98, like Settings::iJitterPercentile.
+ *
+ * A trace has one line per received packet: its sequence number, in 10 ms
+ * frames as in Mumble's voice packets, and its arrival time in
+ * milliseconds, on the clock the sender captured frame 0 at. Lost packets
+ * are left out, and lines starting with # are ignored. Each packet holds
+ * -f frames, 2 by default. Without traces, a few synthetic links are
+ * simulated instead.
+ */
+
+#include "AdaptiveJitterBuffer.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QVector>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define SAMPLE_RATE 48000
+#define FRAMESIZE 480
+/// Length of the synthetic traces, in seconds.
+#define SYNTHETIC_LENGTH 60
+
+struct TracePacket {
+	qint64 iTimestamp;
+	qint64 iArrival;
+
+	bool operator <(const TracePacket &other) const {
+		return iArrival < other.iArrival;
+	}
+};
+
+struct Result {
+	double dMeanDelay;
+	double dP95Delay;
+	double dConcealed;
+	quint64 uiLate;
+	quint64 uiCompressed;
+	quint64 uiExpanded;
+};
+
+static quint32 uiSeed = 1;
+
+static double randomUniform() {
+	uiSeed = uiSeed * 1664525U + 1013904223U;
+	return static_cast<double>(uiSeed >> 8) / static_cast<double>(1 << 24);
+}
+
+static double randomExponential(double mean) {
+	return -mean * log(1.0 - randomUniform());
+}
+
+/// A voiced signal with a 120 Hz pitch, in syllables of 200 ms separated
+/// by 100 ms of near silence, so that stretching has something realistic
+/// to match and quiet frames to prefer.
+static void synthesize(float *pcm, qint64 timestamp, unsigned int n) {
+	for (unsigned int i = 0; i < n; ++i) {
+		const qint64 t = timestamp + i;
+		const double syllable = static_cast<double>(t % (SAMPLE_RATE * 3 / 10)) / SAMPLE_RATE;
+		const double envelope = (syllable < 0.2) ? sin(M_PI * syllable / 0.2) : 0.001;
+		const double phase = 2.0 * M_PI * 120.0 * static_cast<double>(t) / SAMPLE_RATE;
+		pcm[i] = static_cast<float>(envelope * (0.5 * sin(phase) + 0.25 * sin(3.0 * phase) + 0.1 * sin(5.0 * phase)));
+	}
+}
+
+/// Builds a trace of SYNTHETIC_LENGTH seconds. Every packet leaves once
+/// its last frame is captured and takes base plus an exponentially
+/// distributed jitter to arrive. With probability spike, a packet and the
+/// ones queued behind it are held up by spikeDelay more.
+static QVector<TracePacket> synthesizeTrace(int frames, double baseMs, double jitterMs, double loss, double spike, double spikeDelayMs, bool varying) {
+	QVector<TracePacket> trace;
+	double held = 0.0;
+	for (int seq = 0; seq < SYNTHETIC_LENGTH * 100; seq += frames) {
+		const double sent = static_cast<double>(seq + frames) * 10.0;
+		// A link that is good for the first and last third only.
+		const double scale = (varying && (seq > SYNTHETIC_LENGTH * 100 / 3) && (seq < SYNTHETIC_LENGTH * 200 / 3)) ? 4.0 : 1.0;
+
+		if (randomUniform() < spike)
+			held = sent + spikeDelayMs;
+		const double arrival = qMax(sent + baseMs + randomExponential(jitterMs * scale), held);
+
+		if (randomUniform() < loss)
+			continue;
+
+		TracePacket tp;
+		tp.iTimestamp = static_cast<qint64>(seq) * FRAMESIZE;
+		tp.iArrival = static_cast<qint64>(arrival * SAMPLE_RATE / 1000.0);
+		trace << tp;
+	}
+	std::sort(trace.begin(), trace.end());
+	return trace;
+}
+
+static bool readTrace(const char *path, QVector<TracePacket> &trace) {
+	FILE *f = fopen(path, "r");
+	if (! f)
+		return false;
+
+	char line[256];
+	while (fgets(line, sizeof(line), f)) {
+		long long seq;
+		double arrival;
+		if ((line[0] == '#') || (sscanf(line, "%lld %lf", &seq, &arrival) != 2))
+			continue;
+		TracePacket tp;
+		tp.iTimestamp = seq * FRAMESIZE;
+		tp.iArrival = static_cast<qint64>(arrival * SAMPLE_RATE / 1000.0);
+		trace << tp;
+	}
+	fclose(f);
+
+	std::sort(trace.begin(), trace.end());
+	return true;
+}
+
+/// Plays trace the way AudioOutputSpeech does: every 10 ms the mixer
+/// takes a frame, and the decoder pulls packets from the jitter buffer
+/// until it is ahead of the mixer again.
+static Result simulate(const QVector<TracePacket> &trace, int frames, int percentile, bool stretch) {
+	const unsigned int span = static_cast<unsigned int>(frames) * FRAMESIZE;
+	// A margin of one frame, like the default jitter buffer setting.
+	AdaptiveJitterBuffer ajb(SAMPLE_RATE, FRAMESIZE, percentile, FRAMESIZE, 0);
+	QVector<float> pcm(span + AdaptiveJitterBuffer::maxStretch(SAMPLE_RATE));
+	QVector<qint64> delays;
+	quint64 played = 0, concealed = 0;
+
+	const qint64 end = trace.isEmpty() ? 0 : trace.last().iArrival + SAMPLE_RATE;
+	qint64 produced = 0;
+	int next = 0;
+
+	for (qint64 now = 0; now < end; now += FRAMESIZE) {
+		while ((next < trace.count()) && (trace.at(next).iArrival <= now)) {
+			const qint64 ts = trace.at(next).iTimestamp;
+			ajb.put(QByteArray(reinterpret_cast<const char *>(&ts), sizeof(ts)), ts, span);
+			++next;
+		}
+
+		while (produced < now + FRAMESIZE) {
+			QByteArray data;
+			unsigned int n = FRAMESIZE;
+
+			switch (ajb.get(data)) {
+				case AdaptiveJitterBuffer::Buffering:
+					break;
+				case AdaptiveJitterBuffer::Ready: {
+						qint64 ts;
+						memcpy(&ts, data.constData(), sizeof(ts));
+						delays << produced - ts;
+
+						n = span;
+						synthesize(pcm.data(), ts, n);
+						if (stretch) {
+							float energy = 0.0f;
+							for (unsigned int i = 0; i < n; ++i)
+								energy += pcm[i] * pcm[i];
+							const int wanted = ajb.stretch(sqrtf(energy / static_cast<float>(n)) < 0.01f);
+							if (wanted < 0)
+								n = AdaptiveJitterBuffer::compress(pcm.data(), n, SAMPLE_RATE, static_cast<unsigned int>(-wanted));
+							else if (wanted > 0)
+								n = AdaptiveJitterBuffer::expand(pcm.data(), n, SAMPLE_RATE, static_cast<unsigned int>(wanted));
+							ajb.stretched(static_cast<int>(n) - static_cast<int>(span));
+						}
+						played += n;
+					}
+					break;
+				default:
+					played += n;
+					concealed += n;
+					break;
+			}
+
+			ajb.advance(n);
+			produced += n;
+		}
+	}
+
+	// The last second is the stream ending, not the link failing.
+	const quint64 tail = qMin(concealed, static_cast<quint64>(SAMPLE_RATE));
+	concealed -= tail;
+	played -= tail;
+
+	Result r;
+	memset(&r, 0, sizeof(r));
+	if (! delays.isEmpty()) {
+		double sum = 0.0;
+		foreach(qint64 d, delays)
+			sum += static_cast<double>(d);
+		r.dMeanDelay = sum / delays.count() * 1000.0 / SAMPLE_RATE;
+		std::sort(delays.begin(), delays.end());
+		r.dP95Delay = static_cast<double>(delays.at((delays.count() - 1) * 95 / 100)) * 1000.0 / SAMPLE_RATE;
+	}
+	r.dConcealed = played ? 100.0 * static_cast<double>(concealed) / static_cast<double>(played) : 0.0;
+	r.uiLate = ajb.stats().uiLate;
+	r.uiCompressed = ajb.stats().uiCompressed;
+	r.uiExpanded = ajb.stats().uiExpanded;
+	return r;
+}
+
+static void report(const char *name, const QVector<TracePacket> &trace, int frames, int percentile) {
+	for (int s = 1; s >= 0; --s) {
+		const Result r = simulate(trace, frames, percentile, s != 0);
+		printf("%-16s %-10s %8.1f %8.1f %9.2f %6llu %6llu %6llu\n", name, s ? "stretch" : "no stretch", r.dMeanDelay, r.dP95Delay, r.dConcealed,
+		       static_cast<unsigned long long>(r.uiLate), static_cast<unsigned long long>(r.uiCompressed), static_cast<unsigned long long>(r.uiExpanded));
+		fflush(stdout);
+	}
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	int percentile = 98;
+	int frames = 2;
+	QVector<const char *> files;
+	for (int i = 1; i < argc; ++i) {
+		if ((strcmp(argv[i], "-p") == 0) && (i + 1 < argc))
+			percentile = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc))
+			frames = qBound(1, atoi(argv[++i]), 12);
+		else
+			files << argv[i];
+	}
+
+	printf("%d%% percentile, %d ms packets\n", percentile, frames * 10);
+	printf("%-16s %-10s %8s %8s %9s %6s %6s %6s\n", "trace", "playout", "mean ms", "p95 ms", "conceal%", "late", "compr", "expand");
+
+	if (files.isEmpty()) {
+		report("lan", synthesizeTrace(frames, 1.0, 1.0, 0.0, 0.0, 0.0, false), frames, percentile);
+		report("wifi", synthesizeTrace(frames, 5.0, 8.0, 0.005, 0.01, 150.0, false), frames, percentile);
+		report("mobile", synthesizeTrace(frames, 60.0, 25.0, 0.03, 0.002, 300.0, false), frames, percentile);
+		report("varying", synthesizeTrace(frames, 20.0, 5.0, 0.01, 0.0, 0.0, true), frames, percentile);
+		return 0;
+	}
+
+	foreach(const char *file, files) {
+		QVector<TracePacket> trace;
+		if (! readTrace(file, trace)) {
+			fprintf(stderr, "Failed to read %s\n", file);
+			return 1;
+		}
+		report(file, trace, frames, percentile);
+	}
+
+	return 0;
+}
@@ -0,0 +1,124 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+/**
+ * Checks every AudioMixKernels implementation supported by this CPU against
+ * the scalar reference, bit for bit, and times a full mix of many speakers.
+ */
+
+#include "AudioMixKernels.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#define SPEAKERS 30
+#define FRAMESIZE 480
+
+static quint32 uiSeed = 1;
+
+static float randomFloat(float lo, float hi) {
+	uiSeed = uiSeed * 1664525U + 1013904223U;
+	return lo + (hi - lo) * static_cast<float>(uiSeed >> 8) / static_cast<float>(1 << 24);
+}
+
+struct MixInput {
+	QVector<float> qvSamples;
+	QVector<float> qvGain;
+	QVector<float> qvInc;
+	QVector<quint32> qvMask;
+};
+
+/// Builds SPEAKERS speakers for nchan channels. Samples overshoot [-1, 1]
+/// so that clipping is exercised, and a few are NaN, infinite or denormal.
+static QVector<MixInput> makeInput(unsigned int nsamp, unsigned int nchan) {
+	QVector<MixInput> qv(SPEAKERS);
+	for (int sp = 0; sp < SPEAKERS; ++sp) {
+		MixInput &mi = qv[sp];
+		mi.qvSamples.resize(nsamp);
+		for (unsigned int i = 0; i < nsamp; ++i)
+			mi.qvSamples[i] = randomFloat(-0.3f, 0.3f);
+		mi.qvGain.resize(nchan);
+		mi.qvInc.resize(nchan);
+		mi.qvMask.resize(nchan);
+		for (unsigned int s = 0; s < nchan; ++s) {
+			mi.qvGain[s] = randomFloat(0.0f, 1.0f);
+			mi.qvInc[s] = (sp % 2) ? randomFloat(-1.0f, 1.0f) / static_cast<float>(nsamp) : 0.0f;
+			mi.qvMask[s] = (randomFloat(0.0f, 1.0f) < 0.8f) ? 0xffffffffU : 0U;
+		}
+	}
+	qv[1].qvSamples[0] = std::numeric_limits<float>::denorm_min();
+	qv[2].qvSamples[nsamp / 2] = std::numeric_limits<float>::infinity();
+	qv[3].qvSamples[nsamp - 1] = std::numeric_limits<float>::quiet_NaN();
+	return qv;
+}
+
+static void mix(const AudioMixKernels &k, const QVector<MixInput> &input, unsigned int nsamp, unsigned int nchan, float *out, short *out16) {
+	memset(out, 0, sizeof(float) * nsamp * nchan);
+	foreach(const MixInput &mi, input)
+		k.accumulate(out, mi.qvSamples.constData(), nsamp, nchan, mi.qvGain.constData(), mi.qvInc.constData(), mi.qvMask.constData());
+	k.toShort(out, out16, nsamp * nchan);
+	k.clip(out, nsamp * nchan);
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	int iterations = 20000;
+	if (argc > 1)
+		iterations = qMax(1, atoi(argv[1]));
+
+	const QList<const AudioMixKernels *> kernels = AudioMixKernels::available();
+	const AudioMixKernels &ref = AudioMixKernels::scalar();
+	const unsigned int channels[] = { 1, 2, 6, 8 };
+	// FRAMESIZE - 3 exercises the scalar tails of the vector loops.
+	const unsigned int sizes[] = { FRAMESIZE, FRAMESIZE - 3 };
+	bool ok = true;
+
+	printf("%d speakers, %d iterations per run\n", SPEAKERS, iterations);
+	printf("%-8s %5s %5s %12s %8s %s\n", "kernel", "chan", "nsamp", "us/mix", "speedup", "result");
+
+	for (unsigned int c = 0; c < sizeof(channels) / sizeof(channels[0]); ++c) {
+		for (unsigned int n = 0; n < sizeof(sizes) / sizeof(sizes[0]); ++n) {
+			const unsigned int nchan = channels[c];
+			const unsigned int nsamp = sizes[n];
+			const QVector<MixInput> input = makeInput(nsamp, nchan);
+
+			QVector<float> refOut(nsamp * nchan);
+			QVector<short> refOut16(nsamp * nchan);
+			mix(ref, input, nsamp, nchan, refOut.data(), refOut16.data());
+
+			double refTime = 0.0;
+			foreach(const AudioMixKernels *k, kernels) {
+				QVector<float> out(nsamp * nchan);
+				QVector<short> out16(nsamp * nchan);
+
+				mix(*k, input, nsamp, nchan, out.data(), out16.data());
+				const bool same = (memcmp(out.constData(), refOut.constData(), sizeof(float) * out.size()) == 0) &&
+				                  (memcmp(out16.constData(), refOut16.constData(), sizeof(short) * out16.size()) == 0);
+				ok = ok && same;
+
+				QElapsedTimer t;
+				t.start();
+				for (int i = 0; i < iterations; ++i)
+					mix(*k, input, nsamp, nchan, out.data(), out16.data());
+				const double us = static_cast<double>(t.nsecsElapsed()) / 1000.0 / iterations;
+				if (k == &ref)
+					refTime = us;
+
+				printf("%-8s %5u %5u %12.2f %7.2fx %s\n", k->name, nchan, nsamp, us, refTime / us, same ? "identical" : "MISMATCH");
+				fflush(stdout);
+			}
+		}
+	}
+
+	return ok ? 0 : 1;
+}
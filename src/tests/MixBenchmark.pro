@@ -0,0 +1,19 @@
+include(../../qmake/compiler.pri)
+TEMPLATE = app
+CONFIG += qt thread warn_on release console
+CONFIG -= app_bundle
+QT -= gui
+LANGUAGE = C++
+TARGET = MixBenchmark
+SOURCES = MixBenchmark.cpp AudioMixKernels.cpp
+HEADERS = AudioMixKernels.h
+VPATH += ../mumble
+INCLUDEPATH *= .. ../mumble
+
+CONFIG(debug, debug|release) {
+  DESTDIR = ../../debug
+}
+
+CONFIG(release, debug|release) {
+  DESTDIR = ../../release
+}
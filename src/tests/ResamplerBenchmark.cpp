@@ -0,0 +1,136 @@
+// Copyright 2005-2019 The Mumble Developers. All rights reserved.
+// Use of this source code is governed by a BSD-style license
+// that can be found in the LICENSE file at the root of the
+// Mumble source tree or at <https://www.mumble.info/LICENSE>.
+
+/**
+ * Times Resampler against the speex resampler it replaced, on 10 ms frames
+ * for many streams at once, and checks every ResamplerKernels
+ * implementation supported by this CPU against the scalar reference.
+ */
+
+#include "Resampler.h"
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <speex/speex_resampler.h>
+
+#define STREAMS 30
+#define QUALITY 3
+
+static quint32 uiSeed = 1;
+
+static float randomFloat(float lo, float hi) {
+	uiSeed = uiSeed * 1664525U + 1013904223U;
+	return lo + (hi - lo) * static_cast<float>(uiSeed >> 8) / static_cast<float>(1 << 24);
+}
+
+/// Runs frames 10 ms input frames through every resampler, each with its
+/// own input, and returns the microseconds spent per frame and stream.
+static double runResampler(QVector<Resampler *> &rs, const QVector<QVector<float> > &input, unsigned int nin, float *out, unsigned int nout, int frames) {
+	QElapsedTimer t;
+	t.start();
+	for (int f = 0; f < frames; ++f)
+		for (int s = 0; s < rs.count(); ++s)
+			rs[s]->process(input[s].constData(), nin, out, nout);
+	return static_cast<double>(t.nsecsElapsed()) / 1000.0 / frames / rs.count();
+}
+
+static double runSpeex(QVector<SpeexResamplerState *> &srs, const QVector<QVector<float> > &input, unsigned int nin, float *out, unsigned int nout, int frames) {
+	QElapsedTimer t;
+	t.start();
+	for (int f = 0; f < frames; ++f) {
+		for (int s = 0; s < srs.count(); ++s) {
+			spx_uint32_t inlen = nin;
+			spx_uint32_t outlen = nout;
+			speex_resampler_process_float(srs[s], 0, input[s].constData(), &inlen, out, &outlen);
+		}
+	}
+	return static_cast<double>(t.nsecsElapsed()) / 1000.0 / frames / srs.count();
+}
+
+int main(int argc, char **argv) {
+	QCoreApplication a(argc, argv);
+
+	int frames = 2000;
+	if (argc > 1)
+		frames = qMax(1, atoi(argv[1]));
+
+	const unsigned int rates[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 16000, 48000 }, { 32000, 48000 } };
+	const QList<const ResamplerKernels *> kernels = ResamplerKernels::available();
+	const ResamplerKernels &ref = ResamplerKernels::scalar();
+
+	printf("%d streams, %d frames of 10 ms, quality %d\n", STREAMS, frames, QUALITY);
+	printf("%-8s %13s %12s %8s %12s\n", "kernel", "rates", "us/frame", "speedup", "max diff");
+
+	for (unsigned int r = 0; r < sizeof(rates) / sizeof(rates[0]); ++r) {
+		const unsigned int inRate = rates[r][0];
+		const unsigned int outRate = rates[r][1];
+		const unsigned int nin = inRate / 100;
+		const unsigned int nout = outRate / 100;
+
+		QVector<QVector<float> > input(STREAMS);
+		for (int s = 0; s < STREAMS; ++s) {
+			input[s].resize(nin);
+			for (unsigned int i = 0; i < nin; ++i)
+				input[s][i] = randomFloat(-0.5f, 0.5f);
+		}
+		QVector<float> out(nout);
+
+		QVector<SpeexResamplerState *> srs(STREAMS);
+		for (int s = 0; s < STREAMS; ++s) {
+			int err = 0;
+			srs[s] = speex_resampler_init(1, inRate, outRate, QUALITY, &err);
+			speex_resampler_skip_zeros(srs[s]);
+		}
+		const double speexTime = runSpeex(srs, input, nin, out.data(), nout, frames);
+		for (int s = 0; s < STREAMS; ++s)
+			speex_resampler_destroy(srs[s]);
+		printf("%-8s %6u>%6u %12.2f %7.2fx %12s\n", "speex", inRate, outRate, speexTime, 1.0, "-");
+
+		// The scalar output of the first stream is the reference for the
+		// other kernels.
+		QVector<float> refOut(nout);
+		{
+			Resampler check(1, inRate, outRate, QUALITY);
+			check.setKernels(ref);
+			for (int f = 0; f < 4; ++f)
+				check.process(input[0].constData(), nin, refOut.data(), nout);
+		}
+
+		foreach(const ResamplerKernels *k, kernels) {
+			QVector<Resampler *> rs(STREAMS);
+			for (int s = 0; s < STREAMS; ++s) {
+				rs[s] = new Resampler(1, inRate, outRate, QUALITY);
+				rs[s]->setKernels(*k);
+			}
+
+			float maxDiff = 0.0f;
+			{
+				Resampler check(1, inRate, outRate, QUALITY);
+				check.setKernels(*k);
+				for (int f = 0; f < 4; ++f)
+					check.process(input[0].constData(), nin, out.data(), nout);
+				for (unsigned int i = 0; i < nout; ++i)
+					maxDiff = qMax(maxDiff, fabsf(out[i] - refOut[i]));
+			}
+
+			const double us = runResampler(rs, input, nin, out.data(), nout, frames);
+			printf("%-8s %6u>%6u %12.2f %7.2fx %12.3g\n", k->name, inRate, outRate, us, speexTime / us, static_cast<double>(maxDiff));
+			fflush(stdout);
+
+			if (k == kernels.last())
+				printf("%d filter bank(s) shared by %d resamplers\n", Resampler::sharedFilters(), STREAMS);
+
+			qDeleteAll(rs);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,22 @@
+include(../../qmake/compiler.pri)
+TEMPLATE = app
+CONFIG += qt thread warn_on release console
+CONFIG -= app_bundle
+QT -= gui
+LANGUAGE = C++
+TARGET = ResamplerBenchmark
+SOURCES = ResamplerBenchmark.cpp Resampler.cpp AudioMixKernels.cpp
+HEADERS = Resampler.h AudioMixKernels.h
+VPATH += ../mumble
+INCLUDEPATH *= .. ../mumble ../../3rdparty/speex-src/include ../../3rdparty/speex-src/libspeex ../../3rdparty/speex-build
+LIBS *= -lspeex
+
+CONFIG(debug, debug|release) {
+  QMAKE_LIBDIR = ../../debug $$QMAKE_LIBDIR
+  DESTDIR = ../../debug
+}
+
+CONFIG(release, debug|release) {
+  QMAKE_LIBDIR = ../../release $$QMAKE_LIBDIR
+  DESTDIR = ../../release
+}